@@ -0,0 +1,80 @@
+#pragma once
+
+#include <limits>
+#include <memory>
+#include <new>
+
+#ifndef __cpp_aligned_new
+#ifdef _WIN32
+#include <malloc.h> // _aligned_malloc
+#else
+#include <stdlib.h> // posix_memalign
+#endif
+#endif
+
+namespace myfolly {
+
+/// Allocator that honors alignof(T) beyond what operator new guarantees,
+/// for arrays of over-aligned slots: BoundedQueue's Slot<T>, or
+/// SingleElementQueue<T, TurnSequencer, IsolatedSlots> (see LayoutMPMCQueue).
+/// With aligned new (C++17) std::allocator already does this.
+#if defined(__cpp_aligned_new)
+template <typename T> using AlignedAllocator = std::allocator<T>;
+#else
+template <typename T>
+struct AlignedAllocator {
+    using value_type = T;
+
+    template <typename U>
+    struct rebind {
+        using other = AlignedAllocator<U>;
+    };
+
+    AlignedAllocator() noexcept = default;
+
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U>&) noexcept {}
+
+    T* allocate(std::size_t n) {
+        if (n > std::numeric_limits<std::size_t>::max() / sizeof(T)) {
+            throw std::bad_array_new_length();
+        }
+#ifdef _WIN32
+        auto* p = static_cast<T*>(_aligned_malloc(sizeof(T) * n, alignof(T)));
+        if (p == nullptr) {
+            throw std::bad_alloc();
+        }
+#else
+        // posix_memalign wants at least the alignment of a pointer
+        constexpr std::size_t align =
+            alignof(T) < sizeof(void*) ? sizeof(void*) : alignof(T);
+        T* p;
+        if (posix_memalign(reinterpret_cast<void**>(&p), align,
+                    sizeof(T) * n) != 0) {
+            throw std::bad_alloc();
+        }
+#endif
+        return p;
+    }
+
+    void deallocate(T* p, std::size_t) noexcept {
+#ifdef _WIN32
+        _aligned_free(p);
+#else
+        free(p);
+#endif
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const AlignedAllocator<T>&, const AlignedAllocator<U>&) noexcept {
+    return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const AlignedAllocator<T>&, const AlignedAllocator<U>&) noexcept {
+    return false;
+}
+#endif
+
+} // namespace myfolly
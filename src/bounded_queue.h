@@ -24,19 +24,20 @@ SOFTWARE.
 
 #include <atomic>
 #include <cassert>
+#include <chrono>
+#include <climits>
 #include <cstddef> // offsetof
 #include <limits>
 #include <memory>
 #include <new> // std::hardware_destructive_interference_size
 #include <stdexcept>
+#include <thread>
 
-#ifndef __cpp_aligned_new
-#ifdef _WIN32
-#include <malloc.h> // _aligned_malloc
-#else
-#include <stdlib.h> // posix_memalign
-#endif
-#endif
+#include "aligned_allocator.h"
+#include "capacity_policy.h"
+#include "detail/futex.h"
+#include "detail/queue_readiness.h"
+#include "portability.h"
 
 namespace myfolly {
 
@@ -47,45 +48,10 @@ static constexpr size_t hardwareInterferenceSize =
 static constexpr size_t hardwareInterferenceSize = 128;    //64 in 32bit system
 #endif
 
-#if defined(__cpp_aligned_new)
-template <typename T> using AlignedAllocator = std::allocator<T>;
-#else
-template <typename T> struct AlignedAllocator {
-  using value_type = T;
-
-  T *allocate(std::size_t n) {
-    if (n > std::numeric_limits<std::size_t>::max() / sizeof(T)) {
-      throw std::bad_array_new_length();
-    }
-#ifdef _WIN32
-    auto *p = static_cast<T *>(_aligned_malloc(sizeof(T) * n, alignof(T)));
-    if (p == nullptr) {
-      throw std::bad_alloc();
-    }
-#else
-    T *p;
-    if (posix_memalign(reinterpret_cast<void **>(&p), alignof(T),
-                       sizeof(T) * n) != 0) {
-      throw std::bad_alloc();
-    }
-#endif
-    return p;
-  }
-
-  void deallocate(T *p, std::size_t) {
-#ifdef _WIN32
-    _aligned_free(p);
-#else
-    free(p);
-#endif
-  }
-};
-#endif
-
 template <typename T>
 struct Slot {
   ~Slot() noexcept {
-    if (turn & 1) {
+    if (turnOf(turn.load(std::memory_order_relaxed)) & 1) {
       destroy();
     }
   }
@@ -104,12 +70,109 @@ struct Slot {
 
   T &&move() noexcept { return reinterpret_cast<T &&>(storage); }
 
+  // The futex word packs the low bits of the slot's turn counter above a
+  // count of threads parked on it, so completeTurn only makes the
+  // futexWake syscall when somebody sleeps.  Waiters park on the bitset
+  // channel of the turn they wait for and are woken exactly when the slot
+  // reaches it, like TurnSequencer does.
+  static constexpr uint32_t kWaiterBits = 10;
+  static constexpr uint32_t kMaxWaiters = (uint32_t(1) << kWaiterBits) - 1;
+  static constexpr int kSpinLimit = 100;
+
+  static uint32_t turnOf(uint32_t state) noexcept {
+    return state >> kWaiterBits;
+  }
+
+  static uint32_t channelOf(size_t t) noexcept {
+    return uint32_t(1) << (t & 31);
+  }
+
+  bool isTurn(size_t t) const noexcept {
+    return turnOf(turn.load(std::memory_order_acquire)) ==
+           turnOf(uint32_t(t << kWaiterBits));
+  }
+
+  // Advances the turn to next, which must be one past the current turn
+  void completeTurn(size_t next) noexcept {
+    auto const prev =
+        turn.fetch_add(uint32_t(1) << kWaiterBits, std::memory_order_release);
+    assert(turnOf(prev + (uint32_t(1) << kWaiterBits)) ==
+           turnOf(uint32_t(next << kWaiterBits)));
+    if ((prev & kMaxWaiters) != 0) {
+      detail::futexWake(&turn, INT_MAX, channelOf(next));
+    }
+  }
+
+  // Spins for a while, then parks until turn reaches t
+  void waitForTurn(size_t t) noexcept {
+    tryWaitForTurnUntil(t, std::chrono::steady_clock::time_point::max());
+  }
+
+  // Returns false if when passed before turn reached t.  Returns true as
+  // soon as turn is at or past t, which lets a timed caller that hasn't
+  // claimed ticket t wait for it without hanging when others get it first.
+  template <class Clock, class Duration>
+  bool tryWaitForTurnUntil(
+      size_t t,
+      const std::chrono::time_point<Clock, Duration> &when) noexcept {
+    for (int i = 0, n = spinLimitIfMultiCpu(kSpinLimit); i < n; ++i) {
+      if (isTurnReached(turn.load(std::memory_order_acquire), t)) {
+        return true;
+      }
+      asm_volatile_pause();
+    }
+    uint32_t cur = turn.load(std::memory_order_acquire);
+    for (;;) {
+      if (isTurnReached(cur, t)) {
+        return true;
+      }
+      if ((cur & kMaxWaiters) == kMaxWaiters) {
+        // too many sleepers to count, poll instead
+        if (Clock::now() >= when) {
+          return false;
+        }
+        std::this_thread::yield();
+        cur = turn.load(std::memory_order_acquire);
+        continue;
+      }
+      if (!turn.compare_exchange_weak(cur, cur + 1)) {
+        continue;
+      }
+      auto const rv = detail::futexWaitUntil(&turn, cur + 1, when,
+                                             channelOf(t));
+      cur = turn.fetch_sub(1, std::memory_order_acquire) - 1;
+      if (rv == detail::FutexResult::TIMEDOUT) {
+        return isTurnReached(cur, t);
+      }
+    }
+  }
+
+  // Serial number arithmetic on the turn bits: state is at or past t
+  static bool isTurnReached(uint32_t state, size_t t) noexcept {
+    return int32_t((state & ~kMaxWaiters) - uint32_t(t << kWaiterBits)) >= 0;
+  }
+
   // Align to avoid false sharing between adjacent slots
-  alignas(hardwareInterferenceSize) std::atomic<size_t> turn = {0};
+  alignas(hardwareInterferenceSize) detail::Futex turn = {0};
   typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
 };
 
-template <typename T, typename Allocator = AlignedAllocator<Slot<T>>>
+/// Capacity is a capacity policy from capacity_policy.h.  Slots already sit
+/// on separate cache lines, so tickets map to them in order.
+///
+/// SingleProducer / SingleConsumer promise that at most one thread writes
+/// (reads) at a time.  That side then owns its index: it is advanced with a
+/// plain store instead of a fetch_add or CAS.  With both set the queue is
+/// Rigtorp's SPSCQueue: slot turns aren't used at all, and each side keeps
+/// a cached copy of the other side's index next to its own, so it only
+/// touches the other side's cache line when the queue looks full (empty).
+///
+/// Blocking operations wait for their slot's turn by spinning briefly and
+/// then parking on it with futexWait (see Slot::tryWaitForTurnUntil).  The
+/// SPSC queue has no turns and yields instead.
+template <typename T, typename Allocator = AlignedAllocator<Slot<T>>,
+          typename Capacity = RuntimeCapacity,
+          bool SingleProducer = false, bool SingleConsumer = false>
 class BoundedQueue {
 private:
   static_assert(std::is_nothrow_copy_assignable<T>::value ||
@@ -122,7 +185,9 @@ private:
 public:
     explicit BoundedQueue(const size_t capacity,
             const Allocator &allocator = Allocator()) :
-        capacity_(capacity), allocator_(allocator), head_(0), tail_(0) {
+        capacityPolicy_(capacity), capacity_(capacityPolicy_.capacity()),
+        allocator_(allocator), head_(0), tailCache_(0), tail_(0),
+        headCache_(0) {
         if (capacity_ < 1) {
             throw std::invalid_argument("capacity < 1");
         }
@@ -154,6 +219,13 @@ public:
     }
 
     ~BoundedQueue() noexcept {
+        if (kSPSC) {
+            // slot turns aren't maintained, destroy what's left by index
+            auto const head = head_.load(std::memory_order_relaxed);
+            for (auto i = tail_.load(std::memory_order_relaxed); i != head; ++i) {
+                slots_[idx(i)].destroy();
+            }
+        }
         for (size_t i = 0; i < capacity_; ++i) {
             slots_[i].~Slot();
         }
@@ -165,22 +237,64 @@ public:
     BoundedQueue &operator=(const BoundedQueue &) = delete;
 
     void blockingWrite(T const& val) noexcept {
-        auto const head = head_.fetch_add(1);
+        if (kSPSC) {
+            auto const head = head_.load(std::memory_order_relaxed);
+            while (head - tailCache_ == capacity_) {
+                tailCache_ = tail_.load(std::memory_order_acquire);
+                if (head - tailCache_ == capacity_)
+                    std::this_thread::yield();
+            }
+            slots_[idx(head)].construct(val);
+            head_.store(head + 1, std::memory_order_release);
+            notifyWrite();
+            return;
+        }
+        auto const head = SingleProducer ?
+            head_.load(std::memory_order_relaxed) : head_.fetch_add(1);
         auto &slot = slots_[idx(head)];
-        while (turn(head) * 2 != slot.turn.load(std::memory_order_acquire))
-            std::this_thread::yield();
+        slot.waitForTurn(turn(head) * 2);
         slot.construct(val);
-        slot.turn.store(turn(head) * 2 + 1, std::memory_order_release);
+        slot.completeTurn(turn(head) * 2 + 1);
+        if (SingleProducer) {
+            head_.store(head + 1, std::memory_order_release);
+        }
+        notifyWrite();
     }
 
     bool write(T const& val) noexcept {
+        if (kSPSC) {
+            auto const head = head_.load(std::memory_order_relaxed);
+            if (head - tailCache_ == capacity_) {
+                tailCache_ = tail_.load(std::memory_order_acquire);
+                if (head - tailCache_ == capacity_) {
+                    return false;
+                }
+            }
+            slots_[idx(head)].construct(val);
+            head_.store(head + 1, std::memory_order_release);
+            notifyWrite();
+            return true;
+        }
+        if (SingleProducer) {
+            auto const head = head_.load(std::memory_order_relaxed);
+            auto &slot = slots_[idx(head)];
+            if (!slot.isTurn(turn(head) * 2)) {
+                return false;
+            }
+            slot.construct(val);
+            slot.completeTurn(turn(head) * 2 + 1);
+            head_.store(head + 1, std::memory_order_release);
+            notifyWrite();
+            return true;
+        }
         auto head = head_.load(std::memory_order_acquire);
         for (;;) {
             auto &slot = slots_[idx(head)];
-            if (turn(head) * 2 == slot.turn.load(std::memory_order_acquire)) {
+            if (slot.isTurn(turn(head) * 2)) {
                 if (head_.compare_exchange_strong(head, head + 1)) {
                     slot.construct(val);
-                    slot.turn.store(turn(head) * 2 + 1, std::memory_order_release);
+                    slot.completeTurn(turn(head) * 2 + 1);
+                    notifyWrite();
                     return true;
                 }
             } else {
@@ -194,24 +308,66 @@ public:
     }
 
     void blockingRead(T &v) noexcept {
-        auto const tail = tail_.fetch_add(1);
+        if (kSPSC) {
+            auto const tail = tail_.load(std::memory_order_relaxed);
+            while (tail == headCache_) {
+                headCache_ = head_.load(std::memory_order_acquire);
+                if (tail == headCache_)
+                    std::this_thread::yield();
+            }
+            auto &slot = slots_[idx(tail)];
+            v = slot.move();
+            slot.destroy();
+            tail_.store(tail + 1, std::memory_order_release);
+            return;
+        }
+        auto const tail = SingleConsumer ?
+            tail_.load(std::memory_order_relaxed) : tail_.fetch_add(1);
         auto &slot = slots_[idx(tail)];
-        while (turn(tail) * 2 + 1 != slot.turn.load(std::memory_order_acquire))
-            std::this_thread::yield();
+        slot.waitForTurn(turn(tail) * 2 + 1);
         v = slot.move();
         slot.destroy();
-        slot.turn.store(turn(tail) * 2 + 2, std::memory_order_release);
+        slot.completeTurn(turn(tail) * 2 + 2);
+        if (SingleConsumer) {
+            tail_.store(tail + 1, std::memory_order_release);
+        }
     }
 
     bool read(T &v) noexcept {
+        if (kSPSC) {
+            auto const tail = tail_.load(std::memory_order_relaxed);
+            if (tail == headCache_) {
+                headCache_ = head_.load(std::memory_order_acquire);
+                if (tail == headCache_) {
+                    return false;
+                }
+            }
+            auto &slot = slots_[idx(tail)];
+            v = slot.move();
+            slot.destroy();
+            tail_.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+        if (SingleConsumer) {
+            auto const tail = tail_.load(std::memory_order_relaxed);
+            auto &slot = slots_[idx(tail)];
+            if (!slot.isTurn(turn(tail) * 2 + 1)) {
+                return false;
+            }
+            v = slot.move();
+            slot.destroy();
+            slot.completeTurn(turn(tail) * 2 + 2);
+            tail_.store(tail + 1, std::memory_order_release);
+            return true;
+        }
         auto tail = tail_.load(std::memory_order_acquire);
         for (;;) {
             auto &slot = slots_[idx(tail)];
-            if (turn(tail) * 2 + 1 == slot.turn.load(std::memory_order_acquire)) {
+            if (slot.isTurn(turn(tail) * 2 + 1)) {
                 if (tail_.compare_exchange_strong(tail, tail + 1)) {
                     v = slot.move();
                     slot.destroy();
-                    slot.turn.store(turn(tail) * 2 + 2, std::memory_order_release);
+                    slot.completeTurn(turn(tail) * 2 + 2);
                     return true;
                 }
             } else {
@@ -224,6 +380,65 @@ public:
         }
     }
 
+    /// Like write, but waits until when for a full queue to make room.
+    /// Parks on the slot of the next ticket without claiming it, so a
+    /// timed-out call leaves the queue untouched
+    template <class Clock, class Duration>
+    bool tryWriteUntil(const std::chrono::time_point<Clock, Duration> &when,
+            T const& val) noexcept {
+        for (;;) {
+            if (write(val)) {
+                return true;
+            }
+            if (kSPSC) {
+                if (Clock::now() >= when) {
+                    return false;
+                }
+                std::this_thread::yield();
+                continue;
+            }
+            auto const head = head_.load(std::memory_order_acquire);
+            if (!slots_[idx(head)].tryWaitForTurnUntil(turn(head) * 2, when)) {
+                return false;
+            }
+        }
+    }
+
+    template <class Rep, class Period>
+    bool tryWriteFor(const std::chrono::duration<Rep, Period> &duration,
+            T const& val) noexcept {
+        return tryWriteUntil(std::chrono::steady_clock::now() + duration, val);
+    }
+
+    /// Like read, but waits until when for an element to arrive
+    template <class Clock, class Duration>
+    bool tryReadUntil(const std::chrono::time_point<Clock, Duration> &when,
+            T &v) noexcept {
+        for (;;) {
+            if (read(v)) {
+                return true;
+            }
+            if (kSPSC) {
+                if (Clock::now() >= when) {
+                    return false;
+                }
+                std::this_thread::yield();
+                continue;
+            }
+            auto const tail = tail_.load(std::memory_order_acquire);
+            if (!slots_[idx(tail)].tryWaitForTurnUntil(turn(tail) * 2 + 1,
+                        when)) {
+                return false;
+            }
+        }
+    }
+
+    template <class Rep, class Period>
+    bool tryReadFor(const std::chrono::duration<Rep, Period> &duration,
+            T &v) noexcept {
+        return tryReadUntil(std::chrono::steady_clock::now() + duration, v);
+    }
+
     size_t size() const noexcept {
         uint64_t head = head_.load(std::memory_order_acquire); // A
         uint64_t tail = tail_.load(std::memory_order_acquire); // B
@@ -251,12 +466,78 @@ public:
     /// until all reader and writer threads have been joined.
     bool isEmpty() const noexcept { return size() <= 0; }
 
+    /// The capacity after rounding by the capacity policy
+    size_t capacity() const noexcept { return capacityPolicy_.capacity(); }
+
+    /// Notification mode for event-loop consumers, see
+    /// MPMCQueue::notificationFd.  It is off until notificationFd() is
+    /// first called, which must happen before the queue is in use; until
+    /// then writes don't look at the notification state at all
+    int notificationFd() {
+        int fd = readiness_.eventFd();
+        notify_ = true;
+        return fd;
+    }
+
+    /// Returns true if the consumer may now wait for notificationFd(), or
+    /// false if an element is ready (read again first)
+    bool armNotification() noexcept {
+        readiness_.arm();
+        if (readable()) {
+            readiness_.disarm();
+            return false;
+        }
+        return true;
+    }
+
+    void clearNotification() noexcept { readiness_.clearEventFd(); }
+
+    /// What readAny (queue_select.h) waits on.  Like notificationFd(), the
+    /// first call turns producer notifications on and must happen before
+    /// the queue is in use; later calls (from readAny) leave notify_ alone
+    detail::ReadinessEvent& readinessEvent() noexcept {
+        if (!notify_) {
+            notify_ = true;
+        }
+        return readiness_;
+    }
+
+    /// How many times producers wrote the eventfd
+    uint64_t notificationsSent() const noexcept {
+        return readiness_.eventFdSignals();
+    }
+
 private:
-    constexpr size_t idx(size_t i) const noexcept { return i % capacity_; }
+    size_t idx(size_t i) const noexcept {
+        return capacityPolicy_.template index<0>(i);
+    }
 
-    constexpr size_t turn(size_t i) const noexcept { return i / capacity_; }
+    size_t turn(size_t i) const noexcept { return capacityPolicy_.turn(i); }
+
+    /// Whether the next read would find its element.  Looks at the slot
+    /// rather than at head_, because a single producer publishes head_
+    /// only after the slot's (seq_cst) completeTurn
+    bool readable() const noexcept {
+        auto const tail = tail_.load(std::memory_order_acquire);
+        if (kSPSC) {
+            return head_.load(std::memory_order_acquire) != tail;
+        }
+        return slots_[idx(tail)].isTurn(turn(tail) * 2 + 1);
+    }
+
+    void notifyWrite() noexcept {
+        if (notify_) {
+            if (kSPSC) {
+                // the SPSC producer publishes with a plain release store;
+                // order it before the load in notify()
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+            }
+            readiness_.notify();
+        }
+    }
 
 private:
+    const Capacity capacityPolicy_;
     const size_t capacity_;
     Slot<T> *slots_;
 #if defined(__has_cpp_attribute) && __has_cpp_attribute(no_unique_address)
@@ -264,10 +545,34 @@ private:
 #else
     Allocator allocator_;
 #endif
+    // set once by notificationFd(), before the queue is shared
+    bool notify_ = false;
+
+    static constexpr bool kSPSC = SingleProducer && SingleConsumer;
 
-    // Align to avoid false sharing between head_ and tail_
+    // Align to avoid false sharing between head_ and tail_.  SPSC only: each
+    // side caches the other side's index on its own cache line
     alignas(hardwareInterferenceSize) std::atomic<size_t> head_;
+    size_t tailCache_;
     alignas(hardwareInterferenceSize) std::atomic<size_t> tail_;
+    size_t headCache_;
+    // eventfd notification, see notificationFd()
+    alignas(hardwareInterferenceSize) detail::ReadinessEvent readiness_;
 };
 
+/// Single producer, single consumer BoundedQueue
+template <typename T, typename Allocator = AlignedAllocator<Slot<T>>,
+          typename Capacity = RuntimeCapacity>
+using SPSCBoundedQueue = BoundedQueue<T, Allocator, Capacity, true, true>;
+
+/// Multiple producers, single consumer BoundedQueue
+template <typename T, typename Allocator = AlignedAllocator<Slot<T>>,
+          typename Capacity = RuntimeCapacity>
+using MPSCBoundedQueue = BoundedQueue<T, Allocator, Capacity, false, true>;
+
+/// Single producer, multiple consumers BoundedQueue
+template <typename T, typename Allocator = AlignedAllocator<Slot<T>>,
+          typename Capacity = RuntimeCapacity>
+using SPMCBoundedQueue = BoundedQueue<T, Allocator, Capacity, true, false>;
+
 } // namespace myfolly
@@ -0,0 +1,426 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+
+#include "detail/byte_ring.h"
+#include "detail/futex.h"
+#include "mpmc_queue.h"
+#include "portability.h"
+
+namespace myfolly {
+
+/// A ring of variable-length byte records, for messages that would
+/// otherwise each be a std::string in an MPMCQueue: records are written
+/// and read in place, with no allocation and no copy.
+///
+/// Producers reserve a record of n bytes, fill it and commit it:
+///
+///   auto r = ring.blockingReserve(n);
+///   serialize(msg, r.data());
+///   ring.commit(r);
+///
+/// The single consumer reads records in order, as (ptr, len) spans into
+/// the ring, and releases them when it is done:
+///
+///   auto span = ring.blockingRead();
+///   handle(span.data(), span.size());
+///   ring.release(span);
+///
+/// MultiProducer selects MPSC (producers claim their bytes with a CAS on
+/// the write ticket) or SPSC (the producer owns it and uses plain stores).
+///
+/// Tickets are byte offsets that only grow, like MPMCQueue's element
+/// tickets; the ring position is ticket & (capacity - 1).  Every record
+/// starts with an 8 byte header holding its length and a state word, and
+/// is padded to a multiple of 8.  A record is always contiguous: if it
+/// doesn't fit before the end of the ring, the rest of the ring is turned
+/// into a padding record that the consumer skips, and the record starts
+/// at the beginning.  With doubleMapped the ring's memory is mapped twice
+/// back to back instead (see detail::RingMapping), records simply run
+/// past the end, and no space is lost to padding; the capacity is then at
+/// least a page.
+///
+/// Like MPMCQueue's slots, records are committed in any order but read in
+/// ticket order.  The consumer waits on the state word of the header at
+/// its read position: it spins briefly and then sets a waiter bit and
+/// parks on the word with futexWait, and commit only makes the futexWake
+/// syscall when that bit is set.  Producers that find the ring full park
+/// on a futex that release bumps.  Released bytes are zeroed, so that a
+/// header the consumer waits on reads as empty until it is committed.
+template <bool MultiProducer>
+class ByteRing {
+public:
+    static constexpr size_t kHeaderSize = 8;
+    static constexpr size_t kRecordAlign = 8;
+
+    /// capacity is rounded up to a power of two
+    explicit ByteRing(size_t capacity, bool doubleMapped = false) :
+        _mapping(std::max(capacity, 2 * kHeaderSize), doubleMapped),
+        _data(_mapping.data()),
+        _mask(_mapping.capacity() - 1) {}
+
+    // non-copyable and non-movable
+    ByteRing(const ByteRing&) = delete;
+    ByteRing& operator=(const ByteRing&) = delete;
+
+    size_t capacity() const noexcept { return _mask + 1; }
+
+    bool doubleMapped() const noexcept { return _mapping.doubleMapped(); }
+
+    /// The largest record that fits
+    size_t maxRecordSize() const noexcept {
+        return std::min<size_t>(capacity() - kHeaderSize, UINT32_MAX);
+    }
+
+    /// Bytes taken by records and padding that haven't been released yet.
+    /// May be stale by the time it returns
+    size_t sizeGuess() const noexcept {
+        uint64_t read = _readTicket.load(std::memory_order_acquire);
+        uint64_t write = _writeTicket.load(std::memory_order_acquire);
+        return write > read ? size_t(write - read) : 0;
+    }
+
+    /// A record that a producer has reserved: size() bytes at data() for
+    /// it to fill before commit().  The consumer waits for the commit, so
+    /// every reservation must be committed, and soon
+    class Reservation {
+    public:
+        char* data() const noexcept { return _data; }
+        size_t size() const noexcept { return _size; }
+
+    private:
+        friend class ByteRing;
+
+        char* _data{nullptr};
+        size_t _size{0};
+        uint64_t _ticket{0};
+    };
+
+    /// Reserves a record of size bytes if there is room for it now.
+    /// Throws std::invalid_argument if size > maxRecordSize()
+    bool tryReserve(size_t size, Reservation& r) {
+        checkSize(size);
+        return tryClaim(recordSize(size), size, r);
+    }
+
+    /// Waits for room if necessary
+    Reservation blockingReserve(size_t size) {
+        Reservation r;
+        tryReserveUntil(std::chrono::steady_clock::time_point::max(), size, r);
+        return r;
+    }
+
+    template <class Clock>
+    bool tryReserveUntil(const std::chrono::time_point<Clock>& when,
+            size_t size, Reservation& r) {
+        checkSize(size);
+        const size_t bytes = recordSize(size);
+        for (int i = 0, n = spinLimitIfMultiCpu(kSpinLimit); i < n; ++i) {
+            if (tryClaim(bytes, size, r)) {
+                return true;
+            }
+            asm_volatile_pause();
+        }
+        uint32_t cur = _spaceFutex.load(std::memory_order_acquire);
+        while (true) {
+            if ((cur & kWaiting) == 0 &&
+                    !_spaceFutex.compare_exchange_weak(cur, cur | kWaiting)) {
+                continue;
+            }
+            cur |= kWaiting;
+            // release() may have made room before it saw kWaiting
+            if (tryClaim(bytes, size, r)) {
+                return true;
+            }
+            auto rv = detail::futexWaitUntil(&_spaceFutex, cur, when, ~0u);
+            if (rv == detail::FutexResult::TIMEDOUT) {
+                return tryClaim(bytes, size, r);
+            }
+            cur = _spaceFutex.load(std::memory_order_acquire);
+        }
+    }
+
+    template <class Rep, class Period>
+    bool tryReserveFor(const std::chrono::duration<Rep, Period>& duration,
+            size_t size, Reservation& r) {
+        return tryReserveUntil(std::chrono::steady_clock::now() +
+                std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    duration), size, r);
+    }
+
+    /// Publishes a reserved record
+    void commit(Reservation& r) noexcept {
+        publish(r._ticket, kCommitted);
+    }
+
+    /// Copies size bytes into a new record, if there is room now
+    bool write(const void* data, size_t size) {
+        Reservation r;
+        if (!tryReserve(size, r)) {
+            return false;
+        }
+        memcpy(r.data(), data, size);
+        commit(r);
+        return true;
+    }
+
+    void blockingWrite(const void* data, size_t size) {
+        Reservation r = blockingReserve(size);
+        memcpy(r.data(), data, size);
+        commit(r);
+    }
+
+    /// A committed record, read in place.  It stays valid until it is
+    /// released
+    class Span {
+    public:
+        const char* data() const noexcept { return _data; }
+        size_t size() const noexcept { return _size; }
+
+    private:
+        friend class ByteRing;
+
+        const char* _data{nullptr};
+        size_t _size{0};
+        uint64_t _end{0};
+    };
+
+    /// Consumer only.  Reads the next record if it has been committed.
+    /// Several records may be read before any is released, but producers
+    /// only reuse space that has been released
+    bool tryRead(Span& span) noexcept {
+        while (true) {
+            if (_readPos - _releasePos >= capacity()) {
+                // everything is read and nothing released: the header at
+                // _readPos is that of the oldest record
+                return false;
+            }
+            uint32_t state = header(_readPos)->state.load(
+                    std::memory_order_acquire);
+            if ((state & kCommitted) == 0) {
+                return false;
+            }
+            const uint64_t start = _readPos;
+            const size_t size = header(start)->size;
+            if ((state & kPadding) != 0) {
+                _readPos += size;
+                if (_releasePos == start) {
+                    // nothing read is pending, so nobody would release it
+                    releaseTo(_readPos);
+                }
+                continue;
+            }
+            _readPos += recordSize(size);
+            _lastRead = _readPos;
+            span._data = _data + (start & _mask) + kHeaderSize;
+            span._size = size;
+            span._end = _readPos;
+            return true;
+        }
+    }
+
+    /// The consumer must not hold the whole ring read and unreleased,
+    /// since nothing could arrive until it releases
+    Span blockingRead() noexcept {
+        assert(_readPos - _releasePos < capacity());
+        Span span;
+        tryReadUntil(std::chrono::steady_clock::time_point::max(), span);
+        return span;
+    }
+
+    /// Returns false at once if the whole ring is read and unreleased
+    template <class Clock>
+    bool tryReadUntil(const std::chrono::time_point<Clock>& when,
+            Span& span) noexcept {
+        for (int i = 0, n = spinLimitIfMultiCpu(kSpinLimit); i < n; ++i) {
+            if (tryRead(span)) {
+                return true;
+            }
+            asm_volatile_pause();
+        }
+        while (!tryRead(span)) {
+            if (_readPos - _releasePos >= capacity()) {
+                // nothing can arrive until we release
+                return false;
+            }
+            // tryRead skipped any padding, so this is the header of the
+            // next record
+            auto& state = header(_readPos)->state;
+            uint32_t cur = 0;
+            if (!state.compare_exchange_strong(cur, kWaiting) &&
+                    cur != kWaiting) {
+                continue;
+            }
+            auto rv = detail::futexWaitUntil(&state, kWaiting, when, ~0u);
+            if (rv == detail::FutexResult::TIMEDOUT) {
+                return tryRead(span);
+            }
+        }
+        return true;
+    }
+
+    template <class Rep, class Period>
+    bool tryReadFor(const std::chrono::duration<Rep, Period>& duration,
+            Span& span) noexcept {
+        return tryReadUntil(std::chrono::steady_clock::now() +
+                std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    duration), span);
+    }
+
+    /// Consumer only.  Gives span and every record read before it back to
+    /// the producers; their spans become invalid
+    void release(const Span& span) noexcept {
+        // padding read after the last record goes with it
+        releaseTo(span._end == _lastRead ? _readPos : span._end);
+    }
+
+private:
+    enum : uint32_t {
+        /// Header state bits
+        kCommitted = 1,
+        kPadding = 2,
+        /// The consumer is parked on the state word, or producers on
+        /// _spaceFutex
+        kWaiting = 4,
+    };
+
+    enum { kSpinLimit = 100 };
+
+    struct Header {
+        std::atomic<uint32_t> state;
+        uint32_t size;
+    };
+
+    static_assert(sizeof(Header) == kHeaderSize, "unexpected Header size");
+
+    static size_t recordSize(size_t size) noexcept {
+        return (kHeaderSize + size + kRecordAlign - 1) & ~(kRecordAlign - 1);
+    }
+
+    void checkSize(size_t size) const {
+        if (size > maxRecordSize()) {
+            throw std::invalid_argument("ByteRing record too large");
+        }
+    }
+
+    Header* header(uint64_t ticket) const noexcept {
+        return reinterpret_cast<Header*>(_data + (ticket & _mask));
+    }
+
+    /// Claims bytes for a record of size bytes if the ring has room.  A
+    /// record that would wrap in a single mapped ring first claims the
+    /// rest of the ring as padding; the padding is claimed on its own, so
+    /// that the record never needs more than capacity bytes of room
+    bool tryClaim(size_t bytes, size_t size, Reservation& r) noexcept {
+        uint64_t ticket = _writeTicket.load(std::memory_order_acquire);
+        while (true) {
+            const size_t offset = size_t(ticket & _mask);
+            const bool pad = !doubleMapped() && offset + bytes > capacity();
+            const size_t claim = pad ? capacity() - offset : bytes;
+            const uint64_t read = _readTicket.load();
+            if (ticket < read) {
+                // stale, the consumer has already read past it
+                ticket = _writeTicket.load(std::memory_order_acquire);
+                continue;
+            }
+            if (ticket + claim - read > capacity()) {
+                return false;
+            }
+            if (!claimTicket(ticket, claim)) {
+                continue;
+            }
+            header(ticket)->size = uint32_t(pad ? claim : size);
+            if (pad) {
+                publish(ticket, kCommitted | kPadding);
+                ticket += claim;
+                continue;
+            }
+            r._data = _data + offset + kHeaderSize;
+            r._size = size;
+            r._ticket = ticket;
+            return true;
+        }
+    }
+
+    /// Moves _writeTicket from ticket to ticket + claim.  On failure
+    /// ticket is the current write ticket
+    bool claimTicket(uint64_t& ticket, size_t claim) noexcept {
+        if (MultiProducer) {
+            return _writeTicket.compare_exchange_weak(ticket, ticket + claim);
+        }
+        _writeTicket.store(ticket + claim, std::memory_order_release);
+        return true;
+    }
+
+    void publish(uint64_t ticket, uint32_t state) noexcept {
+        auto& word = header(ticket)->state;
+        if (word.exchange(state, std::memory_order_acq_rel) & kWaiting) {
+            detail::futexWake(&word, 1, ~0u);
+        }
+    }
+
+    /// Zeroes [_releasePos, end) for the headers of the next lap and hands
+    /// it back to the producers
+    void releaseTo(uint64_t end) noexcept {
+        if (end <= _releasePos) {
+            return;
+        }
+        const size_t offset = size_t(_releasePos & _mask);
+        const size_t bytes = size_t(end - _releasePos);
+        if (doubleMapped() || offset + bytes <= capacity()) {
+            memset(_data + offset, 0, bytes);
+        } else {
+            // no record wraps, but a range of them may
+            memset(_data + offset, 0, capacity() - offset);
+            memset(_data, 0, bytes - (capacity() - offset));
+        }
+        _releasePos = end;
+        _readTicket.store(end);
+        if (_spaceFutex.load() & kWaiting) {
+            // only we clear the bit, so nobody changed it since the load
+            _spaceFutex.fetch_add(kWaiting);
+            detail::futexWake(&_spaceFutex, INT_MAX, ~0u);
+        }
+    }
+
+    detail::RingMapping _mapping;
+    char* const _data;
+    const size_t _mask;
+
+    /// Producers claim bytes from here
+    alignas(hardware_destructive_interference_size)
+        std::atomic<uint64_t> _writeTicket{0};
+
+    /// Blocked producers park here; bit kWaiting says someone does, the
+    /// bits above count wakeups
+    alignas(hardware_destructive_interference_size)
+        detail::Futex _spaceFutex{0};
+
+    /// Everything below this has been released by the consumer
+    alignas(hardware_destructive_interference_size)
+        std::atomic<uint64_t> _readTicket{0};
+
+    /// Consumer only: the next record to read, the end of the last record
+    /// read, and how far we have released
+    alignas(hardware_destructive_interference_size) uint64_t _readPos{0};
+    uint64_t _lastRead{0};
+    uint64_t _releasePos{0};
+
+    /// Alignment doesn't prevent false sharing at the end of the struct,
+    /// so fill out the last cache line
+    char _pad[hardware_destructive_interference_size - 3 * sizeof(uint64_t)];
+};
+
+/// Any number of producers, one consumer
+using MPSCByteRing = ByteRing<true>;
+
+/// One producer, one consumer
+using SPSCByteRing = ByteRing<false>;
+
+};  // namespace myfolly
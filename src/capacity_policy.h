@@ -0,0 +1,162 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <stdexcept>
+
+namespace myfolly {
+
+/// Capacity policies map a queue ticket to the slot it uses (index) and to
+/// how many times the ring has wrapped around before it (turn).  Both
+/// MPMCQueue and BoundedQueue take one as a template parameter:
+///
+///   RuntimeCapacity      any capacity chosen at construction.  Index and
+///                        turn cost a 64-bit division each (the default)
+///   PowerOfTwoCapacity   capacity chosen at construction and rounded up to
+///                        a power of two, so index and turn are a mask and
+///                        a shift
+///   FixedCapacity<N>     capacity N fixed at compile time; the compiler
+///                        turns the divisions into shifts (or a multiply
+///                        when N isn't a power of two)
+///
+/// Consecutive tickets should not land on the same cache line, or producers
+/// and consumers working on neighbouring tickets would false-share it.
+/// index<SpreadBits>() therefore spreads the slots: RuntimeCapacity by a
+/// prime stride, the power-of-two policies by swapping the low SpreadBits
+/// bits of the index with the SpreadBits bits above them, which sends
+/// 2^SpreadBits consecutive tickets to 2^SpreadBits different lines.  With
+/// SpreadBits == 0 tickets map to slots in order.
+
+namespace detail {
+
+/// Returns the smallest power of two >= n (and 1 for n == 0)
+constexpr size_t nextPowTwo(size_t n) noexcept {
+    return n <= 1 ? 1 : size_t(2) * nextPowTwo((n + 1) / 2);
+}
+
+constexpr bool isPowTwo(size_t n) noexcept {
+    return n != 0 && (n & (n - 1)) == 0;
+}
+
+constexpr unsigned log2Floor(size_t n) noexcept {
+    return n <= 1 ? 0 : 1 + log2Floor(n / 2);
+}
+
+/// Swaps bits [0, B) of i with bits [B, 2B).  A bijection on any range
+/// [0, 2^k) with k >= 2B
+template <unsigned B>
+constexpr uint64_t swapLowBits(uint64_t i) noexcept {
+    return (i & ~((uint64_t(1) << (2 * B)) - 1)) |
+        ((i & ((uint64_t(1) << B) - 1)) << B) |
+        ((i >> B) & ((uint64_t(1) << B) - 1));
+}
+
+/// A stride for capacity that is coprime with it and keeps consecutive
+/// tickets as far apart as a small prime allows
+constexpr int computeStride(size_t capacity) noexcept {
+    const int smallPrimes[] = {2, 3, 5, 7, 11, 13, 17, 19, 23};
+
+    int bestStride = 1;
+    size_t bestSep = 1;
+    for (int stride : smallPrimes) {
+        if ((stride % capacity) == 0 || (capacity % stride) == 0) {
+            continue;
+        }
+        size_t sep = stride % capacity;
+        sep = sep < capacity - sep ? sep : capacity - sep;
+        if (sep > bestSep) {
+            bestStride = stride;
+            bestSep = sep;
+        }
+    }
+    return bestStride;
+}
+
+} // namespace detail
+
+class RuntimeCapacity {
+public:
+    explicit RuntimeCapacity(size_t capacity) :
+        _capacity(capacity),
+        _stride(capacity > 0 ? detail::computeStride(capacity) : 1) {}
+
+    size_t capacity() const noexcept { return _capacity; }
+
+    template <unsigned SpreadBits>
+    size_t index(uint64_t ticket) const noexcept {
+        return SpreadBits == 0 ?
+            ticket % _capacity : (ticket * _stride) % _capacity;
+    }
+
+    uint64_t turn(uint64_t ticket) const noexcept {
+        return ticket / _capacity;
+    }
+
+private:
+    size_t _capacity;
+    int _stride;
+};
+
+class PowerOfTwoCapacity {
+public:
+    explicit PowerOfTwoCapacity(size_t capacity) :
+        _mask(detail::nextPowTwo(capacity) - 1),
+        _shift(detail::log2Floor(_mask + 1)) {}
+
+    size_t capacity() const noexcept { return _mask + 1; }
+
+    template <unsigned SpreadBits>
+    size_t index(uint64_t ticket) const noexcept {
+        // too few slots to spread over 2^SpreadBits lines: map in order
+        if (_shift < 2 * SpreadBits) {
+            return ticket & _mask;
+        }
+        return detail::swapLowBits<SpreadBits>(ticket & _mask);
+    }
+
+    uint64_t turn(uint64_t ticket) const noexcept {
+        return ticket >> _shift;
+    }
+
+private:
+    uint64_t _mask;
+    unsigned _shift;
+};
+
+template <size_t N>
+class FixedCapacity {
+    static_assert(N > 0, "FixedCapacity needs N > 0");
+
+public:
+    /// capacity must be N; it is only taken so that queues can forward
+    /// their constructor argument to any policy
+    explicit FixedCapacity(size_t capacity = N) {
+        if (capacity != N) {
+            throw std::invalid_argument("capacity != FixedCapacity<N>");
+        }
+    }
+
+    static constexpr size_t capacity() noexcept { return N; }
+
+    template <unsigned SpreadBits>
+    size_t index(uint64_t ticket) const noexcept {
+        if (!detail::isPowTwo(N)) {
+            return SpreadBits == 0 ?
+                ticket % N : (ticket * kStride) % N;
+        }
+        if (detail::log2Floor(N) < 2 * SpreadBits) {
+            return ticket % N;
+        }
+        return detail::swapLowBits<SpreadBits>(ticket % N);
+    }
+
+    uint64_t turn(uint64_t ticket) const noexcept {
+        return ticket / N;
+    }
+
+private:
+    enum : uint64_t { kStride = detail::computeStride(N) };
+};
+
+} // namespace myfolly
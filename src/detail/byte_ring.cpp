@@ -0,0 +1,122 @@
+#include "detail/byte_ring.h"
+
+#include <algorithm>
+#include <string>
+#include <system_error>
+
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "capacity_policy.h"
+
+namespace myfolly {
+namespace detail {
+
+namespace {
+
+[[noreturn]] void throwErrno(const std::string& what) {
+    throw std::system_error(errno, std::system_category(), what);
+}
+
+/// An anonymous file for the double mapping.  Called through syscall so
+/// that we don't depend on the glibc wrapper (2.27+)
+int createMemfd() {
+#ifdef SYS_memfd_create
+    return int(syscall(SYS_memfd_create, "byte_ring", 1u /* MFD_CLOEXEC */));
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+char* mapTwice(size_t capacity) {
+    int fd = createMemfd();
+    if (fd < 0) {
+        throwErrno("memfd_create");
+    }
+    if (ftruncate(fd, off_t(capacity)) != 0) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        throwErrno("ftruncate");
+    }
+    // reserve 2 * capacity of address space, then put the file over both
+    // halves of it
+    void* p = mmap(nullptr, 2 * capacity, PROT_NONE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        throwErrno("mmap");
+    }
+    char* base = static_cast<char*>(p);
+    for (int half = 0; half < 2; ++half) {
+        void* q = mmap(base + half * capacity, capacity,
+                PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+        if (q == MAP_FAILED) {
+            int err = errno;
+            munmap(base, 2 * capacity);
+            close(fd);
+            errno = err;
+            throwErrno("mmap");
+        }
+    }
+    // the mappings keep the file alive
+    close(fd);
+    return base;
+}
+
+} // namespace
+
+RingMapping::RingMapping(size_t capacity, bool doubleMapped) :
+    _capacity(nextPowTwo(capacity)),
+    _doubleMapped(doubleMapped) {
+    if (doubleMapped) {
+        _capacity = std::max(_capacity, size_t(sysconf(_SC_PAGESIZE)));
+        _data = mapTwice(_capacity);
+        return;
+    }
+    void* p = mmap(nullptr, _capacity, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        throwErrno("mmap");
+    }
+    _data = static_cast<char*>(p);
+}
+
+RingMapping::~RingMapping() {
+    unmap();
+}
+
+RingMapping::RingMapping(RingMapping&& other) noexcept :
+    _data(other._data),
+    _capacity(other._capacity),
+    _doubleMapped(other._doubleMapped) {
+    other._data = nullptr;
+    other._capacity = 0;
+}
+
+RingMapping& RingMapping::operator=(RingMapping&& other) noexcept {
+    if (this != &other) {
+        unmap();
+        _data = other._data;
+        _capacity = other._capacity;
+        _doubleMapped = other._doubleMapped;
+        other._data = nullptr;
+        other._capacity = 0;
+    }
+    return *this;
+}
+
+void RingMapping::unmap() noexcept {
+    if (_data != nullptr) {
+        munmap(_data, _doubleMapped ? 2 * _capacity : _capacity);
+        _data = nullptr;
+    }
+}
+
+};  // namespace detail
+};  // namespace myfolly
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stddef.h>
+
+namespace myfolly {
+namespace detail {
+
+/// The zero-filled memory of a ByteRing.  capacity is rounded up to a
+/// power of two, and to at least a page when doubleMapped.  A double
+/// mapped ring maps the same capacity bytes twice, back to back, so that
+/// data() .. data() + 2 * capacity() is contiguous and byte i + capacity()
+/// is byte i: a record that runs past the end continues at the start.
+/// Errors are thrown as std::system_error
+class RingMapping {
+public:
+    RingMapping() = default;
+    RingMapping(size_t capacity, bool doubleMapped);
+    ~RingMapping();
+
+    RingMapping(RingMapping&& other) noexcept;
+    RingMapping& operator=(RingMapping&& other) noexcept;
+
+    RingMapping(const RingMapping&) = delete;
+    RingMapping& operator=(const RingMapping&) = delete;
+
+    char* data() const noexcept { return _data; }
+    size_t capacity() const noexcept { return _capacity; }
+    bool doubleMapped() const noexcept { return _doubleMapped; }
+
+private:
+    void unmap() noexcept;
+
+    char* _data{nullptr};
+    size_t _capacity{0};
+    bool _doubleMapped{false};
+};
+
+};  // namespace detail
+};  // namespace myfolly
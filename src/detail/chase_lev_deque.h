@@ -0,0 +1,155 @@
+#pragma once
+
+#include <atomic>
+#include <type_traits>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace myfolly {
+namespace detail {
+
+/// The Chase-Lev work-stealing deque ("Dynamic Circular Work-Stealing
+/// Deque", SPAA 2005), with the C11 memory orders of Le, Pop, Cohen and
+/// Zappa Nardelli ("Correct and Efficient Work-Stealing for Weak Memory
+/// Models", PPoPP 2013).
+///
+/// One owner thread push()es and pop()s at the bottom; any thread may
+/// steal() from the top.  Owner operations only touch _bottom and the
+/// array unless the deque is down to its last element, when owner and
+/// thieves race for it with a CAS on _top.
+///
+/// The array is circular and doubles when full.  A thief may still be
+/// reading an old array, so replaced arrays are only freed by the
+/// destructor (together they are never larger than the current one).
+///
+/// T must be trivially copyable, usually a pointer.
+template <typename T>
+class ChaseLevDeque {
+    static_assert(std::is_trivially_copyable<T>::value,
+            "T must be trivially copyable");
+
+public:
+    explicit ChaseLevDeque(size_t capacity = 256) :
+        _array(new Array(roundUp(capacity))) {}
+
+    ~ChaseLevDeque() {
+        delete _array.load(std::memory_order_relaxed);
+        for (Array* a : _retired) {
+            delete a;
+        }
+    }
+
+    ChaseLevDeque(const ChaseLevDeque&) = delete;
+    ChaseLevDeque& operator=(const ChaseLevDeque&) = delete;
+
+    /// Owner only
+    void push(T x) {
+        int64_t b = _bottom.load(std::memory_order_relaxed);
+        int64_t t = _top.load(std::memory_order_acquire);
+        Array* a = _array.load(std::memory_order_relaxed);
+        if (b - t > int64_t(a->mask)) {
+            a = grow(a, t, b);
+        }
+        a->put(b, x);
+        // publishes x (and what it points to) to thieves
+        _bottom.store(b + 1, std::memory_order_release);
+    }
+
+    /// Owner only.  Takes the element pushed last
+    bool pop(T& x) noexcept {
+        int64_t b = _bottom.load(std::memory_order_relaxed) - 1;
+        Array* a = _array.load(std::memory_order_relaxed);
+        _bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = _top.load(std::memory_order_relaxed);
+        if (t > b) {
+            // empty
+            _bottom.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+        x = a->get(b);
+        if (t == b) {
+            // the last element, thieves may be after it too
+            bool won = _top.compare_exchange_strong(t, t + 1,
+                    std::memory_order_seq_cst, std::memory_order_relaxed);
+            _bottom.store(b + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    /// Any thread.  Takes the oldest element; fails when the deque is
+    /// empty or another thread got the element first
+    bool steal(T& x) noexcept {
+        int64_t t = _top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = _bottom.load(std::memory_order_acquire);
+        if (t >= b) {
+            return false;
+        }
+        Array* a = _array.load(std::memory_order_acquire);
+        x = a->get(t);
+        return _top.compare_exchange_strong(t, t + 1,
+                std::memory_order_seq_cst, std::memory_order_relaxed);
+    }
+
+    /// A guess, unless called by the owner while nobody steals
+    bool isEmpty() const noexcept {
+        return _bottom.load(std::memory_order_acquire) <=
+            _top.load(std::memory_order_acquire);
+    }
+
+    size_t capacity() const noexcept {
+        return _array.load(std::memory_order_relaxed)->mask + 1;
+    }
+
+private:
+    struct Array {
+        explicit Array(size_t capacity) :
+            mask(capacity - 1), slots(new std::atomic<T>[capacity]) {}
+
+        ~Array() { delete[] slots; }
+
+        T get(int64_t i) const noexcept {
+            return slots[size_t(i) & mask].load(std::memory_order_relaxed);
+        }
+
+        void put(int64_t i, T x) noexcept {
+            slots[size_t(i) & mask].store(x, std::memory_order_relaxed);
+        }
+
+        const size_t mask;
+        std::atomic<T>* const slots;
+    };
+
+    static size_t roundUp(size_t capacity) noexcept {
+        size_t c = 2;
+        while (c < capacity) {
+            c *= 2;
+        }
+        return c;
+    }
+
+    Array* grow(Array* a, int64_t t, int64_t b) {
+        Array* bigger = new Array(2 * (a->mask + 1));
+        for (int64_t i = t; i < b; ++i) {
+            bigger->put(i, a->get(i));
+        }
+        _retired.push_back(a);
+        _array.store(bigger, std::memory_order_release);
+        return bigger;
+    }
+
+    /// Thieves' end and owner's end on separate cache lines.  Padded
+    /// rather than aligned, so that deques can be allocated with plain new
+    std::atomic<int64_t> _top{0};
+    char _pad[128 - sizeof(std::atomic<int64_t>)];
+    std::atomic<int64_t> _bottom{0};
+    std::atomic<Array*> _array;
+    /// Owner only
+    std::vector<Array*> _retired;
+};
+
+};  // namespace detail
+};  // namespace myfolly
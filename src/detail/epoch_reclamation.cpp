@@ -0,0 +1,131 @@
+#include "detail/epoch_reclamation.h"
+
+namespace myfolly {
+namespace detail {
+
+/// Releases the thread's record when the thread exits
+struct EpochRecordHolder {
+    EpochDomain::Record* record{nullptr};
+
+    ~EpochRecordHolder() {
+        if (record != nullptr) {
+            record->state.store(0, std::memory_order_release);
+            record->inUse.store(false, std::memory_order_release);
+        }
+    }
+};
+
+EpochDomain& EpochDomain::instance() {
+    // leaked, so that thread exit may still release records during
+    // static destruction
+    static EpochDomain* domain = new EpochDomain;
+    return *domain;
+}
+
+EpochDomain::Record* EpochDomain::acquireRecord() {
+    for (Record* r = _records.load(std::memory_order_acquire); r != nullptr;
+            r = r->next) {
+        bool expected = false;
+        if (!r->inUse.load(std::memory_order_relaxed) &&
+                r->inUse.compare_exchange_strong(expected, true)) {
+            return r;
+        }
+    }
+    // records are never freed, a thread that exits leaves its record for
+    // the next one
+    Record* r = new Record;
+    Record* head = _records.load(std::memory_order_relaxed);
+    do {
+        r->next = head;
+    } while (!_records.compare_exchange_weak(head, r,
+                std::memory_order_release, std::memory_order_relaxed));
+    return r;
+}
+
+EpochDomain::Record* EpochDomain::localRecord() {
+    static thread_local EpochRecordHolder holder;
+    if (holder.record == nullptr) {
+        holder.record = acquireRecord();
+    }
+    return holder.record;
+}
+
+void EpochDomain::enter() noexcept {
+    Record* r = localRecord();
+    if (r->depth++ > 0) {
+        return;
+    }
+    uint64_t e = _epoch.load(std::memory_order_relaxed);
+    while (true) {
+        r->state.store((e << 1) | 1, std::memory_order_relaxed);
+        // the announcement must be visible before we load any pointer,
+        // pairs with the fence in tryAdvance
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        uint64_t now = _epoch.load(std::memory_order_acquire);
+        if (now == e) {
+            break;
+        }
+        e = now;
+    }
+}
+
+void EpochDomain::exit() noexcept {
+    Record* r = localRecord();
+    if (--r->depth > 0) {
+        return;
+    }
+    r->state.store(0, std::memory_order_release);
+}
+
+void EpochDomain::retire(RetireNode& node, void* object, void* owner,
+        Reclaim reclaim) noexcept {
+    node.object = object;
+    node.owner = owner;
+    node.reclaim = reclaim;
+    std::lock_guard<std::mutex> lock(_mutex);
+    uint64_t e = _epoch.load(std::memory_order_relaxed);
+    node.next = _limbo[e % 3];
+    _limbo[e % 3] = &node;
+    tryAdvance();
+}
+
+void EpochDomain::tryAdvance() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint64_t e = _epoch.load(std::memory_order_relaxed);
+    for (Record* r = _records.load(std::memory_order_acquire); r != nullptr;
+            r = r->next) {
+        uint64_t state = r->state.load(std::memory_order_acquire);
+        if ((state & 1) != 0 && (state >> 1) != e) {
+            return;
+        }
+    }
+    _epoch.store(e + 1, std::memory_order_release);
+    // everyone has seen e, so what was retired in e - 1 is unreachable
+    RetireNode* ready = _limbo[(e + 2) % 3];
+    _limbo[(e + 2) % 3] = nullptr;
+    while (ready != nullptr) {
+        // reclaim may reuse the node
+        RetireNode* next = ready->next;
+        ready->reclaim(ready->object, ready->owner);
+        ready = next;
+    }
+}
+
+void EpochDomain::drain(void* owner) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto& bucket : _limbo) {
+        RetireNode** link = &bucket;
+        while (*link != nullptr) {
+            RetireNode* node = *link;
+            if (node->owner == owner) {
+                *link = node->next;
+                node->reclaim(node->object, node->owner);
+            } else {
+                link = &node->next;
+            }
+        }
+    }
+}
+
+};  // namespace detail
+};  // namespace myfolly
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+
+namespace myfolly {
+namespace detail {
+
+/// Epoch-based reclamation.  Threads that follow pointers into shared
+/// structures do so inside an EpochGuard; an object that has been made
+/// unreachable is retire()d and handed to its reclaim function only once
+/// every thread that was inside a guard at the time has left it.
+///
+/// The global epoch advances when every active thread has announced the
+/// current one.  An object retired in epoch e is reclaimed when the epoch
+/// reaches e + 2, so at most three generations of retired objects exist.
+/// Guards must be short: a thread that stays inside one holds back all
+/// reclamation, so never block inside a guard.
+///
+/// There is one domain per process (instance()); objects are tagged with
+/// an owner so that a data structure can drain() its own retired objects
+/// when it is destroyed.
+///
+/// Retired objects wait on intrusive lists, linked through a RetireNode
+/// that each retirable object embeds, so retire() never allocates and may
+/// be called from noexcept code.
+class EpochDomain {
+public:
+    using Reclaim = void (*)(void* object, void* owner);
+
+    /// Filled in by retire(); the object must not touch it until reclaim
+    /// is called
+    struct RetireNode {
+        RetireNode* next{nullptr};
+        void* object{nullptr};
+        void* owner{nullptr};
+        Reclaim reclaim{nullptr};
+    };
+
+    static EpochDomain& instance();
+
+    /// Guards nest; only the outermost one announces an epoch
+    void enter() noexcept;
+    void exit() noexcept;
+
+    /// object must already be unreachable for threads that enter a guard
+    /// from now on.  node is object's RetireNode
+    void retire(RetireNode& node, void* object, void* owner,
+            Reclaim reclaim) noexcept;
+
+    /// Reclaims all of owner's retired objects at once.  Only for an owner
+    /// that no thread can be using any more, i.e. from its destructor
+    void drain(void* owner);
+
+    uint64_t epoch() const noexcept {
+        return _epoch.load(std::memory_order_acquire);
+    }
+
+private:
+    /// A thread's announcement: (epoch << 1) | active.  Padded rather
+    /// than aligned (plain new doesn't align beyond 16 bytes in C++14), so
+    /// that the state words of two records never share a cache line
+    struct Record {
+        std::atomic<uint64_t> state{0};
+        std::atomic<bool> inUse{true};
+        Record* next{nullptr};
+        uint32_t depth{0};
+        char pad[128 - 2 * sizeof(uint64_t) - sizeof(Record*) -
+            sizeof(uint32_t)];
+    };
+
+    friend struct EpochRecordHolder;
+
+    EpochDomain() = default;
+
+    Record* acquireRecord();
+    Record* localRecord();
+
+    /// With _mutex held
+    void tryAdvance();
+
+    std::atomic<uint64_t> _epoch{0};
+    std::atomic<Record*> _records{nullptr};
+    std::mutex _mutex;
+    RetireNode* _limbo[3]{nullptr, nullptr, nullptr};
+};
+
+class EpochGuard {
+public:
+    EpochGuard() noexcept : _domain(EpochDomain::instance()) {
+        _domain.enter();
+    }
+
+    ~EpochGuard() { _domain.exit(); }
+
+    EpochGuard(const EpochGuard&) = delete;
+    EpochGuard& operator=(const EpochGuard&) = delete;
+
+private:
+    EpochDomain& _domain;
+};
+
+};  // namespace detail
+};  // namespace myfolly
@@ -6,6 +6,11 @@
 #include <unistd.h>
 #endif
 #include <errno.h>
+#include <time.h>
+
+#if defined(__linux__) && !defined(__NR_futex_waitv)
+#define __NR_futex_waitv 449
+#endif
 
 namespace myfolly {
 namespace detail {
@@ -32,11 +37,12 @@ struct timespec timeSpecFromTimePoint(time_point<Clock> absTime) {
     return result;
 }
 
-int nativeFutexWake(const void* addr, int count, uint32_t wakeMask) {
+int nativeFutexWake(const void* addr, int count, uint32_t wakeMask,
+        bool processShared) {
     int rv = syscall(
             __NR_futex,
             addr, /* addr1 */
-            FUTEX_WAKE_BITSET | FUTEX_PRIVATE_FLAG, /* op */
+            FUTEX_WAKE_BITSET | (processShared ? 0 : FUTEX_PRIVATE_FLAG), /* op */
             count, /* val */
             nullptr, /* timeout */
             nullptr, /* addr2 */
@@ -57,10 +63,11 @@ FutexResult nativeFutexWait(
     uint32_t expected,
     system_clock::time_point const* absSystemTime,
     steady_clock::time_point const* absSteadyTime,
-    uint32_t waitMask) {
+    uint32_t waitMask,
+    bool processShared) {
     assert(absSystemTime == nullptr || absSteadyTime == nullptr);
 
-    int op = FUTEX_WAIT_BITSET | FUTEX_PRIVATE_FLAG;
+    int op = FUTEX_WAIT_BITSET | (processShared ? 0 : FUTEX_PRIVATE_FLAG);
     struct timespec ts;
     struct timespec* timeout = nullptr;
 
@@ -110,5 +117,85 @@ FutexResult nativeFutexWait(
     }
 }
 
+namespace {
+
+/// struct futex_waitv from <linux/futex.h>, which older headers lack
+struct KernelFutexWaitv {
+    uint64_t val;
+    uint64_t uaddr;
+    uint32_t flags;
+    uint32_t reserved;
+};
+
+/// FUTEX2_SIZE_U32 | FUTEX2_PRIVATE
+constexpr uint32_t kFutexWaitvFlags = 0x02 | 128;
+
+} // namespace
+
+bool futexWaitvSupported() {
+#ifdef __linux__
+    // no futexes is EINVAL where the syscall exists.  Anything else, such
+    // as ENOSYS or a seccomp filter's EPERM, means we can't use it
+    static const bool supported =
+        syscall(__NR_futex_waitv, nullptr, 0, 0, nullptr, 0) == -1 &&
+        errno == EINVAL;
+    return supported;
+#else
+    return false;
+#endif
+}
+
+FutexResult nativeFutexWaitAny(
+    const FutexWaitvEntry* entries,
+    size_t n,
+    system_clock::time_point const* absSystemTime,
+    steady_clock::time_point const* absSteadyTime,
+    size_t* woken) {
+    assert(absSystemTime == nullptr || absSteadyTime == nullptr);
+    assert(n > 0 && n <= kFutexWaitvMax);
+
+    KernelFutexWaitv waiters[kFutexWaitvMax];
+    for (size_t i = 0; i < n; ++i) {
+        waiters[i].val = entries[i].expected;
+        waiters[i].uaddr = reinterpret_cast<uintptr_t>(entries[i].addr);
+        waiters[i].flags = kFutexWaitvFlags;
+        waiters[i].reserved = 0;
+    }
+
+    struct timespec ts;
+    struct timespec* timeout = nullptr;
+    int clockId = CLOCK_MONOTONIC;
+    if (absSystemTime != nullptr) {
+        clockId = CLOCK_REALTIME;
+        ts = timeSpecFromTimePoint(*absSystemTime);
+        timeout = &ts;
+    } else if (absSteadyTime != nullptr) {
+        ts = timeSpecFromTimePoint(*absSteadyTime);
+        timeout = &ts;
+    }
+
+    long rv = syscall(__NR_futex_waitv, waiters, n, 0, timeout, clockId);
+    if (rv >= 0) {
+        if (woken != nullptr) {
+            *woken = size_t(rv);
+        }
+        return FutexResult::AWOKEN;
+    }
+    switch (errno) {
+    case ETIMEDOUT:
+        assert(timeout != nullptr);
+        return FutexResult::TIMEDOUT;
+    case EINTR:
+        return FutexResult::INTERRUPTED;
+    case EAGAIN:
+        return FutexResult::VALUE_CHANGED;
+    default:
+        // ENOSYS (the caller should have checked futexWaitvSupported), or
+        // EINVAL/EFAULT; as in nativeFutexWait
+        assert(false);
+        return FutexResult::VALUE_CHANGED;
+    }
+}
+
 };  // namespace detail
 };  // namespace myfolly
@@ -3,6 +3,8 @@
 #include <atomic>
 #include <chrono>
 #include <cassert>
+#include <type_traits>
+#include <stddef.h>
 #include <stdint.h>
 
 namespace myfolly {
@@ -17,7 +19,12 @@ enum class FutexResult {
     TIMEDOUT, /* wakeup by expiring deadline */
 };
 
-int nativeFutexWake(const void* addr, int count, uint32_t wakeMask);
+/// processShared futexes may live in memory shared between processes
+/// (MAP_SHARED): they are waited on and woken without FUTEX_PRIVATE_FLAG,
+/// so the kernel matches waiters by page instead of by address space.
+/// Waiters and wakers of one futex must agree on it
+int nativeFutexWake(const void* addr, int count, uint32_t wakeMask,
+        bool processShared = false);
 
 /** Optimal when TargetClock is the same type as Clock.
  *
@@ -56,7 +63,49 @@ FutexResult nativeFutexWait(
     uint32_t expected,
     std::chrono::system_clock::time_point const* absSystemTime,
     std::chrono::steady_clock::time_point const* absSteadyTime,
-    uint32_t waitMask);
+    uint32_t waitMask,
+    bool processShared = false);
+
+inline FutexResult nativeFutexWait(
+    const void* addr,
+    uint32_t expected,
+    std::chrono::system_clock::time_point const& absTime,
+    uint32_t waitMask) {
+    return nativeFutexWait(addr, expected, &absTime, nullptr, waitMask);
+}
+
+inline FutexResult nativeFutexWait(
+    const void* addr,
+    uint32_t expected,
+    std::chrono::steady_clock::time_point const& absTime,
+    uint32_t waitMask) {
+    return nativeFutexWait(addr, expected, nullptr, &absTime, waitMask);
+}
+
+/// One futex of a nativeFutexWaitAny call
+struct FutexWaitvEntry {
+    const void* addr;
+    uint32_t expected;
+};
+
+/// The most futexes one futex_waitv call accepts
+constexpr size_t kFutexWaitvMax = 128;
+
+/// Whether the running kernel has futex_waitv (Linux 5.16+)
+bool futexWaitvSupported();
+
+/// Waits on up to kFutexWaitvMax futexes at once with futex_waitv and
+/// returns when any of them is woken or doesn't hold its expected value.
+/// On AWOKEN *woken (if not null) is the index of the futex that was
+/// woken.  Waiters are woken by futexWake with any mask (futex_waitv
+/// doesn't support bitsets).  The timeout rules match nativeFutexWait.
+/// Must only be called when futexWaitvSupported()
+FutexResult nativeFutexWaitAny(
+    const FutexWaitvEntry* entries,
+    size_t n,
+    std::chrono::system_clock::time_point const* absSystemTime,
+    std::chrono::steady_clock::time_point const* absSteadyTime,
+    size_t* woken);
 
 template <typename Futex, class Clock, class Duration>
 FutexResult futexWaitUntil(
@@ -76,15 +125,18 @@ FutexResult futexWaitUntil(
 
 template <typename Futex>
 FutexResult futexWait(
-        const Futex* futex, uint32_t expected, uint32_t waitMask) {
-    auto rv = nativeFutexWait(futex, expected, nullptr, nullptr, waitMask);
+        const Futex* futex, uint32_t expected, uint32_t waitMask,
+        bool processShared = false) {
+    auto rv = nativeFutexWait(futex, expected, nullptr, nullptr, waitMask,
+            processShared);
     assert(rv != FutexResult::TIMEDOUT);
     return rv;
 }
 
 template <typename Futex>
-int futexWake(const Futex* futex, int count, uint32_t wakeMask) {
-    return nativeFutexWake(futex, count, wakeMask);
+int futexWake(const Futex* futex, int count, uint32_t wakeMask,
+        bool processShared = false) {
+    return nativeFutexWake(futex, count, wakeMask, processShared);
 }
 
 };  // namespace detail
@@ -0,0 +1,55 @@
+#include "lifo_sem.h"
+
+#include <chrono>
+
+#include "portability.h"
+
+namespace myfolly {
+
+namespace {
+
+constexpr int kSpinLimit = 100;
+
+} // namespace
+
+void LifoSem::wait() noexcept {
+    for (int i = 0, n = spinLimitIfMultiCpu(kSpinLimit); i < n; ++i) {
+        if (tryWait()) {
+            return;
+        }
+        asm_volatile_pause();
+    }
+    if (_value.fetch_sub(1, std::memory_order_acquire) > 0) {
+        return;
+    }
+
+    // committed: some later post() owes us a wake
+    detail::WaitNode node(0, 0);
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_pendingWakes > 0) {
+            --_pendingWakes;
+            return;
+        }
+        node.next = _top;
+        _top = &node;
+        ++_numWaiters;
+    }
+    node.wait(std::chrono::steady_clock::time_point::max());
+}
+
+void LifoSem::wakeOne() noexcept {
+    std::lock_guard<std::mutex> lock(_mutex);
+    detail::WaitNode* node = _top;
+    if (node == nullptr) {
+        // the waiter decremented _value but hasn't pushed itself yet
+        ++_pendingWakes;
+        return;
+    }
+    _top = node->next;
+    --_numWaiters;
+    // under the lock, see WaitNode::wake
+    node->wake();
+}
+
+};  // namespace myfolly
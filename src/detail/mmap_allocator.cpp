@@ -0,0 +1,119 @@
+#include "detail/mmap_allocator.h"
+
+#include <sys/mman.h>
+#ifdef __linux__
+#include <linux/mempolicy.h>  /* Definition of MPOL_* constants */
+#include <sys/syscall.h>      /* Definition of SYS_* constants */
+#endif
+#include <unistd.h>
+
+namespace myfolly {
+namespace detail {
+
+namespace {
+
+constexpr size_t kHugePageSize = size_t(2) << 20;
+
+size_t roundUp(size_t bytes, size_t align) {
+    return (bytes + align - 1) / align * align;
+}
+
+bool wantsHugePages(const MmapAllocationOptions& options) {
+    return options.hugeTlb || options.transparentHugePages;
+}
+
+bool bindToNode(void* p, size_t length, int node) {
+#ifdef __linux__
+    if (node < 0 || node >= 64) {
+        return false;
+    }
+    unsigned long nodemask = 1ul << node;
+    // maxnode counts bits, and the kernel ignores the last one
+    long rv = syscall(__NR_mbind, p, length, MPOL_BIND, &nodemask,
+            sizeof(nodemask) * 8 + 1, 0);
+    return rv == 0;
+#else
+    return false;
+#endif
+}
+
+/// Writes one byte per page, so that the page is faulted in under the
+/// memory policy that is now in effect
+void touchPages(void* p, size_t length) {
+    const size_t pageSize = sysconf(_SC_PAGESIZE);
+    volatile char* bytes = static_cast<volatile char*>(p);
+    for (size_t i = 0; i < length; i += pageSize) {
+        bytes[i] = 0;
+    }
+}
+
+} // namespace
+
+size_t mmapAllocationSize(size_t bytes, const MmapAllocationOptions& options) {
+    // Round to the huge page size whenever huge pages were requested, even
+    // if we fall back to small pages, so deallocation doesn't need to know
+    return roundUp(bytes, wantsHugePages(options)
+            ? kHugePageSize : size_t(sysconf(_SC_PAGESIZE)));
+}
+
+void* mmapAllocate(size_t bytes,
+        const MmapAllocationOptions& options,
+        MmapAllocationResult* result) {
+    MmapAllocationResult local;
+    MmapAllocationResult& res = result != nullptr ? *result : local;
+    res = MmapAllocationResult();
+
+    const size_t length = mmapAllocationSize(bytes, options);
+    // MAP_POPULATE would fault pages in before mbind or MADV_HUGEPAGE had a
+    // chance to apply, so in those cases we prefault by hand afterwards
+    const int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    const int populate = options.prefault && options.numaNode < 0
+        ? MAP_POPULATE : 0;
+
+    void* p = MAP_FAILED;
+    bool populated = false;
+#ifdef MAP_HUGETLB
+    if (options.hugeTlb) {
+        p = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                flags | MAP_HUGETLB | populate, -1, 0);
+        res.hugeTlb = p != MAP_FAILED;
+        populated = res.hugeTlb && populate != 0;
+    }
+#endif
+    if (p == MAP_FAILED) {
+        const bool late = wantsHugePages(options);
+        p = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                flags | (late ? 0 : populate), -1, 0);
+        if (p == MAP_FAILED) {
+            return nullptr;
+        }
+        populated = !late && populate != 0;
+    }
+
+#ifdef MADV_HUGEPAGE
+    if (!res.hugeTlb && wantsHugePages(options)) {
+        res.transparentHugePages = madvise(p, length, MADV_HUGEPAGE) == 0;
+    }
+#endif
+
+    if (options.numaNode >= 0) {
+        res.numaBound = bindToNode(p, length, options.numaNode);
+    }
+
+    if (options.prefault) {
+        if (!populated) {
+            touchPages(p, length);
+        }
+        res.prefaulted = true;
+    }
+    return p;
+}
+
+void mmapDeallocate(void* p, size_t bytes, const MmapAllocationOptions& options) {
+    if (p != nullptr) {
+        munmap(p, mmapAllocationSize(bytes, options));
+    }
+}
+
+};  // namespace detail
+};  // namespace myfolly
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <stdint.h>
+
+namespace myfolly {
+namespace detail {
+
+/// How MmapAllocator should back an allocation.  Every option is a
+/// request: if the kernel or machine can't honor it the allocation still
+/// succeeds with ordinary pages, and the outcome is reported in
+/// MmapAllocationResult.
+struct MmapAllocationOptions {
+    /// Explicit hugetlbfs pages (MAP_HUGETLB).  Requires pages reserved in
+    /// /proc/sys/vm/nr_hugepages
+    bool hugeTlb = false;
+
+    /// Ask for transparent huge pages with madvise(MADV_HUGEPAGE).  Used
+    /// on its own, or as the fallback when hugeTlb fails
+    bool transparentHugePages = false;
+
+    /// Fault every page in at allocation time instead of on first touch
+    /// on the hot path
+    bool prefault = false;
+
+    /// Bind the memory to this NUMA node with mbind(MPOL_BIND), -1 for the
+    /// default policy (first touch)
+    int numaNode = -1;
+};
+
+struct MmapAllocationResult {
+    bool hugeTlb = false;
+    bool transparentHugePages = false;
+    bool prefaulted = false;
+    bool numaBound = false;
+};
+
+/// Length that mmapAllocate maps for bytes, which must also be passed to
+/// mmapDeallocate
+size_t mmapAllocationSize(size_t bytes, const MmapAllocationOptions& options);
+
+/// Returns nullptr if even a plain anonymous mapping fails
+void* mmapAllocate(size_t bytes,
+        const MmapAllocationOptions& options,
+        MmapAllocationResult* result);
+
+void mmapDeallocate(void* p, size_t bytes, const MmapAllocationOptions& options);
+
+};  // namespace detail
+};  // namespace myfolly
@@ -0,0 +1,58 @@
+#include "detail/parking_lot.h"
+
+namespace myfolly {
+namespace detail {
+
+namespace {
+
+constexpr size_t kNumBuckets = 1024;
+
+ParkingLotBucket gBuckets[kNumBuckets];
+
+/// Keys are mostly addresses, whose low bits are all alike
+uint64_t mixKey(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return key;
+}
+
+} // namespace
+
+void ParkingLotBucket::push(WaitNode* node) noexcept {
+    node->prev = _tail;
+    node->next = nullptr;
+    if (_tail != nullptr) {
+        _tail->next = node;
+    } else {
+        _head = node;
+    }
+    _tail = node;
+}
+
+void ParkingLotBucket::erase(WaitNode* node) noexcept {
+    if (node->prev != nullptr) {
+        node->prev->next = node->next;
+    } else {
+        _head = node->next;
+    }
+    if (node->next != nullptr) {
+        node->next->prev = node->prev;
+    } else {
+        _tail = node->prev;
+    }
+    node->next = nullptr;
+    node->prev = nullptr;
+}
+
+ParkingLotBucket& ParkingLotBucket::forKey(uint64_t key) noexcept {
+    return gBuckets[mixKey(key) % kNumBuckets];
+}
+
+uint64_t nextParkingLotId() noexcept {
+    static std::atomic<uint64_t> nextId{0};
+    return nextId.fetch_add(1, std::memory_order_relaxed);
+}
+
+};  // namespace detail
+};  // namespace myfolly
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <stdint.h>
+
+#include "detail/futex.h"
+
+namespace myfolly {
+namespace detail {
+
+/// A thread parked in a ParkingLot.  It lives on the parked thread's stack
+/// and is linked into the bucket its key hashes to.  The thread sleeps on
+/// its own futex, so unparking it never wakes anyone else.
+class WaitNode {
+public:
+    WaitNode(uint64_t key, uint64_t lotId) noexcept :
+        key(key), lotId(lotId) {}
+
+    /// Called by the unparker, with the bucket lock held, after it took
+    /// the node out of the bucket
+    void wake() noexcept {
+        _state.store(kWaking, std::memory_order_release);
+        futexWake(&_state, 1, ~0u);
+        _state.store(kUnparked, std::memory_order_release);
+    }
+
+    /// Sleeps until wake() or deadline.  Returns false on timeout, in which
+    /// case the node may still be in its bucket
+    template <class Clock, class Duration>
+    bool wait(const std::chrono::time_point<Clock, Duration>& deadline)
+        noexcept {
+        uint32_t state;
+        while ((state = _state.load(std::memory_order_acquire)) == kParked) {
+            if (futexWaitUntil(&_state, kParked, deadline, ~0u) ==
+                    FutexResult::TIMEDOUT) {
+                return false;
+            }
+        }
+        waitUntilUnparked(state);
+        return true;
+    }
+
+    /// The parked thread can't let go of the node (return and pop its
+    /// stack) while wake() still has to pass its address to futexWake
+    void waitUntilUnparked(uint32_t state) noexcept {
+        while (state != kUnparked) {
+            std::this_thread::yield();
+            state = _state.load(std::memory_order_acquire);
+        }
+    }
+
+    bool unparked() const noexcept {
+        return _state.load(std::memory_order_acquire) != kParked;
+    }
+
+    const uint64_t key;
+    const uint64_t lotId;
+    WaitNode* next{nullptr};
+    WaitNode* prev{nullptr};
+
+private:
+    enum : uint32_t { kParked, kWaking, kUnparked };
+
+    Futex _state{kParked};
+};
+
+/// One shard of the global table of parked threads.  count is the number
+/// of nodes in the bucket, so that unpark can skip the lock when nobody is
+/// parked; it is incremented before the parker checks its condition (see
+/// ParkingLot::park)
+class alignas(128) ParkingLotBucket {
+public:
+    void push(WaitNode* node) noexcept;
+    void erase(WaitNode* node) noexcept;
+
+    WaitNode* head() const noexcept { return _head; }
+
+    static ParkingLotBucket& forKey(uint64_t key) noexcept;
+
+    std::mutex mutex;
+    std::atomic<uint64_t> count{0};
+
+private:
+    WaitNode* _head{nullptr};
+    WaitNode* _tail{nullptr};
+};
+
+/// Every ParkingLot gets its own id, so that lots sharing a key (and a
+/// bucket) never see each other's nodes
+uint64_t nextParkingLotId() noexcept;
+
+};  // namespace detail
+};  // namespace myfolly
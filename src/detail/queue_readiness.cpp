@@ -0,0 +1,116 @@
+#include "detail/queue_readiness.h"
+
+#include <limits>
+#include <system_error>
+
+#include <errno.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace myfolly {
+namespace detail {
+
+namespace {
+
+/// The eventcount of waiters that can't use futex_waitv
+Futex gGlobalEpoch{0};
+
+} // namespace
+
+ReadinessEvent::~ReadinessEvent() {
+    if (_eventFd >= 0) {
+        close(_eventFd);
+    }
+}
+
+int ReadinessEvent::eventFd() {
+    if (_eventFd < 0) {
+        _eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (_eventFd < 0) {
+            throw std::system_error(errno, std::system_category(), "eventfd");
+        }
+    }
+    return _eventFd;
+}
+
+void ReadinessEvent::clearEventFd() noexcept {
+    uint64_t count;
+    // EAGAIN when it wasn't signaled, which is fine
+    ssize_t rv = read(_eventFd, &count, sizeof(count));
+    (void)rv;
+}
+
+void ReadinessEvent::notifySlow(uint32_t waiters) noexcept {
+    if ((waiters & kEventFdArmed) != 0 &&
+            (_waiters.fetch_and(~kEventFdArmed) & kEventFdArmed) != 0) {
+        // we disarmed it, so no other producer writes too
+        uint64_t one = 1;
+        ssize_t rv = write(_eventFd, &one, sizeof(one));
+        (void)rv;
+        _eventFdSignals.fetch_add(1, std::memory_order_relaxed);
+    }
+    if ((waiters & (kGlobalWaiter - 1)) != 0) {
+        _epoch.fetch_add(1, std::memory_order_release);
+        futexWake(&_epoch, std::numeric_limits<int>::max(), ~0u);
+    }
+    if ((waiters & ~kEventFdArmed) >= kGlobalWaiter) {
+        gGlobalEpoch.fetch_add(1, std::memory_order_release);
+        futexWake(&gGlobalEpoch, std::numeric_limits<int>::max(), ~0u);
+    }
+}
+
+ReadinessWaitSet::ReadinessWaitSet(ReadinessEvent* const* events, size_t n) :
+    _events(events),
+    _n(n),
+    _useWaitv(n > 0 && n <= kFutexWaitvMax && futexWaitvSupported()),
+    _globalEpoch(0) {
+    const uint32_t waiter = _useWaitv ?
+        ReadinessEvent::kWaitvWaiter : ReadinessEvent::kGlobalWaiter;
+    for (size_t i = 0; i < _n; ++i) {
+        _events[i]->_waiters.fetch_add(waiter, std::memory_order_seq_cst);
+    }
+    // the caller's readability checks must not be reordered before the
+    // registration: ReadinessEvent::notify loads _waiters after the
+    // producer's completeTurn
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (_useWaitv) {
+        _entries.resize(_n);
+        for (size_t i = 0; i < _n; ++i) {
+            _entries[i].addr = &_events[i]->_epoch;
+        }
+    }
+}
+
+ReadinessWaitSet::~ReadinessWaitSet() {
+    const uint32_t waiter = _useWaitv ?
+        ReadinessEvent::kWaitvWaiter : ReadinessEvent::kGlobalWaiter;
+    for (size_t i = 0; i < _n; ++i) {
+        _events[i]->_waiters.fetch_sub(waiter, std::memory_order_release);
+    }
+}
+
+void ReadinessWaitSet::snapshot() noexcept {
+    if (_useWaitv) {
+        for (size_t i = 0; i < _n; ++i) {
+            _entries[i].expected =
+                _events[i]->_epoch.load(std::memory_order_acquire);
+        }
+    } else {
+        _globalEpoch = gGlobalEpoch.load(std::memory_order_acquire);
+    }
+}
+
+FutexResult ReadinessWaitSet::wait(
+        std::chrono::system_clock::time_point const* absSystemTime,
+        std::chrono::steady_clock::time_point const* absSteadyTime,
+        size_t* hint) {
+    if (_useWaitv) {
+        return nativeFutexWaitAny(_entries.data(), _n,
+                absSystemTime, absSteadyTime, hint);
+    }
+    return nativeFutexWait(&gGlobalEpoch, _globalEpoch,
+            absSystemTime, absSteadyTime, ~0u);
+}
+
+};  // namespace detail
+};  // namespace myfolly
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "detail/futex.h"
+
+namespace myfolly {
+namespace detail {
+
+/// Lets a thread wait for any of several queues to become readable (see
+/// queue_select.h).  Every queue has one, and its producers call notify()
+/// after each write.  notify() is a single load unless someone is waiting
+/// on the queue; then it bumps the queue's epoch and wakes the waiters.
+///
+/// Waiters that use futex_waitv sleep on the epochs of all their queues at
+/// once.  Where futex_waitv is missing (or for more than kFutexWaitvMax
+/// queues) they sleep on one process-wide epoch instead, which every
+/// waited-on queue bumps; they may then be woken by queues they don't
+/// watch, and simply check their queues and sleep again.
+///
+/// It also carries the queues' eventfd notification mode, for consumers
+/// that run an event loop.  eventFd() creates the eventfd.  A consumer
+/// that found the queue empty arm()s the event; the first notify() after
+/// that disarms it and writes the eventfd, so producers make one write(2)
+/// per empty -> non-empty transition the consumer waits for, not one per
+/// element.
+class ReadinessEvent {
+public:
+    ReadinessEvent() = default;
+    ~ReadinessEvent();
+
+    ReadinessEvent(const ReadinessEvent&) = delete;
+    ReadinessEvent& operator=(const ReadinessEvent&) = delete;
+
+    /// Called by producers once the element is in place, that is after
+    /// the slot's (seq_cst) completeTurn
+    void notify() noexcept {
+        uint32_t waiters = _waiters.load(std::memory_order_seq_cst);
+        if (waiters != 0) {
+            notifySlow(waiters);
+        }
+    }
+
+    /// Creates the eventfd (non-blocking, close-on-exec) on the first call.
+    /// Not thread-safe against itself: call it while setting up.  Throws
+    /// std::system_error if eventfd(2) fails
+    int eventFd();
+
+    /// Asks for the eventfd to be written by the next notify().  The caller
+    /// must check the queue for elements afterwards (the fence here orders
+    /// that check after the arming) and disarm() if it finds any
+    void arm() noexcept {
+        _waiters.fetch_or(kEventFdArmed, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    void disarm() noexcept {
+        _waiters.fetch_and(~kEventFdArmed, std::memory_order_relaxed);
+    }
+
+    /// Resets the eventfd counter after the event loop saw it readable
+    void clearEventFd() noexcept;
+
+    /// How many times notify() wrote the eventfd
+    uint64_t eventFdSignals() const noexcept {
+        return _eventFdSignals.load(std::memory_order_relaxed);
+    }
+
+private:
+    friend class ReadinessWaitSet;
+
+    /// _waiters counts futex_waitv waiters in bits 0-15 and waiters on the
+    /// process-wide epoch in bits 16-30.  Bit 31 is set while a consumer
+    /// is armed on the eventfd
+    static constexpr uint32_t kWaitvWaiter = 1;
+    static constexpr uint32_t kGlobalWaiter = 1 << 16;
+    static constexpr uint32_t kEventFdArmed = 1u << 31;
+
+    void notifySlow(uint32_t waiters) noexcept;
+
+    std::atomic<uint32_t> _waiters{0};
+    Futex _epoch{0};
+    int _eventFd{-1};
+    std::atomic<uint64_t> _eventFdSignals{0};
+};
+
+/// A waiter's registration with a set of ReadinessEvents.  Use as
+///
+///   ReadinessWaitSet waitSet(events, n);
+///   while (true) {
+///       waitSet.snapshot();
+///       if (any queue is readable) break;
+///       waitSet.wait(...);
+///   }
+///
+/// A notify() that happens after snapshot() makes wait() return at once.
+class ReadinessWaitSet {
+public:
+    ReadinessWaitSet(ReadinessEvent* const* events, size_t n);
+    ~ReadinessWaitSet();
+
+    ReadinessWaitSet(const ReadinessWaitSet&) = delete;
+    ReadinessWaitSet& operator=(const ReadinessWaitSet&) = delete;
+
+    void snapshot() noexcept;
+
+    /// On AWOKEN *hint (if not null) is the index of an event that was
+    /// notified, when futex_waitv can tell; otherwise it is left alone.
+    /// At most one of absSystemTime and absSteadyTime may be non-null
+    FutexResult wait(std::chrono::system_clock::time_point const* absSystemTime,
+            std::chrono::steady_clock::time_point const* absSteadyTime,
+            size_t* hint);
+
+    bool usesWaitv() const noexcept { return _useWaitv; }
+
+private:
+    ReadinessEvent* const* _events;
+    size_t _n;
+    bool _useWaitv;
+    std::vector<FutexWaitvEntry> _entries;
+    uint32_t _globalEpoch;
+};
+
+};  // namespace detail
+};  // namespace myfolly
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <atomic>
+#include <type_traits>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "detail/futex.h"
+
+/// Hot-path counters for MPMCQueue and TurnSequencer.  Off by default:
+/// configure with -DMYFOLLY_QUEUE_STATS=ON (which defines
+/// MYFOLLY_QUEUE_STATS=1 for the library and everything built with it)
+/// to turn them on.  When off the counters compile away and
+/// MPMCQueue::stats() returns zeros.
+#ifndef MYFOLLY_QUEUE_STATS
+#define MYFOLLY_QUEUE_STATS 0
+#endif
+
+namespace myfolly {
+namespace detail {
+
+constexpr bool kQueueStatsEnabled = MYFOLLY_QUEUE_STATS;
+
+enum class QueueStat : uint32_t {
+    PUSH_TICKET_CAS_RETRIES,
+    POP_TICKET_CAS_RETRIES,
+    SPINS,
+    /// one per FutexResult, in the order of its enumerators
+    FUTEX_WAIT_VALUE_CHANGED,
+    FUTEX_WAIT_AWOKEN,
+    FUTEX_WAIT_INTERRUPTED,
+    FUTEX_WAIT_TIMEDOUT,
+    FUTEX_WAKES,
+    FUTEX_WOKEN,
+    EARLY_WAKEUPS,
+    SPURIOUS_WAKEUPS,
+    NUM_STATS
+};
+
+inline QueueStat futexWaitStat(FutexResult result) noexcept {
+    return QueueStat(uint32_t(QueueStat::FUTEX_WAIT_VALUE_CHANGED) +
+            uint32_t(result));
+}
+
+struct TurnSequencerStats {
+    /// pause iterations spent spinning before parking or succeeding
+    uint64_t spins{0};
+    /// futexWait calls, indexed by the FutexResult they returned
+    uint64_t futexWaits[4]{0, 0, 0, 0};
+    /// futexWake calls, and the number of threads they woke
+    uint64_t futexWakes{0};
+    uint64_t futexWoken{0};
+    /// woken because another turn on the same futexChannel (turn & 31)
+    /// completed: an aliased channel, or a waiter more than 32 turns ahead
+    uint64_t earlyWakeups{0};
+    /// woken without any turn having completed
+    uint64_t spuriousWakeups{0};
+};
+
+struct MPMCQueueStats {
+    /// failed ticket CASes in the write / read paths that don't block
+    uint64_t pushTicketCasRetries{0};
+    uint64_t popTicketCasRetries{0};
+    /// summed over all the queue's slots
+    TurnSequencerStats sequencer;
+};
+
+/// The counters of one queue, sharded by thread so that counting doesn't
+/// add contention of its own.  Increments are relaxed; snapshot and reset
+/// are not atomic with respect to concurrent increments.
+class QueueStatsCounters {
+public:
+    QueueStatsCounters() noexcept { reset(); }
+
+    void add(QueueStat stat, uint64_t n = 1) noexcept {
+        auto& counter = _shards[shardIndex()].counts[uint32_t(stat)];
+        counter.store(counter.load(std::memory_order_relaxed) + n,
+                std::memory_order_relaxed);
+    }
+
+    uint64_t get(QueueStat stat) const noexcept {
+        uint64_t sum = 0;
+        for (auto const& shard : _shards) {
+            sum += shard.counts[uint32_t(stat)].load(std::memory_order_relaxed);
+        }
+        return sum;
+    }
+
+    MPMCQueueStats snapshot() const noexcept {
+        MPMCQueueStats s;
+        s.pushTicketCasRetries = get(QueueStat::PUSH_TICKET_CAS_RETRIES);
+        s.popTicketCasRetries = get(QueueStat::POP_TICKET_CAS_RETRIES);
+        s.sequencer.spins = get(QueueStat::SPINS);
+        for (uint32_t r = 0; r < 4; ++r) {
+            s.sequencer.futexWaits[r] = get(futexWaitStat(FutexResult(r)));
+        }
+        s.sequencer.futexWakes = get(QueueStat::FUTEX_WAKES);
+        s.sequencer.futexWoken = get(QueueStat::FUTEX_WOKEN);
+        s.sequencer.earlyWakeups = get(QueueStat::EARLY_WAKEUPS);
+        s.sequencer.spuriousWakeups = get(QueueStat::SPURIOUS_WAKEUPS);
+        return s;
+    }
+
+    void reset() noexcept {
+        for (auto& shard : _shards) {
+            for (auto& counter : shard.counts) {
+                counter.store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    enum { kNumShards = 32 };
+
+    /// Threads are assigned shards round robin the first time they count
+    static size_t shardIndex() noexcept {
+        static std::atomic<size_t> nextShard{0};
+        static thread_local size_t shard =
+            nextShard.fetch_add(1, std::memory_order_relaxed) % kNumShards;
+        return shard;
+    }
+
+    /// Only the owning threads write a shard, so a load and a store are
+    /// enough as long as no two threads share it.  When they do (more than
+    /// kNumShards threads) an increment can occasionally be lost.
+    struct alignas(128) Shard {
+        std::atomic<uint64_t> counts[uint32_t(QueueStat::NUM_STATS)];
+    };
+
+    Shard _shards[kNumShards];
+};
+
+/// Stand-in for QueueStatsCounters when stats are compiled out
+class NoQueueStatsCounters {
+public:
+    void add(QueueStat, uint64_t = 1) noexcept {}
+    uint64_t get(QueueStat) const noexcept { return 0; }
+    MPMCQueueStats snapshot() const noexcept { return MPMCQueueStats(); }
+    void reset() noexcept {}
+};
+
+using QueueCounters = typename std::conditional<kQueueStatsEnabled,
+      QueueStatsCounters, NoQueueStatsCounters>::type;
+
+/// What a queue hands down to TurnSequencer: its counters, or nullptr
+inline QueueStatsCounters* sequencerCounters(QueueStatsCounters& c) noexcept {
+    return &c;
+}
+
+inline QueueStatsCounters* sequencerCounters(NoQueueStatsCounters&) noexcept {
+    return nullptr;
+}
+
+};  // namespace detail
+};  // namespace myfolly
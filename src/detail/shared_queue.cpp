@@ -0,0 +1,256 @@
+#include "detail/shared_queue.h"
+
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace myfolly {
+namespace detail {
+
+constexpr uint64_t SharedQueueHeader::kMagic;
+constexpr uint32_t SharedQueueHeader::kVersion;
+constexpr uint32_t SharedQueueHeader::kMaxPeers;
+constexpr uint32_t SharedQueueHeader::kInitializing;
+constexpr uint32_t SharedQueueHeader::kReady;
+
+namespace {
+
+[[noreturn]] void throwErrno(const std::string& what) {
+    throw std::system_error(errno, std::system_category(), what);
+}
+
+} // namespace
+
+SharedRegion::~SharedRegion() {
+    if (_data != nullptr) {
+        munmap(_data, _size);
+    }
+}
+
+SharedRegion::SharedRegion(SharedRegion&& other) noexcept :
+    _data(other._data),
+    _size(other._size) {
+    other._data = nullptr;
+    other._size = 0;
+}
+
+SharedRegion& SharedRegion::operator=(SharedRegion&& other) noexcept {
+    if (this != &other) {
+        if (_data != nullptr) {
+            munmap(_data, _size);
+        }
+        _data = other._data;
+        _size = other._size;
+        other._data = nullptr;
+        other._size = 0;
+    }
+    return *this;
+}
+
+SharedRegion SharedRegion::mapFd(int fd, size_t size, bool create,
+        const std::string& what) {
+    if (create) {
+        if (ftruncate(fd, off_t(size)) != 0) {
+            int err = errno;
+            close(fd);
+            errno = err;
+            throwErrno("ftruncate " + what);
+        }
+    } else {
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            int err = errno;
+            close(fd);
+            errno = err;
+            throwErrno("fstat " + what);
+        }
+        size = size_t(st.st_size);
+    }
+    void* data = size == 0 ? MAP_FAILED :
+        mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    int err = size == 0 ? EINVAL : errno;
+    // the mapping keeps the object alive
+    close(fd);
+    if (data == MAP_FAILED) {
+        errno = err;
+        throwErrno("mmap " + what);
+    }
+    SharedRegion region;
+    region._data = data;
+    region._size = size;
+    return region;
+}
+
+SharedRegion SharedRegion::createShm(const std::string& name, size_t size) {
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        throwErrno("shm_open " + name);
+    }
+    return mapFd(fd, size, true, name);
+}
+
+SharedRegion SharedRegion::openShm(const std::string& name) {
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0) {
+        throwErrno("shm_open " + name);
+    }
+    return mapFd(fd, 0, false, name);
+}
+
+SharedRegion SharedRegion::createFile(const std::string& path, size_t size) {
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        throwErrno("open " + path);
+    }
+    return mapFd(fd, size, true, path);
+}
+
+SharedRegion SharedRegion::openFile(const std::string& path) {
+    int fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        throwErrno("open " + path);
+    }
+    return mapFd(fd, 0, false, path);
+}
+
+void SharedRegion::unlinkShm(const std::string& name) {
+    if (shm_unlink(name.c_str()) != 0) {
+        throwErrno("shm_unlink " + name);
+    }
+}
+
+void initSharedQueueHeader(SharedQueueHeader* header,
+        const SharedQueueLayout& layout,
+        size_t capacity,
+        size_t numSlots,
+        size_t slotsOffset,
+        size_t regionSize) noexcept {
+    // a fresh region is zero-filled, so state is already kInitializing
+    header->magic = SharedQueueHeader::kMagic;
+    header->version = SharedQueueHeader::kVersion;
+    header->headerSize = sizeof(SharedQueueHeader);
+    header->slotSize = layout.slotSize;
+    header->elementSize = layout.elementSize;
+    header->elementAlign = layout.elementAlign;
+    header->capacity = capacity;
+    header->slotsOffset = slotsOffset;
+    header->numSlots = numSlots;
+    header->regionSize = regionSize;
+    header->broken.store(0, std::memory_order_relaxed);
+    header->pushTicket.store(0, std::memory_order_relaxed);
+    header->popTicket.store(0, std::memory_order_relaxed);
+    header->pushSpinCutoff.store(0, std::memory_order_relaxed);
+    header->popSpinCutoff.store(0, std::memory_order_relaxed);
+    for (auto& peer : header->peers) {
+        peer.pid.store(0, std::memory_order_relaxed);
+        peer.inFlight.store(0, std::memory_order_relaxed);
+    }
+}
+
+void validateSharedQueueHeader(const SharedQueueHeader* header,
+        const SharedQueueLayout& layout,
+        size_t regionSize) {
+    auto check = [](bool ok, const char* what) {
+        if (!ok) {
+            throw std::runtime_error(
+                    std::string("shared queue header mismatch: ") + what);
+        }
+    };
+    check(regionSize >= sizeof(SharedQueueHeader), "region too small");
+    check(header->magic == SharedQueueHeader::kMagic, "magic");
+    check(header->version == SharedQueueHeader::kVersion, "version");
+    check(header->state.load(std::memory_order_acquire) ==
+            SharedQueueHeader::kReady, "not initialized");
+    check(header->headerSize == sizeof(SharedQueueHeader), "header size");
+    check(header->slotSize == layout.slotSize, "slot size");
+    check(header->elementSize == layout.elementSize, "element size");
+    check(header->elementAlign == layout.elementAlign, "element alignment");
+    check(header->regionSize == regionSize, "region size");
+    check(header->capacity > 0 && header->numSlots >= header->capacity &&
+            header->slotsOffset >= sizeof(SharedQueueHeader) &&
+            header->slotsOffset % 128 == 0 &&
+            header->slotsOffset + header->numSlots * header->slotSize <=
+                regionSize,
+            "slot array");
+}
+
+SharedQueuePeer* registerSharedQueuePeer(SharedQueueHeader* header) {
+    const int32_t self = int32_t(getpid());
+    for (auto& peer : header->peers) {
+        int32_t expected = 0;
+        if (peer.pid.compare_exchange_strong(expected, self)) {
+            peer.inFlight.store(0, std::memory_order_relaxed);
+            return &peer;
+        }
+    }
+    // entries of processes that exited without detaching, but only those
+    // that weren't inside an operation
+    for (auto& peer : header->peers) {
+        int32_t pid = peer.pid.load();
+        if (pid != 0 && peer.inFlight.load() == 0 && !processAlive(pid) &&
+                peer.pid.compare_exchange_strong(pid, self)) {
+            return &peer;
+        }
+    }
+    throw std::runtime_error("shared queue has no free peer entry");
+}
+
+void unregisterSharedQueuePeer(SharedQueuePeer* peer) noexcept {
+    peer->inFlight.store(0, std::memory_order_relaxed);
+    peer->pid.store(0, std::memory_order_release);
+}
+
+bool checkSharedQueuePeers(SharedQueueHeader* header) noexcept {
+    if (header->broken.load(std::memory_order_acquire) != 0) {
+        return true;
+    }
+    const int32_t self = int32_t(getpid());
+    for (auto& peer : header->peers) {
+        int32_t pid = peer.pid.load();
+        if (pid != 0 && pid != self && peer.inFlight.load() != 0 &&
+                !processAlive(pid)) {
+            header->broken.store(1, std::memory_order_release);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool processAlive(int32_t pid) noexcept {
+    if (kill(pid, 0) != 0 && errno != EPERM) {
+        return false;
+    }
+    // kill succeeds on zombies, which are dead as far as we care
+    char path[32];
+    snprintf(path, sizeof(path), "/proc/%d/stat", int(pid));
+    FILE* f = fopen(path, "re");
+    if (f == nullptr) {
+        return true;
+    }
+    // "pid (comm) state ...", comm may contain spaces and parentheses
+    char buf[512];
+    size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[n] = '\0';
+    const char* paren = nullptr;
+    for (const char* p = buf; *p != '\0'; ++p) {
+        if (*p == ')') {
+            paren = p;
+        }
+    }
+    if (paren == nullptr || paren[1] != ' ') {
+        return true;
+    }
+    return paren[2] != 'Z' && paren[2] != 'X';
+}
+
+};  // namespace detail
+};  // namespace myfolly
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace myfolly {
+namespace detail {
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LLONG_LOCK_FREE == 2,
+        "shared queues need address-free (lock-free) atomics");
+
+/// A MAP_SHARED mapping of a POSIX shared memory object (shm_open) or of a
+/// file.  create* makes a new object of the given size and fails if the
+/// name is taken; open* maps an existing one whole.  Errors are thrown as
+/// std::system_error.  The mapping goes away with the object, the shared
+/// memory object or file does not (see unlinkShm).
+class SharedRegion {
+public:
+    SharedRegion() = default;
+    ~SharedRegion();
+
+    SharedRegion(SharedRegion&& other) noexcept;
+    SharedRegion& operator=(SharedRegion&& other) noexcept;
+
+    SharedRegion(const SharedRegion&) = delete;
+    SharedRegion& operator=(const SharedRegion&) = delete;
+
+    static SharedRegion createShm(const std::string& name, size_t size);
+    static SharedRegion openShm(const std::string& name);
+    static SharedRegion createFile(const std::string& path, size_t size);
+    static SharedRegion openFile(const std::string& path);
+
+    /// Removes the name of a shared memory object; mappings stay valid
+    static void unlinkShm(const std::string& name);
+
+    void* data() const noexcept { return _data; }
+    size_t size() const noexcept { return _size; }
+
+private:
+    static SharedRegion mapFd(int fd, size_t size, bool create,
+            const std::string& what);
+
+    void* _data{nullptr};
+    size_t _size{0};
+};
+
+/// One process (more precisely one queue handle) attached to a shared
+/// queue.  inFlight is non-zero while the handle is inside a queue
+/// operation, so that a peer that died with inFlight != 0 may have left a
+/// ticket behind that nobody will ever complete
+struct alignas(64) SharedQueuePeer {
+    std::atomic<int32_t> pid;
+    std::atomic<uint32_t> inFlight;
+};
+
+/// The start of a shared queue's region.  It holds no pointers, only sizes
+/// and the offset of the slot array from the start of the region, so every
+/// process may map the region at a different address.  The layout fields
+/// are checked by each process that opens the region (see
+/// validateSharedQueueHeader); bump kVersion whenever this struct or the
+/// slot layout changes
+struct SharedQueueHeader {
+    static constexpr uint64_t kMagic = 0x5155455551504d53; // "SMPQUEUQ"
+    static constexpr uint32_t kVersion = 1;
+    static constexpr uint32_t kMaxPeers = 64;
+
+    /// state values; the creator publishes kReady last
+    static constexpr uint32_t kInitializing = 0;
+    static constexpr uint32_t kReady = 1;
+
+    uint64_t magic;
+    uint32_t version;
+    std::atomic<uint32_t> state;
+    uint64_t headerSize;
+    uint64_t slotSize;
+    uint64_t elementSize;
+    uint64_t elementAlign;
+    uint64_t capacity;
+    uint64_t slotsOffset;
+    uint64_t numSlots;
+    uint64_t regionSize;
+
+    /// Set once a peer was found dead inside an operation; from then on
+    /// every operation fails
+    alignas(128) std::atomic<uint32_t> broken;
+
+    alignas(128) std::atomic<uint64_t> pushTicket;
+    alignas(128) std::atomic<uint64_t> popTicket;
+    alignas(128) std::atomic<uint32_t> pushSpinCutoff;
+    alignas(128) std::atomic<uint32_t> popSpinCutoff;
+
+    alignas(128) SharedQueuePeer peers[kMaxPeers];
+};
+
+/// What a queue of a given element and slot type expects to find in the
+/// header; filled in by the creator and compared by everyone else
+struct SharedQueueLayout {
+    uint64_t slotSize;
+    uint64_t elementSize;
+    uint64_t elementAlign;
+};
+
+/// Writes a header for capacity elements and numSlots slots at the start
+/// of region, leaving state at kInitializing
+void initSharedQueueHeader(SharedQueueHeader* header,
+        const SharedQueueLayout& layout,
+        size_t capacity,
+        size_t numSlots,
+        size_t slotsOffset,
+        size_t regionSize) noexcept;
+
+/// Throws std::runtime_error naming the first field that doesn't match:
+/// a region that isn't a shared queue, that is still being created, that
+/// was made by a different version, or for a different element type
+void validateSharedQueueHeader(const SharedQueueHeader* header,
+        const SharedQueueLayout& layout,
+        size_t regionSize);
+
+/// Claims a peer entry for the calling process: a free one, or one left by
+/// a process that exited between operations.  Throws std::runtime_error if
+/// all kMaxPeers entries are in use
+SharedQueuePeer* registerSharedQueuePeer(SharedQueueHeader* header);
+
+void unregisterSharedQueuePeer(SharedQueuePeer* peer) noexcept;
+
+/// Called by operations that have waited a while without progress.  Marks
+/// the queue broken if a peer died inside an operation, and returns
+/// whether the queue is broken
+bool checkSharedQueuePeers(SharedQueueHeader* header) noexcept;
+
+/// Whether pid names a live process; zombies count as dead
+bool processAlive(int32_t pid) noexcept;
+
+};  // namespace detail
+};  // namespace myfolly
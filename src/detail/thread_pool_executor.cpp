@@ -0,0 +1,80 @@
+#include "thread_pool_executor.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "portability.h"
+
+namespace myfolly {
+
+constexpr size_t ThreadPoolExecutor::kDefaultQueueCapacity;
+
+ThreadPoolExecutor::ThreadPoolExecutor(size_t numThreads,
+        size_t queueCapacity) {
+    if (numThreads == 0) {
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    _tasks = detail::alignedNew<TaskQueue>(queueCapacity);
+    try {
+        _threads.reserve(numThreads);
+        for (size_t i = 0; i < numThreads; ++i) {
+            _threads.emplace_back([this]() { run(); });
+        }
+    } catch (...) {
+        // stops and joins the workers that did start
+        join();
+        detail::alignedDelete(_tasks);
+        throw;
+    }
+}
+
+ThreadPoolExecutor::~ThreadPoolExecutor() {
+    join();
+    detail::alignedDelete(_tasks);
+}
+
+void ThreadPoolExecutor::add(Task task) {
+    if (!task) {
+        throw std::invalid_argument("empty task");
+    }
+    if (_joined.load(std::memory_order_relaxed)) {
+        throw std::logic_error("ThreadPoolExecutor::add after join");
+    }
+    _tasks->blockingWrite(std::move(task));
+    _sem.post();
+}
+
+void ThreadPoolExecutor::join() {
+    if (_joined.exchange(true)) {
+        return;
+    }
+    // an empty task stops the worker that reads it, after everything
+    // that was queued before
+    for (size_t i = 0; i < _threads.size(); ++i) {
+        _tasks->blockingWrite(Task());
+        _sem.post();
+    }
+    for (auto& t : _threads) {
+        t.join();
+    }
+}
+
+void ThreadPoolExecutor::run() noexcept {
+    Task task;
+    while (true) {
+        _sem.wait();
+        // the token was posted after the write completed, but a writer
+        // with an earlier ticket may still be busy with its slot
+        _tasks->blockingRead(task);
+        if (!task) {
+            return;
+        }
+        try {
+            task();
+        } catch (...) {
+        }
+        task.reset();
+    }
+}
+
+};  // namespace myfolly
@@ -3,23 +3,46 @@
 namespace myfolly {
 namespace detail {
 
-void TurnSequencer::waitForTurn(const uint32_t turn,
+template <bool ProcessShared>
+void BasicTurnSequencer<ProcessShared>::waitForTurn(const uint32_t turn,
         std::atomic<uint32_t>& spinCutoff,
-        const bool updateSpinCutoff) {
-    auto ret = tryWaitForTurn(turn, spinCutoff, updateSpinCutoff);
+        const bool updateSpinCutoff,
+        QueueStatsCounters* stats) {
+    auto ret = tryWaitForTurn(turn, spinCutoff, updateSpinCutoff, stats);
+    (void)ret;
+    assert(ret == TryWaitResult::SUCCESS);
 }
 
-TryWaitResult TurnSequencer::tryWaitForTurn(const uint32_t turn,
+template <bool ProcessShared>
+TryWaitResult BasicTurnSequencer<ProcessShared>::tryWaitForTurnImpl(const uint32_t turn,
         std::atomic<uint32_t>& spinCutoff,
-        const bool updateSpinCutoff) {
+        const bool updateSpinCutoff,
+        std::chrono::system_clock::time_point const* absSystemTime,
+        std::chrono::steady_clock::time_point const* absSteadyTime,
+        QueueStatsCounters* stats) {
+    if (!kQueueStatsEnabled) {
+        stats = nullptr;
+    }
+    // stats only: pause iterations, and the turn we saw before the last
+    // futexWait that returned AWOKEN (or ~0u if it didn't)
+    uint32_t spins = 0;
+    uint32_t wokenAtSturn = ~0u;
+
     uint32_t prevThresh = spinCutoff.load(std::memory_order_relaxed);
     const uint32_t effectiveSpinCutoff =
         updateSpinCutoff || prevThresh == 0 ? kMaxSpinLimit : prevThresh;
 
+    uint64_t begin = 0;
+    uint32_t tries;
     const uint32_t sturn = turn << kTurnShift;  //turn左移6位，以便与_state的前26bit比较
-    for(uint32_t tries = 0;; ++tries) {
+    for(tries = 0;; ++tries) {
         uint32_t state = _state.load(std::memory_order_acquire);
         uint32_t current_sturn = decodeCurrentSturn(state); //将state后6bit设置为0
+        if (stats != nullptr && wokenAtSturn != ~0u && current_sturn != sturn) {
+            stats->add(current_sturn == wokenAtSturn ?
+                    QueueStat::SPURIOUS_WAKEUPS : QueueStat::EARLY_WAKEUPS);
+        }
+        wokenAtSturn = ~0u;
         if (current_sturn == sturn) {
             // 当前turn就是当前运行的轮次，直接返回，不需要等待。
             break;
@@ -28,10 +51,31 @@ TryWaitResult TurnSequencer::tryWaitForTurn(const uint32_t turn,
         // turn 比 current_sturn小，直接跳过
         if (sturn - current_sturn >= std::numeric_limits<uint32_t>::max() / 2) {
             // turn is in the past
+            if (stats != nullptr) {
+                stats->add(QueueStat::SPINS, spins);
+            }
             return TryWaitResult::PAST;
         }
 
-        //--TODO
+        // 前effectiveSpinCutoff次尝试只自旋, 之后才把自己记录为waiter并
+        // 调用futexWait阻塞. x86上用TSC按cycle计时, 其他平台按循环次数计.
+        if (kSpinUsingHardwareClock) {
+            auto now = hardware_timestamp();
+            if (tries == 0) {
+                begin = now;
+            }
+            if (tries == 0 || now < begin + effectiveSpinCutoff) {
+                asm_volatile_pause();
+                ++spins;
+                continue;
+            }
+        } else {
+            if (tries < effectiveSpinCutoff) {
+                asm_volatile_pause();
+                ++spins;
+                continue;
+            }
+        }
 
         // 当前最大的等待数量
         uint32_t current_max_waiter_delta = decodeMaxWaitersDelta(state);
@@ -54,15 +98,78 @@ TryWaitResult TurnSequencer::tryWaitForTurn(const uint32_t turn,
             // 进入到该行说明_state更新成了new_state
         }
         // 等待new_state轮次的唤醒. 
-        detail::futexWait(&_state, new_state, futexChannel(turn));
+        FutexResult futexResult;
+        if (absSystemTime != nullptr || absSteadyTime != nullptr) {
+            futexResult = detail::nativeFutexWait(&_state, new_state,
+                    absSystemTime, absSteadyTime, futexChannel(turn),
+                    ProcessShared);
+        } else {
+            futexResult = detail::futexWait(&_state, new_state,
+                    futexChannel(turn), ProcessShared);
+        }
+        if (stats != nullptr) {
+            stats->add(futexWaitStat(futexResult));
+            if (futexResult == FutexResult::AWOKEN) {
+                wokenAtSturn = current_sturn;
+            }
+        }
+        if (futexResult == FutexResult::TIMEDOUT) {
+            if (stats != nullptr) {
+                stats->add(QueueStat::SPINS, spins);
+            }
+            return TryWaitResult::TIMEDOUT;
+        }
+    }
+
+    if (stats != nullptr) {
+        stats->add(QueueStat::SPINS, spins);
+    }
+    if (updateSpinCutoff || prevThresh == 0) {
+        updateSpinCutoffAfterWait(spinCutoff, prevThresh, tries, begin);
     }
 
     return TryWaitResult::SUCCESS;
 }
 
+template <bool ProcessShared>
+void BasicTurnSequencer<ProcessShared>::updateSpinCutoffAfterWait(std::atomic<uint32_t>& spinCutoff,
+        uint32_t prevThresh,
+        const uint32_t tries,
+        const uint64_t begin) noexcept {
+    // 实际等待的时长, 单位与spinCutoff相同 (cycle或者循环次数)
+    const uint64_t elapsed = !kSpinUsingHardwareClock || tries == 0
+        ? tries
+        : hardware_timestamp() - begin;
+
+    // if we hit kMaxSpinLimit then spinning was pointless, so the right
+    // spinCutoff is kMinSpinLimit
+    uint32_t target;
+    if (elapsed >= kMaxSpinLimit) {
+        target = kMinSpinLimit;
+    } else {
+        // to account for variations, we allow ourself to spin 2*N when
+        // we think that N is actually required in order to succeed
+        target = std::min(uint32_t{kMaxSpinLimit},
+                std::max(uint32_t{kMinSpinLimit}, static_cast<uint32_t>(elapsed * 2)));
+    }
+
+    if (prevThresh == 0) {
+        // bootstrap
+        spinCutoff.store(target);
+    } else {
+        // try once, keep moving if CAS fails.  Exponential moving average
+        // with alpha of 7/8
+        // Be careful that the quantity we add to prevThresh is signed.
+        spinCutoff.compare_exchange_weak(
+                prevThresh, prevThresh + int(target - prevThresh) / 8);
+    }
+}
+
 // 临界区在waitForTurn(turn)与completeTurn(turn)之间.
 // completeTurn(turn)将unblock一个阻塞在waitForTurncompleteTurn(turn + 1)的线程.
-void TurnSequencer::completeTurn(const uint32_t turn) noexcept {
+template <bool ProcessShared>
+void BasicTurnSequencer<ProcessShared>::completeTurn(const uint32_t turn,
+        QueueStatsCounters* stats) noexcept {
     uint32_t state = _state.load(std::memory_order_acquire);
     while(true) {
         uint32_t max_waiter_delta = decodeMaxWaitersDelta(state);
@@ -72,8 +179,13 @@ void TurnSequencer::completeTurn(const uint32_t turn) noexcept {
         if (_state.compare_exchange_strong(state, new_state)) {
             // _state 更新为 new_state
             if (max_waiter_delta != 0) {
-                detail::futexWake(
-                        &_state, std::numeric_limits<int>::max(), futexChannel(turn + 1));
+                int woken = detail::futexWake(
+                        &_state, std::numeric_limits<int>::max(), futexChannel(turn + 1),
+                        ProcessShared);
+                if (kQueueStatsEnabled && stats != nullptr) {
+                    stats->add(QueueStat::FUTEX_WAKES);
+                    stats->add(QueueStat::FUTEX_WOKEN, woken > 0 ? woken : 0);
+                }
             }
             break;
         }
@@ -81,5 +193,8 @@ void TurnSequencer::completeTurn(const uint32_t turn) noexcept {
     }
 }
 
+template class BasicTurnSequencer<false>;
+template class BasicTurnSequencer<true>;
+
 };  // namespace detail
 };  // namespace myfolly
@@ -5,6 +5,7 @@
 #include <iostream>
 #include <limits>
 #include "detail/futex.h"
+#include "detail/queue_stats.h"
 #include "portability.h"
 
 namespace myfolly {
@@ -12,8 +13,15 @@ namespace detail {
 
 enum class TryWaitResult { SUCCESS, PAST, TIMEDOUT };
 
-class TurnSequencer {
+/// ProcessShared sequencers may live in memory shared between processes:
+/// they wait and wake with process-shared futexes.  Use the TurnSequencer
+/// and SharedTurnSequencer aliases below
+template <bool ProcessShared>
+class BasicTurnSequencer {
 private:
+    /// shares the spin constants and updateSpinCutoffAfterWait
+    friend class WideTurnSequencer;
+
     static constexpr bool kSpinUsingHardwareClock = kIsArchAmd64;
     static constexpr uint32_t kCyclesPerSpinLimit =
       kSpinUsingHardwareClock ? 1 : 10;
@@ -41,24 +49,62 @@ private:
     static constexpr uint32_t kMaxSpinLimit = 20000 / kCyclesPerSpinLimit;
 
 public:
-    explicit TurnSequencer(const uint32_t firstTurn = 0) :
+    explicit BasicTurnSequencer(const uint32_t firstTurn = 0) :
         _state(encode(firstTurn << kTurnShift, 0)) {}
-    ~TurnSequencer() {}
+    ~BasicTurnSequencer() {}
 
     bool isTurn(const uint32_t turn) const noexcept {
         auto state = _state.load(std::memory_order_acquire);
         return decodeCurrentSturn(state) == (turn << kTurnShift);
     }
 
+    /// Returns the least-most significant byte of the current uncompleted
+    /// turn.  The full 32 bit turn cannot be recovered.
+    uint8_t uncompletedTurnLSB() const noexcept {
+        return uint8_t(_state.load(std::memory_order_acquire) >> kTurnShift);
+    }
+
+    /// stats, if not null, receives this call's spins, futex waits and
+    /// wakeups (see queue_stats.h)
     void waitForTurn(const uint32_t turn,
             std::atomic<uint32_t>& spinCutoff,
-            const bool updateSpinCutoff);
+            const bool updateSpinCutoff,
+            QueueStatsCounters* stats = nullptr);
 
-    void completeTurn(const uint32_t turn) noexcept;
+    void completeTurn(const uint32_t turn,
+            QueueStatsCounters* stats = nullptr) noexcept;
+
+    TryWaitResult tryWaitForTurn(const uint32_t turn,
+            std::atomic<uint32_t>& spinCutoff,
+            const bool updateSpinCutoff,
+            QueueStatsCounters* stats = nullptr) {
+        return tryWaitForTurnImpl(turn, spinCutoff, updateSpinCutoff,
+                nullptr, nullptr, stats);
+    }
 
+    /// Like tryWaitForTurn, but gives up and returns TIMEDOUT once absTime
+    /// has passed.  Clocks with is_steady are waited on as steady_clock,
+    /// everything else as system_clock.  A null absTime or
+    /// time_point::max() waits forever.
+    template <class Clock, class Duration>
     TryWaitResult tryWaitForTurn(const uint32_t turn,
             std::atomic<uint32_t>& spinCutoff,
-            const bool updateSpinCutoff);
+            const bool updateSpinCutoff,
+            const std::chrono::time_point<Clock, Duration>* absTime,
+            QueueStatsCounters* stats = nullptr) {
+        using Target = typename std::conditional<
+            Clock::is_steady,
+            std::chrono::steady_clock,
+            std::chrono::system_clock>::type;
+        if (absTime == nullptr ||
+                *absTime == std::chrono::time_point<Clock, Duration>::max()) {
+            return tryWaitForTurnImpl(turn, spinCutoff, updateSpinCutoff,
+                    nullptr, nullptr, stats);
+        }
+        auto const converted = time_point_conv<Target>(*absTime);
+        return tryWaitForTurnDeadline(turn, spinCutoff, updateSpinCutoff,
+                converted, stats);
+    }
 
 private:
     uint32_t encode(uint32_t currentSturn, uint32_t maxWaiterD) const noexcept {
@@ -82,6 +128,40 @@ private:
         return 1u << (turn & 31);
     }
 
+    TryWaitResult tryWaitForTurnDeadline(const uint32_t turn,
+            std::atomic<uint32_t>& spinCutoff,
+            const bool updateSpinCutoff,
+            std::chrono::system_clock::time_point const& absTime,
+            QueueStatsCounters* stats) {
+        return tryWaitForTurnImpl(turn, spinCutoff, updateSpinCutoff,
+                &absTime, nullptr, stats);
+    }
+
+    TryWaitResult tryWaitForTurnDeadline(const uint32_t turn,
+            std::atomic<uint32_t>& spinCutoff,
+            const bool updateSpinCutoff,
+            std::chrono::steady_clock::time_point const& absTime,
+            QueueStatsCounters* stats) {
+        return tryWaitForTurnImpl(turn, spinCutoff, updateSpinCutoff,
+                nullptr, &absTime, stats);
+    }
+
+    /// At most one of absSystemTime and absSteadyTime may be non-null,
+    /// mirroring nativeFutexWait
+    TryWaitResult tryWaitForTurnImpl(const uint32_t turn,
+            std::atomic<uint32_t>& spinCutoff,
+            const bool updateSpinCutoff,
+            std::chrono::system_clock::time_point const* absSystemTime,
+            std::chrono::steady_clock::time_point const* absSteadyTime,
+            QueueStatsCounters* stats);
+
+    /// Folds the duration of a completed wait into spinCutoff.  tries is
+    /// the number of loop iterations and begin is the hardware timestamp
+    /// at which the spin started (only meaningful if kSpinUsingHardwareClock)
+    static void updateSpinCutoffAfterWait(std::atomic<uint32_t>& spinCutoff,
+            uint32_t prevThresh,
+            const uint32_t tries,
+            const uint64_t begin) noexcept;
 
 
 private:
@@ -90,5 +170,14 @@ private:
     Futex _state;
 };
 
+using TurnSequencer = BasicTurnSequencer<false>;
+
+/// TurnSequencer for memory shared between processes (SharedMPMCQueue).
+/// Same layout; its futex operations cost a little more in the kernel
+using SharedTurnSequencer = BasicTurnSequencer<true>;
+
+extern template class BasicTurnSequencer<false>;
+extern template class BasicTurnSequencer<true>;
+
 };  // namespace detail
 };  // namespace myfolly
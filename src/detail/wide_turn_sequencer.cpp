@@ -0,0 +1,176 @@
+#include "detail/wide_turn_sequencer.h"
+
+#include <thread>
+
+namespace myfolly {
+namespace detail {
+
+namespace {
+
+bool deadlinePassed(std::chrono::system_clock::time_point const* absSystemTime,
+        std::chrono::steady_clock::time_point const* absSteadyTime) {
+    return (absSystemTime != nullptr &&
+            std::chrono::system_clock::now() >= *absSystemTime) ||
+        (absSteadyTime != nullptr &&
+         std::chrono::steady_clock::now() >= *absSteadyTime);
+}
+
+} // namespace
+
+void WideTurnSequencer::waitForTurn(const uint64_t turn,
+        std::atomic<uint32_t>& spinCutoff,
+        const bool updateSpinCutoff,
+        QueueStatsCounters* stats) {
+    auto ret = tryWaitForTurn(turn, spinCutoff, updateSpinCutoff, stats);
+    (void)ret;
+    assert(ret == TryWaitResult::SUCCESS);
+}
+
+TryWaitResult WideTurnSequencer::tryWaitForTurnImpl(const uint64_t turn,
+        std::atomic<uint32_t>& spinCutoff,
+        const bool updateSpinCutoff,
+        std::chrono::system_clock::time_point const* absSystemTime,
+        std::chrono::steady_clock::time_point const* absSteadyTime,
+        QueueStatsCounters* stats) {
+    if (!kQueueStatsEnabled) {
+        stats = nullptr;
+    }
+    // stats only, as in TurnSequencer
+    uint32_t spins = 0;
+    uint64_t wokenAtTurn = ~uint64_t(0);
+
+    uint32_t prevThresh = spinCutoff.load(std::memory_order_relaxed);
+    const uint32_t effectiveSpinCutoff =
+        updateSpinCutoff || prevThresh == 0 ?
+        TurnSequencer::kMaxSpinLimit : prevThresh;
+
+    const uint32_t channel = channelOf(turn);
+    Futex& epoch = epochOf(channel);
+    auto& waiters = _waiters[channel];
+
+    uint64_t begin = 0;
+    uint32_t tries;
+    for (tries = 0;; ++tries) {
+        uint64_t current = _turn.load(std::memory_order_acquire);
+        if (stats != nullptr && wokenAtTurn != ~uint64_t(0) &&
+                current != turn) {
+            stats->add(current == wokenAtTurn ?
+                    QueueStat::SPURIOUS_WAKEUPS : QueueStat::EARLY_WAKEUPS);
+        }
+        wokenAtTurn = ~uint64_t(0);
+        if (current == turn) {
+            break;
+        }
+        if (current > turn) {
+            if (stats != nullptr) {
+                stats->add(QueueStat::SPINS, spins);
+            }
+            return TryWaitResult::PAST;
+        }
+
+        if (TurnSequencer::kSpinUsingHardwareClock) {
+            auto now = hardware_timestamp();
+            if (tries == 0) {
+                begin = now;
+            }
+            if (tries == 0 || now < begin + effectiveSpinCutoff) {
+                asm_volatile_pause();
+                ++spins;
+                continue;
+            }
+        } else {
+            if (tries < effectiveSpinCutoff) {
+                asm_volatile_pause();
+                ++spins;
+                continue;
+            }
+        }
+
+        // Register, read the epoch, and only then check the turn again.
+        // completeTurn stores the turn before it looks at the count, so
+        // either we see the new turn here or it sees us and bumps the
+        // epoch, which makes the futexWait below return at once.
+        uint8_t count = waiters.load(std::memory_order_relaxed);
+        if (count == kMaxChannelWaiters) {
+            // we can't park, so the deadline is ours to check
+            if (deadlinePassed(absSystemTime, absSteadyTime)) {
+                if (stats != nullptr) {
+                    stats->add(QueueStat::SPINS, spins);
+                }
+                return TryWaitResult::TIMEDOUT;
+            }
+            std::this_thread::yield();
+            continue;
+        }
+        if (!waiters.compare_exchange_weak(count, count + 1)) {
+            continue;
+        }
+        uint32_t expected = epoch.load();
+        if (_turn.load() != current) {
+            waiters.fetch_sub(1, std::memory_order_release);
+            continue;
+        }
+        FutexResult futexResult;
+        if (absSystemTime != nullptr || absSteadyTime != nullptr) {
+            futexResult = detail::nativeFutexWait(&epoch, expected,
+                    absSystemTime, absSteadyTime, channelMask(channel));
+        } else {
+            futexResult = detail::futexWait(&epoch, expected,
+                    channelMask(channel));
+        }
+        waiters.fetch_sub(1, std::memory_order_release);
+        if (stats != nullptr) {
+            stats->add(futexWaitStat(futexResult));
+            if (futexResult == FutexResult::AWOKEN) {
+                wokenAtTurn = current;
+            }
+        }
+        if (futexResult == FutexResult::TIMEDOUT) {
+            if (stats != nullptr) {
+                stats->add(QueueStat::SPINS, spins);
+            }
+            return TryWaitResult::TIMEDOUT;
+        }
+    }
+
+    if (stats != nullptr) {
+        stats->add(QueueStat::SPINS, spins);
+    }
+    if (updateSpinCutoff || prevThresh == 0) {
+        TurnSequencer::updateSpinCutoffAfterWait(spinCutoff, prevThresh,
+                tries, begin);
+    }
+    return TryWaitResult::SUCCESS;
+}
+
+void WideTurnSequencer::completeTurn(const uint64_t turn,
+        QueueStatsCounters* stats) noexcept {
+    assert(_turn.load(std::memory_order_relaxed) == turn);
+    _turn.store(turn + 1);
+
+    const uint32_t channel = channelOf(turn + 1);
+    auto& waiters = _waiters[channel];
+    if (waiters.load() == 0) {
+        // anyone who registers from now on sees the new turn
+        return;
+    }
+    Futex& epoch = epochOf(channel);
+    epoch.fetch_add(1);
+
+    // Counted after the bump, so every thread we didn't count reads the
+    // new epoch and queues in the kernel, if at all, behind the ones we
+    // did.  With a single count waking one thread therefore reaches it,
+    // whichever turn it waits for.  With several we can't tell which of
+    // them wants turn + 1 and wake the whole channel.
+    uint32_t n = waiters.load();
+    int woken = detail::futexWake(&epoch,
+            n <= 1 ? 1 : std::numeric_limits<int>::max(),
+            channelMask(channel));
+    if (kQueueStatsEnabled && stats != nullptr) {
+        stats->add(QueueStat::FUTEX_WAKES);
+        stats->add(QueueStat::FUTEX_WOKEN, woken > 0 ? woken : 0);
+    }
+}
+
+};  // namespace detail
+};  // namespace myfolly
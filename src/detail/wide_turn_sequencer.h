@@ -0,0 +1,143 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include "detail/futex.h"
+#include "detail/queue_stats.h"
+#include "detail/turn_sequencer.h"
+
+namespace myfolly {
+namespace detail {
+
+/// A TurnSequencer that keeps its turn in a 64-bit word of its own and
+/// counts parked waiters per channel, instead of packing a 26-bit turn and
+/// a max-waiter delta into one 32-bit futex.
+///
+/// TurnSequencer has 32 futexChannels and wakes every thread on the
+/// channel of turn + 1.  With many more blocked threads than that (say 100
+/// consumers on a small MPMCQueue) several of them share each channel,
+/// and every completeTurn wakes them all only for most to park again.
+/// WideTurnSequencer has kChannels channels, spread over kChannels / 32
+/// futex words, and a waiter count for each.  completeTurn skips the
+/// syscall when nobody is parked on the channel of turn + 1, wakes a single
+/// thread when exactly one is, and only falls back to waking the whole
+/// channel when several are (waiters kChannels turns apart, or more than
+/// one thread waiting for the same turn with tryWaitForTurn).
+///
+/// The futex words are wake epochs: completeTurn bumps the word of the
+/// channel it is about to wake, so a waiter that registered just before
+/// can't miss the wake.  Waking a single thread relies on the kernel
+/// queueing futex waiters of equal priority in FIFO order (see the comment
+/// in completeTurn).
+///
+/// Costs 152 bytes instead of 4, so it is meant for queues that expect far
+/// more blocked threads than slots, not as a general replacement.  The
+/// counts are a byte each; a thread that finds its channel's count at
+/// kMaxChannelWaiters yields instead of parking.  In an MPMCQueue
+/// producers only wait for even turns and consumers for odd ones, so each
+/// side gets kChannels / 2 exact channels per slot.
+class WideTurnSequencer {
+public:
+    static constexpr uint32_t kChannels = 128;
+    static constexpr uint32_t kMaxChannelWaiters = 255;
+
+    explicit WideTurnSequencer(const uint64_t firstTurn = 0) :
+        _turn(firstTurn), _epochs{}, _waiters{} {}
+
+    bool isTurn(const uint64_t turn) const noexcept {
+        return _turn.load(std::memory_order_acquire) == turn;
+    }
+
+    uint8_t uncompletedTurnLSB() const noexcept {
+        return uint8_t(_turn.load(std::memory_order_acquire));
+    }
+
+    void waitForTurn(const uint64_t turn,
+            std::atomic<uint32_t>& spinCutoff,
+            const bool updateSpinCutoff,
+            QueueStatsCounters* stats = nullptr);
+
+    void completeTurn(const uint64_t turn,
+            QueueStatsCounters* stats = nullptr) noexcept;
+
+    TryWaitResult tryWaitForTurn(const uint64_t turn,
+            std::atomic<uint32_t>& spinCutoff,
+            const bool updateSpinCutoff,
+            QueueStatsCounters* stats = nullptr) {
+        return tryWaitForTurnImpl(turn, spinCutoff, updateSpinCutoff,
+                nullptr, nullptr, stats);
+    }
+
+    /// See TurnSequencer::tryWaitForTurn
+    template <class Clock, class Duration>
+    TryWaitResult tryWaitForTurn(const uint64_t turn,
+            std::atomic<uint32_t>& spinCutoff,
+            const bool updateSpinCutoff,
+            const std::chrono::time_point<Clock, Duration>* absTime,
+            QueueStatsCounters* stats = nullptr) {
+        using Target = typename std::conditional<
+            Clock::is_steady,
+            std::chrono::steady_clock,
+            std::chrono::system_clock>::type;
+        if (absTime == nullptr ||
+                *absTime == std::chrono::time_point<Clock, Duration>::max()) {
+            return tryWaitForTurnImpl(turn, spinCutoff, updateSpinCutoff,
+                    nullptr, nullptr, stats);
+        }
+        auto const converted = time_point_conv<Target>(*absTime);
+        return tryWaitForTurnDeadline(turn, spinCutoff, updateSpinCutoff,
+                converted, stats);
+    }
+
+private:
+    static uint32_t channelOf(uint64_t turn) noexcept {
+        return uint32_t(turn % kChannels);
+    }
+
+    Futex& epochOf(uint32_t channel) noexcept {
+        return _epochs[channel / 32];
+    }
+
+    /// The FUTEX_WAIT_BITSET / FUTEX_WAKE_BITSET mask within epochOf
+    static uint32_t channelMask(uint32_t channel) noexcept {
+        return 1u << (channel % 32);
+    }
+
+    TryWaitResult tryWaitForTurnDeadline(const uint64_t turn,
+            std::atomic<uint32_t>& spinCutoff,
+            const bool updateSpinCutoff,
+            std::chrono::system_clock::time_point const& absTime,
+            QueueStatsCounters* stats) {
+        return tryWaitForTurnImpl(turn, spinCutoff, updateSpinCutoff,
+                &absTime, nullptr, stats);
+    }
+
+    TryWaitResult tryWaitForTurnDeadline(const uint64_t turn,
+            std::atomic<uint32_t>& spinCutoff,
+            const bool updateSpinCutoff,
+            std::chrono::steady_clock::time_point const& absTime,
+            QueueStatsCounters* stats) {
+        return tryWaitForTurnImpl(turn, spinCutoff, updateSpinCutoff,
+                nullptr, &absTime, stats);
+    }
+
+    TryWaitResult tryWaitForTurnImpl(const uint64_t turn,
+            std::atomic<uint32_t>& spinCutoff,
+            const bool updateSpinCutoff,
+            std::chrono::system_clock::time_point const* absSystemTime,
+            std::chrono::steady_clock::time_point const* absSteadyTime,
+            QueueStatsCounters* stats);
+
+private:
+    /// The current (uncompleted) turn.  64 bits, so it never wraps
+    std::atomic<uint64_t> _turn;
+
+    /// Wake epochs, one futex word per 32 channels
+    Futex _epochs[kChannels / 32];
+
+    /// Threads parked (or about to park) on each channel
+    std::atomic<uint8_t> _waiters[kChannels];
+};
+
+};  // namespace detail
+};  // namespace myfolly
@@ -0,0 +1,228 @@
+#include "work_stealing_scheduler.h"
+
+#include <climits>
+
+#include "portability.h"
+
+namespace myfolly {
+
+struct WorkStealingScheduler::Worker {
+    explicit Worker(WorkStealingScheduler* s, uint64_t seed) noexcept :
+        scheduler(s), rng(seed) {}
+
+    size_t nextVictim(size_t n) noexcept {
+        // xorshift64
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        return size_t(rng % n);
+    }
+
+    detail::ChaseLevDeque<detail::StealJob*> deque;
+    WorkStealingScheduler* const scheduler;
+    uint64_t rng;
+};
+
+namespace {
+
+constexpr int kIdleSpins = 64;
+constexpr int kSyncSpins = 64;
+
+} // namespace
+
+WorkStealingScheduler::WorkStealingScheduler(size_t numThreads) {
+    if (numThreads == 0) {
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    _injected = detail::alignedNew<InjectQueue>(1024);
+    try {
+        _workers.reserve(numThreads);
+        for (size_t i = 0; i < numThreads; ++i) {
+            _workers.push_back(
+                    new Worker(this, 0x9e3779b97f4a7c15ULL * (i + 1)));
+        }
+        // all deques exist before any worker looks for a victim
+        _threads.reserve(numThreads);
+        for (size_t i = 0; i < numThreads; ++i) {
+            Worker* w = _workers[i];
+            _threads.emplace_back([this, w]() { workerLoop(w); });
+        }
+    } catch (...) {
+        // stops the threads that did start and frees the workers
+        shutdown();
+        throw;
+    }
+}
+
+WorkStealingScheduler::~WorkStealingScheduler() {
+    shutdown();
+}
+
+void WorkStealingScheduler::shutdown() noexcept {
+    _stop.store(true, std::memory_order_release);
+    _idleEpoch.fetch_add(1, std::memory_order_release);
+    detail::futexWake(&_idleEpoch, INT_MAX, ~0u);
+    for (auto& t : _threads) {
+        t.join();
+    }
+    for (Worker* w : _workers) {
+        delete w;
+    }
+    detail::alignedDelete(_injected);
+}
+
+WorkStealingScheduler::Worker*& WorkStealingScheduler::localWorker()
+    noexcept {
+    static thread_local Worker* worker = nullptr;
+    return worker;
+}
+
+WorkStealingScheduler* WorkStealingScheduler::current() noexcept {
+    Worker* tlWorker = localWorker();
+    return tlWorker != nullptr ? tlWorker->scheduler : nullptr;
+}
+
+void WorkStealingScheduler::submit(detail::StealJob* job) {
+    Worker* tlWorker = localWorker();
+    if (tlWorker != nullptr && tlWorker->scheduler == this) {
+        tlWorker->deque.push(job);
+    } else {
+        _injected->blockingWrite(job);
+    }
+    // pairs with the fence in workerLoop: either we see the sleeper or
+    // it sees the job
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (_sleepers.load(std::memory_order_relaxed) != 0) {
+        _idleEpoch.fetch_add(1, std::memory_order_release);
+        detail::futexWake(&_idleEpoch, 1, ~0u);
+    }
+}
+
+detail::StealJob* WorkStealingScheduler::findWork(Worker* self) noexcept {
+    detail::StealJob* job = nullptr;
+    if (self != nullptr && self->deque.pop(job)) {
+        return job;
+    }
+    if (_injected->read(job)) {
+        return job;
+    }
+    const size_t n = _workers.size();
+    if (self == nullptr) {
+        // a thread in sync that isn't a worker: sweep once
+        for (Worker* w : _workers) {
+            if (w->deque.steal(job)) {
+                return job;
+            }
+        }
+        return nullptr;
+    }
+    if (n == 1) {
+        return nullptr;
+    }
+    for (size_t k = 0; k < 2 * n; ++k) {
+        Worker* victim = _workers[self->nextVictim(n)];
+        if (victim != self && victim->deque.steal(job)) {
+            return job;
+        }
+    }
+    return nullptr;
+}
+
+bool WorkStealingScheduler::runOne() noexcept {
+    Worker* tlWorker = localWorker();
+    Worker* self = (tlWorker != nullptr && tlWorker->scheduler == this) ?
+        tlWorker : nullptr;
+    detail::StealJob* job = findWork(self);
+    if (job == nullptr) {
+        return false;
+    }
+    execute(job);
+    return true;
+}
+
+void WorkStealingScheduler::execute(detail::StealJob* job) noexcept {
+    job->fn();
+    TaskGroup* group = job->group;
+    delete job;
+    group->finish();
+}
+
+bool WorkStealingScheduler::hasWork() const noexcept {
+    if (!_injected->isEmpty()) {
+        return true;
+    }
+    for (Worker* w : _workers) {
+        if (!w->deque.isEmpty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingScheduler::workerLoop(Worker* self) noexcept {
+    localWorker() = self;
+    while (true) {
+        detail::StealJob* job = findWork(self);
+        for (int i = 0, n = spinLimitIfMultiCpu(kIdleSpins); job == nullptr && i < n;
+                ++i) {
+            asm_volatile_pause();
+            job = findWork(self);
+        }
+        if (job != nullptr) {
+            execute(job);
+            continue;
+        }
+        if (_stop.load(std::memory_order_acquire)) {
+            break;
+        }
+
+        uint32_t epoch = _idleEpoch.load(std::memory_order_acquire);
+        _sleepers.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!hasWork() && !_stop.load(std::memory_order_acquire)) {
+            detail::futexWait(&_idleEpoch, epoch, ~0u);
+        }
+        _sleepers.fetch_sub(1, std::memory_order_relaxed);
+    }
+    localWorker() = nullptr;
+}
+
+void TaskGroup::finish() noexcept {
+    uint32_t prev = _pending.fetch_sub(1, std::memory_order_acq_rel);
+    if (prev == (kSleeping | 1)) {
+        // The owner may see the count reach zero on a spurious wakeup and
+        // destroy the group before this runs; a wake on a stale address
+        // is harmless, since every futex waiter rechecks its condition
+        detail::futexWake(&_pending, 1, ~0u);
+    }
+}
+
+void TaskGroup::sync() noexcept {
+    int spins = 0;
+    while ((_pending.load(std::memory_order_acquire) & ~kSleeping) != 0) {
+        if (_scheduler.runOne()) {
+            spins = 0;
+            continue;
+        }
+        if (spins++ < spinLimitIfMultiCpu(kSyncSpins)) {
+            asm_volatile_pause();
+            continue;
+        }
+        // our tasks are running elsewhere, sleep until the last one is
+        // done
+        uint32_t p = _pending.load(std::memory_order_acquire);
+        if ((p & ~kSleeping) == 0) {
+            break;
+        }
+        if ((p & kSleeping) == 0 &&
+                !_pending.compare_exchange_strong(p, p | kSleeping)) {
+            continue;
+        }
+        detail::futexWait(&_pending, p | kSleeping, ~0u);
+        _pending.fetch_and(~kSleeping, std::memory_order_relaxed);
+        spins = 0;
+    }
+    _pending.store(0, std::memory_order_relaxed);
+}
+
+};  // namespace myfolly
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+
+#include "detail/parking_lot.h"
+
+namespace myfolly {
+
+/// A counting semaphore that wakes its waiters in LIFO order: post() hands
+/// its token to the thread that started waiting most recently.  A pool of
+/// workers that waits on one keeps reusing the same few threads, whose
+/// caches (and CPUs) are still warm, while the others stay asleep.
+///
+/// _value is the number of tokens minus the number of threads that have
+/// committed to waiting.  wait() and post() only touch it while tokens are
+/// available; a post() that finds committed waiters takes the lock and
+/// wakes the waiter on top of the stack.  A waiter that has committed but
+/// isn't on the stack yet gets a pending wake instead, which it picks up
+/// when it takes the lock to push itself.
+///
+/// Every waiter sleeps on a futex of its own (a ParkingLot WaitNode), so a
+/// post wakes exactly one thread.
+class LifoSem {
+public:
+    explicit LifoSem(uint32_t value = 0) noexcept : _value(value) {}
+
+    LifoSem(const LifoSem&) = delete;
+    LifoSem& operator=(const LifoSem&) = delete;
+
+    void post() noexcept {
+        if (_value.fetch_add(1, std::memory_order_release) < 0) {
+            wakeOne();
+        }
+    }
+
+    void post(uint32_t n) noexcept {
+        for (uint32_t i = 0; i < n; ++i) {
+            post();
+        }
+    }
+
+    /// Takes a token if one is available
+    bool tryWait() noexcept {
+        int64_t v = _value.load(std::memory_order_relaxed);
+        while (v > 0) {
+            if (_value.compare_exchange_weak(v, v - 1,
+                        std::memory_order_acquire)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /// Spins briefly (with more than one CPU) and then sleeps until it
+    /// gets a token
+    void wait() noexcept;
+
+    /// Tokens available, or minus the number of committed waiters
+    int64_t value() const noexcept {
+        return _value.load(std::memory_order_acquire);
+    }
+
+    /// Threads asleep on the stack
+    size_t waiters() noexcept {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _numWaiters;
+    }
+
+private:
+    void wakeOne() noexcept;
+
+    std::atomic<int64_t> _value;
+    std::mutex _mutex;
+    /// Guarded by _mutex: the waiters, most recent first, and the wakes
+    /// owed to committed waiters that haven't pushed themselves yet
+    detail::WaitNode* _top{nullptr};
+    size_t _numWaiters{0};
+    uint32_t _pendingWakes{0};
+};
+
+};  // namespace myfolly
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <limits>
+#include <new>
+
+#include "detail/mmap_allocator.h"
+
+namespace myfolly {
+
+using detail::MmapAllocationOptions;
+using detail::MmapAllocationResult;
+
+/// Allocator that gives every allocation its own anonymous mapping, for
+/// large slot arrays (MPMCQueue<T, MmapAllocator<SingleElementQueue<T>>>).
+/// Depending on MmapAllocationOptions the mapping is backed by huge pages,
+/// prefaulted, and/or bound to a NUMA node; each of these silently falls
+/// back to ordinary behavior when unavailable, see lastResult().
+template <typename T>
+class MmapAllocator {
+public:
+    using value_type = T;
+
+    template <typename U>
+    struct rebind {
+        using other = MmapAllocator<U>;
+    };
+
+    explicit MmapAllocator(
+            const MmapAllocationOptions& options = MmapAllocationOptions())
+        : options_(options) {}
+
+    template <typename U>
+    MmapAllocator(const MmapAllocator<U>& other) noexcept
+        : options_(other.options()) {}
+
+    T* allocate(std::size_t n) {
+        if (n > std::numeric_limits<std::size_t>::max() / sizeof(T)) {
+            throw std::bad_array_new_length();
+        }
+        void* p = detail::mmapAllocate(sizeof(T) * n, options_, &lastResult_);
+        if (p == nullptr) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(p);
+    }
+
+    void deallocate(T* p, std::size_t n) noexcept {
+        detail::mmapDeallocate(p, sizeof(T) * n, options_);
+    }
+
+    const MmapAllocationOptions& options() const noexcept { return options_; }
+
+    /// What the most recent allocate() call actually obtained
+    const MmapAllocationResult& lastResult() const noexcept {
+        return lastResult_;
+    }
+
+private:
+    MmapAllocationOptions options_;
+    MmapAllocationResult lastResult_;
+};
+
+/// Mappings are rounded according to the options, so only allocators with
+/// the same options can free each other's memory
+template <typename T, typename U>
+bool operator==(const MmapAllocator<T>& a, const MmapAllocator<U>& b) noexcept {
+    return a.options().hugeTlb == b.options().hugeTlb &&
+        a.options().transparentHugePages == b.options().transparentHugePages &&
+        a.options().prefault == b.options().prefault &&
+        a.options().numaNode == b.options().numaNode;
+}
+
+template <typename T, typename U>
+bool operator!=(const MmapAllocator<T>& a, const MmapAllocator<U>& b) noexcept {
+    return !(a == b);
+}
+
+} // namespace myfolly
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <array>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "mpmc_queue.h"
+#include "portability.h"
+
+namespace myfolly {
+
+/// A chain of MPMCQueues for processing stages that run in parallel but
+/// must keep their input order, e.g. decode -> transform -> write:
+///
+///   MPMCPipeline<Raw, Decoded, Encoded> p(1024);
+///   // producer
+///   p.blockingWrite(raw);
+///   // any number of stage 0 workers
+///   MPMCPipeline<Raw, Decoded, Encoded>::Ticket<0> t;
+///   Raw in;
+///   p.blockingReadStage<0>(t, in);
+///   p.blockingWriteStage<0>(t, decode(in));
+///   // any number of stage 1 workers: the same with <1>
+///   // consumer, sees the encodings in the order the raws were written
+///   p.blockingRead(out);
+///
+/// Queue i holds the i-th type: In for stage 0, the type stage i produces
+/// for stage i + 1, and Out (the last type) for the consumer.
+///
+/// A worker that reads element k of a stage gets ticket k, and writes its
+/// result as element k of the next queue (MPMCQueue::writeWithTicket)
+/// instead of taking a fresh push ticket.  The next queue's slot turn
+/// sequencers then hand the results out in input order no matter in
+/// which order the workers finish, and a reader that gets ahead waits on
+/// its slot's futex, as in any MPMCQueue.  No reorder buffer and no lock
+/// are involved.  A result only waits for an earlier one when they are a
+/// whole queue capacity apart.
+///
+/// Every ticket must be written exactly once (the stage is 1:1): a
+/// worker that drops an element stalls the pipeline at that element.
+template <typename In, typename... Stages>
+class MPMCPipeline {
+    static_assert(sizeof...(Stages) > 0, "a pipeline needs a stage");
+
+    using Types = std::tuple<In, Stages...>;
+
+    template <size_t I>
+    using Queue = MPMCQueue<typename std::tuple_element<I, Types>::type>;
+
+    template <typename Indices> struct QueuesOf;
+
+    template <size_t... I>
+    struct QueuesOf<std::index_sequence<I...>> {
+        using type = std::tuple<Queue<I>*...>;
+    };
+
+public:
+    static constexpr size_t kNumStages = sizeof...(Stages);
+
+    /// What stage Stage reads
+    template <size_t Stage>
+    using StageInput = typename std::tuple_element<Stage, Types>::type;
+
+    /// What stage Stage writes
+    template <size_t Stage>
+    using StageOutput = typename std::tuple_element<Stage + 1, Types>::type;
+
+    using Out = StageInput<kNumStages>;
+
+    /// Identifies an element read by stage Stage, so that its result can
+    /// be written in its place
+    template <size_t Stage>
+    class Ticket {
+    public:
+        Ticket() noexcept : _value(0) {}
+
+    private:
+        friend class MPMCPipeline;
+        uint64_t _value;
+    };
+
+    /// Every queue gets capacity slots
+    explicit MPMCPipeline(size_t capacity) {
+        std::array<size_t, kNumStages + 1> capacities;
+        capacities.fill(capacity);
+        allocate(capacities, Indices());
+    }
+
+    /// capacities[i] is the capacity of queue i
+    explicit MPMCPipeline(
+            const std::array<size_t, kNumStages + 1>& capacities) {
+        allocate(capacities, Indices());
+    }
+
+    ~MPMCPipeline() noexcept { destroy(Indices()); }
+
+    // non-copyable and non-movable
+    MPMCPipeline(const MPMCPipeline&) = delete;
+    MPMCPipeline& operator=(const MPMCPipeline&) = delete;
+
+    template <typename... Args>
+    bool write(Args&&... args) noexcept {
+        return queue<0>().write(std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    void blockingWrite(Args&&... args) noexcept {
+        queue<0>().blockingWrite(std::forward<Args>(args)...);
+    }
+
+    template <size_t Stage>
+    bool readStage(Ticket<Stage>& ticket, StageInput<Stage>& elem) noexcept {
+        static_assert(Stage < kNumStages, "no such stage");
+        return queue<Stage>().readAndGetTicket(ticket._value, elem);
+    }
+
+    template <size_t Stage>
+    void blockingReadStage(Ticket<Stage>& ticket,
+            StageInput<Stage>& elem) noexcept {
+        static_assert(Stage < kNumStages, "no such stage");
+        ticket._value = queue<Stage>().blockingReadWithTicket(elem);
+    }
+
+    /// Writes the result for the element ticket was read with.  Blocks
+    /// only while the next queue is a whole capacity behind
+    template <size_t Stage, typename... Args>
+    void blockingWriteStage(const Ticket<Stage>& ticket,
+            Args&&... args) noexcept {
+        static_assert(Stage < kNumStages, "no such stage");
+        queue<Stage + 1>().writeWithTicket(ticket._value,
+                std::forward<Args>(args)...);
+    }
+
+    bool read(Out& elem) noexcept {
+        return queue<kNumStages>().read(elem);
+    }
+
+    void blockingRead(Out& elem) noexcept {
+        queue<kNumStages>().blockingRead(elem);
+    }
+
+    /// Elements written but not yet read at the end, including those
+    /// being worked on.  Negative while readers wait
+    ssize_t sizeGuess() const noexcept {
+        uint64_t reads = std::get<kNumStages>(_queues)->readCount();
+        uint64_t writes = std::get<0>(_queues)->writeCount();
+        return ssize_t(writes - reads);
+    }
+
+private:
+    using Indices = std::make_index_sequence<kNumStages + 1>;
+
+    template <size_t I>
+    Queue<I>& queue() noexcept { return *std::get<I>(_queues); }
+
+    /// Queues are over-aligned, hence detail::alignedNew
+    template <size_t... I>
+    void allocate(const std::array<size_t, kNumStages + 1>& capacities,
+            std::index_sequence<I...>) {
+        try {
+            using expand = int[];
+            (void)expand{0,
+                (std::get<I>(_queues) =
+                 detail::alignedNew<Queue<I>>(capacities[I]), 0)...};
+        } catch (...) {
+            destroy(Indices());
+            throw;
+        }
+    }
+
+    template <size_t... I>
+    void destroy(std::index_sequence<I...>) noexcept {
+        using expand = int[];
+        (void)expand{0, (destroyQueue(std::get<I>(_queues)), 0)...};
+    }
+
+    template <typename Q>
+    static void destroyQueue(Q*& q) noexcept {
+        detail::alignedDelete(q);
+        q = nullptr;
+    }
+
+    typename QueuesOf<Indices>::type _queues{};
+};
+
+};  // namespace myfolly
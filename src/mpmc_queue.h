@@ -1,6 +1,17 @@
 #pragma once
 
+#include <iterator>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+
+#include "aligned_allocator.h"
+#include "capacity_policy.h"
+#include "detail/queue_readiness.h"
+#include "detail/queue_stats.h"
 #include "detail/turn_sequencer.h"
+#include "detail/wide_turn_sequencer.h"
 #include "portability.h"
 
 namespace myfolly {
@@ -9,82 +20,359 @@ using namespace detail;
 constexpr size_t hardware_destructive_interference_size =
     (kIsArchArm || kIsArchS390X) ? 64 : 128;
 
+/// Slot layout policies for SingleElementQueue, trading density against
+/// false sharing between neighbouring slots.
+///
+/// DenseSlots (the default): sequencer and element side by side, as
+/// tightly as their alignment allows: 16 bytes and 8 slots per cache line
+/// for uint64_t.  The fixed MPMCQueue spreads consecutive tickets over
+/// different lines, but slots that are a few tickets apart still share one.
+struct DenseSlots {
+    static constexpr size_t kAlign = 0;
+    static constexpr bool kSplit = false;
+};
+
+/// Every slot aligned and padded to hardware_destructive_interference_size,
+/// so no two slots share a line.  Costs a whole line per slot for small T.
+/// The slot array must be allocated with the alignment, e.g. with
+/// AlignedAllocator
+struct IsolatedSlots {
+    static constexpr size_t kAlign = hardware_destructive_interference_size;
+    static constexpr bool kSplit = false;
+};
+
+/// Sequencers in the slot array, elements in a second array allocated
+/// with it.  Waiters spin on a compact array that element copies never
+/// write, which pays off when T is large.  Each slot keeps a pointer to
+/// its element, so the sequencer array takes 16 bytes per slot whatever T
+/// is
+struct SplitSlots {
+    static constexpr size_t kAlign = 0;
+    static constexpr bool kSplit = true;
+};
+
+namespace detail {
+
+/// Where a SingleElementQueue keeps its element: inline, or in the
+/// element array of a SplitSlots queue
+template <typename T, bool Split>
+class SlotStorage {
+public:
+    using Payload = typename std::aligned_storage<sizeof(T), alignof(T)>::type;
+
+    T* ptr() noexcept { return reinterpret_cast<T*>(&_contents); }
+
+    void attach(Payload*) noexcept {}
+
+    Payload* payload() noexcept { return nullptr; }
+
+private:
+    Payload _contents;
+};
+
 template <typename T>
-class SingleElementQueue {
+class SlotStorage<T, true> {
 public:
-    void enqueue(uint32_t turn,
+    using Payload = typename std::aligned_storage<sizeof(T), alignof(T)>::type;
+
+    T* ptr() noexcept { return reinterpret_cast<T*>(_payload); }
+
+    void attach(Payload* p) noexcept { _payload = p; }
+
+    Payload* payload() noexcept { return _payload; }
+
+private:
+    Payload* _payload{nullptr};
+};
+
+constexpr size_t maxAlign(size_t a, size_t b) noexcept {
+    return a > b ? a : b;
+}
+
+template <typename Slot, typename T>
+struct IsSlotOf : std::false_type {};
+
+/// Whether It can be walked more than once, which the batch writes need
+template <typename It>
+struct IsForwardIterator : std::is_base_of<std::forward_iterator_tag,
+        typename std::iterator_traits<It>::iterator_category> {};
+
+} // namespace detail
+
+/// A single slot of an MPMCQueue.  The element lives in raw storage: it is
+/// constructed in place by enqueue and moved out and destroyed by dequeue,
+/// so T needs neither a default constructor nor copy assignment.  As with
+/// BoundedQueue's Slot<T>, construction and destruction must not throw.
+///
+/// Sequencer is TurnSequencer or WideTurnSequencer.  Turns are passed down
+/// as 64-bit values; TurnSequencer only looks at their low bits.
+///
+/// Layout is DenseSlots, IsolatedSlots or SplitSlots.  A SplitSlots slot
+/// only works once MPMCQueue has attached its element storage.
+template <typename T,
+          typename Sequencer = TurnSequencer,
+          typename Layout = DenseSlots>
+class alignas(detail::maxAlign(Layout::kAlign, detail::maxAlign(
+                alignof(Sequencer),
+                alignof(detail::SlotStorage<T, Layout::kSplit>))))
+SingleElementQueue {
+    using Storage = detail::SlotStorage<T, Layout::kSplit>;
+
+public:
+    using Payload = typename Storage::Payload;
+
+    /// True if the element lives outside the slot
+    static constexpr bool kSplitPayload = Layout::kSplit;
+
+    /// SplitSlots only: where the element goes
+    void attachPayload(Payload* p) noexcept { _storage.attach(p); }
+
+    Payload* payload() noexcept { return _storage.payload(); }
+
+    ~SingleElementQueue() noexcept {
+        if ((_sequencer.uncompletedTurnLSB() & 1) == 1) {
+            // we are pending a dequeue, so we have a constructed item
+            destroyContents();
+        }
+    }
+
+    template <typename... Args>
+    void enqueue(uint64_t turn,
+            std::atomic<uint32_t>& spinCutoff,
+            const bool updateSpinCutoff,
+            QueueStatsCounters* stats,
+            Args&&... args) noexcept {
+        static_assert(std::is_nothrow_constructible<T, Args&&...>::value,
+                "T must be nothrow constructible with Args&&...");
+        new (beginEnqueue(turn, spinCutoff, updateSpinCutoff, stats))
+            T(std::forward<Args>(args)...);
+        endEnqueue(turn, stats);
+    }
+
+    /// enqueue in two halves, for MPMCQueue's reservations: waits for the
+    /// turn and returns the raw storage, in which the caller constructs
+    /// the element before calling endEnqueue
+    void* beginEnqueue(uint64_t turn,
             std::atomic<uint32_t>& spinCutoff,
             const bool updateSpinCutoff,
-            const T& goner) {
-        _sequencer.waitForTurn(turn * 2, spinCutoff, updateSpinCutoff);
-        _contents = goner;
-        _sequencer.completeTurn(turn * 2);
+            QueueStatsCounters* stats) noexcept {
+        _sequencer.waitForTurn(turn * 2, spinCutoff, updateSpinCutoff, stats);
+        return ptr();
+    }
+
+    void endEnqueue(uint64_t turn, QueueStatsCounters* stats) noexcept {
+        _sequencer.completeTurn(turn * 2, stats);
     }
 
     template <class Clock>
     bool tryWaitForEnqueueTurnUntil(
-            const uint32_t turn,
+            const uint64_t turn,
             std::atomic<uint32_t>& spinCutoff,
             const bool updateSpinCutoff,
-            const std::chrono::time_point<Clock>& when) noexcept {
+            const std::chrono::time_point<Clock>& when,
+            QueueStatsCounters* stats = nullptr) noexcept {
         return _sequencer.tryWaitForTurn(
-                turn * 2, spinCutoff, updateSpinCutoff, &when) !=
+                turn * 2, spinCutoff, updateSpinCutoff, &when, stats) !=
           TryWaitResult::TIMEDOUT;
     }
 
-    bool mayEnqueue(const uint32_t turn) const noexcept {
+    bool mayEnqueue(const uint64_t turn) const noexcept {
         return _sequencer.isTurn(turn * 2);
     }
 
-    void dequeue(uint32_t turn,
+    void dequeue(uint64_t turn,
             std::atomic<uint32_t>& spinCutoff,
             const bool updateSpinCutoff,
-            T& elem) {
-        _sequencer.waitForTurn(turn * 2 + 1, spinCutoff, updateSpinCutoff);
-        elem = _contents;
-        _sequencer.completeTurn(turn * 2 + 1);
+            QueueStatsCounters* stats,
+            T& elem) noexcept {
+        elem = std::move(beginDequeue(turn, spinCutoff, updateSpinCutoff,
+                    stats));
+        endDequeue(turn, stats);
+    }
+
+    /// dequeue in two halves, for MPMCQueue's visits: waits for the turn
+    /// and returns the element, which endDequeue destroys
+    T& beginDequeue(uint64_t turn,
+            std::atomic<uint32_t>& spinCutoff,
+            const bool updateSpinCutoff,
+            QueueStatsCounters* stats) noexcept {
+        _sequencer.waitForTurn(turn * 2 + 1, spinCutoff, updateSpinCutoff,
+                stats);
+        return *ptr();
+    }
+
+    void endDequeue(uint64_t turn, QueueStatsCounters* stats) noexcept {
+        destroyContents();
+        _sequencer.completeTurn(turn * 2 + 1, stats);
     }
 
     template <class Clock>
     bool tryWaitForDequeueTurnUntil(
-            const uint32_t turn,
+            const uint64_t turn,
             std::atomic<uint32_t>& spinCutoff,
             const bool updateSpinCutoff,
-            const std::chrono::time_point<Clock>& when) noexcept {
+            const std::chrono::time_point<Clock>& when,
+            QueueStatsCounters* stats = nullptr) noexcept {
         return _sequencer.tryWaitForTurn(
-                turn * 2 + 1, spinCutoff, updateSpinCutoff, &when) !=
+                turn * 2 + 1, spinCutoff, updateSpinCutoff, &when, stats) !=
           TryWaitResult::TIMEDOUT;
     }
 
-    bool mayDequeue(const uint32_t turn) const noexcept {
+    bool mayDequeue(const uint64_t turn) const noexcept {
         return _sequencer.isTurn(turn * 2 + 1);
     }
 
 private:
-    TurnSequencer _sequencer;
-    T _contents;
+    T* ptr() noexcept { return _storage.ptr(); }
+
+    void destroyContents() noexcept {
+        static_assert(std::is_nothrow_destructible<T>::value,
+                "T must be nothrow destructible");
+        ptr()->~T();
+    }
+
+private:
+    Sequencer _sequencer;
+    Storage _storage;
 };
 
-template <typename T, typename Allocator = std::allocator<SingleElementQueue<T>>>
+namespace detail {
+
+template <typename T, typename Sequencer, typename Layout>
+struct IsSlotOf<SingleElementQueue<T, Sequencer, Layout>, T> :
+    std::integral_constant<bool,
+        std::is_same<Sequencer, TurnSequencer>::value ||
+        std::is_same<Sequencer, WideTurnSequencer>::value> {};
+
+} // namespace detail
+
+/// MPMCQueue<T, Allocator, true> is the dynamic version.  It starts with a
+/// small backing array (minCapacity) and, when a writer finds it full,
+/// replaces it with one expansionMultiplier times larger, up to capacity.
+///
+/// Tickets issued before an expansion keep using the array that was
+/// current when they were issued: each expansion records the old array
+/// together with the first ticket that no longer maps to it (the offset)
+/// in _closed, so lagging producers and consumers can still find it.
+/// Closed arrays are only freed by the destructor, which bounds their
+/// total size to capacity / (expansionMultiplier - 1).  Elements still
+/// waiting in closed arrays count against capacity: writes fail, and
+/// blockingWrite waits, once capacity elements are queued across all the
+/// arrays.
+///
+/// _dstate packs the offset of the current array and a seqlock:
+///   bits 63..kSeqlockBits : ticket offset of the current array
+///   bits kSeqlockBits-1..1: number of closed arrays
+///   bit  0                : expansion in progress
+///
+/// Capacity is the capacity policy of the fixed queue (see
+/// capacity_policy.h).  PowerOfTwoCapacity or FixedCapacity<N> replace the
+/// two 64-bit divisions per operation by a mask and a shift.  Dynamic
+/// queues resize their array at runtime and need RuntimeCapacity.
+template <typename T,
+          typename Allocator = std::allocator<SingleElementQueue<T>>,
+          bool Dynamic = false,
+          typename Capacity = RuntimeCapacity>
 class MPMCQueue {
+private:
+    static_assert(!Dynamic || std::is_same<Capacity, RuntimeCapacity>::value,
+                  "Dynamic MPMCQueue needs RuntimeCapacity");
+
+    static_assert(std::is_nothrow_copy_assignable<T>::value ||
+                      std::is_nothrow_move_assignable<T>::value,
+                  "T must be nothrow copy or move assignable");
+
+    static_assert(std::is_nothrow_destructible<T>::value,
+                  "T must be nothrow destructible");
+
 public:
-    using Slot = SingleElementQueue<T>;
+    /// The slot type comes from the allocator, so allocating
+    /// SingleElementQueue<T, WideTurnSequencer> selects the wide sequencer
+    /// (see WideMPMCQueue) and SingleElementQueue<T, Sequencer, Layout> the
+    /// slot layout (see LayoutMPMCQueue)
+    using Slot = typename std::allocator_traits<Allocator>::value_type;
+    static_assert(detail::IsSlotOf<Slot, T>::value,
+                  "Allocator must allocate "
+                  "SingleElementQueue<T, Sequencer, Layout>");
+#ifndef __cpp_aligned_new
+    static_assert(alignof(Slot) <= alignof(std::max_align_t) ||
+                  !std::is_same<Allocator, std::allocator<Slot>>::value,
+                  "std::allocator doesn't align IsolatedSlots, "
+                  "use AlignedAllocator");
+#endif
+
     explicit MPMCQueue(size_t const capacity,
             Allocator const& allocator = Allocator()) :
-        _capacity(capacity),
-        _allocator(allocator),
-        _stride(computeStride(capacity)),
-        _pushTicket(0),
-        _popTicket(0),
-        _pushSpinCutoff(0),
-        _popSpinCutoff(0) {
-        _slots = new Slot[capacity + 2 * this->kSlotPadding];
-    }
+        MPMCQueue(capacity, kDefaultMinDynamicCapacity,
+                kDefaultExpansionMultiplier, allocator, 0) {}
+
+    /// Dynamic only: starts with min(minCapacity, capacity) slots and grows
+    /// by expansionMultiplier (at least 2) whenever the queue fills up
+    template <bool D = Dynamic, typename = typename std::enable_if<D>::type>
+    MPMCQueue(size_t const capacity,
+            size_t const minCapacity,
+            size_t const expansionMultiplier,
+            Allocator const& allocator = Allocator()) :
+        MPMCQueue(capacity, minCapacity, expansionMultiplier, allocator, 0) {}
 
     ~MPMCQueue() noexcept {
-        delete[] _slots;
+        if (Dynamic) {
+            int numClosed = getNumClosed(_dstate.load());
+            for (int i = 0; i < numClosed; ++i) {
+                deallocateSlots(_closed[i].slots, _closed[i].capacity);
+            }
+            delete[] _closed;
+            deallocateSlots(_dslots.load(), _dcapacity.load());
+        } else {
+            deallocateSlots(_slots, _capacity);
+        }
     }
 
+    // non-copyable and non-movable
+    MPMCQueue(const MPMCQueue&) = delete;
+    MPMCQueue& operator=(const MPMCQueue&) = delete;
+
+    /// The allocator that backs the slot arrays
+    const Allocator& allocator() const noexcept { return _allocator; }
+
+    /// Hot-path counters accumulated since construction or the last
+    /// resetStats().  All zero unless built with MYFOLLY_QUEUE_STATS (see
+    /// detail/queue_stats.h)
+    MPMCQueueStats stats() const noexcept { return _stats.snapshot(); }
+
+    void resetStats() noexcept { _stats.reset(); }
+
+    /// What readAny (queue_select.h) waits on to learn that this queue
+    /// may have become readable
+    ReadinessEvent& readinessEvent() noexcept { return _readiness; }
+
+    /// Notification mode, for consumers that run an event loop and can't
+    /// block in blockingRead.  notificationFd() returns an eventfd that
+    /// becomes readable when an element arrives after armNotification():
+    ///
+    ///   on notificationFd() readable:
+    ///     q.clearNotification();
+    ///     do {
+    ///       while (q.read(elem)) handle(elem);
+    ///     } while (!q.armNotification());
+    ///
+    /// Producers write the eventfd only for the first element after the
+    /// consumer armed it.  Create the fd before the queue is in use
+    int notificationFd() { return _readiness.eventFd(); }
+
+    /// Returns true if the consumer may now wait for notificationFd(), or
+    /// false if the queue isn't empty (read again first)
+    bool armNotification() noexcept {
+        _readiness.arm();
+        if (!isEmpty()) {
+            _readiness.disarm();
+            return false;
+        }
+        return true;
+    }
+
+    void clearNotification() noexcept { _readiness.clearEventFd(); }
+
     ssize_t size() const noexcept {
         uint64_t pushes = _pushTicket.load(std::memory_order_acquire); // A
         uint64_t pops = _popTicket.load(std::memory_order_acquire); // B
@@ -110,12 +398,24 @@ public:
 
     bool isFull() const noexcept {
         // careful with signed -> unsigned promotion, since size can be negative
-        return size() >= static_cast<ssize_t>(_capacity);
+        return size() >= static_cast<ssize_t>(capacity());
     }
 
-    size_t capacity() const noexcept { return _capacity; }
+    /// The number of elements the queue holds, after rounding by the
+    /// capacity policy
+    size_t capacity() const noexcept { return _capacityPolicy.capacity(); }
+
+    /// Number of slots in the current backing array.  Always equal to
+    /// capacity() unless Dynamic
+    size_t allocatedCapacity() const noexcept {
+        return Dynamic ? _dcapacity.load(std::memory_order_relaxed) : _capacity;
+    }
 
-    bool write(T const& val) noexcept {
+    /// If an item can be enqueued with no blocking, does so and returns
+    /// true, otherwise returns false.  The element is constructed in place
+    /// from args, so write(std::move(x)) and write(ctorArgs...) never copy.
+    template <typename... Args>
+    bool write(Args&&... args) noexcept {
         uint64_t ticket;
         Slot* slots;
         size_t cap;
@@ -123,21 +423,48 @@ public:
         if (tryObtainReadyPushTicket(ticket, slots, cap, stride)) {
             // we have pre-validated that the ticket won't block
             enqueueWithTicketBase(
-                    ticket, slots, cap, stride, val);
+                    ticket, slots, cap, stride, std::forward<Args>(args)...);
             return true;
         } else {
             return false;
         }
     }
 
-    void blockingWrite(T const& val) noexcept {
-        enqueueWithTicketBase(
-                _pushTicket++, _slots, _capacity, _stride, val);
+    /// Like write, but returns false only if the queue is full: it may
+    /// block briefly for a pop that is in progress on the target slot.
+    /// Linearizable, unlike write, which can also fail on a slow consumer.
+    template <typename... Args>
+    bool writeIfNotFull(Args&&... args) noexcept {
+        uint64_t ticket;
+        Slot* slots;
+        size_t cap;
+        int stride;
+        if (tryObtainPromisedPushTicket(ticket, slots, cap, stride)) {
+            // some other thread is already dequeuing the slot into which we
+            // are going to enqueue, but we might have to wait for them to
+            // finish
+            enqueueWithTicketBase(
+                    ticket, slots, cap, stride, std::forward<Args>(args)...);
+            return true;
+        } else {
+            return false;
+        }
     }
 
-    template <class Clock>
+    template <typename... Args>
+    void blockingWrite(Args&&... args) noexcept {
+        uint64_t ticket;
+        Slot* slots;
+        size_t cap;
+        int stride;
+        obtainBlockingPushTicket(ticket, slots, cap, stride);
+        enqueueWithTicketBase(ticket, slots, cap, stride,
+                std::forward<Args>(args)...);
+    }
+
+    template <class Clock, typename... Args>
     bool tryWriteUntil(
-            const std::chrono::time_point<Clock>& when, T const& val) noexcept {
+            const std::chrono::time_point<Clock>& when, Args&&... args) noexcept {
         uint64_t ticket;
         Slot* slots;
         size_t cap;
@@ -147,13 +474,23 @@ public:
             // it won't block longer than it takes another thread to dequeue an
             // element from the slot it identifies.
             enqueueWithTicketBase(
-                    ticket, slots, cap, stride, val);
+                    ticket, slots, cap, stride, std::forward<Args>(args)...);
             return true;
         } else {
             return false;
         }
     }
 
+    /// Like tryWriteUntil, with a deadline relative to now
+    template <class Rep, class Period, typename... Args>
+    bool tryWriteFor(
+            const std::chrono::duration<Rep, Period>& duration,
+            Args&&... args) noexcept {
+        return tryWriteUntil(std::chrono::steady_clock::now() +
+                std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    duration), std::forward<Args>(args)...);
+    }
+
     bool read(T& elem) noexcept {
         uint64_t ticket = 0;
         Slot* slots = nullptr;
@@ -169,8 +506,12 @@ public:
     }
 
     void blockingRead(T& elem) noexcept {
-        uint64_t ticket = _popTicket++;
-        dequeueWithTicketBase(ticket, _slots, _capacity, _stride, elem);
+        uint64_t ticket;
+        Slot* slots;
+        size_t cap;
+        int stride;
+        obtainBlockingPopTicket(ticket, slots, cap, stride);
+        dequeueWithTicketBase(ticket, slots, cap, stride, elem);
     }
 
     template <class Clock>
@@ -191,37 +532,448 @@ public:
         }
     }
 
-private:
-    static int computeStride(size_t capacity) noexcept {
-        static const int smallPrimes[] = {2, 3, 5, 7, 11, 13, 17, 19, 23};
+    /// Like tryReadUntil, with a deadline relative to now
+    template <class Rep, class Period>
+    bool tryReadFor(
+            const std::chrono::duration<Rep, Period>& duration,
+            T& elem) noexcept {
+        return tryReadUntil(std::chrono::steady_clock::now() +
+                std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    duration), elem);
+    }
 
-        int bestStride = 1;
-        size_t bestSep = 1;
-        for (int stride : smallPrimes) {
-            if ((stride % capacity) == 0 || (capacity % stride) == 0) {
-                continue;
+    /// Zero-copy writes.  A Reservation holds a push ticket whose slot is
+    /// ours: construct the element at storage() with placement new, then
+    /// commit() it.  Readers of this ticket, and behind them readers of
+    /// later tickets, wait for the commit, so every reservation must be
+    /// committed, and soon.
+    ///
+    ///   auto r = q.blockingReserve();
+    ///   auto* frame = new (r.storage()) Frame(header);
+    ///   fill(frame->payload);
+    ///   q.commit(r);
+    ///
+    /// Reservations are move-only, and commit empties them, so a slot is
+    /// published exactly once.
+    class Reservation {
+    public:
+        Reservation() noexcept = default;
+
+        Reservation(Reservation&& other) noexcept :
+            _slot(other._slot), _storage(other._storage), _turn(other._turn) {
+            other._slot = nullptr;
+            other._storage = nullptr;
+        }
+
+        Reservation& operator=(Reservation&& other) noexcept {
+            if (this != &other) {
+                assert(_slot == nullptr);
+                _slot = other._slot;
+                _storage = other._storage;
+                _turn = other._turn;
+                other._slot = nullptr;
+                other._storage = nullptr;
             }
-            size_t sep = stride % capacity;
-            sep = std::min(sep, capacity - sep);
-            if (sep > bestSep) {
-                bestStride = stride;
-                bestSep = sep;
+            return *this;
+        }
+
+        Reservation(const Reservation&) = delete;
+        Reservation& operator=(const Reservation&) = delete;
+
+        /// Uninitialized storage for one T, nullptr once committed
+        void* storage() const noexcept { return _storage; }
+
+    private:
+        friend class MPMCQueue;
+
+        Slot* _slot{nullptr};
+        void* _storage{nullptr};
+        uint64_t _turn{0};
+    };
+
+    /// Reserves like blockingWrite writes
+    Reservation blockingReserve() noexcept {
+        uint64_t ticket;
+        Slot* slots;
+        size_t cap;
+        int stride;
+        obtainBlockingPushTicket(ticket, slots, cap, stride);
+        Reservation r;
+        reserveWithTicketBase(ticket, slots, cap, stride, r);
+        return r;
+    }
+
+    /// Reserves like write writes: returns false if that would block
+    bool tryReserve(Reservation& r) noexcept {
+        uint64_t ticket;
+        Slot* slots;
+        size_t cap;
+        int stride;
+        if (tryObtainReadyPushTicket(ticket, slots, cap, stride)) {
+            reserveWithTicketBase(ticket, slots, cap, stride, r);
+            return true;
+        }
+        return false;
+    }
+
+    template <class Clock>
+    bool tryReserveUntil(const std::chrono::time_point<Clock>& when,
+            Reservation& r) noexcept {
+        uint64_t ticket;
+        Slot* slots;
+        size_t cap;
+        int stride;
+        if (tryObtainPromisedPushTicketUntil(ticket, slots, cap, stride, when)) {
+            reserveWithTicketBase(ticket, slots, cap, stride, r);
+            return true;
+        }
+        return false;
+    }
+
+    template <class Rep, class Period>
+    bool tryReserveFor(const std::chrono::duration<Rep, Period>& duration,
+            Reservation& r) noexcept {
+        return tryReserveUntil(std::chrono::steady_clock::now() +
+                std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    duration), r);
+    }
+
+    /// Publishes the element constructed in r.storage(), and empties r
+    void commit(Reservation& r) noexcept {
+        assert(r._slot != nullptr);
+        r._slot->endEnqueue(r._turn, sequencerCounters(_stats));
+        r._slot = nullptr;
+        r._storage = nullptr;
+        _readiness.notify();
+    }
+
+    /// Zero-copy reads.  Calls f(T&) on the element in its slot, then
+    /// destroys it and frees the slot, also if f throws.  Writers of later
+    /// laps of the slot wait for f, so keep it short
+    template <typename F>
+    void blockingVisit(F&& f) {
+        uint64_t ticket;
+        Slot* slots;
+        size_t cap;
+        int stride;
+        obtainBlockingPopTicket(ticket, slots, cap, stride);
+        visitWithTicketBase(ticket, slots, cap, stride, f);
+    }
+
+    /// Visits like read reads: returns false if that would block
+    template <typename F>
+    bool tryVisit(F&& f) {
+        uint64_t ticket;
+        Slot* slots;
+        size_t cap;
+        int stride;
+        if (tryObtainReadyPopTicket(ticket, slots, cap, stride)) {
+            visitWithTicketBase(ticket, slots, cap, stride, f);
+            return true;
+        }
+        return false;
+    }
+
+    template <class Clock, typename F>
+    bool tryVisitUntil(const std::chrono::time_point<Clock>& when, F&& f) {
+        uint64_t ticket;
+        Slot* slots;
+        size_t cap;
+        int stride;
+        if (tryObtainPromisedPopTicketUntil(ticket, slots, cap, stride, when)) {
+            visitWithTicketBase(ticket, slots, cap, stride, f);
+            return true;
+        }
+        return false;
+    }
+
+    template <class Rep, class Period, typename F>
+    bool tryVisitFor(const std::chrono::duration<Rep, Period>& duration,
+            F&& f) {
+        return tryVisitUntil(std::chrono::steady_clock::now() +
+                std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    duration), std::forward<F>(f));
+    }
+
+    /// Enqueues every element of [first, last), blocking as needed.  The
+    /// whole range is reserved with a single fetch_add on _pushTicket, so
+    /// the elements occupy consecutive tickets and are read in order.
+    /// Pass std::make_move_iterator to move the elements in.  The range is
+    /// walked twice, once to size it, so it must be a forward range.
+    template <typename ForwardIt>
+    void blockingWriteBatch(ForwardIt first, ForwardIt last) noexcept {
+        static_assert(detail::IsForwardIterator<ForwardIt>::value,
+                "blockingWriteBatch needs a forward iterator");
+        if (Dynamic) {
+            for (; first != last; ++first) {
+                blockingWrite(*first);
+            }
+            return;
+        }
+        const uint64_t n = std::distance(first, last);
+        uint64_t ticket = _pushTicket.fetch_add(n);
+        for (; first != last; ++first, ++ticket) {
+            enqueueWithTicketBase(ticket, _slots, _capacity, 0, *first);
+        }
+    }
+
+    /// Enqueues as many elements from the front of [first, last) as fit,
+    /// and returns how many that was.  Like writeIfNotFull the free slots
+    /// are claimed with a single CAS, and may still be in the middle of a
+    /// pop that we have to wait for.  Like blockingWriteBatch it needs a
+    /// forward range.
+    template <typename ForwardIt>
+    size_t writeBatch(ForwardIt first, ForwardIt last) noexcept {
+        static_assert(detail::IsForwardIterator<ForwardIt>::value,
+                "writeBatch needs a forward iterator");
+        size_t written = 0;
+        if (Dynamic) {
+            for (; first != last && writeIfNotFull(*first); ++first) {
+                ++written;
             }
+            return written;
+        }
+        uint64_t ticket;
+        written = tryObtainPromisedPushTickets(ticket, std::distance(first, last));
+        for (size_t i = 0; i < written; ++i, ++first, ++ticket) {
+            enqueueWithTicketBase(ticket, _slots, _capacity, 0, *first);
+        }
+        return written;
+    }
+
+    /// Dequeues n elements into the n elements starting at out, blocking
+    /// as needed.  Claims all n tickets with a single fetch_add.
+    template <typename ForwardIt>
+    void blockingReadBatch(ForwardIt out, size_t n) noexcept {
+        if (Dynamic) {
+            for (size_t i = 0; i < n; ++i, ++out) {
+                blockingRead(*out);
+            }
+            return;
+        }
+        uint64_t ticket = _popTicket.fetch_add(n);
+        for (size_t i = 0; i < n; ++i, ++out, ++ticket) {
+            dequeueWithTicketBase(ticket, _slots, _capacity, 0, *out);
         }
-        return bestStride;
+    }
+
+    /// Dequeues up to maxN elements that have already been (or are being)
+    /// enqueued into the elements starting at out, and returns how many.
+    /// Claims them with a single CAS on _popTicket.
+    template <typename ForwardIt>
+    size_t readBatch(ForwardIt out, size_t maxN) noexcept {
+        size_t numRead = 0;
+        if (Dynamic) {
+            uint64_t ticket;
+            Slot* slots;
+            size_t cap;
+            int stride;
+            for (; numRead < maxN &&
+                    tryObtainPromisedPopTicket(ticket, slots, cap, stride);
+                    ++numRead, ++out) {
+                dequeueWithTicketBase(ticket, slots, cap, stride, *out);
+            }
+            return numRead;
+        }
+        uint64_t ticket;
+        numRead = tryObtainPromisedPopTickets(ticket, maxN);
+        for (size_t i = 0; i < numRead; ++i, ++out, ++ticket) {
+            dequeueWithTicketBase(ticket, _slots, _capacity, 0, *out);
+        }
+        return numRead;
+    }
+
+    /// Consumer micro-batching: waits until at least one element is
+    /// available or when has passed, then takes whatever else is already
+    /// there, up to maxN in total.  Returns the number of elements read,
+    /// 0 only on timeout.
+    template <typename ForwardIt, class Clock>
+    size_t readUpTo(ForwardIt out, size_t maxN,
+            const std::chrono::time_point<Clock>& when) noexcept {
+        if (maxN == 0) {
+            return 0;
+        }
+        size_t numRead = readBatch(out, maxN);
+        if (numRead > 0) {
+            return numRead;
+        }
+        if (!tryReadUntil(when, *out)) {
+            return 0;
+        }
+        return 1 + readBatch(++out, maxN - 1);
+    }
+
+    /// Ticket access for MPMCPipeline (mpmc_pipeline.h), fixed capacity
+    /// only.  Like blockingRead, and returns the ticket elem was read with
+    template <bool D = Dynamic, typename = typename std::enable_if<!D>::type>
+    uint64_t blockingReadWithTicket(T& elem) noexcept {
+        uint64_t ticket = _popTicket++;
+        dequeueWithTicketBase(ticket, _slots, _capacity, 0, elem);
+        return ticket;
+    }
+
+    /// Like read, and sets ticket to the ticket elem was read with
+    template <bool D = Dynamic, typename = typename std::enable_if<!D>::type>
+    bool readAndGetTicket(uint64_t& ticket, T& elem) noexcept {
+        Slot* slots;
+        size_t cap;
+        int stride;
+        if (tryObtainReadyPopTicket(ticket, slots, cap, stride)) {
+            dequeueWithTicketBase(ticket, slots, cap, stride, elem);
+            return true;
+        }
+        return false;
+    }
+
+    /// Writes with a push ticket chosen by the caller rather than taken
+    /// from _pushTicket, blocking until the slot has been emptied by the
+    /// read of ticket - capacity.  Readers still see the elements in
+    /// ticket order.  Every ticket must be written exactly once, and a
+    /// queue written this way must not be written any other way; its
+    /// size() is meaningless
+    template <typename... Args,
+              bool D = Dynamic, typename = typename std::enable_if<!D>::type>
+    void writeWithTicket(uint64_t ticket, Args&&... args) noexcept {
+        enqueueWithTicketBase(ticket, _slots, _capacity, 0,
+                std::forward<Args>(args)...);
+    }
+
+    /// Push tickets handed out so far
+    uint64_t writeCount() const noexcept {
+        return _pushTicket.load(std::memory_order_acquire);
+    }
+
+    /// Pop tickets handed out so far
+    uint64_t readCount() const noexcept {
+        return _popTicket.load(std::memory_order_acquire);
+    }
+
+private:
+    MPMCQueue(size_t const capacity,
+            size_t const minCapacity,
+            size_t const expansionMultiplier,
+            Allocator const& allocator,
+            int) :
+        _capacityPolicy(capacity),
+        _capacity(_capacityPolicy.capacity()),
+        _allocator(allocator),
+        _slots(nullptr),
+        _dstate(0),
+        _dcapacity(0),
+        _dslots(nullptr),
+        _dstride(0),
+        _dmult(0),
+        _closed(nullptr),
+        _pushTicket(0),
+        _popTicket(0),
+        _pushSpinCutoff(0),
+        _popSpinCutoff(0) {
+        if (!Dynamic) {
+            _slots = allocateSlots(_capacity);
+            return;
+        }
+        size_t cap = std::min<size_t>(std::max<size_t>(1, minCapacity), capacity);
+        _dmult = std::max<size_t>(2, expansionMultiplier);
+        size_t maxClosed = 0;
+        for (size_t expanded = cap; expanded < capacity; expanded *= _dmult) {
+            ++maxClosed;
+        }
+        // the count of closed arrays has to fit in _dstate
+        if (2 * maxClosed >= (1u << kSeqlockBits)) {
+            throw std::invalid_argument(
+                    "DynamicMPMCQueue: too many expansions, raise "
+                    "minCapacity or expansionMultiplier");
+        }
+        _closed = maxClosed > 0 ? new ClosedArray[maxClosed] : nullptr;
+        try {
+            _dslots.store(allocateSlots(cap));
+        } catch (...) {
+            delete[] _closed;
+            throw;
+        }
+        _dcapacity.store(cap);
+        _dstride.store(detail::computeStride(cap));
+    }
+
+    /// Allocates and constructs a slot array for cap elements, plus
+    /// kSlotPadding slots on each side.  SplitSlots arrays also get their
+    /// cap elements, from the allocator rebound to Slot::Payload
+    Slot* allocateSlots(size_t cap) {
+        const size_t n = cap + 2 * kSlotPadding;
+        Slot* slots = _allocator.allocate(n);
+        for (size_t i = 0; i < n; ++i) {
+            new (&slots[i]) Slot();
+        }
+        try {
+            attachPayloads(slots, cap, SplitPayload());
+        } catch (...) {
+            destroySlots(slots, n);
+            throw;
+        }
+        return slots;
+    }
+
+    void deallocateSlots(Slot* slots, size_t cap) noexcept {
+        const size_t n = cap + 2 * kSlotPadding;
+        auto payloads = slots[kSlotPadding].payload();
+        destroySlots(slots, n);
+        detachPayloads(payloads, cap, SplitPayload());
+    }
+
+    using SplitPayload = std::integral_constant<bool, Slot::kSplitPayload>;
+
+    void attachPayloads(Slot*, size_t, std::false_type) noexcept {}
+
+    void attachPayloads(Slot* slots, size_t cap, std::true_type) {
+        using PayloadAllocator = typename std::allocator_traits<Allocator>::
+            template rebind_alloc<typename Slot::Payload>;
+        PayloadAllocator alloc(_allocator);
+        auto payloads = alloc.allocate(cap);
+        for (size_t i = 0; i < cap; ++i) {
+            slots[kSlotPadding + i].attachPayload(&payloads[i]);
+        }
+    }
+
+    void detachPayloads(typename Slot::Payload*, size_t,
+            std::false_type) noexcept {}
+
+    void detachPayloads(typename Slot::Payload* payloads, size_t cap,
+            std::true_type) noexcept {
+        using PayloadAllocator = typename std::allocator_traits<Allocator>::
+            template rebind_alloc<typename Slot::Payload>;
+        PayloadAllocator alloc(_allocator);
+        alloc.deallocate(payloads, cap);
+    }
+
+    /// Runs the slot destructors, which destroy any elements still queued,
+    /// and frees the slot array
+    void destroySlots(Slot* slots, size_t n) noexcept {
+        for (size_t i = 0; i < n; ++i) {
+            slots[i].~Slot();
+        }
+        _allocator.deallocate(slots, n);
     }
 
     /// Returns the index into _slots that should be used when enqueuing or
-    /// dequeuing with the specified ticket
+    /// dequeuing with the specified ticket.  cap and stride describe a
+    /// dynamic queue's array; the fixed array is laid out by _capacityPolicy
+    /// and ignores them
     size_t idx(uint64_t ticket, size_t cap, int stride) noexcept {
+        if (!Dynamic) {
+            return _capacityPolicy.template index<kSpreadBits>(ticket) +
+                kSlotPadding;
+        }
         return ((ticket * stride) % cap) + kSlotPadding;
     }
 
     /// Maps an enqueue or dequeue ticket to the turn should be used at the
     /// corresponding SingleElementQueue
-    uint32_t turn(uint64_t ticket, size_t cap) noexcept {
+    uint64_t turn(uint64_t ticket, size_t cap) noexcept {
+        if (!Dynamic) {
+            return _capacityPolicy.turn(ticket);
+        }
         assert(cap != 0);
-        return uint32_t(ticket / cap);
+        return ticket / cap;
     }
 
     /// Tries to obtain a push ticket for which SingleElementQueue::enqueue
@@ -229,10 +981,13 @@ private:
     /// failure.
     bool tryObtainReadyPushTicket(
             uint64_t& ticket, Slot*& slots, size_t& cap, int& stride) noexcept {
+        if (Dynamic) {
+            return dynamicTryObtainReadyPushTicket(ticket, slots, cap, stride);
+        }
         ticket = _pushTicket.load(std::memory_order_acquire); // A
         slots = _slots;
         cap = _capacity;
-        stride = _stride;
+        stride = 0;
         while (true) {
             if (!slots[idx(ticket, cap, stride)].mayEnqueue(turn(ticket, cap))) {
                 // if we call enqueue(ticket, ...) on the SingleElementQueue
@@ -253,6 +1008,7 @@ private:
                 if (_pushTicket.compare_exchange_strong(ticket, ticket + 1)) {
                     return true;
                 }
+                _stats.add(QueueStat::PUSH_TICKET_CAS_RETRIES);
             }
         }
     }
@@ -282,7 +1038,8 @@ private:
                         turn(ticket, cap),
                         _pushSpinCutoff,
                         (ticket % kAdaptationFreq) == 0,
-                        when);
+                        when,
+                        sequencerCounters(_stats));
           }
           return false;
       }
@@ -294,16 +1051,19 @@ private:
     /// pop has not yet completed).
     bool tryObtainPromisedPushTicket(
             uint64_t& ticket, Slot*& slots, size_t& cap, int& stride) noexcept {
+        if (Dynamic) {
+            return dynamicTryObtainPromisedPushTicket(ticket, slots, cap, stride);
+        }
         auto numPushes = _pushTicket.load(std::memory_order_acquire); // A
         slots = _slots;
         cap = _capacity;
-        stride = _stride;
+        stride = 0;
         while (true) {
             ticket = numPushes;
             const auto numPops = _popTicket.load(std::memory_order_acquire); // B
             // n will be negative if pops are pending
             const int64_t n = int64_t(numPushes - numPops);
-            if (n >= static_cast<ssize_t>(_capacity)) {
+            if (n >= static_cast<ssize_t>(capacity())) {
                 // Full, linearize at B.  We don't need to recheck the read we
                 // performed at A, because if numPushes was stale at B then the
                 // real numPushes value is even worse
@@ -312,6 +1072,47 @@ private:
             if (_pushTicket.compare_exchange_strong(numPushes, numPushes + 1)) {
                 return true;
             }
+            _stats.add(QueueStat::PUSH_TICKET_CAS_RETRIES);
+        }
+    }
+
+    /// Fixed capacity only.  Claims up to n consecutive push tickets, each
+    /// of which satisfies tryObtainPromisedPushTicket, with a single CAS.
+    /// Returns the number claimed, starting at ticket.
+    size_t tryObtainPromisedPushTickets(uint64_t& ticket, size_t n) noexcept {
+        auto numPushes = _pushTicket.load(std::memory_order_acquire); // A
+        while (true) {
+            const auto numPops = _popTicket.load(std::memory_order_acquire); // B
+            // n will be negative if pops are pending
+            const int64_t size = int64_t(numPushes - numPops);
+            const int64_t free = static_cast<int64_t>(capacity()) - size;
+            if (free <= 0 || n == 0) {
+                return 0;
+            }
+            const size_t k = std::min(n, size_t(free));
+            if (_pushTicket.compare_exchange_strong(numPushes, numPushes + k)) {
+                ticket = numPushes;
+                return k;
+            }
+            _stats.add(QueueStat::PUSH_TICKET_CAS_RETRIES);
+        }
+    }
+
+    /// Fixed capacity only.  Claims up to n consecutive pop tickets whose
+    /// push tickets have been handed out, with a single CAS.
+    size_t tryObtainPromisedPopTickets(uint64_t& ticket, size_t n) noexcept {
+        auto numPops = _popTicket.load(std::memory_order_acquire); // A
+        while (true) {
+            const auto numPushes = _pushTicket.load(std::memory_order_acquire); // B
+            if (numPops >= numPushes || n == 0) {
+                return 0;
+            }
+            const size_t k = std::min<uint64_t>(n, numPushes - numPops);
+            if (_popTicket.compare_exchange_strong(numPops, numPops + k)) {
+                ticket = numPops;
+                return k;
+            }
+            _stats.add(QueueStat::POP_TICKET_CAS_RETRIES);
         }
     }
 
@@ -320,10 +1121,13 @@ private:
     /// failure.
     bool tryObtainReadyPopTicket(
             uint64_t& ticket, Slot*& slots, size_t& cap, int& stride) noexcept {
+        if (Dynamic) {
+            return dynamicTryObtainReadyPopTicket(ticket, slots, cap, stride);
+        }
         ticket = _popTicket.load(std::memory_order_acquire);
         slots = _slots;
         cap = _capacity;
-        stride = _stride;
+        stride = 0;
         while (true) {
             if (!slots[idx(ticket, cap, stride)].mayDequeue(turn(ticket, cap))) {
                 auto prev = ticket;
@@ -335,6 +1139,7 @@ private:
                 if (_popTicket.compare_exchange_strong(ticket, ticket + 1)) {
                     return true;
                 }
+                _stats.add(QueueStat::POP_TICKET_CAS_RETRIES);
             }
         }
     }
@@ -362,9 +1167,10 @@ private:
               deadlineReached =
                 !slots[idx(ticket, cap, stride)].tryWaitForDequeueTurnUntil(
                         turn(ticket, cap),
-                        _pushSpinCutoff,
+                        _popSpinCutoff,
                         (ticket % kAdaptationFreq) == 0,
-                        when);
+                        when,
+                        sequencerCounters(_stats));
           }
           return false;
       }
@@ -381,10 +1187,13 @@ private:
     /// MPMCQueue itself.
     bool tryObtainPromisedPopTicket(
             uint64_t& ticket, Slot*& slots, size_t& cap, int& stride) noexcept {
+        if (Dynamic) {
+            return dynamicTryObtainPromisedPopTicket(ticket, slots, cap, stride);
+        }
         auto numPops = _popTicket.load(std::memory_order_acquire); // A
         slots = _slots;
         cap = _capacity;
-        stride = _stride;
+        stride = 0;
         while (true) {
             ticket = numPops;
             const auto numPushes = _pushTicket.load(std::memory_order_acquire); // B
@@ -397,21 +1206,323 @@ private:
             if (_popTicket.compare_exchange_strong(numPops, numPops + 1)) {
                 return true;
             }
+            _stats.add(QueueStat::POP_TICKET_CAS_RETRIES);
+        }
+    }
+
+    /// Dynamic only.  Reads the current array and _dstate inside a seqlock
+    /// read section.  Returns false if an expansion is in progress or
+    /// completed concurrently, in which case the caller should retry.
+    bool trySeqlockReadSection(
+            uint64_t& state, Slot*& slots, size_t& cap, int& stride) noexcept {
+        state = _dstate.load(std::memory_order_acquire);
+        if (state & 1) {
+            // Locked.
+            return false;
+        }
+        // Start read-only section.
+        slots = _dslots.load(std::memory_order_relaxed);
+        cap = _dcapacity.load(std::memory_order_relaxed);
+        stride = _dstride.load(std::memory_order_relaxed);
+        // End of read-only section. Validate seqlock.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return state == _dstate.load(std::memory_order_relaxed);
+    }
+
+    static uint64_t getOffset(const uint64_t state) noexcept {
+        return state >> kSeqlockBits;
+    }
+
+    static int getNumClosed(const uint64_t state) noexcept {
+        return (state & ((1 << kSeqlockBits) - 1)) >> 1;
+    }
+
+    /// Dynamic only.  Given state from trySeqlockReadSection and the array
+    /// it describes, finds the array that ticket belongs to.  On return
+    /// offset is that array's first ticket.  Returns true if ticket
+    /// belongs to a closed array.
+    bool maybeUpdateFromClosed(
+            const uint64_t state,
+            const uint64_t ticket,
+            uint64_t& offset,
+            Slot*& slots,
+            size_t& cap,
+            int& stride) noexcept {
+        offset = getOffset(state);
+        if (ticket >= offset) {
+            return false;
+        }
+        for (int i = getNumClosed(state) - 1; i >= 0; --i) {
+            offset = _closed[i].offset;
+            if (offset <= ticket) {
+                slots = _closed[i].slots;
+                cap = _closed[i].capacity;
+                stride = _closed[i].stride;
+                return true;
+            }
+        }
+        // A closed array with offset <= ticket should have been found
+        assert(false);
+        return false;
+    }
+
+    /// Dynamic only.  Tries to replace the current array (whose capacity is
+    /// cap, as observed in state) with one _dmult times larger.  Returns
+    /// true if this or another thread expanded the queue, so the caller
+    /// should reload its view; false if the queue is already at capacity
+    /// or allocation failed.
+    bool tryExpand(const uint64_t state, const size_t cap) noexcept {
+        if (cap == _capacity) {
+            return false;
+        }
+        // Acquire seqlock
+        uint64_t oldval = state;
+        assert((state & 1) == 0);
+        if (!_dstate.compare_exchange_strong(oldval, state + 1)) {
+            // Someone acquired the seqlock or finished an expansion. Go back
+            // to the caller and get up-to-date info.
+            return true;
+        }
+        assert(cap == _dcapacity.load());
+        // Every ticket issued so far (push or pop) stays in the arrays it
+        // was issued against.  Tickets issued from here on and resolved
+        // after we release the seqlock may land in the new array; callers
+        // always resolve a ticket after obtaining it, so the mapping a
+        // producer and consumer see for the same ticket is identical.
+        uint64_t ticket = std::max(_pushTicket.load(), _popTicket.load());
+        size_t newCapacity = std::min(_dmult * cap, _capacity);
+        Slot* newSlots = nullptr;
+        try {
+            newSlots = allocateSlots(newCapacity);
+        } catch (const std::bad_alloc&) {
+        }
+        if (newSlots == nullptr) {
+            // Expansion failed. Restore the seqlock
+            _dstate.store(state);
+            return false;
+        }
+        int index = getNumClosed(state);
+        _closed[index].offset = getOffset(state);
+        _closed[index].slots = _dslots.load();
+        _closed[index].capacity = cap;
+        _closed[index].stride = _dstride.load();
+        _dslots.store(newSlots);
+        _dcapacity.store(newCapacity);
+        _dstride.store(detail::computeStride(newCapacity));
+        // Release the seqlock and record the new ticket offset
+        _dstate.store((ticket << kSeqlockBits) + 2 * (index + 1),
+                std::memory_order_release);
+        return true;
+    }
+
+    /// Dynamic only.  Maps an already issued ticket to its array and
+    /// rewrites it relative to that array's offset.
+    void resolveTicket(
+            uint64_t& ticket, Slot*& slots, size_t& cap, int& stride) noexcept {
+        uint64_t state;
+        uint64_t offset;
+        while (!trySeqlockReadSection(state, slots, cap, stride)) {
+            asm_volatile_pause();
+        }
+        maybeUpdateFromClosed(state, ticket, offset, slots, cap, stride);
+        ticket -= offset;
+    }
+
+    bool dynamicTryObtainReadyPushTicket(
+            uint64_t& ticket, Slot*& slots, size_t& cap, int& stride) noexcept {
+        uint64_t state;
+        uint64_t offset;
+        while (true) {
+            ticket = _pushTicket.load(std::memory_order_acquire); // A
+            auto numPops = _popTicket.load(std::memory_order_acquire);
+            // Elements in closed arrays count against capacity too
+            if (int64_t(ticket - numPops) >= static_cast<ssize_t>(_capacity)) {
+                return false;
+            }
+            if (!trySeqlockReadSection(state, slots, cap, stride)) {
+                asm_volatile_pause();
+                continue;
+            }
+            // If consumers were ahead of producers at the last expansion,
+            // the next few push tickets still belong to a closed array
+            bool closed =
+                maybeUpdateFromClosed(state, ticket, offset, slots, cap, stride);
+            if (slots[idx(ticket - offset, cap, stride)].mayEnqueue(
+                        turn(ticket - offset, cap))) {
+                // A slot is ready.
+                if (_pushTicket.compare_exchange_strong(ticket, ticket + 1)) {
+                    // An expansion racing with the CAS can only move this
+                    // ticket to the head of a fresh array, which won't block
+                    resolveTicket(ticket, slots, cap, stride);
+                    return true;
+                }
+                _stats.add(QueueStat::PUSH_TICKET_CAS_RETRIES);
+                continue;
+            }
+            if (ticket != _pushTicket.load(std::memory_order_relaxed)) { // B
+                // Try again. Ticket changed.
+                continue;
+            }
+            // Likely to be full. Try to expand. A closed array is waiting
+            // for an in-progress pop, expanding again wouldn't help.
+            if (closed || !tryExpand(state, cap)) {
+                // Can't expand.
+                return false;
+            }
+            // This or another thread started an expansion. Get updated info.
+        }
+    }
+
+    bool dynamicTryObtainPromisedPushTicket(
+            uint64_t& ticket, Slot*& slots, size_t& cap, int& stride) noexcept {
+        uint64_t state;
+        uint64_t offset;
+        while (true) {
+            ticket = _pushTicket.load(std::memory_order_acquire);
+            auto numPops = _popTicket.load(std::memory_order_acquire);
+            if (!trySeqlockReadSection(state, slots, cap, stride)) {
+                asm_volatile_pause();
+                continue;
+            }
+            // Elements in closed arrays count against capacity too.  The
+            // caller waits for the slot the pop capacity tickets back
+            // frees, as the ticket of that slot's next lap
+            if (int64_t(ticket - numPops) >= static_cast<ssize_t>(_capacity)) {
+                ticket -= _capacity;
+                resolveTicket(ticket, slots, cap, stride);
+                ticket += cap;
+                return false;
+            }
+            // If there was an expansion with offset greater than this ticket,
+            // adjust accordingly
+            bool closed =
+                maybeUpdateFromClosed(state, ticket, offset, slots, cap, stride);
+
+            // Only count pops that belong to this ticket's array
+            const int64_t n = int64_t(ticket - std::max(numPops, offset));
+            if (n >= static_cast<ssize_t>(cap)) {
+                if (!closed && tryExpand(state, cap)) {
+                    // This or another thread started an expansion. Start over.
+                    continue;
+                }
+                // Can't expand.
+                ticket -= offset;
+                return false;
+            }
+            if (_pushTicket.compare_exchange_strong(ticket, ticket + 1)) {
+                resolveTicket(ticket, slots, cap, stride);
+                return true;
+            }
+            _stats.add(QueueStat::PUSH_TICKET_CAS_RETRIES);
+        }
+    }
+
+    bool dynamicTryObtainReadyPopTicket(
+            uint64_t& ticket, Slot*& slots, size_t& cap, int& stride) noexcept {
+        uint64_t state;
+        uint64_t offset;
+        while (true) {
+            ticket = _popTicket.load(std::memory_order_relaxed);
+            if (!trySeqlockReadSection(state, slots, cap, stride)) {
+                asm_volatile_pause();
+                continue;
+            }
+            // If there was an expansion after the corresponding push ticket
+            // was issued, adjust accordingly
+            maybeUpdateFromClosed(state, ticket, offset, slots, cap, stride);
+            if (!slots[idx(ticket - offset, cap, stride)].mayDequeue(
+                        turn(ticket - offset, cap))) {
+                return false;
+            }
+            if (_popTicket.compare_exchange_strong(ticket, ticket + 1)) {
+                resolveTicket(ticket, slots, cap, stride);
+                return true;
+            }
+            _stats.add(QueueStat::POP_TICKET_CAS_RETRIES);
+        }
+    }
+
+    bool dynamicTryObtainPromisedPopTicket(
+            uint64_t& ticket, Slot*& slots, size_t& cap, int& stride) noexcept {
+        uint64_t state;
+        uint64_t offset;
+        while (true) {
+            ticket = _popTicket.load(std::memory_order_acquire);
+            auto numPushes = _pushTicket.load(std::memory_order_acquire);
+            if (!trySeqlockReadSection(state, slots, cap, stride)) {
+                asm_volatile_pause();
+                continue;
+            }
+            // If there was an expansion after the corresponding push
+            // ticket was issued, adjust accordingly
+            maybeUpdateFromClosed(state, ticket, offset, slots, cap, stride);
+            if (ticket >= numPushes) {
+                ticket -= offset;
+                return false;
+            }
+            if (_popTicket.compare_exchange_strong(ticket, ticket + 1)) {
+                resolveTicket(ticket, slots, cap, stride);
+                return true;
+            }
+            _stats.add(QueueStat::POP_TICKET_CAS_RETRIES);
+        }
+    }
+
+    /// The push ticket of blockingWrite.  A dynamic queue expands if it
+    /// can, and otherwise waits in line like the fixed queue does
+    void obtainBlockingPushTicket(
+            uint64_t& ticket, Slot*& slots, size_t& cap, int& stride) noexcept {
+        if (!Dynamic) {
+            ticket = _pushTicket++;
+            slots = _slots;
+            cap = _capacity;
+            stride = 0;
+        } else if (!tryObtainPromisedPushTicket(ticket, slots, cap, stride)) {
+            // fully grown and full
+            ticket = _pushTicket++;
+            if (ticket >= _capacity) {
+                // The pop capacity tickets back may be in a closed array,
+                // where our own slot's turn doesn't wait for it
+                uint64_t prev = ticket - _capacity;
+                resolveTicket(prev, slots, cap, stride);
+                slots[idx(prev, cap, stride)].tryWaitForEnqueueTurnUntil(
+                        turn(prev, cap) + 1,
+                        _pushSpinCutoff,
+                        false,
+                        std::chrono::steady_clock::time_point::max(),
+                        sequencerCounters(_stats));
+            }
+            resolveTicket(ticket, slots, cap, stride);
+        }
+    }
+
+    /// The pop ticket of blockingRead
+    void obtainBlockingPopTicket(
+            uint64_t& ticket, Slot*& slots, size_t& cap, int& stride) noexcept {
+        ticket = _popTicket++;
+        slots = _slots;
+        cap = _capacity;
+        stride = 0;
+        if (Dynamic) {
+            resolveTicket(ticket, slots, cap, stride);
         }
     }
 
     // Given a ticket, constructs an enqueued item using args
+    template <typename... Args>
     void enqueueWithTicketBase(
             uint64_t ticket,
             Slot* slots,
             size_t cap,
             int stride,
-            const T& val) noexcept {
+            Args&&... args) noexcept {
         slots[idx(ticket, cap, stride)].enqueue(
                 turn(ticket, cap),
                 _pushSpinCutoff,
                 (ticket % kAdaptationFreq) == 0,
-                val);
+                sequencerCounters(_stats),
+                std::forward<Args>(args)...);
+        _readiness.notify();
     }
     void dequeueWithTicketBase(
             uint64_t ticket, Slot* slots, size_t cap, int stride, T& elem) noexcept {
@@ -420,9 +1531,46 @@ private:
                 turn(ticket, cap),
                 _popSpinCutoff,
                 (ticket % kAdaptationFreq) == 0,
+                sequencerCounters(_stats),
                 elem);
     }
 
+    // Given a ticket, waits for its slot to be empty and hands it to r
+    void reserveWithTicketBase(uint64_t ticket, Slot* slots, size_t cap,
+            int stride, Reservation& r) noexcept {
+        // an uncommitted reservation would block its readers forever
+        assert(r._slot == nullptr);
+        r._slot = &slots[idx(ticket, cap, stride)];
+        r._turn = turn(ticket, cap);
+        r._storage = r._slot->beginEnqueue(
+                r._turn,
+                _pushSpinCutoff,
+                (ticket % kAdaptationFreq) == 0,
+                sequencerCounters(_stats));
+    }
+
+    /// Ends the dequeue of a visit, also when the visitor throws
+    struct VisitGuard {
+        Slot& slot;
+        uint64_t turn;
+        QueueStatsCounters* stats;
+
+        ~VisitGuard() { slot.endDequeue(turn, stats); }
+    };
+
+    template <typename F>
+    void visitWithTicketBase(
+            uint64_t ticket, Slot* slots, size_t cap, int stride, F& f) {
+        assert(cap != 0);
+        VisitGuard guard{slots[idx(ticket, cap, stride)], turn(ticket, cap),
+            sequencerCounters(_stats)};
+        f(guard.slot.beginDequeue(
+                    guard.turn,
+                    _popSpinCutoff,
+                    (ticket % kAdaptationFreq) == 0,
+                    guard.stats));
+    }
+
 private:
     enum {
         /// Once every kAdaptationFreq we will spin longer, to try to estimate
@@ -433,15 +1581,49 @@ private:
         /// allocations, we pad it with this many SingleElementQueue-s at
         /// each end
         kSlotPadding =
-          (hardware_destructive_interference_size - 1) / sizeof(Slot) + 1
+          (hardware_destructive_interference_size - 1) / sizeof(Slot) + 1,
+
+        /// The fixed array is spread so that 2^kSpreadBits consecutive
+        /// tickets use different cache lines
+        kSpreadBits = log2Floor(nextPowTwo(kSlotPadding)),
+
+        /// Low bits of _dstate used by the dynamic expansion seqlock
+        kSeqlockBits = 6,
+
+        /// Dynamic queues constructed without explicit sizing start with
+        /// this many slots and grow by this factor
+        kDefaultMinDynamicCapacity = 10,
+        kDefaultExpansionMultiplier = 10
+    };
+
+    /// A backing array retired by a dynamic expansion.  Tickets in
+    /// [offset, next closed array's offset) map to it
+    struct ClosedArray {
+        uint64_t offset{0};
+        Slot* slots{nullptr};
+        size_t capacity{0};
+        int stride{0};
     };
 
-    alignas(hardware_destructive_interference_size) size_t _capacity;
+    alignas(hardware_destructive_interference_size) Capacity _capacityPolicy;
+    size_t _capacity;
 
     Allocator _allocator;
     Slot* _slots;
 
-    int _stride;
+    /// Dynamic only: seqlock + ticket offset, and the current backing array
+    std::atomic<uint64_t> _dstate;
+    std::atomic<size_t> _dcapacity;
+    std::atomic<Slot*> _dslots;
+    std::atomic<int> _dstride;
+    size_t _dmult;
+    ClosedArray* _closed;
+
+    /// Sharded per-thread, so counting doesn't contend on its own
+    QueueCounters _stats;
+
+    /// Written only by threads in readAny, read by every enqueue
+    alignas(hardware_destructive_interference_size) ReadinessEvent _readiness;
 
     /// Enqueuers get tickets from here
     alignas(hardware_destructive_interference_size) std::atomic<uint64_t> _pushTicket;
@@ -463,4 +1645,27 @@ private:
     char _pad[hardware_destructive_interference_size - sizeof(std::atomic<uint32_t>)];
 };
 
+/// Growable MPMCQueue, see the Dynamic template parameter of MPMCQueue
+template <typename T,
+          typename Allocator = std::allocator<SingleElementQueue<T>>>
+using DynamicMPMCQueue = MPMCQueue<T, Allocator, true>;
+
+/// MPMCQueue whose slots use WideTurnSequencer: for queues that expect many
+/// more blocked producers or consumers than they have slots
+template <typename T,
+          typename Capacity = RuntimeCapacity>
+using WideMPMCQueue = MPMCQueue<T,
+      std::allocator<SingleElementQueue<T, WideTurnSequencer>>, false,
+      Capacity>;
+
+/// MPMCQueue with the given slot layout (DenseSlots, IsolatedSlots or
+/// SplitSlots).  AlignedAllocator is needed for IsolatedSlots, whose slots
+/// are more aligned than operator new guarantees
+template <typename T,
+          typename Layout,
+          typename Capacity = RuntimeCapacity>
+using LayoutMPMCQueue = MPMCQueue<T,
+      AlignedAllocator<SingleElementQueue<T, TurnSequencer, Layout>>, false,
+      Capacity>;
+
 };  //namespace myfolly
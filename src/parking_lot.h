@@ -0,0 +1,210 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <utility>
+
+#include "detail/parking_lot.h"
+
+namespace myfolly {
+
+enum class ParkResult {
+    Skip,       /* toPark returned false, the thread didn't park */
+    Unpark,     /* unparked by unpark() */
+    Timeout,    /* the deadline passed first */
+};
+
+/// What unpark's callback wants done with the node it was shown
+enum class UnparkControl {
+    RetainContinue,
+    RemoveContinue,
+    RetainBreak,
+    RemoveBreak,
+};
+
+/// A ParkingLot lets threads block on an arbitrary address, whatever lives
+/// there: a 64-bit ticket, a word that isn't an atomic<uint32_t>, or
+/// nothing at all.  Parked threads are kept in a global hash table of a
+/// thousand-odd buckets keyed by address, each with its own lock, and every
+/// parked thread sleeps on a futex of its own, so unpark wakes exactly the
+/// threads it removes.
+///
+/// park(key, data, toPark, preWait) locks the bucket of key and calls
+/// toPark().  If it returns false park returns Skip; otherwise the thread
+/// is queued with data, the bucket is unlocked, preWait() runs, and the
+/// thread sleeps until unparked (or the deadline of parkUntil passes).
+///
+/// unpark(key, func) locks the bucket and calls func(data) for every thread
+/// parked on key, oldest first; its UnparkControl says whether to wake and
+/// remove that thread and whether to look at the next one.  Data lets the
+/// unparker pick: a thread waiting for turn t can park with data t, and
+/// completing turn t - 1 then wakes only that thread.
+///
+/// Wakeups can't be lost: whoever changes the state that toPark() checks
+/// and then calls unpark either finds the thread parked, or the thread's
+/// toPark() sees the change.  unpark skips the bucket lock when nobody is
+/// parked in the bucket.
+///
+/// Different ParkingLot objects never see each other's threads, even on
+/// the same key.
+template <typename Data = uint64_t>
+class ParkingLot {
+public:
+    ParkingLot() : _lotId(detail::nextParkingLotId()) {}
+
+    ParkingLot(const ParkingLot&) = delete;
+    ParkingLot& operator=(const ParkingLot&) = delete;
+
+    template <typename D, typename ToPark, typename PreWait>
+    ParkResult park(const void* key,
+            D&& data,
+            ToPark&& toPark,
+            PreWait&& preWait) {
+        return parkUntil(key, std::forward<D>(data),
+                std::forward<ToPark>(toPark), std::forward<PreWait>(preWait),
+                std::chrono::steady_clock::time_point::max());
+    }
+
+    template <typename D, typename ToPark, typename PreWait,
+             class Clock, class Duration>
+    ParkResult parkUntil(const void* key,
+            D&& data,
+            ToPark&& toPark,
+            PreWait&& preWait,
+            const std::chrono::time_point<Clock, Duration>& deadline) {
+        const uint64_t k = keyOf(key);
+        auto& bucket = detail::ParkingLotBucket::forKey(k);
+        Node node(k, _lotId, std::forward<D>(data));
+
+        // Counted before toPark() looks at the state, so an unparker that
+        // changed the state and then reads a zero count knows toPark()
+        // will see the change
+        bucket.count.fetch_add(1, std::memory_order_seq_cst);
+        {
+            std::lock_guard<std::mutex> lock(bucket.mutex);
+            if (!std::forward<ToPark>(toPark)()) {
+                bucket.count.fetch_sub(1, std::memory_order_relaxed);
+                return ParkResult::Skip;
+            }
+            bucket.push(&node);
+        }
+        std::forward<PreWait>(preWait)();
+
+        if (node.wait(deadline)) {
+            return ParkResult::Unpark;
+        }
+        std::lock_guard<std::mutex> lock(bucket.mutex);
+        if (node.unparked()) {
+            // lost the race against unpark, which is done with the node
+            // since it wakes under the bucket lock
+            return ParkResult::Unpark;
+        }
+        bucket.erase(&node);
+        bucket.count.fetch_sub(1, std::memory_order_relaxed);
+        return ParkResult::Timeout;
+    }
+
+    /// func is called as func(const Data&) and returns an UnparkControl
+    template <typename Func>
+    void unpark(const void* key, Func&& func) {
+        const uint64_t k = keyOf(key);
+        auto& bucket = detail::ParkingLotBucket::forKey(k);
+        // pairs with the fetch_add in parkUntil; the caller's change to the
+        // waited-on state may be relaxed
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (bucket.count.load(std::memory_order_seq_cst) == 0) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(bucket.mutex);
+        for (detail::WaitNode* n = bucket.head(); n != nullptr;) {
+            detail::WaitNode* next = n->next;
+            if (n->key == k && n->lotId == _lotId) {
+                auto* node = static_cast<Node*>(n);
+                UnparkControl control =
+                    func(static_cast<const Data&>(node->data));
+                if (control == UnparkControl::RemoveContinue ||
+                        control == UnparkControl::RemoveBreak) {
+                    bucket.erase(node);
+                    bucket.count.fetch_sub(1, std::memory_order_relaxed);
+                    node->wake();
+                }
+                if (control == UnparkControl::RetainBreak ||
+                        control == UnparkControl::RemoveBreak) {
+                    return;
+                }
+            }
+            n = next;
+        }
+    }
+
+private:
+    struct Node : public detail::WaitNode {
+        template <typename D>
+        Node(uint64_t key, uint64_t lotId, D&& d) :
+            WaitNode(key, lotId), data(std::forward<D>(d)) {}
+
+        Data data;
+    };
+
+    static uint64_t keyOf(const void* key) noexcept {
+        return reinterpret_cast<uintptr_t>(key);
+    }
+
+    const uint64_t _lotId;
+};
+
+namespace detail {
+
+/// The lot behind atomicWait and atomicNotify*
+inline ParkingLot<>& atomicWaitParkingLot() {
+    static ParkingLot<> lot;
+    return lot;
+}
+
+} // namespace detail
+
+/// Blocks while *atomic == expected.  Works for any lock-free std::atomic,
+/// including 64-bit ones that can't be passed to futexWait.  The thread
+/// that changes *atomic must call atomicNotifyOne/All afterwards
+template <typename Integer>
+void atomicWait(const std::atomic<Integer>* atomic, Integer expected) {
+    while (atomic->load(std::memory_order_acquire) == expected) {
+        detail::atomicWaitParkingLot().park(atomic, uint64_t(0),
+                [&] { return atomic->load(std::memory_order_seq_cst) == expected; },
+                [] {});
+    }
+}
+
+/// Like atomicWait, but returns false if *atomic still equals expected
+/// once deadline has passed
+template <typename Integer, class Clock, class Duration>
+bool atomicWaitUntil(const std::atomic<Integer>* atomic,
+        Integer expected,
+        const std::chrono::time_point<Clock, Duration>& deadline) {
+    while (atomic->load(std::memory_order_acquire) == expected) {
+        auto result = detail::atomicWaitParkingLot().parkUntil(atomic,
+                uint64_t(0),
+                [&] { return atomic->load(std::memory_order_seq_cst) == expected; },
+                [] {},
+                deadline);
+        if (result == ParkResult::Timeout) {
+            return atomic->load(std::memory_order_acquire) != expected;
+        }
+    }
+    return true;
+}
+
+template <typename Integer>
+void atomicNotifyOne(const std::atomic<Integer>* atomic) {
+    detail::atomicWaitParkingLot().unpark(atomic,
+            [](const uint64_t&) { return UnparkControl::RemoveBreak; });
+}
+
+template <typename Integer>
+void atomicNotifyAll(const std::atomic<Integer>* atomic) {
+    detail::atomicWaitParkingLot().unpark(atomic,
+            [](const uint64_t&) { return UnparkControl::RemoveContinue; });
+}
+
+} // namespace myfolly
@@ -1,6 +1,11 @@
 #pragma once
 
 #include <cstddef>
+#include <new>
+#include <thread>
+#include <utility>
+#include <stdint.h>
+#include <stdlib.h>
 
 // detection for 64 bit
 #if defined(__x86_64__) || defined(_M_X64)
@@ -40,3 +45,69 @@ constexpr bool kIsArchAArch64 = (FOLLY_AARCH64 == 1);
 constexpr bool kIsArchPPC64 = (FOLLY_PPC64 == 1);
 constexpr bool kIsArchS390X = (FOLLY_S390X == 1);
 } // namespace myfolly
+
+namespace myfolly {
+
+/// Hint to the CPU that we are in a spin-wait loop, so that it can back off
+/// the pipeline and yield resources to a sibling hyperthread
+inline void asm_volatile_pause() {
+#if FOLLY_X64
+    asm volatile("pause");
+#elif FOLLY_AARCH64 || FOLLY_ARM
+    asm volatile("yield");
+#elif FOLLY_PPC64
+    asm volatile("or 27,27,27");
+#endif
+}
+
+/// spins, or 0 when there is a single CPU: spinning only helps if the
+/// thread we wait for runs on another one
+inline int spinLimitIfMultiCpu(int spins) noexcept {
+    static const bool multiCpu = std::thread::hardware_concurrency() > 1;
+    return multiCpu ? spins : 0;
+}
+
+/// Returns a cheap, monotonically increasing cycle counter.  Only meaningful
+/// on x86_64 (rdtsc), elsewhere it returns 0 and callers must count loop
+/// iterations instead (see kIsArchAmd64)
+inline uint64_t hardware_timestamp() {
+#if FOLLY_X64
+    uint32_t lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return (uint64_t(hi) << 32) | lo;
+#else
+    return 0;
+#endif
+}
+
+namespace detail {
+
+/// new for over-aligned types, which plain new doesn't honor before C++17.
+/// Free the result with alignedDelete
+template <typename T, typename... Args>
+T* alignedNew(Args&&... args) {
+    constexpr size_t align =
+        alignof(T) > sizeof(void*) ? alignof(T) : sizeof(void*);
+    void* mem = nullptr;
+    if (posix_memalign(&mem, align, sizeof(T)) != 0) {
+        throw std::bad_alloc();
+    }
+    try {
+        return new (mem) T(std::forward<Args>(args)...);
+    } catch (...) {
+        free(mem);
+        throw;
+    }
+}
+
+template <typename T>
+void alignedDelete(T* p) noexcept {
+    if (p != nullptr) {
+        p->~T();
+        free(p);
+    }
+}
+
+} // namespace detail
+
+} // namespace myfolly
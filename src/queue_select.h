@@ -0,0 +1,126 @@
+#pragma once
+
+#include <chrono>
+#include <type_traits>
+#include <vector>
+#include <stddef.h>
+
+#include "detail/queue_readiness.h"
+
+namespace myfolly {
+
+/// Reading from whichever of several queues has an element, for threads
+/// that service many queues (select/poll for MPMCQueues).  Queue is any
+/// queue with read(T&) and readinessEvent(), i.e. MPMCQueue and its
+/// aliases; all queues must have the same type.
+///
+///   size_t i = readAny(queues, n, elem);   // elem came from *queues[i]
+///
+/// readAny polls every queue once and only then registers with their
+/// ReadinessEvents and blocks, on all of them with one futex_waitv where
+/// the kernel has it (Linux 5.16+) and on a process-wide eventcount
+/// otherwise.  While nobody blocks, producers pay one extra load per
+/// write; while someone does, every write to a watched queue bumps the
+/// queue's epoch and makes a futex wake syscall.
+///
+/// Queues are polled starting after the one that last delivered, so a
+/// busy queue doesn't starve the others.
+
+namespace detail {
+
+template <typename Queue, typename T>
+size_t pollQueues(Queue* const* queues, size_t n, size_t start, T& elem) {
+    for (size_t k = 0; k < n; ++k) {
+        size_t i = (start + k) % n;
+        if (queues[i]->read(elem)) {
+            return i;
+        }
+    }
+    return n;
+}
+
+template <typename Queue, typename T>
+size_t tryReadAnyImpl(Queue* const* queues,
+        size_t n,
+        T& elem,
+        std::chrono::system_clock::time_point const* absSystemTime,
+        std::chrono::steady_clock::time_point const* absSteadyTime) {
+    static thread_local size_t start = 0;
+    size_t i = pollQueues(queues, n, start, elem);
+    if (i != n || n == 0) {
+        start = i + 1;
+        return i;
+    }
+
+    std::vector<ReadinessEvent*> events(n);
+    for (size_t k = 0; k < n; ++k) {
+        events[k] = &queues[k]->readinessEvent();
+    }
+    ReadinessWaitSet waitSet(events.data(), n);
+    size_t hint = start;
+    while (true) {
+        waitSet.snapshot();
+        i = pollQueues(queues, n, hint, elem);
+        if (i != n) {
+            start = i + 1;
+            return i;
+        }
+        if (waitSet.wait(absSystemTime, absSteadyTime, &hint) ==
+                FutexResult::TIMEDOUT) {
+            return pollQueues(queues, n, start, elem);
+        }
+    }
+}
+
+template <typename Queue, typename T>
+size_t tryReadAnyDeadline(Queue* const* queues,
+        size_t n,
+        T& elem,
+        std::chrono::system_clock::time_point const& absTime) {
+    return tryReadAnyImpl(queues, n, elem, &absTime, nullptr);
+}
+
+template <typename Queue, typename T>
+size_t tryReadAnyDeadline(Queue* const* queues,
+        size_t n,
+        T& elem,
+        std::chrono::steady_clock::time_point const& absTime) {
+    return tryReadAnyImpl(queues, n, elem, nullptr, &absTime);
+}
+
+} // namespace detail
+
+/// Blocks until it has read an element from one of queues[0..n) and
+/// returns the index of that queue
+template <typename Queue, typename T>
+size_t readAny(Queue* const* queues, size_t n, T& elem) {
+    return detail::tryReadAnyImpl(queues, n, elem, nullptr, nullptr);
+}
+
+/// Like readAny, but returns n if nothing could be read before when
+template <typename Queue, typename T, class Clock>
+size_t tryReadAnyUntil(Queue* const* queues,
+        size_t n,
+        T& elem,
+        const std::chrono::time_point<Clock>& when) {
+    using Target = typename std::conditional<
+        Clock::is_steady,
+        std::chrono::steady_clock,
+        std::chrono::system_clock>::type;
+    if (when == std::chrono::time_point<Clock>::max()) {
+        return detail::tryReadAnyImpl(queues, n, elem, nullptr, nullptr);
+    }
+    return detail::tryReadAnyDeadline(queues, n, elem,
+            detail::time_point_conv<Target>(when));
+}
+
+template <typename Queue, typename T, class Rep, class Period>
+size_t tryReadAnyFor(Queue* const* queues,
+        size_t n,
+        T& elem,
+        const std::chrono::duration<Rep, Period>& duration) {
+    return tryReadAnyUntil(queues, n, elem,
+            std::chrono::steady_clock::now() + duration);
+}
+
+} // namespace myfolly
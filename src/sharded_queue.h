@@ -0,0 +1,210 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <sched.h>
+
+#include "mpmc_queue.h"
+#include "portability.h"
+#include "queue_select.h"
+
+namespace myfolly {
+
+/// How ShardedQueue picks a thread's home shard
+enum class ShardSelection {
+    /// The CPU the thread is running on (sched_getcpu), so that threads on
+    /// one core share a shard's cache lines.  Falls back to Thread where
+    /// sched_getcpu fails
+    Cpu,
+    /// An id handed out to each thread on first use.  Costs nothing per
+    /// operation, but a thread keeps its shard when it migrates
+    Thread,
+};
+
+namespace detail {
+
+inline size_t shardThreadId() noexcept {
+    static std::atomic<size_t> next{0};
+    static thread_local size_t id = next.fetch_add(1,
+            std::memory_order_relaxed);
+    return id;
+}
+
+} // namespace detail
+
+/// A relaxed-FIFO MPMC queue made of numShards independent queues, so
+/// that producers and consumers on different cores don't all hit the same
+/// two ticket counters.  Queue is MPMCQueue (the default) or BoundedQueue.
+///
+/// Each thread has a home shard (see ShardSelection).  Writers try their
+/// home shard first and spill to the others when it is full; readers take
+/// from their home shard first and steal from the others when it is
+/// empty.  Elements written by one thread to one shard are read in order,
+/// but there is no order across shards, and with Cpu selection a thread
+/// that migrates may change shards between two writes.
+///
+/// blockingRead and tryReadUntil wait on all shards at once (readAny from
+/// queue_select.h), so a reader is woken by a write to any shard.  A
+/// blockingWrite that finds every shard full waits on its home shard only.
+///
+/// numShards defaults to the number of hardware threads; every shard has
+/// shardCapacity slots.
+template <typename T, typename Queue = MPMCQueue<T>>
+class ShardedQueue {
+public:
+    explicit ShardedQueue(size_t shardCapacity,
+            size_t numShards = 0,
+            ShardSelection selection = ShardSelection::Cpu) :
+        _selection(selection) {
+        if (numShards == 0) {
+            numShards = std::max(1u, std::thread::hardware_concurrency());
+        }
+        _shards.reserve(numShards);
+        try {
+            for (size_t i = 0; i < numShards; ++i) {
+                // shards are over-aligned
+                _shards.push_back(detail::alignedNew<Queue>(shardCapacity));
+                // readAny waits on it, and BoundedQueue only notifies once
+                // asked for it
+                _shards.back()->readinessEvent();
+            }
+        } catch (...) {
+            destroyShards();
+            throw;
+        }
+    }
+
+    ~ShardedQueue() noexcept { destroyShards(); }
+
+    // non-copyable and non-movable
+    ShardedQueue(const ShardedQueue&) = delete;
+    ShardedQueue& operator=(const ShardedQueue&) = delete;
+
+    size_t numShards() const noexcept { return _shards.size(); }
+
+    Queue& shard(size_t i) noexcept { return *_shards[i]; }
+
+    /// The calling thread's home shard
+    size_t homeShard() const noexcept {
+        if (_selection == ShardSelection::Cpu) {
+            int cpu = sched_getcpu();
+            if (cpu >= 0) {
+                return size_t(cpu) % _shards.size();
+            }
+        }
+        return detail::shardThreadId() % _shards.size();
+    }
+
+    /// The total capacity of all shards
+    size_t capacity() const noexcept {
+        return _shards[0]->capacity() * _shards.size();
+    }
+
+    /// The sum of the shards' sizes, which are read one after the other
+    ssize_t size() const noexcept {
+        ssize_t total = 0;
+        for (auto* q : _shards) {
+            total += ssize_t(q->size());
+        }
+        return total;
+    }
+
+    bool isEmpty() const noexcept { return size() <= 0; }
+
+    /// Returns false only if every shard was full
+    template <typename... Args>
+    bool write(Args&&... args) noexcept {
+        return writeFrom(homeShard(), std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    void blockingWrite(Args&&... args) noexcept {
+        size_t home = homeShard();
+        if (!writeFrom(home, std::forward<Args>(args)...)) {
+            _shards[home]->blockingWrite(std::forward<Args>(args)...);
+        }
+    }
+
+    /// Returns false only if every shard was empty
+    bool read(T& elem) noexcept {
+        return readFrom(homeShard(), elem);
+    }
+
+    void blockingRead(T& elem) noexcept {
+        if (_shards.size() == 1) {
+            _shards[0]->blockingRead(elem);
+            return;
+        }
+        size_t home = homeShard();
+        for (int i = 0; i < kPollRounds; ++i) {
+            if (readFrom(home, elem)) {
+                return;
+            }
+            std::this_thread::yield();
+        }
+        readAny(_shards.data(), _shards.size(), elem);
+    }
+
+    template <class Clock>
+    bool tryReadUntil(const std::chrono::time_point<Clock>& when,
+            T& elem) noexcept {
+        return read(elem) ||
+            tryReadAnyUntil(_shards.data(), _shards.size(), elem, when) !=
+                _shards.size();
+    }
+
+    template <class Rep, class Period>
+    bool tryReadFor(const std::chrono::duration<Rep, Period>& duration,
+            T& elem) noexcept {
+        return tryReadUntil(std::chrono::steady_clock::now() + duration, elem);
+    }
+
+private:
+    /// Polling rounds before a blocked reader registers with readAny.  A
+    /// registered reader makes every write to any shard wake it until it
+    /// gets to run, so it pays to let the producers run first
+    static constexpr int kPollRounds = 16;
+
+    /// A write that fails doesn't consume its arguments, so they can be
+    /// passed on to the next shard
+    template <typename... Args>
+    bool writeFrom(size_t home, Args&&... args) noexcept {
+        const size_t n = _shards.size();
+        for (size_t k = 0; k < n; ++k) {
+            size_t i = home + k < n ? home + k : home + k - n;
+            if (_shards[i]->write(std::forward<Args>(args)...)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool readFrom(size_t home, T& elem) noexcept {
+        const size_t n = _shards.size();
+        for (size_t k = 0; k < n; ++k) {
+            size_t i = home + k < n ? home + k : home + k - n;
+            if (_shards[i]->read(elem)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void destroyShards() noexcept {
+        for (auto* q : _shards) {
+            detail::alignedDelete(q);
+        }
+        _shards.clear();
+    }
+
+private:
+    const ShardSelection _selection;
+    std::vector<Queue*> _shards;
+};
+
+};  //namespace myfolly
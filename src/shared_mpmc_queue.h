@@ -0,0 +1,395 @@
+#pragma once
+
+#include <chrono>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "capacity_policy.h"
+#include "detail/shared_queue.h"
+#include "detail/turn_sequencer.h"
+#include "mpmc_queue.h"
+
+namespace myfolly {
+
+/// A fixed-capacity MPMCQueue that lives in memory shared between
+/// processes: a POSIX shared memory object or a memory-mapped file.  One
+/// process creates the queue, the others open it by name:
+///
+///   auto q = SharedMPMCQueue<Packet>::createShm("/capture", 4096);
+///   ...
+///   auto q = SharedMPMCQueue<Packet>::openShm("/capture");  // elsewhere
+///   q.blockingWrite(packet);
+///
+/// The region starts with a versioned header (detail::SharedQueueHeader)
+/// followed by the slots; it contains offsets rather than pointers, so each
+/// process may map it at a different address, and opening a region made
+/// for another element type or by an incompatible version throws.  The
+/// slots use SharedTurnSequencer, whose futexes are process-shared.  T
+/// must be trivially copyable since elements are handed between address
+/// spaces as bytes.
+///
+/// A SharedMPMCQueue object is one process's handle on the queue: it owns
+/// the mapping and may be used by any number of that process's threads.
+/// Don't use it in a child after fork(); open a new handle there.
+///
+/// A process that dies inside an operation may hold a ticket that nobody
+/// will complete, which would block its partners forever.  Handles
+/// therefore record that they are inside an operation in the header, and
+/// operations that make no progress for kLivenessCheckMs look for peers
+/// that died that way.  If there is one the queue is marked broken: from
+/// then on every operation fails (blocking ones return false) and the
+/// queue has to be recreated.  Peers that die between operations leave
+/// the queue intact.
+template <typename T>
+class SharedMPMCQueue {
+    static_assert(std::is_trivially_copyable<T>::value,
+            "T must be trivially copyable to be shared between processes");
+
+public:
+    using Slot = SingleElementQueue<T, SharedTurnSequencer>;
+
+    enum {
+        /// How long an operation waits without progress before it checks
+        /// for dead peers
+        kLivenessCheckMs = 100
+    };
+
+    /// Bytes of shared memory a queue of capacity elements needs
+    static size_t regionSize(size_t capacity) noexcept {
+        return slotsOffset() + (capacity + 2 * kSlotPadding) * sizeof(Slot);
+    }
+
+    /// Creates the shared memory object name (see shm_open; it must not
+    /// exist yet) and a queue in it.  Throws std::system_error
+    static SharedMPMCQueue createShm(const std::string& name, size_t capacity) {
+        return create(
+                detail::SharedRegion::createShm(name, regionSize(capacity)),
+                capacity);
+    }
+
+    /// Opens a queue created by createShm.  Throws std::system_error, or
+    /// std::runtime_error if the header doesn't match this queue type
+    static SharedMPMCQueue openShm(const std::string& name) {
+        return open(detail::SharedRegion::openShm(name));
+    }
+
+    /// Like createShm and openShm with a regular file, e.g. on a tmpfs
+    static SharedMPMCQueue createFile(const std::string& path, size_t capacity) {
+        return create(
+                detail::SharedRegion::createFile(path, regionSize(capacity)),
+                capacity);
+    }
+
+    static SharedMPMCQueue openFile(const std::string& path) {
+        return open(detail::SharedRegion::openFile(path));
+    }
+
+    static void unlinkShm(const std::string& name) {
+        detail::SharedRegion::unlinkShm(name);
+    }
+
+    SharedMPMCQueue(SharedMPMCQueue&& other) noexcept :
+        _region(std::move(other._region)),
+        _header(other._header),
+        _slots(other._slots),
+        _peer(other._peer),
+        _capacityPolicy(other._capacityPolicy) {
+        other._header = nullptr;
+        other._slots = nullptr;
+        other._peer = nullptr;
+    }
+
+    SharedMPMCQueue& operator=(SharedMPMCQueue&&) = delete;
+    SharedMPMCQueue(const SharedMPMCQueue&) = delete;
+    SharedMPMCQueue& operator=(const SharedMPMCQueue&) = delete;
+
+    ~SharedMPMCQueue() {
+        if (_peer != nullptr) {
+            detail::unregisterSharedQueuePeer(_peer);
+        }
+    }
+
+    size_t capacity() const noexcept { return _capacityPolicy.capacity(); }
+
+    ssize_t size() const noexcept {
+        uint64_t pushes = _header->pushTicket.load(std::memory_order_acquire);
+        uint64_t pops = _header->popTicket.load(std::memory_order_acquire);
+        while (true) {
+            uint64_t nextPushes =
+                _header->pushTicket.load(std::memory_order_acquire);
+            if (pushes == nextPushes) {
+                return ssize_t(pushes - pops);
+            }
+            pushes = nextPushes;
+            uint64_t nextPops =
+                _header->popTicket.load(std::memory_order_acquire);
+            if (pops == nextPops) {
+                return ssize_t(pushes - pops);
+            }
+            pops = nextPops;
+        }
+    }
+
+    bool isEmpty() const noexcept { return size() <= 0; }
+
+    bool isFull() const noexcept {
+        return size() >= static_cast<ssize_t>(capacity());
+    }
+
+    /// Whether a peer died inside an operation, see the class comment
+    bool isBroken() const noexcept {
+        return _header->broken.load(std::memory_order_acquire) != 0;
+    }
+
+    /// Writes elem if there is room right now
+    bool write(const T& elem) noexcept {
+        if (isBroken()) {
+            return false;
+        }
+        OperationGuard guard(_peer);
+        uint64_t ticket;
+        if (!tryObtainReadyTicket(_header->pushTicket, ticket, false)) {
+            return false;
+        }
+        slot(ticket).enqueue(_capacityPolicy.turn(ticket),
+                _header->pushSpinCutoff, false, nullptr, elem);
+        return true;
+    }
+
+    /// Waits for room and writes elem.  Returns false only if the queue
+    /// is (or became) broken
+    bool blockingWrite(const T& elem) noexcept {
+        if (isBroken()) {
+            return false;
+        }
+        OperationGuard guard(_peer);
+        uint64_t ticket = _header->pushTicket++;
+        Slot& s = slot(ticket);
+        uint64_t turn = _capacityPolicy.turn(ticket);
+        auto forever = std::chrono::steady_clock::time_point::max();
+        if (!waitForTurn(s, turn, ticket, false, forever)) {
+            return false;
+        }
+        s.enqueue(turn, _header->pushSpinCutoff, false, nullptr, elem);
+        return true;
+    }
+
+    template <class Clock>
+    bool tryWriteUntil(const std::chrono::time_point<Clock>& when,
+            const T& elem) noexcept {
+        while (true) {
+            if (write(elem)) {
+                return true;
+            }
+            if (isBroken() || Clock::now() >= when) {
+                return false;
+            }
+            OperationGuard guard(_peer);
+            uint64_t ticket = _header->pushTicket.load(std::memory_order_acquire);
+            if (!waitForTurn(slot(ticket), _capacityPolicy.turn(ticket),
+                        ticket, false, when)) {
+                return false;
+            }
+        }
+    }
+
+    template <class Rep, class Period>
+    bool tryWriteFor(const std::chrono::duration<Rep, Period>& duration,
+            const T& elem) noexcept {
+        return tryWriteUntil(std::chrono::steady_clock::now() + duration, elem);
+    }
+
+    /// Reads an element if one is ready right now
+    bool read(T& elem) noexcept {
+        if (isBroken()) {
+            return false;
+        }
+        OperationGuard guard(_peer);
+        uint64_t ticket;
+        if (!tryObtainReadyTicket(_header->popTicket, ticket, true)) {
+            return false;
+        }
+        slot(ticket).dequeue(_capacityPolicy.turn(ticket),
+                _header->popSpinCutoff, false, nullptr, elem);
+        return true;
+    }
+
+    /// Waits for an element and reads it.  Returns false only if the queue
+    /// is (or became) broken
+    bool blockingRead(T& elem) noexcept {
+        if (isBroken()) {
+            return false;
+        }
+        OperationGuard guard(_peer);
+        uint64_t ticket = _header->popTicket++;
+        Slot& s = slot(ticket);
+        uint64_t turn = _capacityPolicy.turn(ticket);
+        auto forever = std::chrono::steady_clock::time_point::max();
+        if (!waitForTurn(s, turn, ticket, true, forever)) {
+            return false;
+        }
+        s.dequeue(turn, _header->popSpinCutoff, false, nullptr, elem);
+        return true;
+    }
+
+    template <class Clock>
+    bool tryReadUntil(const std::chrono::time_point<Clock>& when,
+            T& elem) noexcept {
+        while (true) {
+            if (read(elem)) {
+                return true;
+            }
+            if (isBroken() || Clock::now() >= when) {
+                return false;
+            }
+            OperationGuard guard(_peer);
+            uint64_t ticket = _header->popTicket.load(std::memory_order_acquire);
+            if (!waitForTurn(slot(ticket), _capacityPolicy.turn(ticket),
+                        ticket, true, when)) {
+                return false;
+            }
+        }
+    }
+
+    template <class Rep, class Period>
+    bool tryReadFor(const std::chrono::duration<Rep, Period>& duration,
+            T& elem) noexcept {
+        return tryReadUntil(std::chrono::steady_clock::now() + duration, elem);
+    }
+
+private:
+    enum {
+        /// Once every kAdaptationFreq we will spin longer, to try to estimate
+        /// the proper spin backoff
+        kAdaptationFreq = 128,
+
+        /// Padding slots at each end of the array, as in MPMCQueue
+        kSlotPadding =
+          (hardware_destructive_interference_size - 1) / sizeof(Slot) + 1,
+
+        kSpreadBits = log2Floor(nextPowTwo(kSlotPadding))
+    };
+
+    /// Keeps the handle's inFlight count raised for the duration of an
+    /// operation (see detail::SharedQueuePeer)
+    class OperationGuard {
+    public:
+        explicit OperationGuard(detail::SharedQueuePeer* peer) noexcept :
+            _peer(peer) {
+            _peer->inFlight.fetch_add(1, std::memory_order_seq_cst);
+        }
+
+        ~OperationGuard() {
+            _peer->inFlight.fetch_sub(1, std::memory_order_release);
+        }
+
+    private:
+        detail::SharedQueuePeer* _peer;
+    };
+
+    static constexpr size_t slotsOffset() noexcept {
+        return (sizeof(detail::SharedQueueHeader) +
+                hardware_destructive_interference_size - 1) /
+            hardware_destructive_interference_size *
+            hardware_destructive_interference_size;
+    }
+
+    static detail::SharedQueueLayout layout() noexcept {
+        return detail::SharedQueueLayout{sizeof(Slot), sizeof(T), alignof(T)};
+    }
+
+    static SharedMPMCQueue create(detail::SharedRegion region,
+            size_t capacity) {
+        auto header = static_cast<detail::SharedQueueHeader*>(region.data());
+        const size_t numSlots = capacity + 2 * kSlotPadding;
+        detail::initSharedQueueHeader(header, layout(), capacity, numSlots,
+                slotsOffset(), region.size());
+        Slot* slots = reinterpret_cast<Slot*>(
+                static_cast<char*>(region.data()) + slotsOffset());
+        for (size_t i = 0; i < numSlots; ++i) {
+            new (&slots[i]) Slot();
+        }
+        header->state.store(detail::SharedQueueHeader::kReady,
+                std::memory_order_release);
+        return SharedMPMCQueue(std::move(region));
+    }
+
+    static SharedMPMCQueue open(detail::SharedRegion region) {
+        detail::validateSharedQueueHeader(
+                static_cast<detail::SharedQueueHeader*>(region.data()),
+                layout(), region.size());
+        return SharedMPMCQueue(std::move(region));
+    }
+
+    explicit SharedMPMCQueue(detail::SharedRegion&& region) :
+        _region(std::move(region)),
+        _header(static_cast<detail::SharedQueueHeader*>(_region.data())),
+        _slots(reinterpret_cast<Slot*>(
+                    static_cast<char*>(_region.data()) + _header->slotsOffset)),
+        _peer(detail::registerSharedQueuePeer(_header)),
+        _capacityPolicy(_header->capacity) {}
+
+    Slot& slot(uint64_t ticket) noexcept {
+        return _slots[_capacityPolicy.template index<kSpreadBits>(ticket) +
+            kSlotPadding];
+    }
+
+    /// As MPMCQueue::tryObtainReadyPushTicket and tryObtainReadyPopTicket
+    bool tryObtainReadyTicket(std::atomic<uint64_t>& dispenser,
+            uint64_t& ticket, bool dequeue) noexcept {
+        ticket = dispenser.load(std::memory_order_acquire);
+        while (true) {
+            uint64_t turn = _capacityPolicy.turn(ticket);
+            Slot& s = slot(ticket);
+            if (!(dequeue ? s.mayDequeue(turn) : s.mayEnqueue(turn))) {
+                auto prev = ticket;
+                ticket = dispenser.load(std::memory_order_acquire);
+                if (prev == ticket) {
+                    return false;
+                }
+            } else if (dispenser.compare_exchange_strong(ticket, ticket + 1)) {
+                return true;
+            }
+        }
+    }
+
+    /// Waits until when for ticket's enqueue (or dequeue) turn in s, in
+    /// slices of kLivenessCheckMs between which it checks for dead peers.
+    /// Returns false on timeout or if the queue is broken
+    template <class Clock>
+    bool waitForTurn(Slot& s, uint64_t turn, uint64_t ticket, bool dequeue,
+            const std::chrono::time_point<Clock>& when) noexcept {
+        const bool updateSpinCutoff = (ticket % kAdaptationFreq) == 0;
+        auto& spinCutoff = dequeue ?
+            _header->popSpinCutoff : _header->pushSpinCutoff;
+        while (true) {
+            auto sliceEnd = Clock::now() +
+                std::chrono::duration_cast<typename Clock::duration>(
+                        std::chrono::milliseconds(kLivenessCheckMs));
+            const bool lastSlice = !(sliceEnd < when);
+            const std::chrono::time_point<Clock> deadline =
+                lastSlice ? when : sliceEnd;
+            bool ready = dequeue ?
+                s.tryWaitForDequeueTurnUntil(
+                        turn, spinCutoff, updateSpinCutoff, deadline) :
+                s.tryWaitForEnqueueTurnUntil(
+                        turn, spinCutoff, updateSpinCutoff, deadline);
+            if (ready) {
+                return true;
+            }
+            if (detail::checkSharedQueuePeers(_header) || lastSlice) {
+                return false;
+            }
+        }
+    }
+
+    detail::SharedRegion _region;
+    detail::SharedQueueHeader* _header;
+    Slot* _slots;
+    detail::SharedQueuePeer* _peer;
+    RuntimeCapacity _capacityPolicy;
+};
+
+};  //namespace myfolly
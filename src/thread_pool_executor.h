@@ -0,0 +1,196 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "lifo_sem.h"
+#include "mpmc_queue.h"
+
+namespace myfolly {
+
+/// A move-only void() callable for executors.  Callables of up to
+/// kInlineSize bytes that are nothrow move constructible live inside the
+/// Task, so wrapping a lambda with a few captures doesn't allocate; larger
+/// ones are moved to the heap.  A default-constructed Task is empty.
+/// A Task is 64 bytes: the ops pointer, padded to the storage's alignment,
+/// and the storage.
+class Task {
+public:
+    static constexpr size_t kInlineSize = 64 -
+        (alignof(std::max_align_t) > sizeof(void*) ?
+         alignof(std::max_align_t) : sizeof(void*));
+
+    Task() noexcept = default;
+
+    template <typename F,
+             typename = typename std::enable_if<!std::is_same<
+                 typename std::decay<F>::type, Task>::value>::type>
+    /* implicit */ Task(F&& f) {
+        using Fn = typename std::decay<F>::type;
+        init<Fn>(std::forward<F>(f),
+                std::integral_constant<bool, fitsInline<Fn>()>());
+    }
+
+    Task(Task&& other) noexcept : _ops(other._ops) {
+        if (_ops != nullptr) {
+            _ops->move(&_storage, &other._storage);
+            other._ops = nullptr;
+        }
+    }
+
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            reset();
+            _ops = other._ops;
+            if (_ops != nullptr) {
+                _ops->move(&_storage, &other._storage);
+                other._ops = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    ~Task() { reset(); }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    explicit operator bool() const noexcept { return _ops != nullptr; }
+
+    /// Whether the callable lives inside the Task
+    bool isInline() const noexcept { return _ops != nullptr && _ops->inlined; }
+
+    void operator()() { _ops->invoke(&_storage); }
+
+    void reset() noexcept {
+        if (_ops != nullptr) {
+            _ops->destroy(&_storage);
+            _ops = nullptr;
+        }
+    }
+
+private:
+    struct Ops {
+        void (*invoke)(void* storage);
+        /// Moves the callable from src to dst and destroys what's left
+        /// in src
+        void (*move)(void* dst, void* src) noexcept;
+        void (*destroy)(void* storage) noexcept;
+        bool inlined;
+    };
+
+    using Storage = typename std::aligned_storage<kInlineSize,
+          alignof(std::max_align_t)>::type;
+
+    template <typename Fn>
+    static constexpr bool fitsInline() {
+        return sizeof(Fn) <= kInlineSize &&
+            alignof(Fn) <= alignof(std::max_align_t) &&
+            std::is_nothrow_move_constructible<Fn>::value;
+    }
+
+    template <typename Fn>
+    struct InlineOps {
+        static void invoke(void* s) { (*static_cast<Fn*>(s))(); }
+
+        static void move(void* dst, void* src) noexcept {
+            new (dst) Fn(std::move(*static_cast<Fn*>(src)));
+            static_cast<Fn*>(src)->~Fn();
+        }
+
+        static void destroy(void* s) noexcept { static_cast<Fn*>(s)->~Fn(); }
+
+        static constexpr Ops ops{&invoke, &move, &destroy, true};
+    };
+
+    template <typename Fn>
+    struct HeapOps {
+        static Fn*& ptr(void* s) { return *static_cast<Fn**>(s); }
+
+        static void invoke(void* s) { (*ptr(s))(); }
+
+        static void move(void* dst, void* src) noexcept {
+            new (dst) Fn*(ptr(src));
+        }
+
+        static void destroy(void* s) noexcept { delete ptr(s); }
+
+        static constexpr Ops ops{&invoke, &move, &destroy, false};
+    };
+
+    template <typename Fn, typename F>
+    void init(F&& f, std::true_type) {
+        new (&_storage) Fn(std::forward<F>(f));
+        _ops = &InlineOps<Fn>::ops;
+    }
+
+    template <typename Fn, typename F>
+    void init(F&& f, std::false_type) {
+        new (&_storage) Fn*(new Fn(std::forward<F>(f)));
+        _ops = &HeapOps<Fn>::ops;
+    }
+
+    const Ops* _ops{nullptr};
+    Storage _storage;
+};
+
+static_assert(sizeof(Task) == 64, "Task should be 64 bytes");
+
+template <typename Fn>
+constexpr Task::Ops Task::InlineOps<Fn>::ops;
+
+template <typename Fn>
+constexpr Task::Ops Task::HeapOps<Fn>::ops;
+
+/// Runs Tasks on a fixed number of threads.  Tasks go through one
+/// MPMCQueue<Task>; every add() posts a LifoSem, so an idle worker is
+/// woken only when there is a task for it, and it is the one that went
+/// idle last.  Under light load the same worker runs task after task with
+/// a warm cache while the rest of the pool stays asleep.
+///
+/// add() blocks while the queue is full (queueCapacity tasks).  join()
+/// lets the workers finish every task added before it and then stops
+/// them; tasks may not be added after join().  The destructor joins.
+/// Exceptions thrown by tasks are swallowed.
+class ThreadPoolExecutor {
+public:
+    static constexpr size_t kDefaultQueueCapacity = 1 << 14;
+
+    /// numThreads 0 means one per hardware thread
+    explicit ThreadPoolExecutor(size_t numThreads,
+            size_t queueCapacity = kDefaultQueueCapacity);
+
+    ~ThreadPoolExecutor();
+
+    ThreadPoolExecutor(const ThreadPoolExecutor&) = delete;
+    ThreadPoolExecutor& operator=(const ThreadPoolExecutor&) = delete;
+
+    /// Throws std::logic_error after join() and std::invalid_argument for
+    /// an empty task
+    void add(Task task);
+
+    void join();
+
+    size_t numThreads() const noexcept { return _threads.size(); }
+
+    /// Tasks added but not yet picked up by a worker
+    ssize_t pendingTasks() const noexcept { return _tasks->size(); }
+
+private:
+    using TaskQueue = MPMCQueue<Task>;
+
+    void run() noexcept;
+
+    /// Over-aligned, so allocated with detail::alignedNew
+    TaskQueue* _tasks;
+    LifoSem _sem;
+    std::vector<std::thread> _threads;
+    std::atomic<bool> _joined{false};
+};
+
+};  // namespace myfolly
@@ -0,0 +1,381 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "capacity_policy.h"
+#include "detail/epoch_reclamation.h"
+#include "detail/turn_sequencer.h"
+#include "mpmc_queue.h"
+#include "portability.h"
+
+namespace myfolly {
+
+/// An MPMC queue without a capacity limit.  Elements live in a linked list
+/// of segments of 2^SegmentBits SingleElementQueue slots; tickets are
+/// handed out as in MPMCQueue, and ticket t uses slot t % 2^SegmentBits of
+/// the segment that starts at t rounded down.
+///
+/// Writes never wait: the slot a producer's ticket names is always free,
+/// and a producer that runs off the end of the list appends a segment.
+/// blockingRead waits for its element in the slot's TurnSequencer, i.e.
+/// spins and then parks on its futex like MPMCQueue.
+///
+/// head and tail point at the segments consumers and producers currently
+/// use.  A segment is retired once both have moved past it and all of its
+/// elements have been read (its pending count reaches zero); it then goes
+/// through epoch-based reclamation (detail/epoch_reclamation.h), which
+/// protects the threads that may still be walking the list through it,
+/// and on to a freelist of up to maxFreeSegments segments for reuse.  A
+/// reused segment keeps its slots: they simply start the next turn.  Only
+/// list walks happen inside an epoch guard; blocked readers hold on to
+/// their segment through its pending count instead, so they don't delay
+/// reclamation.
+///
+/// As MPMCQueue, T must be nothrow constructible from the write arguments
+/// and nothrow destructible.  Writes may throw std::bad_alloc when a new
+/// segment can't be allocated.
+template <typename T, unsigned SegmentBits = 8>
+class UnboundedQueue {
+    static_assert(SegmentBits >= 1 && SegmentBits <= 16,
+            "SegmentBits must be in [1, 16]");
+
+    static_assert(std::is_nothrow_copy_assignable<T>::value ||
+                      std::is_nothrow_move_assignable<T>::value,
+                  "T must be nothrow copy or move assignable");
+
+    static_assert(std::is_nothrow_destructible<T>::value,
+                  "T must be nothrow destructible");
+
+public:
+    using Slot = SingleElementQueue<T>;
+
+    static constexpr size_t kSegmentSize = size_t(1) << SegmentBits;
+
+    explicit UnboundedQueue(size_t maxFreeSegments = 8) :
+        _maxFreeSegments(maxFreeSegments) {
+        // so that recycle never allocates
+        _freeSegments.reserve(maxFreeSegments);
+        Segment* s = allocateSegment(0);
+        _head.store(s, std::memory_order_relaxed);
+        _tail.store(s, std::memory_order_relaxed);
+    }
+
+    ~UnboundedQueue() {
+        detail::EpochDomain::instance().drain(this);
+        Segment* head = _head.load(std::memory_order_relaxed);
+        Segment* tail = _tail.load(std::memory_order_relaxed);
+        Segment* s = head->minTicket < tail->minTicket ? head : tail;
+        while (s != nullptr) {
+            Segment* next = s->next.load(std::memory_order_relaxed);
+            freeSegment(s);
+            s = next;
+        }
+        for (Segment* free : _freeSegments) {
+            freeSegment(free);
+        }
+    }
+
+    UnboundedQueue(const UnboundedQueue&) = delete;
+    UnboundedQueue& operator=(const UnboundedQueue&) = delete;
+
+    /// Approximate number of elements, negative while readers wait
+    ssize_t size() const noexcept {
+        uint64_t pushes = _pushTicket.load(std::memory_order_acquire);
+        uint64_t pops = _popTicket.load(std::memory_order_acquire);
+        while (true) {
+            uint64_t nextPushes = _pushTicket.load(std::memory_order_acquire);
+            if (pushes == nextPushes) {
+                return ssize_t(pushes - pops);
+            }
+            pushes = nextPushes;
+            uint64_t nextPops = _popTicket.load(std::memory_order_acquire);
+            if (pops == nextPops) {
+                return ssize_t(pushes - pops);
+            }
+            pops = nextPops;
+        }
+    }
+
+    bool isEmpty() const noexcept { return size() <= 0; }
+
+    /// Segments currently taken from the heap: in the list, waiting for
+    /// reclamation or on the freelist
+    size_t segmentsAllocated() const noexcept {
+        return _segmentsAllocated.load(std::memory_order_relaxed);
+    }
+
+    /// Never waits
+    template <typename... Args>
+    void write(Args&&... args) {
+        uint64_t ticket;
+        Segment* s;
+        {
+            detail::EpochGuard guard;
+            // loaded before the ticket is taken, so the segment can't be
+            // past it
+            s = _tail.load(std::memory_order_acquire);
+            ticket = _pushTicket.fetch_add(1);
+            s = findSegment(s, ticket, _tail, true);
+        }
+        // the segment stays until our element has been read
+        s->slots[index(ticket)].enqueue(s->turn, _pushSpinCutoff, false,
+                nullptr, std::forward<Args>(args)...);
+    }
+
+    /// Alias of write, for symmetry with the bounded queues
+    template <typename... Args>
+    void blockingWrite(Args&&... args) {
+        write(std::forward<Args>(args)...);
+    }
+
+    /// Reads an element if one is ready right now
+    bool read(T& elem) noexcept {
+        uint64_t ticket;
+        Segment* s;
+        {
+            detail::EpochGuard guard;
+            while (true) {
+                // head first: the ticket can't be behind it then
+                s = _head.load(std::memory_order_acquire);
+                ticket = _popTicket.load(std::memory_order_acquire);
+                s = findSegment(s, ticket, _head, false);
+                if (s == nullptr ||
+                        !s->slots[index(ticket)].mayDequeue(s->turn)) {
+                    // as in MPMCQueue::tryObtainReadyPopTicket: empty if
+                    // the check is bracketed by two loads of the same ticket
+                    if (ticket == _popTicket.load(std::memory_order_acquire)) {
+                        return false;
+                    }
+                } else if (_popTicket.compare_exchange_strong(
+                            ticket, ticket + 1)) {
+                    break;
+                }
+            }
+        }
+        dequeueFrom(s, ticket, elem);
+        return true;
+    }
+
+    void blockingRead(T& elem) noexcept {
+        uint64_t ticket;
+        Segment* s;
+        {
+            detail::EpochGuard guard;
+            s = _head.load(std::memory_order_acquire);
+            ticket = _popTicket.fetch_add(1);
+            s = findSegment(s, ticket, _head, true);
+        }
+        dequeueFrom(s, ticket, elem);
+    }
+
+    template <class Clock>
+    bool tryReadUntil(const std::chrono::time_point<Clock>& when,
+            T& elem) noexcept {
+        while (true) {
+            if (read(elem)) {
+                return true;
+            }
+            if (Clock::now() >= when) {
+                return false;
+            }
+            // wait for the next ticket's element without taking the ticket
+            uint64_t ticket;
+            Segment* s;
+            {
+                detail::EpochGuard guard;
+                s = _head.load(std::memory_order_acquire);
+                ticket = _popTicket.load(std::memory_order_acquire);
+                s = findSegment(s, ticket, _head, true);
+                if (!pin(s)) {
+                    // others read the whole segment meanwhile
+                    continue;
+                }
+            }
+            s->slots[index(ticket)].tryWaitForDequeueTurnUntil(s->turn,
+                    _popSpinCutoff, false, when);
+            release(s);
+        }
+    }
+
+    template <class Rep, class Period>
+    bool tryReadFor(const std::chrono::duration<Rep, Period>& duration,
+            T& elem) noexcept {
+        return tryReadUntil(std::chrono::steady_clock::now() + duration, elem);
+    }
+
+private:
+    enum {
+        /// Once every kAdaptationFreq we will spin longer, to try to estimate
+        /// the proper spin backoff
+        kAdaptationFreq = 128,
+
+        /// Consecutive tickets are spread over 2^kSpreadBits cache lines,
+        /// as in MPMCQueue, if the segment is big enough
+        kLineSlots =
+          (hardware_destructive_interference_size - 1) / sizeof(Slot) + 1,
+        kSpreadBits = 2 * log2Floor(nextPowTwo(kLineSlots)) <= SegmentBits ?
+            log2Floor(nextPowTwo(kLineSlots)) : 0
+    };
+
+    struct Segment {
+        explicit Segment(uint64_t min) : minTicket(min) {}
+
+        std::atomic<Segment*> next{nullptr};
+        uint64_t minTicket;
+        /// The turn every slot is on: segments are reused
+        uint64_t turn{0};
+        /// Unread elements plus one each for head and tail not having
+        /// moved past the segment yet (and for tryReadUntil waiters)
+        std::atomic<uint32_t> pending{uint32_t(kSegmentSize + 2)};
+        detail::EpochDomain::RetireNode retireNode;
+        alignas(hardware_destructive_interference_size)
+            Slot slots[kSegmentSize];
+    };
+
+    static size_t index(uint64_t ticket) noexcept {
+        const uint64_t i = ticket & (kSegmentSize - 1);
+        return kSpreadBits == 0 ? i : detail::swapLowBits<kSpreadBits>(i);
+    }
+
+    /// Walks from s (which must not be past ticket) to ticket's segment,
+    /// appending segments if allocate, else returning nullptr when the
+    /// list ends early.  Moves endpoint (_head or _tail) along
+    Segment* findSegment(Segment* s, uint64_t ticket,
+            std::atomic<Segment*>& endpoint, bool allocate) {
+        assert(ticket >= s->minTicket);
+        while (ticket >= s->minTicket + kSegmentSize) {
+            Segment* next = s->next.load(std::memory_order_acquire);
+            if (next == nullptr) {
+                if (!allocate) {
+                    return nullptr;
+                }
+                next = appendSegment(s);
+            }
+            Segment* expected = s;
+            if (endpoint.compare_exchange_strong(expected, next)) {
+                release(s);
+            }
+            s = next;
+        }
+        return s;
+    }
+
+    Segment* appendSegment(Segment* s) {
+        Segment* fresh = takeSegment(s->minTicket + kSegmentSize);
+        Segment* next = nullptr;
+        if (s->next.compare_exchange_strong(next, fresh,
+                    std::memory_order_acq_rel, std::memory_order_acquire)) {
+            return fresh;
+        }
+        // never published
+        recycle(fresh);
+        return next;
+    }
+
+    void dequeueFrom(Segment* s, uint64_t ticket, T& elem) noexcept {
+        s->slots[index(ticket)].dequeue(s->turn, _popSpinCutoff,
+                (ticket % kAdaptationFreq) == 0, nullptr, elem);
+        release(s);
+    }
+
+    /// Keeps s from being retired, unless it already has been
+    static bool pin(Segment* s) noexcept {
+        uint32_t pending = s->pending.load(std::memory_order_relaxed);
+        while (pending != 0) {
+            if (s->pending.compare_exchange_weak(pending, pending + 1,
+                        std::memory_order_acquire)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /// Called from the noexcept reads, so neither retiring nor recycling
+    /// may allocate
+    void release(Segment* s) noexcept {
+        if (s->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            detail::EpochDomain::instance().retire(s->retireNode, s, this,
+                    &reclaimSegment);
+        }
+    }
+
+    static void reclaimSegment(void* segment, void* owner) noexcept {
+        auto s = static_cast<Segment*>(segment);
+        // every slot went through this turn
+        ++s->turn;
+        static_cast<UnboundedQueue*>(owner)->recycle(s);
+    }
+
+    /// Segment allocation never waits for the freelist's lock: when it is
+    /// busy we go to the heap instead
+    Segment* takeSegment(uint64_t minTicket) {
+        Segment* s = nullptr;
+        if (_freeLock.try_lock()) {
+            if (!_freeSegments.empty()) {
+                s = _freeSegments.back();
+                _freeSegments.pop_back();
+            }
+            _freeLock.unlock();
+        }
+        if (s == nullptr) {
+            return allocateSegment(minTicket);
+        }
+        s->next.store(nullptr, std::memory_order_relaxed);
+        s->minTicket = minTicket;
+        s->pending.store(uint32_t(kSegmentSize + 2), std::memory_order_relaxed);
+        return s;
+    }
+
+    void recycle(Segment* s) noexcept {
+        if (_freeLock.try_lock()) {
+            if (_freeSegments.size() < _maxFreeSegments) {
+                _freeSegments.push_back(s);
+                s = nullptr;
+            }
+            _freeLock.unlock();
+        }
+        if (s != nullptr) {
+            freeSegment(s);
+        }
+    }
+
+    /// Segment is over-aligned
+    Segment* allocateSegment(uint64_t minTicket) {
+        Segment* s = detail::alignedNew<Segment>(minTicket);
+        _segmentsAllocated.fetch_add(1, std::memory_order_relaxed);
+        return s;
+    }
+
+    void freeSegment(Segment* s) noexcept {
+        _segmentsAllocated.fetch_sub(1, std::memory_order_relaxed);
+        detail::alignedDelete(s);
+    }
+
+    alignas(hardware_destructive_interference_size)
+        std::atomic<Segment*> _head{nullptr};
+    alignas(hardware_destructive_interference_size)
+        std::atomic<Segment*> _tail{nullptr};
+    alignas(hardware_destructive_interference_size)
+        std::atomic<uint64_t> _pushTicket{0};
+    alignas(hardware_destructive_interference_size)
+        std::atomic<uint64_t> _popTicket{0};
+    alignas(hardware_destructive_interference_size)
+        std::atomic<uint32_t> _pushSpinCutoff{0};
+    alignas(hardware_destructive_interference_size)
+        std::atomic<uint32_t> _popSpinCutoff{0};
+
+    alignas(hardware_destructive_interference_size) std::mutex _freeLock;
+    std::vector<Segment*> _freeSegments;
+    size_t _maxFreeSegments;
+    std::atomic<size_t> _segmentsAllocated{0};
+};
+
+template <typename T, unsigned SegmentBits>
+constexpr size_t UnboundedQueue<T, SegmentBits>::kSegmentSize;
+
+};  //namespace myfolly
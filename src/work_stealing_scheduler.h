@@ -0,0 +1,197 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "detail/chase_lev_deque.h"
+#include "detail/futex.h"
+#include "mpmc_queue.h"
+#include "thread_pool_executor.h"
+
+namespace myfolly {
+
+class TaskGroup;
+
+namespace detail {
+
+struct StealJob {
+    Task fn;
+    TaskGroup* group;
+};
+
+} // namespace detail
+
+/// A fork/join scheduler.  Every worker owns a Chase-Lev deque
+/// (detail/chase_lev_deque.h): tasks it spawns go to the bottom of its own
+/// deque and it takes them back from there, newest first, so a recursive
+/// split runs depth first on warm caches.  A worker whose deque is empty
+/// steals the oldest task, i.e. the biggest piece of work, from the top of
+/// a random victim's deque.  Spawning and running tasks therefore touches
+/// no shared counter at all until workers run out of work.
+///
+/// Tasks spawned by threads that aren't workers go through one MPMCQueue,
+/// which workers check before they steal.
+///
+/// Idle workers park on a futex (an eventcount, _idleEpoch); a spawn
+/// wakes one of them only if some are parked.  A thread waiting in
+/// TaskGroup::sync runs tasks itself (its own first, then stolen ones)
+/// until its group is done, and parks on the group when there is nothing
+/// left to take.
+///
+/// Tasks must not throw: an exception that leaves a task terminates the
+/// program, as it would leave a std::thread.
+class WorkStealingScheduler {
+public:
+    /// numThreads 0 means one per hardware thread
+    explicit WorkStealingScheduler(size_t numThreads = 0);
+
+    /// All task groups must have been synced
+    ~WorkStealingScheduler();
+
+    WorkStealingScheduler(const WorkStealingScheduler&) = delete;
+    WorkStealingScheduler& operator=(const WorkStealingScheduler&) = delete;
+
+    /// Runs f as a task and returns once it and everything it spawned
+    /// (and synced) has finished
+    template <typename F>
+    void run(F&& f);
+
+    size_t numThreads() const noexcept { return _threads.size(); }
+
+    /// The scheduler the calling thread works for, or nullptr
+    static WorkStealingScheduler* current() noexcept;
+
+private:
+    friend class TaskGroup;
+
+    struct Worker;
+
+    /// The calling thread's Worker, of whichever scheduler
+    static Worker*& localWorker() noexcept;
+
+    void submit(detail::StealJob* job);
+
+    /// Runs one task if the calling thread can find one
+    bool runOne() noexcept;
+
+    detail::StealJob* findWork(Worker* self) noexcept;
+
+    void execute(detail::StealJob* job) noexcept;
+
+    bool hasWork() const noexcept;
+
+    void workerLoop(Worker* self) noexcept;
+
+    /// Stops and joins the threads, then frees the workers and the queue
+    void shutdown() noexcept;
+
+    using InjectQueue = MPMCQueue<detail::StealJob*>;
+
+    std::vector<Worker*> _workers;
+    std::vector<std::thread> _threads;
+    /// Over-aligned, so allocated with detail::alignedNew
+    InjectQueue* _injected;
+    std::atomic<bool> _stop{false};
+    /// Bumped to wake parked workers
+    detail::Futex _idleEpoch{0};
+    std::atomic<uint32_t> _sleepers{0};
+};
+
+/// Tasks spawned together and waited for together:
+///
+///   TaskGroup g(scheduler);
+///   g.spawn([&] { a = fib(n - 1); });
+///   b = fib(n - 2);
+///   g.sync();
+///
+/// spawn may be called from any thread, sync only by the thread that owns
+/// the group (its destructor syncs).
+class TaskGroup {
+public:
+    explicit TaskGroup(WorkStealingScheduler& scheduler) noexcept :
+        _scheduler(scheduler) {}
+
+    ~TaskGroup() { sync(); }
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    template <typename F>
+    void spawn(F&& f) {
+        _pending.fetch_add(1, std::memory_order_relaxed);
+        _scheduler.submit(
+                new detail::StealJob{Task(std::forward<F>(f)), this});
+    }
+
+    /// Returns once every task spawned so far has finished, running tasks
+    /// in the meantime
+    void sync() noexcept;
+
+private:
+    friend class WorkStealingScheduler;
+
+    /// Set in _pending while the owner is parked in sync
+    static constexpr uint32_t kSleeping = 1u << 31;
+
+    void finish() noexcept;
+
+    WorkStealingScheduler& _scheduler;
+    /// Unfinished tasks, and kSleeping
+    detail::Futex _pending{0};
+};
+
+template <typename F>
+void WorkStealingScheduler::run(F&& f) {
+    TaskGroup group(*this);
+    group.spawn(std::forward<F>(f));
+    group.sync();
+}
+
+namespace detail {
+
+template <typename F>
+void parallelForRange(WorkStealingScheduler& scheduler,
+        size_t begin, size_t end, size_t grain, const F& f) {
+    TaskGroup group(scheduler);
+    // hand the upper halves to the deque, biggest first, so thieves take
+    // big pieces
+    while (end - begin > grain) {
+        size_t mid = begin + (end - begin) / 2;
+        group.spawn([&scheduler, mid, end, grain, &f]() {
+                parallelForRange(scheduler, mid, end, grain, f);
+                });
+        end = mid;
+    }
+    for (size_t i = begin; i < end; ++i) {
+        f(i);
+    }
+    group.sync();
+}
+
+} // namespace detail
+
+/// Calls f(i) for every i in [begin, end), in tasks of at most grain
+/// iterations that are split off recursively.  May be called from inside
+/// a task or from any other thread
+template <typename F>
+void parallelFor(WorkStealingScheduler& scheduler,
+        size_t begin, size_t end, size_t grain, const F& f) {
+    if (begin >= end) {
+        return;
+    }
+    grain = std::max<size_t>(grain, 1);
+    if (WorkStealingScheduler::current() != &scheduler) {
+        scheduler.run([&]() {
+                detail::parallelForRange(scheduler, begin, end, grain, f);
+                });
+        return;
+    }
+    detail::parallelForRange(scheduler, begin, end, grain, f);
+}
+
+};  // namespace myfolly
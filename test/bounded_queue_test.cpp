@@ -0,0 +1,276 @@
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "bounded_queue.h"
+#include "notification_test.h"
+#include "gtest/gtest.h"
+
+using namespace myfolly;
+
+template <typename Q>
+static void testFifoAcrossTurns(Q& q) {
+    const int cap = q.capacity();
+    int elem = -1;
+    for (int round = 0; round < 5; ++round) {
+        for (int i = 0; i < cap; ++i) {
+            EXPECT_TRUE(q.write(round * cap + i));
+        }
+        EXPECT_FALSE(q.write(-1));
+        EXPECT_EQ(size_t(cap), q.size());
+        for (int i = 0; i < cap; ++i) {
+            EXPECT_TRUE(q.read(elem));
+            EXPECT_EQ(round * cap + i, elem);
+        }
+        EXPECT_FALSE(q.read(elem));
+        // shift the next round by a few tickets
+        q.blockingWrite(0);
+        q.blockingRead(elem);
+    }
+}
+
+TEST(BoundedQueueTest, runtime_capacity) {
+    BoundedQueue<int> q(10);
+    EXPECT_EQ(10u, q.capacity());
+    testFifoAcrossTurns(q);
+    EXPECT_THROW(BoundedQueue<int>(0), std::invalid_argument);
+}
+
+TEST(BoundedQueueTest, power_of_two_capacity) {
+    BoundedQueue<int, AlignedAllocator<Slot<int>>, PowerOfTwoCapacity> q(10);
+    EXPECT_EQ(16u, q.capacity());
+    testFifoAcrossTurns(q);
+}
+
+TEST(BoundedQueueTest, fixed_capacity) {
+    BoundedQueue<int, AlignedAllocator<Slot<int>>, FixedCapacity<8>> q(8);
+    EXPECT_EQ(8u, q.capacity());
+    testFifoAcrossTurns(q);
+}
+
+TEST(BoundedQueueTest, single_producer_consumer_fifo) {
+    SPSCBoundedQueue<int> spsc(10);
+    testFifoAcrossTurns(spsc);
+    MPSCBoundedQueue<int> mpsc(10);
+    testFifoAcrossTurns(mpsc);
+    SPMCBoundedQueue<int> spmc(10);
+    testFifoAcrossTurns(spmc);
+    SPSCBoundedQueue<int, AlignedAllocator<Slot<int>>, PowerOfTwoCapacity>
+        spscPow2(10);
+    testFifoAcrossTurns(spscPow2);
+}
+
+template <typename Q>
+static void testDestroysLeftovers() {
+    auto p = std::make_shared<int>(1);
+    {
+        Q q(4);
+        // wrap around once so that the leftovers don't start at slot 0
+        for (int i = 0; i < 3; ++i) {
+            q.blockingWrite(p);
+            std::shared_ptr<int> out;
+            q.blockingRead(out);
+        }
+        q.blockingWrite(p);
+        q.blockingWrite(p);
+        EXPECT_EQ(3, p.use_count());
+    }
+    EXPECT_EQ(1, p.use_count());
+}
+
+TEST(BoundedQueueTest, destroys_leftovers) {
+    testDestroysLeftovers<BoundedQueue<std::shared_ptr<int>>>();
+    testDestroysLeftovers<SPSCBoundedQueue<std::shared_ptr<int>>>();
+    testDestroysLeftovers<MPSCBoundedQueue<std::shared_ptr<int>>>();
+}
+
+template <typename Q>
+static void testMtSum(int numProducers = 4, int numConsumers = 4) {
+    const uint64_t n = 400000;
+    Q q(64);
+
+    std::atomic<uint64_t> sum{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numProducers; ++t) {
+        threads.emplace_back([&, t]() {
+                for (uint64_t i = t; i < n; i += numProducers) {
+                    // mix the blocking and non-blocking paths
+                    if (i % 3 == 0) {
+                        while (!q.write(i)) {
+                            std::this_thread::yield();
+                        }
+                    } else {
+                        q.blockingWrite(i);
+                    }
+                }
+                });
+    }
+    for (int t = 0; t < numConsumers; ++t) {
+        threads.emplace_back([&, t]() {
+                uint64_t threadSum = 0;
+                uint64_t elem;
+                for (uint64_t i = t; i < n; i += numConsumers) {
+                    if (i % 5 == 0) {
+                        while (!q.read(elem)) {
+                            std::this_thread::yield();
+                        }
+                    } else {
+                        q.blockingRead(elem);
+                    }
+                    threadSum += elem;
+                }
+                sum += threadSum;
+                });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    EXPECT_EQ(n * (n - 1) / 2, sum.load());
+    EXPECT_TRUE(q.isEmpty());
+}
+
+TEST(BoundedQueueTest, mt_sum) {
+    testMtSum<BoundedQueue<uint64_t>>();
+    testMtSum<BoundedQueue<uint64_t, AlignedAllocator<Slot<uint64_t>>,
+        PowerOfTwoCapacity>>();
+    testMtSum<BoundedQueue<uint64_t, AlignedAllocator<Slot<uint64_t>>,
+        FixedCapacity<64>>>();
+}
+
+TEST(BoundedQueueTest, single_producer_consumer_mt_sum) {
+    testMtSum<SPSCBoundedQueue<uint64_t>>(1, 1);
+    testMtSum<MPSCBoundedQueue<uint64_t>>(4, 1);
+    testMtSum<SPMCBoundedQueue<uint64_t>>(1, 4);
+    testMtSum<SPSCBoundedQueue<uint64_t, AlignedAllocator<Slot<uint64_t>>,
+        PowerOfTwoCapacity>>(1, 1);
+}
+
+template <typename Q>
+static void testTimeouts() {
+    using namespace std::chrono;
+    Q q(2);
+    int elem = 0;
+    auto start = steady_clock::now();
+    EXPECT_FALSE(q.tryReadUntil(start + milliseconds(20), elem));
+    EXPECT_GE(steady_clock::now() - start, milliseconds(20));
+
+    EXPECT_TRUE(q.tryWriteFor(milliseconds(20), 1));
+    EXPECT_TRUE(q.tryWriteFor(milliseconds(20), 2));
+    start = steady_clock::now();
+    EXPECT_FALSE(q.tryWriteUntil(system_clock::now() + milliseconds(20), 3));
+    EXPECT_GE(steady_clock::now() - start, milliseconds(20));
+    // the timed out write didn't take a ticket
+    EXPECT_EQ(2u, q.size());
+
+    EXPECT_TRUE(q.tryReadFor(milliseconds(20), elem));
+    EXPECT_EQ(1, elem);
+    EXPECT_TRUE(q.tryReadFor(milliseconds(20), elem));
+    EXPECT_EQ(2, elem);
+    q.blockingWrite(4);
+    q.blockingRead(elem);
+    EXPECT_EQ(4, elem);
+}
+
+TEST(BoundedQueueTest, timeouts) {
+    testTimeouts<BoundedQueue<int>>();
+    testTimeouts<SPSCBoundedQueue<int>>();
+    testTimeouts<MPSCBoundedQueue<int>>();
+    testTimeouts<SPMCBoundedQueue<int>>();
+}
+
+template <typename Q>
+static void testTimedWakeups() {
+    using namespace std::chrono;
+    Q q(1);
+    int elem = 0;
+    std::thread writer([&q]() {
+            std::this_thread::sleep_for(milliseconds(20));
+            q.blockingWrite(1);
+            q.blockingWrite(2);
+            });
+    EXPECT_TRUE(q.tryReadFor(seconds(10), elem));
+    EXPECT_EQ(1, elem);
+    // the writer is now blocked on the full queue until we read
+    std::this_thread::sleep_for(milliseconds(20));
+    EXPECT_TRUE(q.tryReadFor(seconds(10), elem));
+    EXPECT_EQ(2, elem);
+    writer.join();
+
+    q.blockingWrite(3);
+    std::thread reader([&q]() {
+            std::this_thread::sleep_for(milliseconds(20));
+            int v;
+            q.blockingRead(v);
+            });
+    EXPECT_TRUE(q.tryWriteFor(seconds(10), 4));
+    reader.join();
+    q.blockingRead(elem);
+    EXPECT_EQ(4, elem);
+}
+
+TEST(BoundedQueueTest, timed_wakeups) {
+    testTimedWakeups<BoundedQueue<int>>();
+    testTimedWakeups<SPSCBoundedQueue<int>>();
+    testTimedWakeups<MPSCBoundedQueue<int>>();
+}
+
+TEST(BoundedQueueTest, oversubscribed_mt_sum) {
+    // many more threads than slots (and cores), so most of them park
+    const int numThreads = 16;
+    const uint64_t n = 16 * 5000;
+    BoundedQueue<uint64_t> q(2);
+
+    std::atomic<uint64_t> sum{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; ++t) {
+        threads.emplace_back([&, t]() {
+                for (uint64_t i = t; i < n; i += numThreads) {
+                    if (i % 7 == 0) {
+                        while (!q.tryWriteFor(std::chrono::milliseconds(1), i)) {
+                        }
+                    } else {
+                        q.blockingWrite(i);
+                    }
+                }
+                });
+        threads.emplace_back([&, t]() {
+                uint64_t threadSum = 0;
+                uint64_t elem;
+                for (uint64_t i = t; i < n; i += numThreads) {
+                    if (i % 5 == 0) {
+                        while (!q.tryReadFor(std::chrono::milliseconds(1), elem)) {
+                        }
+                    } else {
+                        q.blockingRead(elem);
+                    }
+                    threadSum += elem;
+                }
+                sum += threadSum;
+                });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    EXPECT_EQ(n * (n - 1) / 2, sum.load());
+    EXPECT_TRUE(q.isEmpty());
+}
+
+TEST(BoundedQueueTest, notification) {
+    BoundedQueue<int> q(16);
+    testNotification(q, 3, 2000);
+    EXPECT_GT(q.notificationsSent(), 0u);
+
+    SPSCBoundedQueue<int> spsc(16);
+    testNotification(spsc, 1, 2000);
+
+    MPSCBoundedQueue<int> mpsc(16);
+    testNotification(mpsc, 3, 2000);
+}
+
+int main(int argc, char* argv[]) {
+    testing::InitGoogleTest(&argc, argv);
+
+    return RUN_ALL_TESTS();
+}
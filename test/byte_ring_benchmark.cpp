@@ -0,0 +1,182 @@
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "byte_ring.h"
+#include "mpmc_queue.h"
+#include "portability.h"
+
+using namespace myfolly;
+
+static uint64_t now_steady_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>
+      (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// Record sizes from 40 bytes to 64 KB, the way log and message traffic
+/// looks: 70% short (40-256 B), 25% medium (256 B-4 KB) and 5% large
+/// (4-64 KB), log-uniform within each class
+static std::vector<uint32_t> makeSizes(size_t n) {
+    std::vector<uint32_t> sizes(n);
+    uint64_t rng = 88172645463325252ULL;
+    auto next = [&]() {
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        return rng;
+    };
+    for (auto& size : sizes) {
+        uint64_t r = next() % 100;
+        double lo = r < 70 ? 40 : r < 95 ? 256 : 4096;
+        double hi = r < 70 ? 256 : r < 95 ? 4096 : 65536;
+        double u = double(next() % 1000000) / 1000000;
+        size = uint32_t(lo * std::pow(hi / lo, u));
+    }
+    return sizes;
+}
+
+/// Writes a record of size bytes for seq, as a serializer would
+static void serialize(char* out, uint32_t size, uint64_t seq) noexcept {
+    memcpy(out, &seq, sizeof(seq));
+    memset(out + sizeof(seq), int(seq & 0xff), size - sizeof(seq));
+}
+
+/// Reads every word of a record, as a parser would
+static uint64_t parse(const char* data, size_t size) noexcept {
+    uint64_t sum = 0;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t w;
+        memcpy(&w, data + i, sizeof(w));
+        sum += w;
+    }
+    for (; i < size; ++i) {
+        sum += uint8_t(data[i]);
+    }
+    return sum;
+}
+
+struct Result {
+    uint64_t nsPerRecord;
+    double mbPerSec;
+    uint64_t check;
+};
+
+static Result makeResult(uint64_t elapsed, const std::vector<uint32_t>& sizes,
+        uint64_t check) {
+    uint64_t bytes = 0;
+    for (auto size : sizes) {
+        bytes += size;
+    }
+    return {elapsed / sizes.size(), double(bytes) * 1000 / double(elapsed),
+        check};
+}
+
+/// Today: each record is a std::string moved through an MPMCQueue
+static Result runStringQueue(int numProducers,
+        const std::vector<uint32_t>& sizes) {
+    auto q = detail::alignedNew<MPMCQueue<std::string>>(1024);
+    const size_t n = sizes.size();
+    uint64_t start = now_steady_ns();
+    std::vector<std::thread> producers;
+    for (int p = 0; p < numProducers; ++p) {
+        producers.emplace_back([&, p]() {
+                for (size_t i = p; i < n; i += numProducers) {
+                    std::string s(sizes[i], '\0');
+                    serialize(&s[0], sizes[i], i);
+                    q->blockingWrite(std::move(s));
+                }
+                });
+    }
+    uint64_t check = 0;
+    std::string s;
+    for (size_t i = 0; i < n; ++i) {
+        q->blockingRead(s);
+        check += parse(s.data(), s.size());
+    }
+    uint64_t elapsed = now_steady_ns() - start;
+    for (auto& t : producers) {
+        t.join();
+    }
+    detail::alignedDelete(q);
+    return makeResult(elapsed, sizes, check);
+}
+
+/// Records serialized into and parsed in a ByteRing; the consumer
+/// releases every 16 records
+template <typename Ring>
+static Result runRing(int numProducers, const std::vector<uint32_t>& sizes,
+        bool doubleMapped) {
+    Ring* ring = detail::alignedNew<Ring>(1 << 20, doubleMapped);
+    const size_t n = sizes.size();
+    uint64_t start = now_steady_ns();
+    std::vector<std::thread> producers;
+    for (int p = 0; p < numProducers; ++p) {
+        producers.emplace_back([&, p]() {
+                for (size_t i = p; i < n; i += numProducers) {
+                    auto r = ring->blockingReserve(sizes[i]);
+                    serialize(r.data(), sizes[i], i);
+                    ring->commit(r);
+                }
+                });
+    }
+    uint64_t check = 0;
+    for (size_t i = 0; i < n; ++i) {
+        auto span = ring->blockingRead();
+        check += parse(span.data(), span.size());
+        if (i % 16 == 15 || i + 1 == n) {
+            ring->release(span);
+        }
+    }
+    uint64_t elapsed = now_steady_ns() - start;
+    for (auto& t : producers) {
+        t.join();
+    }
+    detail::alignedDelete(ring);
+    return makeResult(elapsed, sizes, check);
+}
+
+static void print(const char* name, int numProducers, const Result& r,
+        uint64_t expectedCheck) {
+    std::cout << std::setw(26) << name << " " << numProducers << "P/1C: "
+      << std::setw(6) << r.nsPerRecord << " ns/record "
+      << std::setw(7) << std::fixed << std::setprecision(0) << r.mbPerSec
+      << " MB/s";
+    if (r.check != expectedCheck) {
+        std::cout << " ERROR check differs!";
+    }
+    std::cout << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "Start ByteRingBenchmark!" << std::endl;
+    const auto sizes = makeSizes(200000);
+    uint64_t mean = 0;
+    for (auto size : sizes) {
+        mean += size;
+    }
+    std::cout << "mean record size " << mean / sizes.size() << " bytes"
+      << std::endl;
+    for (int numProducers : {1, 4}) {
+        Result queue = runStringQueue(numProducers, sizes);
+        print("MPMCQueue<std::string>", numProducers, queue, queue.check);
+        if (numProducers == 1) {
+            print("SPSCByteRing", numProducers,
+                    runRing<SPSCByteRing>(1, sizes, false), queue.check);
+            print("SPSCByteRing double mapped", numProducers,
+                    runRing<SPSCByteRing>(1, sizes, true), queue.check);
+        }
+        print("MPSCByteRing", numProducers,
+                runRing<MPSCByteRing>(numProducers, sizes, false),
+                queue.check);
+        print("MPSCByteRing double mapped", numProducers,
+                runRing<MPSCByteRing>(numProducers, sizes, true),
+                queue.check);
+    }
+    return 0;
+}
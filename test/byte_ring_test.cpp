@@ -0,0 +1,257 @@
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "byte_ring.h"
+#include "gtest/gtest.h"
+
+using namespace myfolly;
+using namespace std::chrono;
+
+/// The i-th test record: i's bytes then a pattern derived from i, of a
+/// length that varies with i
+static std::string makeRecord(uint64_t i, size_t maxSize) {
+    size_t size = sizeof(i) + 1 + (i * 37) % (maxSize - sizeof(i));
+    std::string s(size, char('a' + i % 26));
+    memcpy(&s[0], &i, sizeof(i));
+    return s;
+}
+
+template <typename Ring>
+static void testFifoAcrossLaps(Ring& ring, size_t maxSize) {
+    const uint64_t n = 20 * ring.capacity() / maxSize + 100;
+    uint64_t written = 0;
+    uint64_t read = 0;
+    while (read < n) {
+        // fill until full, then read half of it back
+        while (written < n) {
+            std::string s = makeRecord(written, maxSize);
+            if (!ring.write(s.data(), s.size())) {
+                break;
+            }
+            ++written;
+        }
+        if (written == read) {
+            // a large record claimed the end of the ring as padding, and
+            // needs the consumer to skip it
+            typename Ring::Span span;
+            ASSERT_FALSE(ring.tryRead(span));
+            std::string s = makeRecord(written, maxSize);
+            ASSERT_TRUE(ring.write(s.data(), s.size()));
+            ++written;
+        }
+        const uint64_t target = read + (written - read + 1) / 2;
+        for (; read < target; ++read) {
+            typename Ring::Span span;
+            ASSERT_TRUE(ring.tryRead(span));
+            std::string expected = makeRecord(read, maxSize);
+            ASSERT_EQ(expected.size(), span.size());
+            ASSERT_EQ(0, memcmp(expected.data(), span.data(), span.size()));
+            ring.release(span);
+        }
+    }
+    typename Ring::Span span;
+    EXPECT_FALSE(ring.tryRead(span));
+    EXPECT_EQ(0u, ring.sizeGuess());
+}
+
+TEST(ByteRingTest, fifo_across_laps) {
+    SPSCByteRing spsc(4096);
+    EXPECT_EQ(4096u, spsc.capacity());
+    EXPECT_FALSE(spsc.doubleMapped());
+    testFifoAcrossLaps(spsc, 300);
+
+    MPSCByteRing mpsc(1000);
+    EXPECT_EQ(1024u, mpsc.capacity());
+    testFifoAcrossLaps(mpsc, 1016);
+}
+
+TEST(ByteRingTest, double_mapped) {
+    MPSCByteRing ring(4096, true);
+    EXPECT_TRUE(ring.doubleMapped());
+    EXPECT_GE(ring.capacity(), 4096u);
+    testFifoAcrossLaps(ring, 1000);
+
+    // a record that runs past the end of the ring is still contiguous
+    const size_t cap = ring.capacity();
+    std::string filler(cap - 64 - MPSCByteRing::kHeaderSize, 'x');
+    ASSERT_TRUE(ring.write(filler.data(), filler.size()));
+    MPSCByteRing::Span span;
+    ASSERT_TRUE(ring.tryRead(span));
+    ring.release(span);
+    std::string big(cap / 2, 'y');
+    ASSERT_TRUE(ring.write(big.data(), big.size()));
+    ASSERT_TRUE(ring.tryRead(span));
+    EXPECT_EQ(big, std::string(span.data(), span.size()));
+    ring.release(span);
+}
+
+TEST(ByteRingTest, padding_at_the_end) {
+    SPSCByteRing ring(256);
+    std::string a(200, 'a');
+    std::string b(100, 'b');
+    ASSERT_TRUE(ring.write(a.data(), a.size()));
+    // doesn't fit behind a, nor in front of it until a is released
+    EXPECT_FALSE(ring.write(b.data(), b.size()));
+    SPSCByteRing::Span span;
+    ASSERT_TRUE(ring.tryRead(span));
+    ring.release(span);
+    // the tail of the ring is skipped, and b starts at the beginning
+    ASSERT_TRUE(ring.write(b.data(), b.size()));
+    ASSERT_TRUE(ring.tryRead(span));
+    EXPECT_EQ(b, std::string(span.data(), span.size()));
+    ring.release(span);
+    EXPECT_EQ(0u, ring.sizeGuess());
+
+    // the largest record fits whatever the position, once the consumer
+    // has skipped the padding in front of it
+    std::string max(ring.maxRecordSize(), 'm');
+    EXPECT_FALSE(ring.write(max.data(), max.size()));
+    EXPECT_FALSE(ring.tryRead(span));
+    ASSERT_TRUE(ring.write(max.data(), max.size()));
+    ASSERT_TRUE(ring.tryRead(span));
+    EXPECT_EQ(max, std::string(span.data(), span.size()));
+    ring.release(span);
+    EXPECT_THROW(ring.write(max.data(), max.size() + 1), std::invalid_argument);
+}
+
+TEST(ByteRingTest, reserve_and_release_in_batches) {
+    MPSCByteRing ring(1024);
+    MPSCByteRing::Reservation r1;
+    MPSCByteRing::Reservation r2;
+    ASSERT_TRUE(ring.tryReserve(10, r1));
+    ASSERT_TRUE(ring.tryReserve(20, r2));
+    EXPECT_EQ(10u, r1.size());
+    memset(r2.data(), '2', r2.size());
+    ring.commit(r2);
+    // r1 comes first, and isn't committed yet
+    MPSCByteRing::Span span;
+    EXPECT_FALSE(ring.tryRead(span));
+    memset(r1.data(), '1', r1.size());
+    ring.commit(r1);
+
+    MPSCByteRing::Span s1;
+    MPSCByteRing::Span s2;
+    ASSERT_TRUE(ring.tryRead(s1));
+    ASSERT_TRUE(ring.tryRead(s2));
+    EXPECT_EQ(std::string(10, '1'), std::string(s1.data(), s1.size()));
+    EXPECT_EQ(std::string(20, '2'), std::string(s2.data(), s2.size()));
+    EXPECT_FALSE(ring.tryRead(span));
+    // releasing the second releases both
+    ring.release(s2);
+    EXPECT_EQ(0u, ring.sizeGuess());
+}
+
+TEST(ByteRingTest, timeouts) {
+    SPSCByteRing ring(256);
+    SPSCByteRing::Span span;
+    auto start = steady_clock::now();
+    EXPECT_FALSE(ring.tryReadFor(milliseconds(20), span));
+    EXPECT_GE(steady_clock::now() - start, milliseconds(20));
+
+    std::string s(200, 's');
+    ASSERT_TRUE(ring.write(s.data(), s.size()));
+    SPSCByteRing::Reservation r;
+    start = steady_clock::now();
+    EXPECT_FALSE(ring.tryReserveFor(milliseconds(20), 100, r));
+    EXPECT_GE(steady_clock::now() - start, milliseconds(20));
+
+    // a blocked reader wakes up on commit, a blocked writer on release
+    std::thread reader([&]() {
+            SPSCByteRing::Span span;
+            ASSERT_TRUE(ring.tryRead(span));
+            ring.release(span);
+            ASSERT_TRUE(ring.tryReadFor(seconds(10), span));
+            EXPECT_EQ(100u, span.size());
+            ring.release(span);
+            });
+    ASSERT_TRUE(ring.tryReserveFor(seconds(10), 100, r));
+    std::this_thread::sleep_for(milliseconds(20));
+    ring.commit(r);
+    reader.join();
+}
+
+TEST(ByteRingTest, read_everything_unreleased) {
+    // four records of 64 bytes with their headers fill the ring
+    SPSCByteRing ring(256);
+    std::string s(64 - SPSCByteRing::kHeaderSize, 's');
+    for (int i = 0; i < 4; ++i) {
+        ASSERT_TRUE(ring.write(s.data(), s.size()));
+    }
+    SPSCByteRing::Span span;
+    for (int i = 0; i < 4; ++i) {
+        ASSERT_TRUE(ring.tryRead(span));
+    }
+    // only this thread could make room, so a timed read doesn't wait
+    auto start = steady_clock::now();
+    EXPECT_FALSE(ring.tryReadFor(seconds(10), span));
+    EXPECT_LT(steady_clock::now() - start, seconds(1));
+    ring.release(span);
+    EXPECT_EQ(0u, ring.sizeGuess());
+}
+
+template <typename Ring>
+static void testMt(Ring& ring, int numProducers, uint64_t perProducer) {
+    std::vector<std::thread> producers;
+    for (int p = 0; p < numProducers; ++p) {
+        producers.emplace_back([&, p]() {
+                for (uint64_t i = 0; i < perProducer; ++i) {
+                    std::string s = makeRecord(i, 500);
+                    s[sizeof(i)] = char(p);
+                    auto r = ring.blockingReserve(s.size());
+                    memcpy(r.data(), s.data(), s.size());
+                    ring.commit(r);
+                }
+                });
+    }
+    std::vector<uint64_t> next(numProducers, 0);
+    for (uint64_t n = 0; n < numProducers * perProducer; ++n) {
+        auto span = ring.blockingRead();
+        ASSERT_GT(span.size(), sizeof(uint64_t));
+        uint64_t i;
+        memcpy(&i, span.data(), sizeof(i));
+        int p = span.data()[sizeof(i)];
+        ASSERT_LT(p, numProducers);
+        // each producer's records arrive in order and intact
+        ASSERT_EQ(next[p], i);
+        std::string expected = makeRecord(i, 500);
+        expected[sizeof(i)] = char(p);
+        ASSERT_EQ(expected, std::string(span.data(), span.size()));
+        ++next[p];
+        // release in batches of a few records
+        if (n % 3 == 0) {
+            ring.release(span);
+        }
+        if (n + 1 == numProducers * perProducer) {
+            ring.release(span);
+        }
+    }
+    for (auto& t : producers) {
+        t.join();
+    }
+    EXPECT_EQ(0u, ring.sizeGuess());
+}
+
+TEST(ByteRingTest, mpsc_mt) {
+    MPSCByteRing ring(4096);
+    testMt(ring, 4, 20000);
+    MPSCByteRing doubleMapped(4096, true);
+    testMt(doubleMapped, 4, 20000);
+}
+
+TEST(ByteRingTest, spsc_mt) {
+    SPSCByteRing ring(2048);
+    testMt(ring, 1, 50000);
+    SPSCByteRing doubleMapped(4096, true);
+    testMt(doubleMapped, 1, 50000);
+}
+
+int main(int argc, char* argv[]) {
+    testing::InitGoogleTest(&argc, argv);
+
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,137 @@
+#include <iostream>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <iomanip>
+
+#include <unistd.h>
+
+#include "mpmc_queue.h"
+#include "portability.h"
+
+using namespace myfolly;
+
+static uint64_t now_real_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>
+      (std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+/// Resident set size of this process in KB, from /proc/self/statm
+static uint64_t rss_kb() {
+    std::ifstream statm("/proc/self/statm");
+    uint64_t size = 0;
+    uint64_t resident = 0;
+    statm >> size >> resident;
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/// MPMCQueue is over-aligned
+template <typename Q>
+struct AlignedDelete {
+    void operator()(Q* q) const { detail::alignedDelete(q); }
+};
+
+template <typename Q>
+using AlignedPtr = std::unique_ptr<Q, AlignedDelete<Q>>;
+
+template <typename Q>
+AlignedPtr<Q> makeAligned(size_t capacity) {
+    return AlignedPtr<Q>(detail::alignedNew<Q>(capacity));
+}
+
+/// Creates numQueues queues sized for a burst of capacity elements, but
+/// only ever pushes steadyDepth elements through each of them.  Reports
+/// how much resident memory the queues pin.
+template <typename Q>
+void runMemoryTest(const char* name,
+        int numQueues, size_t capacity, size_t steadyDepth) {
+    auto before = rss_kb();
+    std::vector<AlignedPtr<Q>> queues;
+    for (int i = 0; i < numQueues; ++i) {
+        queues.push_back(makeAligned<Q>(capacity));
+        for (size_t j = 0; j < steadyDepth; ++j) {
+            queues.back()->blockingWrite(j);
+        }
+    }
+    auto after = rss_kb();
+    size_t allocated = 0;
+    for (auto& q : queues) {
+        allocated += q->allocatedCapacity();
+    }
+    std::cout << name << ": " << numQueues << " queues, capacity "
+      << capacity << ", depth " << std::setw(5) << steadyDepth
+      << ". rss: " << std::setw(8) << (after - before) << " KB"
+      << ", allocated slots/queue: " << allocated / numQueues << std::endl;
+}
+
+template <typename Q>
+void runEnqThread(int numThreads, uint64_t n, Q& cq, int t) {
+    for (uint64_t src = t; src < n; src += numThreads) {
+        cq.blockingWrite(src);
+    }
+}
+
+template <typename Q>
+void runDeqThread(int numThreads, uint64_t n, Q& cq,
+        std::atomic<uint64_t>& sum, int t) {
+    uint64_t threadSum = 0;
+    for (uint64_t received = t; received < n; received += numThreads) {
+        uint64_t dst = 0;
+        cq.blockingRead(dst);
+        threadSum += dst;
+    }
+    sum += threadSum;
+}
+
+template <typename Q>
+uint64_t runThroughputTest(int numThreads, uint64_t n, size_t capacity) {
+    Q cq(capacity);
+    std::atomic<uint64_t> sum(0);
+    std::vector<std::thread> threads;
+    auto start = now_real_us();
+    for (int t = 0; t < numThreads; ++t) {
+        threads.emplace_back(runEnqThread<Q>, numThreads, n, std::ref(cq), t);
+        threads.emplace_back(runDeqThread<Q>, numThreads, n,
+                std::ref(cq), std::ref(sum), t);
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    auto elapsed = now_real_us() - start;
+    if (n * (n - 1) / 2 != sum) {
+        std::cout << "ERROR Result! sum:" << n * (n - 1) / 2
+          << " : " << sum << std::endl;
+    }
+    return elapsed;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "Start DynamicMPMCQueueBenchmark!" << std::endl;
+
+    const int numQueues = 100;
+    const size_t capacity = 100000;
+    size_t depths[] = {10, 1000, 100000};
+    for (size_t depth : depths) {
+        runMemoryTest<MPMCQueue<uint64_t>>(
+                "fixed  ", numQueues, capacity, depth);
+        runMemoryTest<DynamicMPMCQueue<uint64_t>>(
+                "dynamic", numQueues, capacity, depth);
+    }
+    std::cout << std::endl;
+
+    int nts[] = {1, 4, 10};
+    const uint64_t n = 1000000;
+    for (int nt : nts) {
+        auto fixedTime = runThroughputTest<MPMCQueue<uint64_t>>(nt, n, 10000);
+        auto dynamicTime =
+            runThroughputTest<DynamicMPMCQueue<uint64_t>>(nt, n, 10000);
+        std::cout << "thread num:" << std::setw(4) << nt
+          << ". fixed queue time: " << std::setw(8) << fixedTime << " us"
+          << ", dynamic queue time: " << std::setw(8) << dynamicTime << " us"
+          << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <stdint.h>
+
+namespace myfolly {
+
+/// A log-linear latency histogram in the style of HdrHistogram: each power
+/// of two is split into 2^kSubBits linear buckets, so every recorded value
+/// is known to within 1 / 2^kSubBits (about 3%) over the whole range of
+/// uint64_t, in a fixed 16 KB of counters.
+///
+/// Not thread-safe: every thread records into its own histogram, and the
+/// histograms are merged when the run is over.
+class LatencyHistogram {
+public:
+    static constexpr int kSubBits = 5;
+    static constexpr int kSubBuckets = 1 << kSubBits;
+
+    LatencyHistogram() noexcept { reset(); }
+
+    void reset() noexcept {
+        _counts.fill(0);
+        _total = 0;
+        _sum = 0;
+        _min = std::numeric_limits<uint64_t>::max();
+        _max = 0;
+    }
+
+    void record(uint64_t value) noexcept {
+        ++_counts[bucket(value)];
+        ++_total;
+        _sum += value;
+        _min = std::min(_min, value);
+        _max = std::max(_max, value);
+    }
+
+    void merge(const LatencyHistogram& other) noexcept {
+        for (size_t i = 0; i < _counts.size(); ++i) {
+            _counts[i] += other._counts[i];
+        }
+        _total += other._total;
+        _sum += other._sum;
+        _min = std::min(_min, other._min);
+        _max = std::max(_max, other._max);
+    }
+
+    uint64_t count() const noexcept { return _total; }
+
+    uint64_t min() const noexcept { return _total == 0 ? 0 : _min; }
+
+    uint64_t max() const noexcept { return _max; }
+
+    double mean() const noexcept {
+        return _total == 0 ? 0 : double(_sum) / double(_total);
+    }
+
+    /// The value below which a fraction q (0..1) of the recorded values
+    /// fall, rounded up to the end of its bucket and capped at max()
+    uint64_t percentile(double q) const noexcept {
+        if (_total == 0) {
+            return 0;
+        }
+        uint64_t rank = uint64_t(q * double(_total) + 0.5);
+        rank = std::max<uint64_t>(1, std::min(rank, _total));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < _counts.size(); ++i) {
+            seen += _counts[i];
+            if (seen >= rank) {
+                return std::min(bucketEnd(i), _max);
+            }
+        }
+        return _max;
+    }
+
+private:
+    static constexpr int kNumBuckets = (64 - kSubBits + 1) * kSubBuckets;
+
+    /// Values below kSubBuckets get a bucket each; above, the bucket is
+    /// the position of the highest bit and the kSubBits bits below it
+    static size_t bucket(uint64_t v) noexcept {
+        if (v < uint64_t(kSubBuckets)) {
+            return size_t(v);
+        }
+        int msb = 63 - __builtin_clzll(v);
+        int shift = msb - kSubBits;
+        size_t sub = size_t(v >> shift) & (kSubBuckets - 1);
+        return size_t(shift + 1) * kSubBuckets + sub;
+    }
+
+    /// The largest value that falls into bucket i
+    static uint64_t bucketEnd(size_t i) noexcept {
+        if (i < size_t(kSubBuckets)) {
+            return i;
+        }
+        int shift = int(i / kSubBuckets) - 1;
+        uint64_t sub = i % kSubBuckets;
+        uint64_t start = (uint64_t(kSubBuckets) + sub) << shift;
+        return start + ((uint64_t(1) << shift) - 1);
+    }
+
+    std::array<uint64_t, kNumBuckets> _counts;
+    uint64_t _total;
+    uint64_t _sum;
+    uint64_t _min;
+    uint64_t _max;
+};
+
+};  // namespace myfolly
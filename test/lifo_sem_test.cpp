@@ -0,0 +1,95 @@
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "lifo_sem.h"
+#include "gtest/gtest.h"
+
+using namespace myfolly;
+using namespace std::chrono;
+
+TEST(LifoSemTest, counts) {
+    LifoSem sem(2);
+    EXPECT_TRUE(sem.tryWait());
+    EXPECT_TRUE(sem.tryWait());
+    EXPECT_FALSE(sem.tryWait());
+    sem.post(3);
+    EXPECT_EQ(3, sem.value());
+    sem.wait();
+    sem.wait();
+    sem.wait();
+    EXPECT_FALSE(sem.tryWait());
+    EXPECT_EQ(0, sem.value());
+}
+
+static void waitForWaiters(LifoSem& sem, size_t n) {
+    while (sem.waiters() != n) {
+        std::this_thread::yield();
+    }
+}
+
+TEST(LifoSemTest, wakes_most_recent_waiter_first) {
+    LifoSem sem;
+    std::mutex mutex;
+    std::vector<int> woken;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t]() {
+                sem.wait();
+                std::lock_guard<std::mutex> lock(mutex);
+                woken.push_back(t);
+                });
+        // t is on the stack before t + 1 starts waiting
+        waitForWaiters(sem, t + 1);
+    }
+    EXPECT_EQ(-4, sem.value());
+    for (int i = 0; i < 4; ++i) {
+        sem.post();
+        waitForWaiters(sem, 3 - i);
+        while (true) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (woken.size() == size_t(i + 1)) {
+                break;
+            }
+        }
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    EXPECT_EQ((std::vector<int>{3, 2, 1, 0}), woken);
+}
+
+TEST(LifoSemTest, mt_post_wait) {
+    LifoSem sem;
+    const int numThreads = 4;
+    const int perThread = 20000;
+    std::atomic<int> taken{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; ++t) {
+        threads.emplace_back([&]() {
+                for (int i = 0; i < perThread; ++i) {
+                    sem.wait();
+                    ++taken;
+                }
+                });
+        threads.emplace_back([&]() {
+                for (int i = 0; i < perThread; ++i) {
+                    sem.post();
+                }
+                });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    EXPECT_EQ(numThreads * perThread, taken.load());
+    EXPECT_EQ(0, sem.value());
+    EXPECT_EQ(0u, sem.waiters());
+}
+
+int main(int argc, char* argv[]) {
+    testing::InitGoogleTest(&argc, argv);
+
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,183 @@
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "mpmc_pipeline.h"
+#include "portability.h"
+
+using namespace myfolly;
+
+static uint64_t now_steady_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>
+      (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// Busy work of about cost iterations, returns something that depends on x
+static uint64_t process(uint64_t x, uint32_t cost) {
+    uint64_t h = x;
+    for (uint32_t i = 0; i < cost; ++i) {
+        h = h * 6364136223846793005ULL + 1442695040888963407ULL;
+    }
+    return h;
+}
+
+/// Per-item costs: uniform, or mostly cheap with every 16th item 32 times
+/// as expensive, which is what makes items finish out of order
+static std::vector<uint32_t> makeCosts(size_t n, uint32_t cost, bool skewed) {
+    std::vector<uint32_t> costs(n, cost);
+    if (skewed) {
+        uint64_t rng = 88172645463325252ULL;
+        for (size_t i = 0; i < n; ++i) {
+            rng ^= rng << 13;
+            rng ^= rng >> 7;
+            rng ^= rng << 17;
+            costs[i] = (rng % 16 == 0) ? cost * 32 : cost / 2;
+        }
+    }
+    return costs;
+}
+
+template <typename Q>
+static Q* newQueue(size_t capacity) {
+    return detail::alignedNew<Q>(capacity);
+}
+
+template <typename Q>
+static void deleteQueue(Q* q) {
+    detail::alignedDelete(q);
+}
+
+/// What we do today: workers process items in any order, then put the
+/// results into a map under a mutex, and whoever holds the mutex emits the
+/// results that are next in line.
+///
+/// Both runs fold the results into check in the order they come out, so
+/// their checks only match if both kept the input order
+static uint64_t runReorderBuffer(size_t workers,
+        const std::vector<uint32_t>& costs, uint64_t& check) {
+    using Item = std::pair<uint64_t, uint32_t>;
+    const size_t n = costs.size();
+    auto* in = newQueue<MPMCQueue<Item>>(1024);
+    auto* out = newQueue<MPMCQueue<uint64_t>>(1024);
+    std::mutex mutex;
+    std::map<uint64_t, uint64_t> pending;
+    uint64_t next = 0;
+
+    std::vector<std::thread> threads;
+    for (size_t w = 0; w < workers; ++w) {
+        threads.emplace_back([&, w]() {
+                for (size_t i = w; i < n; i += workers) {
+                    Item item;
+                    in->blockingRead(item);
+                    uint64_t result = process(item.first, item.second);
+                    std::lock_guard<std::mutex> lock(mutex);
+                    pending.emplace(item.first, result);
+                    auto it = pending.begin();
+                    while (it != pending.end() && it->first == next) {
+                        out->blockingWrite(it->second);
+                        it = pending.erase(it);
+                        ++next;
+                    }
+                }
+                });
+    }
+    uint64_t start = now_steady_ns();
+    std::thread producer([&]() {
+            for (size_t i = 0; i < n; ++i) {
+                in->blockingWrite(Item(i, costs[i]));
+            }
+            });
+    check = 0;
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t v;
+        out->blockingRead(v);
+        check = check * 31 + v;
+    }
+    uint64_t elapsed = now_steady_ns() - start;
+    producer.join();
+    for (auto& t : threads) {
+        t.join();
+    }
+    deleteQueue(in);
+    deleteQueue(out);
+    return elapsed / n;
+}
+
+static uint64_t runPipeline(size_t workers,
+        const std::vector<uint32_t>& costs, uint64_t& check) {
+    using Item = std::pair<uint64_t, uint32_t>;
+    using Pipeline = MPMCPipeline<Item, uint64_t>;
+    const size_t n = costs.size();
+    Pipeline p(1024);
+
+    std::vector<std::thread> threads;
+    for (size_t w = 0; w < workers; ++w) {
+        threads.emplace_back([&, w]() {
+                for (size_t i = w; i < n; i += workers) {
+                    Pipeline::Ticket<0> ticket;
+                    Item item;
+                    p.blockingReadStage<0>(ticket, item);
+                    p.blockingWriteStage<0>(ticket,
+                            process(item.first, item.second));
+                }
+                });
+    }
+    uint64_t start = now_steady_ns();
+    std::thread producer([&]() {
+            for (size_t i = 0; i < n; ++i) {
+                p.blockingWrite(Item(i, costs[i]));
+            }
+            });
+    check = 0;
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t v;
+        p.blockingRead(v);
+        check = check * 31 + v;
+    }
+    uint64_t elapsed = now_steady_ns() - start;
+    producer.join();
+    for (auto& t : threads) {
+        t.join();
+    }
+    return elapsed / n;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "Start MPMCPipelineBenchmark!" << std::endl;
+    const size_t n = 500000;
+    const size_t hw = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<size_t> numWorkers = {1, 2, 4, hw};
+    std::sort(numWorkers.begin(), numWorkers.end());
+    numWorkers.erase(std::unique(numWorkers.begin(), numWorkers.end()),
+            numWorkers.end());
+    for (uint32_t cost : {0u, 64u, 512u}) {
+        for (bool skewed : {false, true}) {
+            auto costs = makeCosts(n, cost, skewed);
+            for (size_t workers : numWorkers) {
+                uint64_t pipelineCheck;
+                uint64_t reorderCheck;
+                uint64_t pipelineNs = runPipeline(workers, costs,
+                        pipelineCheck);
+                uint64_t reorderNs = runReorderBuffer(workers, costs,
+                        reorderCheck);
+                std::cout << "cost " << std::setw(3) << cost
+                  << (skewed ? " skewed " : " uniform")
+                  << " workers " << std::setw(3) << workers
+                  << ". pipeline " << std::setw(5) << pipelineNs
+                  << " ns/item, mutex reorder " << std::setw(5) << reorderNs
+                  << " ns/item";
+                if (pipelineCheck != reorderCheck) {
+                    std::cout << " ERROR order differs!";
+                }
+                std::cout << std::endl;
+            }
+        }
+    }
+    return 0;
+}
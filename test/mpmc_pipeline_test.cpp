@@ -0,0 +1,136 @@
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mpmc_pipeline.h"
+#include "gtest/gtest.h"
+
+using namespace myfolly;
+using namespace std::chrono;
+
+TEST(MPMCPipelineTest, queue_reads_tickets_in_order) {
+    MPMCQueue<int> q(4);
+    // written back to front, read front to back
+    for (int i = 3; i >= 0; --i) {
+        q.writeWithTicket(uint64_t(i), i * 10);
+    }
+    uint64_t ticket = 99;
+    int v = -1;
+    for (int i = 0; i < 4; ++i) {
+        ASSERT_TRUE(q.readAndGetTicket(ticket, v));
+        EXPECT_EQ(uint64_t(i), ticket);
+        EXPECT_EQ(i * 10, v);
+    }
+    EXPECT_FALSE(q.readAndGetTicket(ticket, v));
+    EXPECT_EQ(0u, q.writeCount());
+    EXPECT_EQ(4u, q.readCount());
+
+    q.writeWithTicket(4, 40);
+    EXPECT_EQ(4u, q.blockingReadWithTicket(v));
+    EXPECT_EQ(40, v);
+}
+
+TEST(MPMCPipelineTest, single_thread_stages) {
+    MPMCPipeline<int, std::string, size_t> p(std::array<size_t, 3>{{4, 2, 4}});
+    EXPECT_EQ(2u, size_t(decltype(p)::kNumStages));
+    for (int i = 0; i < 4; ++i) {
+        EXPECT_TRUE(p.write(i * 11));
+    }
+    EXPECT_FALSE(p.write(0));
+    EXPECT_EQ(4, p.sizeGuess());
+
+    decltype(p)::Ticket<0> t0[2];
+    int in[2];
+    ASSERT_TRUE(p.readStage<0>(t0[0], in[0]));
+    ASSERT_TRUE(p.readStage<0>(t0[1], in[1]));
+    // finish the second element first
+    p.blockingWriteStage<0>(t0[1], std::to_string(in[1]));
+    p.blockingWriteStage<0>(t0[0], std::to_string(in[0]));
+
+    decltype(p)::Ticket<1> t1;
+    std::string s;
+    for (int i = 0; i < 2; ++i) {
+        ASSERT_TRUE(p.readStage<1>(t1, s));
+        p.blockingWriteStage<1>(t1, s.size());
+    }
+    EXPECT_FALSE(p.readStage<1>(t1, s));
+
+    size_t out = 0;
+    ASSERT_TRUE(p.read(out));
+    EXPECT_EQ(1u, out);  // "0"
+    ASSERT_TRUE(p.read(out));
+    EXPECT_EQ(2u, out);  // "11"
+    EXPECT_FALSE(p.read(out));
+    EXPECT_EQ(2, p.sizeGuess());
+}
+
+TEST(MPMCPipelineTest, mt_keeps_input_order) {
+    const int n = 20000;
+    const int workers = 4;
+    MPMCPipeline<int, int, int> p(64);
+    std::vector<std::thread> threads;
+    for (int w = 0; w < workers; ++w) {
+        threads.emplace_back([&p, w]() {
+                decltype(p)::Ticket<0> t;
+                int v;
+                for (int i = 0; i < n / workers; ++i) {
+                    p.blockingReadStage<0>(t, v);
+                    if ((v + w) % 7 == 0) {
+                        // finish out of order
+                        std::this_thread::yield();
+                    }
+                    p.blockingWriteStage<0>(t, v * 2);
+                }
+                });
+        threads.emplace_back([&p]() {
+                decltype(p)::Ticket<1> t;
+                int v;
+                for (int i = 0; i < n / workers; ++i) {
+                    p.blockingReadStage<1>(t, v);
+                    if (v % 5 == 0) {
+                        std::this_thread::sleep_for(microseconds(1));
+                    }
+                    p.blockingWriteStage<1>(t, v + 1);
+                }
+                });
+    }
+    std::thread producer([&p]() {
+            for (int i = 0; i < n; ++i) {
+                p.blockingWrite(i);
+            }
+            });
+    for (int i = 0; i < n; ++i) {
+        int v = -1;
+        p.blockingRead(v);
+        ASSERT_EQ(i * 2 + 1, v);
+    }
+    producer.join();
+    for (auto& t : threads) {
+        t.join();
+    }
+    EXPECT_EQ(0, p.sizeGuess());
+}
+
+TEST(MPMCPipelineTest, destroys_queued_elements) {
+    auto counter = std::make_shared<int>(0);
+    {
+        MPMCPipeline<std::shared_ptr<int>, std::shared_ptr<int>> p(4);
+        p.blockingWrite(counter);
+        p.blockingWrite(counter);
+        decltype(p)::Ticket<0> t;
+        std::shared_ptr<int> v;
+        p.blockingReadStage<0>(t, v);
+        p.blockingWriteStage<0>(t, std::move(v));
+        EXPECT_EQ(3, counter.use_count());
+    }
+    EXPECT_EQ(1, counter.use_count());
+}
+
+int main(int argc, char* argv[]) {
+    testing::InitGoogleTest(&argc, argv);
+
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,122 @@
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <iomanip>
+
+#include <sys/resource.h>
+
+#include "mpmc_queue.h"
+#include "mmap_allocator.h"
+
+using namespace myfolly;
+
+static uint64_t now_real_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>
+      (std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+/// Minor page faults of the whole process so far
+static uint64_t minor_faults() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_minflt;
+}
+
+using Slot = SingleElementQueue<uint64_t>;
+
+template <typename Alloc>
+static std::string describe(const Alloc&) {
+    return "";
+}
+
+static std::string describe(const MmapAllocator<Slot>& alloc) {
+    auto const& r = alloc.lastResult();
+    std::string s;
+    s += r.hugeTlb ? " hugetlb" : "";
+    s += r.transparentHugePages ? " thp" : "";
+    s += r.prefaulted ? " prefaulted" : "";
+    s += r.numaBound ? " numa-bound" : "";
+    return s.empty() ? " 4k-pages" : s;
+}
+
+/// Keeps a large queue half full while numThreads producers and consumers
+/// stream n elements through it, so every operation lands on a slot far
+/// away from the previous one in memory.
+template <typename Alloc>
+void runLargeQueueTest(const char* name, size_t capacity, int numThreads,
+        uint64_t n, const Alloc& alloc) {
+    auto faultsBefore = minor_faults();
+    auto constructStart = now_real_us();
+    MPMCQueue<uint64_t, Alloc> q(capacity, alloc);
+    auto constructTime = now_real_us() - constructStart;
+
+    for (size_t i = 0; i < capacity / 2; ++i) {
+        q.blockingWrite(i);
+    }
+    auto faultsAfterSetup = minor_faults();
+
+    std::vector<std::thread> threads;
+    auto start = now_real_us();
+    for (int t = 0; t < numThreads; ++t) {
+        threads.emplace_back([&, t]() {
+                for (uint64_t i = t; i < n; i += numThreads) {
+                    q.blockingWrite(i);
+                }
+                });
+        threads.emplace_back([&, t]() {
+                uint64_t elem;
+                for (uint64_t i = t; i < n; i += numThreads) {
+                    q.blockingRead(elem);
+                }
+                });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    auto elapsed = now_real_us() - start;
+    auto faultsAfterRun = minor_faults();
+
+    std::cout << name << " capacity:" << std::setw(8) << capacity
+      << " threads:" << std::setw(2) << numThreads
+      << ". setup: " << std::setw(7) << constructTime << " us, "
+      << std::setw(7) << (faultsAfterSetup - faultsBefore) << " faults"
+      << ". run: " << std::setw(8) << elapsed << " us ("
+      << std::setw(6) << n * 1000000 / std::max<uint64_t>(elapsed, 1) / 1000
+      << " Kops/s), " << (faultsAfterRun - faultsAfterSetup) << " faults."
+      << describe(q.allocator()) << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "Start MPMCQueueAllocatorBenchmark!" << std::endl;
+    size_t capacities[] = {size_t(1) << 20, size_t(1) << 22};
+    int nts[] = {1, 4};
+    const uint64_t n = 4000000;
+
+    MmapAllocationOptions thp;
+    thp.transparentHugePages = true;
+    MmapAllocationOptions hugeTlb;
+    hugeTlb.hugeTlb = true;
+    hugeTlb.prefault = true;
+    MmapAllocationOptions numa;
+    numa.transparentHugePages = true;
+    numa.prefault = true;
+    numa.numaNode = 0;
+
+    for (size_t cap : capacities) {
+        for (int nt : nts) {
+            runLargeQueueTest("std::allocator     ", cap, nt, n,
+                    std::allocator<Slot>());
+            runLargeQueueTest("mmap               ", cap, nt, n,
+                    MmapAllocator<Slot>());
+            runLargeQueueTest("mmap thp           ", cap, nt, n,
+                    MmapAllocator<Slot>(thp));
+            runLargeQueueTest("mmap hugetlb+fault ", cap, nt, n,
+                    MmapAllocator<Slot>(hugeTlb));
+            runLargeQueueTest("mmap thp+fault+numa", cap, nt, n,
+                    MmapAllocator<Slot>(numa));
+        }
+    }
+    return 0;
+}
@@ -1,4 +1,5 @@
 #include <iostream>
+#include <algorithm>
 #include <functional>
 #include <memory>
 #include <string>
@@ -8,9 +9,15 @@
 #include <queue>
 #include <mutex>
 #include <iomanip>
+#include <vector>
+
+#include <time.h>
 
 #include "mpmc_queue.h"
 #include "bounded_queue.h"
+#include "sharded_queue.h"
+#include "normal_queue.h"
+#include "perf_counters.h"
 
 using namespace myfolly;
 
@@ -19,70 +26,13 @@ static uint64_t now_real_us() {
       (std::chrono::system_clock::now().time_since_epoch()).count();
 }
 
-template <typename T>
-class NormalQueue {
-public:
-    NormalQueue(size_t cap) :
-        _capacity(cap) {}
-
-    bool write(T const& val) {
-        std::lock_guard<std::mutex> lk(_mutex);
-        if(_q.size() >= _capacity) {
-            return false;
-        }
-        _q.push(val);
-        return true;
-    }
-
-    void blockingWrite(T const& val) {
-        while(true) {
-            while(_q.size() >= _capacity) {
-                std::this_thread::yield();
-            }
-            std::lock_guard<std::mutex> lk(_mutex);
-            if(_q.size() >= _capacity) {
-                continue;
-            }
-            _q.push(val);
-            break;
-        }
-    }
-
-    bool read(T& val) {
-        std::lock_guard<std::mutex> lk(_mutex);
-        if(_q.empty()) {
-            return false;
-        }
-        val = _q.front();
-        _q.pop();
-        return true;
-    }
-
-    void blockingRead(T& val) {
-        while(true) {
-            while(_q.empty()) {
-                std::this_thread::yield();
-            }
-            std::lock_guard<std::mutex> lk(_mutex);
-            if(_q.empty()) {
-                continue;
-            }
-            val = _q.front();
-            _q.pop();
-            break;
-        }
-    }
-
-    bool isEmpty() {
-        std::lock_guard<std::mutex> lk(_mutex);
-        return _q.empty();
-    }
-
-private:
-    size_t _capacity;
-    std::queue<T> _q;
-    std::mutex _mutex;
-};
+/// CPU time consumed by all threads of the process so far.  Together with
+/// the wall time it shows how much of a run was spent spinning
+static uint64_t now_cpu_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
 
 template <typename Q>
 void runEnqThread(
@@ -159,58 +109,279 @@ void runTryEnqDeqTest(int numThreads, int numOps) {
     }
 }
 
-void mt_test_enq_deq() {
+void mt_test_enq_deq(const PerfCounters& perf) {
     int nts[] = {1, 4, 10, 50, 100};
 
     int32_t n = 1000000;
     {
         std::cout << "Test normal queue:" << std::endl;
+        PerfPhase phase(perf, "normal queue", double(n) * 5);
         uint64_t all_time = 0;
+        uint64_t all_cpu_time = 0;
         for (int nt : nts) {
             auto start = now_real_us();
+            auto cpu_start = now_cpu_us();
             runTryEnqDeqTest<NormalQueue<uint64_t>>(nt, n);
             auto normal_queue_time = now_real_us() - start;
+            auto cpu_time = now_cpu_us() - cpu_start;
             std::cout << "thread num:" << std::setw(4) << nt
-              << ". normal  queue time: " << normal_queue_time << " us" << std::endl;
+              << ". normal  queue time: " << normal_queue_time << " us"
+              << ", cpu: " << cpu_time << " us" << std::endl;
             all_time += normal_queue_time;
+            all_cpu_time += cpu_time;
         }
-        std::cout << "normal  queue time: " << all_time << " us" << std::endl;
+        std::cout << "normal  queue time: " << all_time << " us"
+          << ", cpu: " << all_cpu_time << " us" << std::endl;
     }
     std::cout << std::endl;
 
     {
         std::cout << "Test bounded queue:" << std::endl;
+        PerfPhase phase(perf, "bounded queue", double(n) * 5);
         uint64_t all_time = 0;
+        uint64_t all_cpu_time = 0;
         for (int nt : nts) {
             auto start = now_real_us();
+            auto cpu_start = now_cpu_us();
             runTryEnqDeqTest<BoundedQueue<uint64_t>>(nt, n);
             auto run_time = now_real_us() - start;
+            auto cpu_time = now_cpu_us() - cpu_start;
             std::cout << "thread num:" << std::setw(4) << nt
-              << ". bounded queue time: " << run_time << " us" << std::endl;
+              << ". bounded queue time: " << run_time << " us"
+              << ", cpu: " << cpu_time << " us" << std::endl;
             all_time += run_time;
+            all_cpu_time += cpu_time;
         }
-        std::cout << "bounded queue time: " << all_time << " us" << std::endl;
+        std::cout << "bounded queue time: " << all_time << " us"
+          << ", cpu: " << all_cpu_time << " us" << std::endl;
     }
     std::cout << std::endl;
 
     {
         std::cout << "Test mpmc queue:" << std::endl;
+        PerfPhase phase(perf, "mpmc queue", double(n) * 5);
         uint64_t all_time = 0;
+        uint64_t all_cpu_time = 0;
         for (int nt : nts) {
             auto start = now_real_us();
+            auto cpu_start = now_cpu_us();
             runTryEnqDeqTest<MPMCQueue<uint64_t>>(nt, n);
             auto mpmc_queue_time = now_real_us() - start;
+            auto cpu_time = now_cpu_us() - cpu_start;
             std::cout << "thread num:" << std::setw(4) << nt
-              << ". mpmc    queue time: " << mpmc_queue_time << " us" << std::endl;
+              << ". mpmc    queue time: " << mpmc_queue_time << " us"
+              << ", cpu: " << cpu_time << " us" << std::endl;
             all_time += mpmc_queue_time;
+            all_cpu_time += cpu_time;
+        }
+        std::cout << "mpmc    queue time: " << all_time << " us"
+          << ", cpu: " << all_cpu_time << " us" << std::endl;
+    }
+}
+
+/// numProducers threads write n elements in total, numConsumers threads
+/// read them
+template <typename Q>
+uint64_t runProducerConsumerTest(int numProducers, int numConsumers,
+        uint64_t n) {
+    Q cq(128);
+    std::atomic<uint64_t> sum(0);
+    std::vector<std::thread> threads;
+    auto start = now_real_us();
+    for (int t = 0; t < numProducers; ++t) {
+        threads.emplace_back(runEnqThread<Q>, numProducers, n, std::ref(cq), t);
+    }
+    for (int t = 0; t < numConsumers; ++t) {
+        threads.emplace_back(runDeqThread<Q>, numConsumers, n,
+                std::ref(cq), std::ref(sum), t);
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    auto run_time = now_real_us() - start;
+    if(n * (n - 1) / 2 != sum) {
+        std::cout << "ERROR Result! sum:" << n * (n - 1) / 2 << " : " << sum << std::endl;
+    }
+    return run_time;
+}
+
+void mt_test_single_producer_consumer(const PerfCounters& perf) {
+    int32_t n = 1000000;
+    std::cout << "Test single producer/consumer:" << std::endl;
+    PerfPhase phase(perf, "single producer/consumer", double(n) * 9);
+    std::cout << "1 producer, 1 consumer. spsc bounded queue time: "
+      << runProducerConsumerTest<SPSCBoundedQueue<uint64_t>>(1, 1, n)
+      << " us, mpmc bounded queue time: "
+      << runProducerConsumerTest<BoundedQueue<uint64_t>>(1, 1, n)
+      << " us, mpmc queue time: "
+      << runProducerConsumerTest<MPMCQueue<uint64_t>>(1, 1, n)
+      << " us" << std::endl;
+    for (int nt : {4, 10}) {
+        std::cout << nt << " producers, 1 consumer. mpsc bounded queue time: "
+          << runProducerConsumerTest<MPSCBoundedQueue<uint64_t>>(nt, 1, n)
+          << " us, mpmc bounded queue time: "
+          << runProducerConsumerTest<BoundedQueue<uint64_t>>(nt, 1, n)
+          << " us, mpmc queue time: "
+          << runProducerConsumerTest<MPMCQueue<uint64_t>>(nt, 1, n)
+          << " us" << std::endl;
+    }
+}
+
+template <typename Q>
+void runBatchEnqThread(
+        int numThreads,
+        uint64_t n, /*numOps*/
+        size_t batch,
+        Q& cq,
+        int t) {
+    std::vector<uint64_t> buf(batch);
+    uint64_t src = t * batch;
+    while (src < n) {
+        size_t len = 0;
+        for (; len < batch && src + len < n; ++len) {
+            buf[len] = src + len;
+        }
+        cq.blockingWriteBatch(buf.begin(), buf.begin() + len);
+        src += numThreads * batch;
+    }
+}
+
+template <typename Q>
+void runBatchDeqThread(
+        int numThreads,
+        uint64_t n, /*numOps*/
+        size_t batch,
+        Q& cq,
+        std::atomic<uint64_t>& sum,
+        int t) {
+    std::vector<uint64_t> buf(batch);
+    uint64_t threadSum = 0;
+    uint64_t received = t * batch;
+    while (received < n) {
+        size_t len = std::min<uint64_t>(batch, n - received);
+        cq.blockingReadBatch(buf.begin(), len);
+        for (size_t i = 0; i < len; ++i) {
+            threadSum += buf[i];
+        }
+        received += numThreads * batch;
+    }
+    sum += threadSum;
+}
+
+/// Same as runTryEnqDeqTest, but every thread moves batch elements per
+/// ticket reservation
+template <typename Q>
+void runBatchEnqDeqTest(int numThreads, int numOps, size_t batch) {
+    Q cq(128);
+
+    uint64_t n = numOps;
+    std::vector<std::unique_ptr<std::thread>> push_threads(numThreads);
+    std::vector<std::unique_ptr<std::thread>> pop_threads(numThreads);
+    std::atomic<uint64_t> sum(0);
+    for (int t = 0; t < numThreads; ++t) {
+        push_threads[t].reset(new std::thread(std::bind(
+                runBatchEnqThread<Q>,
+                numThreads,
+                n,
+                batch,
+                std::ref(cq),
+                t)));
+        pop_threads[t].reset(new std::thread(std::bind(
+                runBatchDeqThread<Q>,
+                numThreads,
+                n,
+                batch,
+                std::ref(cq),
+                std::ref(sum),
+                t)));
+    }
+    for(auto& t : push_threads) {
+        if(t->joinable()) {
+            t->join();
+        }
+    }
+    push_threads.clear();
+    for(auto& t : pop_threads) {
+        if(t->joinable()) {
+            t->join();
         }
-        std::cout << "mpmc    queue time: " << all_time << " us" << std::endl;
+    }
+    pop_threads.clear();
+    if(!cq.isEmpty()) {
+        std::cout << "ERROR Result! cq is not empty." << std::endl;
+        return;
+    }
+    if(n * (n - 1) / 2 != sum) {
+        std::cout << "ERROR Result! sum:" << n * (n - 1) / 2 << " : " << sum << std::endl;
+    }
+}
+
+void mt_test_batch_enq_deq(const PerfCounters& perf) {
+    int nts[] = {1, 4, 10, 50, 100};
+    size_t batches[] = {1, 8, 32, 128};
+
+    int32_t n = 1000000;
+    std::cout << "Test mpmc queue batch:" << std::endl;
+    for (size_t batch : batches) {
+        PerfPhase phase(perf, "batch " + std::to_string(batch),
+                double(n) * 5);
+        uint64_t all_time = 0;
+        for (int nt : nts) {
+            auto start = now_real_us();
+            runBatchEnqDeqTest<MPMCQueue<uint64_t>>(nt, n, batch);
+            auto run_time = now_real_us() - start;
+            std::cout << "thread num:" << std::setw(4) << nt
+              << ". batch:" << std::setw(4) << batch
+              << ". mpmc    queue time: " << run_time << " us" << std::endl;
+            all_time += run_time;
+        }
+        std::cout << "batch:" << std::setw(4) << batch
+          << ". mpmc    queue time: " << all_time << " us" << std::endl;
+    }
+}
+
+/// Thread scaling up to twice the hardware threads: one MPMCQueue against
+/// a ShardedQueue with one 128-slot shard per hardware thread
+void mt_test_sharded_enq_deq(const PerfCounters& perf) {
+    const int maxThreads =
+        2 * std::max(1u, std::thread::hardware_concurrency());
+    std::vector<int> nts;
+    for (int nt = 1; nt < maxThreads; nt *= 2) {
+        nts.push_back(nt);
+    }
+    nts.push_back(maxThreads);
+
+    int32_t n = 1000000;
+    std::cout << "Test sharded queue scaling:" << std::endl;
+    PerfPhase phase(perf, "mpmc and sharded queue scaling",
+            double(n) * 2 * nts.size());
+    for (int nt : nts) {
+        auto start = now_real_us();
+        runTryEnqDeqTest<MPMCQueue<uint64_t>>(nt, n);
+        auto mpmc_queue_time = now_real_us() - start;
+        start = now_real_us();
+        runTryEnqDeqTest<ShardedQueue<uint64_t>>(nt, n);
+        auto sharded_queue_time = now_real_us() - start;
+        std::cout << "thread num:" << std::setw(4) << nt
+          << ". mpmc    queue time: " << mpmc_queue_time << " us"
+          << ", sharded queue time: " << sharded_queue_time << " us"
+          << std::endl;
     }
 }
 
+/// --perf prints hardware and software counters for every phase (see
+/// perf_counters.h)
 int main(int argc, char* argv[]) {
+    // opened before any benchmark thread exists, so that they are counted
+    PerfCounters perf(argc > 1 && std::string(argv[1]) == "--perf");
     std::cout << "Start MPMCQueueBenchmark!" << std::endl;
-    mt_test_enq_deq();
+    mt_test_enq_deq(perf);
+    std::cout << std::endl;
+    mt_test_single_producer_consumer(perf);
+    std::cout << std::endl;
+    mt_test_batch_enq_deq(perf);
+    std::cout << std::endl;
+    mt_test_sharded_enq_deq(perf);
     return 0;
 }
 
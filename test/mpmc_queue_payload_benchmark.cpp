@@ -0,0 +1,159 @@
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <iomanip>
+
+#include "mpmc_queue.h"
+
+using namespace myfolly;
+
+static uint64_t now_real_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>
+      (std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+/// A 256 byte message that counts how often it is copied
+struct Payload256 {
+    static std::atomic<uint64_t> copies;
+
+    explicit Payload256(uint64_t v = 0) noexcept {
+        memset(data, 0, sizeof(data));
+        memcpy(data, &v, sizeof(v));
+    }
+    Payload256(const Payload256& rhs) noexcept {
+        memcpy(data, rhs.data, sizeof(data));
+        copies.fetch_add(1, std::memory_order_relaxed);
+    }
+    Payload256(Payload256&& rhs) noexcept {
+        memcpy(data, rhs.data, sizeof(data));
+    }
+    Payload256& operator=(const Payload256& rhs) noexcept {
+        memcpy(data, rhs.data, sizeof(data));
+        copies.fetch_add(1, std::memory_order_relaxed);
+        return *this;
+    }
+    Payload256& operator=(Payload256&& rhs) noexcept {
+        memcpy(data, rhs.data, sizeof(data));
+        return *this;
+    }
+
+    uint64_t value() const noexcept {
+        uint64_t v;
+        memcpy(&v, data, sizeof(v));
+        return v;
+    }
+
+    char data[256];
+};
+
+std::atomic<uint64_t> Payload256::copies{0};
+
+enum class WriteMode { COPY, MOVE, EMPLACE };
+
+static const char* modeName(WriteMode mode) {
+    switch (mode) {
+    case WriteMode::COPY: return "copy   ";
+    case WriteMode::MOVE: return "move   ";
+    default: return "emplace";
+    }
+}
+
+/// Builds the i-th message.  Strings are long enough to defeat the small
+/// string optimization, so every copy is a heap allocation plus memcpy.
+static std::string makeString(uint64_t i) {
+    std::string s(200, 'x');
+    memcpy(&s[0], &i, sizeof(i));
+    return s;
+}
+
+static void writeOne(MPMCQueue<Payload256>& q, uint64_t i, WriteMode mode) {
+    switch (mode) {
+    case WriteMode::COPY: {
+        Payload256 p(i);
+        q.blockingWrite(p);
+        break;
+    }
+    case WriteMode::MOVE: {
+        Payload256 p(i);
+        q.blockingWrite(std::move(p));
+        break;
+    }
+    case WriteMode::EMPLACE:
+        q.blockingWrite(i);
+        break;
+    }
+}
+
+static uint64_t valueOf(const Payload256& p) { return p.value(); }
+
+/// std::string's copy and fill constructors may throw, so like BoundedQueue
+/// the queue only accepts it by (noexcept) move.  COPY models a producer
+/// that keeps its message and has to hand the queue a copy.
+static void writeOne(MPMCQueue<std::string>& q, uint64_t i, WriteMode mode) {
+    std::string s = makeString(i);
+    if (mode == WriteMode::COPY) {
+        std::string copy(s);
+        q.blockingWrite(std::move(copy));
+    } else {
+        q.blockingWrite(std::move(s));
+    }
+}
+
+static uint64_t valueOf(const std::string& s) { return s.size(); }
+
+template <typename T>
+void runPayloadTest(const char* name, int numThreads, uint64_t n,
+        WriteMode mode) {
+    MPMCQueue<T> q(128);
+    Payload256::copies = 0;
+    std::atomic<uint64_t> sum{0};
+    std::vector<std::thread> threads;
+    auto start = now_real_us();
+    for (int t = 0; t < numThreads; ++t) {
+        threads.emplace_back([&, t]() {
+                for (uint64_t i = t; i < n; i += numThreads) {
+                    writeOne(q, i, mode);
+                }
+                });
+        threads.emplace_back([&, t]() {
+                uint64_t threadSum = 0;
+                T elem;
+                for (uint64_t i = t; i < n; i += numThreads) {
+                    q.blockingRead(elem);
+                    threadSum += valueOf(elem);
+                }
+                sum += threadSum;
+                });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    auto elapsed = now_real_us() - start;
+    std::cout << name << " " << modeName(mode)
+      << " thread num:" << std::setw(3) << numThreads
+      << ". time: " << std::setw(8) << elapsed << " us"
+      << ", ns/op: " << std::setw(6) << elapsed * 1000 / n;
+    if (std::is_same<T, Payload256>::value) {
+        std::cout << ", copies/op: " << std::setprecision(3)
+          << double(Payload256::copies.load()) / n;
+    }
+    std::cout << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "Start MPMCQueuePayloadBenchmark!" << std::endl;
+    const uint64_t n = 1000000;
+    int nts[] = {1, 4};
+    WriteMode modes[] = {WriteMode::COPY, WriteMode::MOVE, WriteMode::EMPLACE};
+    for (int nt : nts) {
+        for (auto mode : modes) {
+            runPayloadTest<Payload256>("payload256", nt, n, mode);
+        }
+        runPayloadTest<std::string>("string    ", nt, n, WriteMode::COPY);
+        runPayloadTest<std::string>("string    ", nt, n, WriteMode::MOVE);
+    }
+    return 0;
+}
@@ -0,0 +1,1018 @@
+#include <array>
+#include <forward_list>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "mpmc_queue.h"
+#include "mmap_allocator.h"
+#include "notification_test.h"
+#include "portability.h"
+#include "queue_select.h"
+#include "gtest/gtest.h"
+
+using namespace myfolly;
+using namespace std::chrono;
+
+/// Generous upper bound on how late a timed operation may return.  The
+/// tests run on loaded CI machines, so we only check that the deadline is
+/// honored and that the call doesn't hang far past it.
+static const milliseconds kSlack{200};
+
+template <class Clock>
+static void testWriteUntilTimesOut() {
+    MPMCQueue<int> q(2);
+    EXPECT_TRUE(q.write(1));
+    EXPECT_TRUE(q.write(2));
+
+    auto const timeout = milliseconds(20);
+    auto const start = Clock::now();
+    EXPECT_FALSE(q.tryWriteUntil(start + timeout, 3));
+    auto const elapsed = Clock::now() - start;
+    EXPECT_GE(elapsed, timeout);
+    EXPECT_LT(elapsed, timeout + kSlack);
+    EXPECT_EQ(2, q.size());
+}
+
+template <class Clock>
+static void testReadUntilTimesOut() {
+    MPMCQueue<int> q(2);
+    int elem = 0;
+
+    auto const timeout = milliseconds(20);
+    auto const start = Clock::now();
+    EXPECT_FALSE(q.tryReadUntil(start + timeout, elem));
+    auto const elapsed = Clock::now() - start;
+    EXPECT_GE(elapsed, timeout);
+    EXPECT_LT(elapsed, timeout + kSlack);
+    EXPECT_EQ(0, q.size());
+}
+
+TEST(MPMCQueueTest, write_until_timeout_steady) {
+    testWriteUntilTimesOut<steady_clock>();
+}
+
+TEST(MPMCQueueTest, write_until_timeout_system) {
+    testWriteUntilTimesOut<system_clock>();
+}
+
+TEST(MPMCQueueTest, read_until_timeout_steady) {
+    testReadUntilTimesOut<steady_clock>();
+}
+
+TEST(MPMCQueueTest, read_until_timeout_system) {
+    testReadUntilTimesOut<system_clock>();
+}
+
+TEST(MPMCQueueTest, read_for_wakes_on_write) {
+    MPMCQueue<int> q(4);
+    std::thread producer([&q]() {
+            std::this_thread::sleep_for(milliseconds(10));
+            q.blockingWrite(42);
+            });
+
+    int elem = 0;
+    EXPECT_TRUE(q.tryReadFor(seconds(10), elem));
+    EXPECT_EQ(42, elem);
+    producer.join();
+}
+
+TEST(MPMCQueueTest, write_for_wakes_on_read) {
+    MPMCQueue<int> q(1);
+    q.blockingWrite(1);
+    std::thread consumer([&q]() {
+            std::this_thread::sleep_for(milliseconds(10));
+            int elem = 0;
+            q.blockingRead(elem);
+            EXPECT_EQ(1, elem);
+            });
+
+    EXPECT_TRUE(q.tryWriteFor(seconds(10), 2));
+    consumer.join();
+    int elem = 0;
+    EXPECT_TRUE(q.read(elem));
+    EXPECT_EQ(2, elem);
+}
+
+/// Many producers contend for a queue that a slow consumer drains.  Each
+/// tryWriteFor either succeeds or fails no earlier than its timeout and not
+/// much later, and every successful write is eventually read.
+TEST(MPMCQueueTest, timeout_accuracy_under_contention) {
+    const int numProducers = 8;
+    const int attempts = 20;
+    const milliseconds timeout(5);
+    MPMCQueue<int> q(4);
+
+    std::atomic<int> written{0};
+    std::atomic<int> early{0};
+    std::atomic<int> late{0};
+    std::atomic<bool> done{false};
+
+    std::thread consumer([&]() {
+            int elem;
+            int numRead = 0;
+            while (!done.load() || numRead < written.load()) {
+                if (q.tryReadFor(milliseconds(1), elem)) {
+                    ++numRead;
+                    std::this_thread::sleep_for(microseconds(500));
+                }
+            }
+            EXPECT_EQ(written.load(), numRead);
+            });
+
+    std::vector<std::thread> producers;
+    for (int t = 0; t < numProducers; ++t) {
+        producers.emplace_back([&, t]() {
+                for (int i = 0; i < attempts; ++i) {
+                    auto const start = steady_clock::now();
+                    if (q.tryWriteFor(timeout, t * attempts + i)) {
+                        ++written;
+                        continue;
+                    }
+                    auto const elapsed = steady_clock::now() - start;
+                    if (elapsed < timeout) {
+                        ++early;
+                    }
+                    if (elapsed > timeout + kSlack) {
+                        ++late;
+                    }
+                }
+                });
+    }
+    for (auto& t : producers) {
+        t.join();
+    }
+    done = true;
+    consumer.join();
+
+    EXPECT_EQ(0, early.load());
+    EXPECT_EQ(0, late.load());
+    EXPECT_GT(written.load(), 0);
+    EXPECT_TRUE(q.isEmpty());
+}
+
+TEST(MPMCQueueTest, dynamic_grows_and_keeps_fifo) {
+    DynamicMPMCQueue<int> q(1000, 10, 10);
+    EXPECT_EQ(1000, q.capacity());
+    EXPECT_EQ(10, q.allocatedCapacity());
+
+    // the elements in the 10 + 100 slots of the closed arrays count
+    // against capacity
+    int written = 0;
+    while (q.write(written)) {
+        ++written;
+    }
+    EXPECT_EQ(1000, written);
+    EXPECT_EQ(1000, q.allocatedCapacity());
+    EXPECT_TRUE(q.isFull());
+
+    int elem = -1;
+    for (int i = 0; i < written; ++i) {
+        EXPECT_TRUE(q.read(elem));
+        EXPECT_EQ(i, elem);
+    }
+    EXPECT_FALSE(q.read(elem));
+    EXPECT_TRUE(q.isEmpty());
+}
+
+TEST(MPMCQueueTest, dynamic_timed_write_expands) {
+    DynamicMPMCQueue<int> q(64, 2, 2);
+    int written = 0;
+    while (q.tryWriteFor(milliseconds(1), written)) {
+        ++written;
+    }
+    // 2 + 4 + ... + 32 in closed arrays, the rest in the current one
+    EXPECT_EQ(64, written);
+    EXPECT_EQ(64, q.allocatedCapacity());
+    int elem = -1;
+    for (int i = 0; i < written; ++i) {
+        EXPECT_TRUE(q.tryReadFor(milliseconds(1), elem));
+        EXPECT_EQ(i, elem);
+    }
+}
+
+TEST(MPMCQueueTest, dynamic_too_many_expansions) {
+    // 32 closed arrays don't fit in the 5 bits _dstate counts them in
+    EXPECT_THROW(DynamicMPMCQueue<int>(uint64_t(1) << 32, 1, 2),
+            std::invalid_argument);
+    DynamicMPMCQueue<int> q(uint64_t(1) << 31, 1, 2);
+    EXPECT_EQ(1, q.allocatedCapacity());
+}
+
+TEST(MPMCQueueTest, dynamic_blocking_write_waits_for_closed_arrays) {
+    DynamicMPMCQueue<int> q(64, 2, 2);
+    for (int i = 0; i < 64; ++i) {
+        EXPECT_TRUE(q.write(i));
+    }
+    EXPECT_FALSE(q.write(64));
+    // the current array has free slots, but element 0 is still in the
+    // first closed array
+    std::atomic<bool> written{false};
+    std::thread producer([&]() {
+            q.blockingWrite(64);
+            written = true;
+            });
+    std::this_thread::sleep_for(milliseconds(20));
+    EXPECT_FALSE(written);
+    int elem = -1;
+    EXPECT_TRUE(q.read(elem));
+    EXPECT_EQ(0, elem);
+    producer.join();
+    for (int i = 1; i <= 64; ++i) {
+        EXPECT_TRUE(q.read(elem));
+        EXPECT_EQ(i, elem);
+    }
+}
+
+/// Producers and consumers mix blocking and non-blocking operations while
+/// the queue expands underneath them; nothing may be lost or duplicated.
+TEST(MPMCQueueTest, dynamic_mt_sum) {
+    const int numThreads = 4;
+    const uint64_t n = 200000;
+    DynamicMPMCQueue<uint64_t> q(4096, 1, 2);
+
+    std::atomic<uint64_t> sum{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; ++t) {
+        threads.emplace_back([&, t]() {
+                for (uint64_t i = t; i < n; i += numThreads) {
+                    if ((i & 1) || !q.write(i)) {
+                        q.blockingWrite(i);
+                    }
+                }
+                });
+        threads.emplace_back([&, t]() {
+                uint64_t threadSum = 0;
+                for (uint64_t i = t; i < n; i += numThreads) {
+                    uint64_t elem = 0;
+                    if ((i & 1) || !q.read(elem)) {
+                        q.blockingRead(elem);
+                    }
+                    threadSum += elem;
+                }
+                sum += threadSum;
+                });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    EXPECT_EQ(n * (n - 1) / 2, sum.load());
+    EXPECT_TRUE(q.isEmpty());
+    EXPECT_GT(q.allocatedCapacity(), 1);
+}
+
+TEST(MPMCQueueTest, move_only) {
+    MPMCQueue<std::unique_ptr<int>> q(4);
+    std::unique_ptr<int> p(new int(1));
+    EXPECT_TRUE(q.write(std::move(p)));
+    EXPECT_EQ(nullptr, p);
+    q.blockingWrite(new int(2));
+    EXPECT_TRUE(q.writeIfNotFull(new int(3)));
+    EXPECT_TRUE(q.tryWriteFor(milliseconds(1), new int(4)));
+    // a failed write leaves its argument alone
+    std::unique_ptr<int> five(new int(5));
+    EXPECT_FALSE(q.writeIfNotFull(std::move(five)));
+    EXPECT_NE(nullptr, five);
+
+    std::unique_ptr<int> elem;
+    for (int i = 1; i <= 4; ++i) {
+        if (i % 2) {
+            EXPECT_TRUE(q.read(elem));
+        } else {
+            q.blockingRead(elem);
+        }
+        ASSERT_NE(nullptr, elem);
+        EXPECT_EQ(i, *elem);
+    }
+    EXPECT_FALSE(q.read(elem));
+}
+
+namespace {
+
+struct Lifetime {
+    static std::atomic<int> alive;
+    static std::atomic<int> copies;
+
+    explicit Lifetime(int v) noexcept : value(v) { ++alive; }
+    Lifetime(const Lifetime& rhs) noexcept : value(rhs.value) {
+        ++alive;
+        ++copies;
+    }
+    Lifetime(Lifetime&& rhs) noexcept : value(rhs.value) { ++alive; }
+    Lifetime& operator=(const Lifetime& rhs) noexcept {
+        value = rhs.value;
+        ++copies;
+        return *this;
+    }
+    Lifetime& operator=(Lifetime&& rhs) noexcept {
+        value = rhs.value;
+        return *this;
+    }
+    ~Lifetime() noexcept { --alive; }
+
+    int value;
+};
+
+std::atomic<int> Lifetime::alive{0};
+std::atomic<int> Lifetime::copies{0};
+
+} // namespace
+
+TEST(MPMCQueueTest, emplace_and_destroy) {
+    Lifetime::alive = 0;
+    Lifetime::copies = 0;
+    {
+        // no default constructor required
+        MPMCQueue<Lifetime> q(8);
+        EXPECT_EQ(0, Lifetime::alive.load());
+        q.blockingWrite(1);
+        EXPECT_TRUE(q.write(2));
+        Lifetime three(3);
+        EXPECT_TRUE(q.write(std::move(three)));
+        EXPECT_EQ(4, Lifetime::alive.load());
+
+        Lifetime elem(0);
+        q.blockingRead(elem);
+        EXPECT_EQ(1, elem.value);
+        EXPECT_EQ(0, Lifetime::copies.load());
+        // two elements left in the queue, plus three and elem
+        EXPECT_EQ(4, Lifetime::alive.load());
+    }
+    // the queue destroys elements that were never dequeued
+    EXPECT_EQ(0, Lifetime::alive.load());
+}
+
+namespace {
+
+template <typename T>
+struct CountingAllocator : std::allocator<T> {
+    template <typename U>
+    struct rebind {
+        using other = CountingAllocator<U>;
+    };
+
+    explicit CountingAllocator(std::atomic<int>* live) : live(live) {}
+
+    template <typename U>
+    CountingAllocator(const CountingAllocator<U>& other) : live(other.live) {}
+
+    T* allocate(size_t n) {
+        ++*live;
+        return std::allocator<T>::allocate(n);
+    }
+
+    void deallocate(T* p, size_t n) {
+        --*live;
+        std::allocator<T>::deallocate(p, n);
+    }
+
+    std::atomic<int>* live;
+};
+
+} // namespace
+
+TEST(MPMCQueueTest, uses_allocator) {
+    using Alloc = CountingAllocator<SingleElementQueue<int>>;
+    std::atomic<int> live{0};
+    {
+        MPMCQueue<int, Alloc> q(16, Alloc(&live));
+        EXPECT_EQ(1, live.load());
+        q.blockingWrite(1);
+    }
+    EXPECT_EQ(0, live.load());
+    {
+        MPMCQueue<int, Alloc, true> q(100, 2, 10, Alloc(&live));
+        for (int i = 0; i < 100; ++i) {
+            EXPECT_TRUE(q.write(i));
+        }
+        // the initial array and two expansions, all live until destruction
+        EXPECT_EQ(3, live.load());
+    }
+    EXPECT_EQ(0, live.load());
+}
+
+TEST(MPMCQueueTest, mmap_allocator) {
+    MmapAllocationOptions options[4];
+    options[1].transparentHugePages = true;
+    options[2].hugeTlb = true;
+    options[2].prefault = true;
+    options[3].prefault = true;
+    options[3].numaNode = 0;
+    for (auto const& opts : options) {
+        using Alloc = MmapAllocator<SingleElementQueue<uint64_t>>;
+        MPMCQueue<uint64_t, Alloc> q(100000, Alloc(opts));
+        // whatever the kernel grants, the queue must work
+        EXPECT_EQ(opts.prefault, q.allocator().lastResult().prefaulted);
+        for (uint64_t i = 0; i < 100000; ++i) {
+            EXPECT_TRUE(q.write(i));
+        }
+        uint64_t elem;
+        for (uint64_t i = 0; i < 100000; ++i) {
+            EXPECT_TRUE(q.read(elem));
+            EXPECT_EQ(i, elem);
+        }
+    }
+}
+
+TEST(MPMCQueueTest, batch) {
+    MPMCQueue<int> q(10);
+    std::vector<int> in{0, 1, 2, 3, 4, 5, 6, 7};
+    q.blockingWriteBatch(in.begin(), in.end());
+    EXPECT_EQ(8, q.size());
+    // only two slots left
+    EXPECT_EQ(2u, q.writeBatch(in.begin(), in.end()));
+    EXPECT_EQ(0u, q.writeBatch(in.begin(), in.end()));
+
+    std::vector<int> out(10, -1);
+    q.blockingReadBatch(out.begin(), 3);
+    EXPECT_EQ(5u, q.readBatch(out.begin() + 3, 5));
+    EXPECT_EQ(2u, q.readBatch(out.begin() + 8, 5));
+    EXPECT_EQ(0u, q.readBatch(out.begin(), 5));
+    std::vector<int> expected{0, 1, 2, 3, 4, 5, 6, 7, 0, 1};
+    EXPECT_EQ(expected, out);
+}
+
+TEST(MPMCQueueTest, batch_move_only) {
+    MPMCQueue<std::unique_ptr<int>> q(4);
+    std::vector<std::unique_ptr<int>> in;
+    in.emplace_back(new int(1));
+    in.emplace_back(new int(2));
+    q.blockingWriteBatch(std::make_move_iterator(in.begin()),
+            std::make_move_iterator(in.end()));
+    std::unique_ptr<int> out[2];
+    q.blockingReadBatch(out, 2);
+    EXPECT_EQ(1, *out[0]);
+    EXPECT_EQ(2, *out[1]);
+}
+
+TEST(MPMCQueueTest, batch_forward_iterators) {
+    // the batch writes walk the range twice, so single pass iterators
+    // such as std::istream_iterator are rejected at compile time
+    static_assert(!detail::IsForwardIterator<
+            std::istream_iterator<int>>::value, "");
+    static_assert(detail::IsForwardIterator<
+            std::forward_list<int>::iterator>::value, "");
+
+    MPMCQueue<int> q(4);
+    std::forward_list<int> in{1, 2, 3};
+    q.blockingWriteBatch(in.begin(), in.end());
+    EXPECT_EQ(1u, q.writeBatch(in.begin(), in.end()));
+    int out[4];
+    q.blockingReadBatch(out, 4);
+    EXPECT_EQ(1, out[0]);
+    EXPECT_EQ(3, out[2]);
+    EXPECT_EQ(1, out[3]);
+}
+
+TEST(MPMCQueueTest, read_up_to) {
+    MPMCQueue<int> q(16);
+    int out[8];
+    auto const start = steady_clock::now();
+    EXPECT_EQ(0u, q.readUpTo(out, 8, start + milliseconds(10)));
+    EXPECT_GE(steady_clock::now() - start, milliseconds(10));
+
+    std::thread producer([&q]() {
+            std::this_thread::sleep_for(milliseconds(10));
+            int in[] = {1, 2, 3};
+            q.blockingWriteBatch(in, in + 3);
+            });
+    size_t n = q.readUpTo(out, 8, steady_clock::now() + seconds(10));
+    producer.join();
+    EXPECT_GE(n, 1u);
+    n += q.readBatch(out + n, 8 - n);
+    EXPECT_EQ(3u, n);
+    EXPECT_EQ(1, out[0]);
+    EXPECT_EQ(3, out[2]);
+}
+
+TEST(MPMCQueueTest, batch_mt_sum) {
+    const int numThreads = 4;
+    const size_t batch = 32;
+    const uint64_t perThread = 32 * 1000;
+    MPMCQueue<uint64_t> q(64);
+
+    std::atomic<uint64_t> sum{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; ++t) {
+        threads.emplace_back([&, t]() {
+                std::vector<uint64_t> buf(batch);
+                for (uint64_t i = 0; i < perThread; i += batch) {
+                    for (size_t j = 0; j < batch; ++j) {
+                        buf[j] = t * perThread + i + j;
+                    }
+                    if (i % 64) {
+                        q.blockingWriteBatch(buf.begin(), buf.end());
+                        continue;
+                    }
+                    auto it = buf.begin();
+                    while (it != buf.end()) {
+                        it += q.writeBatch(it, buf.end());
+                    }
+                }
+                });
+        threads.emplace_back([&]() {
+                std::vector<uint64_t> buf(batch);
+                uint64_t threadSum = 0;
+                uint64_t received = 0;
+                while (received < perThread) {
+                    size_t n = q.readUpTo(buf.begin(),
+                            std::min<uint64_t>(batch, perThread - received),
+                            steady_clock::now() + milliseconds(100));
+                    for (size_t j = 0; j < n; ++j) {
+                        threadSum += buf[j];
+                    }
+                    received += n;
+                }
+                sum += threadSum;
+                });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    const uint64_t n = numThreads * perThread;
+    EXPECT_EQ(n * (n - 1) / 2, sum.load());
+    EXPECT_TRUE(q.isEmpty());
+}
+
+template <unsigned SpreadBits, typename Capacity>
+static void checkCapacityPolicy(const Capacity& policy) {
+    const size_t cap = policy.capacity();
+    std::vector<int> hits(cap, 0);
+    for (uint64_t ticket = 0; ticket < 3 * cap; ++ticket) {
+        size_t index = policy.template index<SpreadBits>(ticket);
+        ASSERT_LT(index, cap);
+        EXPECT_EQ(index, policy.template index<SpreadBits>(ticket + cap));
+        EXPECT_EQ(ticket / cap, policy.turn(ticket));
+        if (ticket < cap) {
+            ++hits[index];
+        }
+    }
+    // every slot is used exactly once per turn
+    for (size_t i = 0; i < cap; ++i) {
+        EXPECT_EQ(1, hits[i]) << i;
+    }
+}
+
+TEST(MPMCQueueTest, capacity_policies) {
+    checkCapacityPolicy<0>(RuntimeCapacity(1000));
+    checkCapacityPolicy<3>(RuntimeCapacity(1000));
+    checkCapacityPolicy<3>(RuntimeCapacity(7));
+    checkCapacityPolicy<0>(PowerOfTwoCapacity(1000));
+    checkCapacityPolicy<3>(PowerOfTwoCapacity(1000));
+    checkCapacityPolicy<3>(PowerOfTwoCapacity(16));
+    checkCapacityPolicy<3>(FixedCapacity<1024>());
+    checkCapacityPolicy<3>(FixedCapacity<1000>());
+    checkCapacityPolicy<3>(FixedCapacity<16>());
+    checkCapacityPolicy<0>(FixedCapacity<1>());
+
+    EXPECT_EQ(1024u, PowerOfTwoCapacity(1000).capacity());
+    EXPECT_EQ(1024u, PowerOfTwoCapacity(1024).capacity());
+    EXPECT_EQ(1u, PowerOfTwoCapacity(1).capacity());
+    EXPECT_THROW(FixedCapacity<16>(10), std::invalid_argument);
+
+    // the bit permutation puts 8 consecutive tickets on 8 different lines
+    PowerOfTwoCapacity pow2(1024);
+    for (uint64_t ticket = 0; ticket < 8; ++ticket) {
+        EXPECT_EQ(ticket * 8, pow2.index<3>(ticket));
+    }
+    EXPECT_EQ(1u, pow2.index<3>(8));
+    EXPECT_EQ(64u, pow2.index<3>(64));
+}
+
+template <typename Q>
+static void testFifoAcrossTurns(Q& q) {
+    const int cap = q.capacity();
+    int elem = -1;
+    for (int round = 0; round < 5; ++round) {
+        for (int i = 0; i < cap; ++i) {
+            EXPECT_TRUE(q.write(round * cap + i));
+        }
+        EXPECT_FALSE(q.write(-1));
+        EXPECT_TRUE(q.isFull());
+        for (int i = 0; i < cap; ++i) {
+            EXPECT_TRUE(q.read(elem));
+            EXPECT_EQ(round * cap + i, elem);
+        }
+        EXPECT_FALSE(q.read(elem));
+        // shift the next round by a few tickets
+        q.blockingWrite(0);
+        q.blockingRead(elem);
+    }
+}
+
+TEST(MPMCQueueTest, power_of_two_capacity) {
+    MPMCQueue<int, std::allocator<SingleElementQueue<int>>, false,
+        PowerOfTwoCapacity> q(100);
+    EXPECT_EQ(128u, q.capacity());
+    testFifoAcrossTurns(q);
+}
+
+TEST(MPMCQueueTest, fixed_capacity) {
+    MPMCQueue<int, std::allocator<SingleElementQueue<int>>, false,
+        FixedCapacity<64>> q(64);
+    EXPECT_EQ(64u, q.capacity());
+    testFifoAcrossTurns(q);
+
+    MPMCQueue<int, std::allocator<SingleElementQueue<int>>, false,
+        FixedCapacity<10>> q10(10);
+    testFifoAcrossTurns(q10);
+}
+
+TEST(MPMCQueueTest, fixed_capacity_mt_sum) {
+    const int numThreads = 4;
+    const uint64_t perThread = 100000;
+    MPMCQueue<uint64_t, std::allocator<SingleElementQueue<uint64_t>>, false,
+        FixedCapacity<64>> q(64);
+
+    std::atomic<uint64_t> sum{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; ++t) {
+        threads.emplace_back([&, t]() {
+                for (uint64_t i = 0; i < perThread; ++i) {
+                    q.blockingWrite(t * perThread + i);
+                }
+                });
+        threads.emplace_back([&]() {
+                uint64_t threadSum = 0;
+                uint64_t elem;
+                for (uint64_t i = 0; i < perThread; ++i) {
+                    q.blockingRead(elem);
+                    threadSum += elem;
+                }
+                sum += threadSum;
+                });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    const uint64_t n = numThreads * perThread;
+    EXPECT_EQ(n * (n - 1) / 2, sum.load());
+}
+
+TEST(MPMCQueueTest, wide_sequencer) {
+    WideMPMCQueue<int> q(10);
+    testFifoAcrossTurns(q);
+
+    // far more blocked consumers than slots and wake channels
+    WideMPMCQueue<uint64_t, PowerOfTwoCapacity> q2(2);
+    const int numThreads = 80;
+    const uint64_t perThread = 500;
+    std::atomic<uint64_t> sum{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; ++t) {
+        threads.emplace_back([&]() {
+                uint64_t threadSum = 0;
+                uint64_t elem;
+                for (uint64_t i = 0; i < perThread; ++i) {
+                    q2.blockingRead(elem);
+                    threadSum += elem;
+                }
+                sum += threadSum;
+                });
+    }
+    const uint64_t n = numThreads * perThread;
+    for (uint64_t i = 0; i < n; ++i) {
+        q2.blockingWrite(i);
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    EXPECT_EQ(n * (n - 1) / 2, sum.load());
+}
+
+TEST(MPMCQueueTest, slot_layouts) {
+    using Dense = SingleElementQueue<uint64_t, TurnSequencer, DenseSlots>;
+    using Isolated = SingleElementQueue<uint64_t, TurnSequencer, IsolatedSlots>;
+    using Split = SingleElementQueue<uint64_t, TurnSequencer, SplitSlots>;
+    EXPECT_EQ(sizeof(SingleElementQueue<uint64_t>), sizeof(Dense));
+    EXPECT_EQ(hardware_destructive_interference_size, alignof(Isolated));
+    EXPECT_EQ(hardware_destructive_interference_size, sizeof(Isolated));
+    // only the sequencer and the element pointer, whatever T is
+    EXPECT_EQ(sizeof(Split),
+            sizeof(SingleElementQueue<std::array<char, 1024>, TurnSequencer,
+                SplitSlots>));
+
+    LayoutMPMCQueue<int, DenseSlots> dense(10);
+    testFifoAcrossTurns(dense);
+    LayoutMPMCQueue<int, IsolatedSlots, PowerOfTwoCapacity> isolated(10);
+    testFifoAcrossTurns(isolated);
+    LayoutMPMCQueue<int, SplitSlots, FixedCapacity<10>> split(10);
+    testFifoAcrossTurns(split);
+
+    using DynamicSplit = MPMCQueue<int,
+          std::allocator<SingleElementQueue<int, TurnSequencer, SplitSlots>>,
+          true>;
+    DynamicSplit dynamic(100, 2, 10);
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_TRUE(dynamic.write(i));
+    }
+    int elem;
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_TRUE(dynamic.read(elem));
+        EXPECT_EQ(i, elem);
+    }
+}
+
+TEST(MPMCQueueTest, split_slots_destroy) {
+    Lifetime::alive = 0;
+    {
+        LayoutMPMCQueue<Lifetime, SplitSlots> q(8);
+        q.blockingWrite(1);
+        EXPECT_TRUE(q.write(2));
+        EXPECT_TRUE(q.write(3));
+        Lifetime elem(0);
+        q.blockingRead(elem);
+        EXPECT_EQ(1, elem.value);
+        EXPECT_EQ(3, Lifetime::alive.load());
+    }
+    EXPECT_EQ(0, Lifetime::alive.load());
+
+    // the element array comes from the rebound allocator
+    using Alloc = CountingAllocator<
+        SingleElementQueue<int, TurnSequencer, SplitSlots>>;
+    std::atomic<int> live{0};
+    {
+        MPMCQueue<int, Alloc> q(16, Alloc(&live));
+        EXPECT_EQ(2, live.load());
+        q.blockingWrite(1);
+    }
+    EXPECT_EQ(0, live.load());
+}
+
+template <typename Layout>
+static void testLayoutMtSum() {
+    const int numThreads = 4;
+    const uint64_t perThread = 50000;
+    LayoutMPMCQueue<uint64_t, Layout> q(32);
+
+    std::atomic<uint64_t> sum{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; ++t) {
+        threads.emplace_back([&, t]() {
+                for (uint64_t i = 0; i < perThread; ++i) {
+                    q.blockingWrite(t * perThread + i);
+                }
+                });
+        threads.emplace_back([&]() {
+                uint64_t threadSum = 0;
+                uint64_t elem;
+                for (uint64_t i = 0; i < perThread; ++i) {
+                    q.blockingRead(elem);
+                    threadSum += elem;
+                }
+                sum += threadSum;
+                });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    const uint64_t n = numThreads * perThread;
+    EXPECT_EQ(n * (n - 1) / 2, sum.load());
+}
+
+TEST(MPMCQueueTest, slot_layouts_mt_sum) {
+    testLayoutMtSum<DenseSlots>();
+    testLayoutMtSum<IsolatedSlots>();
+    testLayoutMtSum<SplitSlots>();
+}
+
+TEST(MPMCQueueTest, reserve_and_commit) {
+    Lifetime::alive = 0;
+    Lifetime::copies = 0;
+    {
+        MPMCQueue<Lifetime> q(2);
+        auto r = q.blockingReserve();
+        new (r.storage()) Lifetime(1);
+        // reserved but not committed: not readable yet
+        Lifetime elem(0);
+        EXPECT_FALSE(q.read(elem));
+        q.commit(r);
+        EXPECT_EQ(nullptr, r.storage());
+
+        static_assert(!std::is_copy_constructible<
+                MPMCQueue<Lifetime>::Reservation>::value, "");
+        MPMCQueue<Lifetime>::Reservation r2;
+        EXPECT_TRUE(q.tryReserve(r2));
+        new (r2.storage()) Lifetime(2);
+        q.commit(r2);
+        EXPECT_FALSE(q.tryReserve(r2));
+        EXPECT_FALSE(q.tryReserveFor(milliseconds(10), r2));
+
+        q.blockingRead(elem);
+        EXPECT_EQ(1, elem.value);
+        EXPECT_TRUE(q.tryReserveFor(milliseconds(10), r2));
+        new (r2.storage()) Lifetime(3);
+        q.commit(r2);
+        EXPECT_EQ(0, Lifetime::copies.load());
+        // 2 and 3 in the queue, plus elem
+        EXPECT_EQ(3, Lifetime::alive.load());
+    }
+    EXPECT_EQ(0, Lifetime::alive.load());
+
+    DynamicMPMCQueue<int> dq(100, 2, 10);
+    for (int i = 0; i < 100; ++i) {
+        auto r = dq.blockingReserve();
+        new (r.storage()) int(i);
+        dq.commit(r);
+    }
+    int elem;
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_TRUE(dq.read(elem));
+        EXPECT_EQ(i, elem);
+    }
+}
+
+TEST(MPMCQueueTest, visit) {
+    Lifetime::alive = 0;
+    Lifetime::copies = 0;
+    {
+        MPMCQueue<Lifetime> q(4);
+        EXPECT_FALSE(q.tryVisit([](Lifetime&) { FAIL(); }));
+        EXPECT_FALSE(q.tryVisitFor(milliseconds(10),
+                    [](Lifetime&) { FAIL(); }));
+        for (int i = 1; i <= 4; ++i) {
+            q.blockingWrite(i);
+        }
+        int seen = 0;
+        q.blockingVisit([&](Lifetime& elem) {
+                seen = elem.value;
+                // still in its slot
+                EXPECT_EQ(4, Lifetime::alive.load());
+                });
+        EXPECT_EQ(1, seen);
+        EXPECT_EQ(3, Lifetime::alive.load());
+        EXPECT_TRUE(q.tryVisit([&](Lifetime& elem) { seen = elem.value; }));
+        EXPECT_EQ(2, seen);
+
+        // a throwing visitor still frees the slot
+        EXPECT_THROW(q.blockingVisit([](Lifetime&) { throw 1; }), int);
+        EXPECT_EQ(1, Lifetime::alive.load());
+        EXPECT_TRUE(q.tryVisitUntil(steady_clock::now() + milliseconds(10),
+                    [&](Lifetime& elem) { seen = elem.value; }));
+        EXPECT_EQ(4, seen);
+        EXPECT_EQ(0, Lifetime::copies.load());
+        EXPECT_TRUE(q.write(5));
+    }
+    EXPECT_EQ(0, Lifetime::alive.load());
+}
+
+TEST(MPMCQueueTest, reserve_visit_mt_sum) {
+    const int numThreads = 4;
+    const uint64_t perThread = 50000;
+    LayoutMPMCQueue<uint64_t, SplitSlots> q(16);
+
+    std::atomic<uint64_t> sum{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; ++t) {
+        threads.emplace_back([&, t]() {
+                for (uint64_t i = 0; i < perThread; ++i) {
+                    auto r = q.blockingReserve();
+                    new (r.storage()) uint64_t(t * perThread + i);
+                    q.commit(r);
+                }
+                });
+        threads.emplace_back([&]() {
+                uint64_t threadSum = 0;
+                for (uint64_t i = 0; i < perThread; ++i) {
+                    q.blockingVisit([&](uint64_t& elem) { threadSum += elem; });
+                }
+                sum += threadSum;
+                });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    const uint64_t n = numThreads * perThread;
+    EXPECT_EQ(n * (n - 1) / 2, sum.load());
+}
+
+TEST(MPMCQueueTest, stats) {
+    // many threads on a single slot: ticket CASes fail and threads park
+    MPMCQueue<int> q(1);
+    const int numThreads = 4;
+    const int perThread = 2000;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; ++t) {
+        threads.emplace_back([&q]() {
+                for (int i = 0; i < perThread; ++i) {
+                    if (i % 2) {
+                        q.blockingWrite(i);
+                    } else {
+                        while (!q.write(i)) {
+                            std::this_thread::yield();
+                        }
+                    }
+                }
+                });
+        threads.emplace_back([&q]() {
+                int elem;
+                for (int i = 0; i < perThread; ++i) {
+                    if (i % 2) {
+                        q.blockingRead(elem);
+                    } else {
+                        while (!q.read(elem)) {
+                            std::this_thread::yield();
+                        }
+                    }
+                }
+                });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    auto const s = q.stats();
+    if (!kQueueStatsEnabled) {
+        EXPECT_EQ(0u, s.pushTicketCasRetries);
+        EXPECT_EQ(0u, s.sequencer.spins);
+        EXPECT_EQ(0u, s.sequencer.futexWakes);
+        return;
+    }
+    EXPECT_GT(s.sequencer.spins, 0u);
+    EXPECT_GT(s.sequencer.futexWaits[int(FutexResult::AWOKEN)] +
+            s.sequencer.futexWaits[int(FutexResult::VALUE_CHANGED)], 0u);
+    EXPECT_GT(s.sequencer.futexWakes, 0u);
+    EXPECT_GT(s.sequencer.futexWoken, 0u);
+    q.resetStats();
+    EXPECT_EQ(0u, q.stats().sequencer.spins);
+}
+
+/// One producer per queue writes perQueue elements with random pauses,
+/// one dispatcher collects them all with readAny
+static void testReadAny(size_t numQueues, int perQueue) {
+    // MPMCQueue is over-aligned
+    std::vector<MPMCQueue<int>*> queues;
+    for (size_t i = 0; i < numQueues; ++i) {
+        queues.push_back(detail::alignedNew<MPMCQueue<int>>(4));
+    }
+
+    std::vector<std::thread> producers;
+    for (size_t i = 0; i < numQueues; ++i) {
+        producers.emplace_back([&, i]() {
+                for (int k = 0; k < perQueue; ++k) {
+                    if ((k + i) % 7 == 0) {
+                        std::this_thread::sleep_for(microseconds(200));
+                    }
+                    queues[i]->blockingWrite(k);
+                }
+                });
+    }
+
+    std::vector<int> next(numQueues, 0);
+    for (size_t got = 0; got < numQueues * perQueue; ++got) {
+        int elem = -1;
+        size_t i = readAny(queues.data(), numQueues, elem);
+        ASSERT_LT(i, numQueues);
+        // each queue's elements still arrive in order
+        EXPECT_EQ(next[i]++, elem);
+    }
+    for (auto& t : producers) {
+        t.join();
+    }
+    for (auto q : queues) {
+        detail::alignedDelete(q);
+    }
+}
+
+TEST(MPMCQueueTest, read_any) {
+    testReadAny(8, 200);
+}
+
+TEST(MPMCQueueTest, read_any_fallback) {
+    // more queues than one futex_waitv call takes: the eventcount path
+    testReadAny(detail::kFutexWaitvMax + 2, 20);
+}
+
+TEST(MPMCQueueTest, try_read_any_until) {
+    MPMCQueue<int> a(2);
+    MPMCQueue<int> b(2);
+    MPMCQueue<int>* queues[] = {&a, &b};
+    int elem = 0;
+
+    auto const start = steady_clock::now();
+    EXPECT_EQ(2u, tryReadAnyFor(queues, 2, elem, milliseconds(20)));
+    EXPECT_GE(steady_clock::now() - start, milliseconds(20));
+    EXPECT_EQ(2u, tryReadAnyUntil(queues, 2, elem,
+                system_clock::now() + milliseconds(5)));
+
+    std::thread t([&]() {
+            std::this_thread::sleep_for(milliseconds(10));
+            b.write(7);
+            });
+    EXPECT_EQ(1u, tryReadAnyFor(queues, 2, elem, seconds(10)));
+    EXPECT_EQ(7, elem);
+    t.join();
+}
+
+TEST(MPMCQueueTest, notification) {
+    MPMCQueue<int> q(16);
+    testNotification(q, 3, 2000);
+    EXPECT_GT(q.readinessEvent().eventFdSignals(), 0u);
+}
+
+int main(int argc, char* argv[]) {
+    testing::InitGoogleTest(&argc, argv);
+
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,141 @@
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <thread>
+#include <vector>
+
+#include "mpmc_queue.h"
+#include "portability.h"
+
+using namespace myfolly;
+
+static uint64_t now_steady_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>
+      (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// An N byte frame: a header and a body that the producer fills and the
+/// consumer parses.  The default constructor leaves the body alone, so
+/// building a frame costs the same in a temporary and in a slot
+template <size_t N>
+struct Frame {
+    Frame() noexcept {}
+
+    uint64_t seq;
+    uint64_t len;
+    char body[N - 2 * sizeof(uint64_t)];
+};
+
+template <size_t N>
+static void fill(Frame<N>& f, uint64_t seq) noexcept {
+    f.seq = seq;
+    f.len = sizeof(f.body);
+    memset(f.body, int(seq & 0xff), sizeof(f.body));
+}
+
+/// Sums the body a word at a time, and returns seq so that the caller can
+/// check that every frame arrived
+template <size_t N>
+static uint64_t parse(const Frame<N>& f, uint64_t& check) noexcept {
+    uint64_t sum = 0;
+    for (size_t i = 0; i + sizeof(uint64_t) <= f.len; i += sizeof(uint64_t)) {
+        uint64_t w;
+        memcpy(&w, f.body + i, sizeof(w));
+        sum += w;
+    }
+    check += sum;
+    return f.seq;
+}
+
+template <typename Q>
+static Q* newQueue(size_t capacity) {
+    return detail::alignedNew<Q>(capacity);
+}
+
+template <typename Q>
+static void deleteQueue(Q* q) {
+    detail::alignedDelete(q);
+}
+
+/// numThreads producers and as many consumers pass n frames.  The
+/// producers build each frame in a temporary and write it, or in the slot
+/// with blockingReserve/commit; the consumers read it into a local, or
+/// parse it in the slot with blockingVisit.  Returns ns per frame
+template <size_t N>
+static uint64_t runFrames(int numThreads, uint64_t n, bool zeroCopy) {
+    using Q = MPMCQueue<Frame<N>>;
+    Q* q = newQueue<Q>(64);
+    std::atomic<uint64_t> seqSum{0};
+    std::atomic<uint64_t> check{0};
+    std::vector<std::thread> threads;
+    uint64_t start = now_steady_ns();
+    for (int t = 0; t < numThreads; ++t) {
+        threads.emplace_back([&, t]() {
+                for (uint64_t i = t; i < n; i += numThreads) {
+                    if (zeroCopy) {
+                        auto r = q->blockingReserve();
+                        fill(*new (r.storage()) Frame<N>(), i);
+                        q->commit(r);
+                    } else {
+                        Frame<N> f;
+                        fill(f, i);
+                        q->blockingWrite(std::move(f));
+                    }
+                }
+                });
+        threads.emplace_back([&, t]() {
+                uint64_t threadSeqSum = 0;
+                uint64_t threadCheck = 0;
+                Frame<N> f;
+                for (uint64_t i = t; i < n; i += numThreads) {
+                    if (zeroCopy) {
+                        q->blockingVisit([&](Frame<N>& elem) {
+                                threadSeqSum += parse(elem, threadCheck);
+                                });
+                    } else {
+                        q->blockingRead(f);
+                        threadSeqSum += parse(f, threadCheck);
+                    }
+                }
+                seqSum += threadSeqSum;
+                check += threadCheck;
+                });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    uint64_t elapsed = now_steady_ns() - start;
+    if (seqSum.load() != n * (n - 1) / 2) {
+        std::cout << "ERROR frames lost!" << std::endl;
+    }
+    deleteQueue(q);
+    return elapsed / n;
+}
+
+template <size_t N>
+static void runSize(const std::vector<int>& numThreads, uint64_t n) {
+    for (int threads : numThreads) {
+        uint64_t copyNs = runFrames<N>(threads, n, false);
+        uint64_t zeroCopyNs = runFrames<N>(threads, n, true);
+        std::cout << std::setw(4) << N << " byte frames, "
+          << std::setw(2) << threads << "P/" << std::setw(2) << threads
+          << "C. write/read " << std::setw(5) << copyNs
+          << " ns/frame, reserve/visit " << std::setw(5) << zeroCopyNs
+          << " ns/frame" << std::endl;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "Start MPMCQueueZeroCopyBenchmark!" << std::endl;
+    const uint64_t n = 500000;
+    const int hw = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<int> numThreads = {1, 2, hw};
+    std::sort(numThreads.begin(), numThreads.end());
+    numThreads.erase(std::unique(numThreads.begin(), numThreads.end()),
+            numThreads.end());
+    runSize<1024>(numThreads, n);
+    runSize<4096>(numThreads, n / 4);
+    return 0;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <mutex>
+#include <queue>
+#include <thread>
+
+namespace myfolly {
+
+/// The baseline the queue benchmarks compare against: a std::queue under
+/// a mutex, whose blocking operations poll with yield
+template <typename T>
+class NormalQueue {
+public:
+    NormalQueue(size_t cap) :
+        _capacity(cap) {}
+
+    bool write(T const& val) {
+        std::lock_guard<std::mutex> lk(_mutex);
+        if(_q.size() >= _capacity) {
+            return false;
+        }
+        _q.push(val);
+        return true;
+    }
+
+    void blockingWrite(T const& val) {
+        while(true) {
+            while(_q.size() >= _capacity) {
+                std::this_thread::yield();
+            }
+            std::lock_guard<std::mutex> lk(_mutex);
+            if(_q.size() >= _capacity) {
+                continue;
+            }
+            _q.push(val);
+            break;
+        }
+    }
+
+    bool read(T& val) {
+        std::lock_guard<std::mutex> lk(_mutex);
+        if(_q.empty()) {
+            return false;
+        }
+        val = _q.front();
+        _q.pop();
+        return true;
+    }
+
+    void blockingRead(T& val) {
+        while(true) {
+            while(_q.empty()) {
+                std::this_thread::yield();
+            }
+            std::lock_guard<std::mutex> lk(_mutex);
+            if(_q.empty()) {
+                continue;
+            }
+            val = _q.front();
+            _q.pop();
+            break;
+        }
+    }
+
+    bool isEmpty() {
+        std::lock_guard<std::mutex> lk(_mutex);
+        return _q.empty();
+    }
+
+private:
+    size_t _capacity;
+    std::queue<T> _q;
+    std::mutex _mutex;
+};
+
+};  // namespace myfolly
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+
+namespace myfolly {
+
+/// Producers write in bursts while the test thread consumes from an epoll
+/// loop on the queue's notification eventfd.  A lost notification shows
+/// up as an epoll_wait timeout
+template <typename Q>
+void testNotification(Q& q, int numProducers, int perProducer) {
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    ASSERT_GE(ep, 0);
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u64 = 0;
+    ASSERT_EQ(0, epoll_ctl(ep, EPOLL_CTL_ADD, q.notificationFd(), &ev));
+
+    std::vector<std::thread> producers;
+    for (int t = 0; t < numProducers; ++t) {
+        producers.emplace_back([&q, perProducer]() {
+                for (int i = 1; i <= perProducer; ++i) {
+                    if (i % 50 == 0) {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    }
+                    q.blockingWrite(i);
+                }
+                });
+    }
+
+    const int total = numProducers * perProducer;
+    int received = 0;
+    int64_t sum = 0;
+    int wakeups = 0;
+    while (true) {
+        int elem;
+        while (q.read(elem)) {
+            sum += elem;
+            ++received;
+        }
+        if (received == total) {
+            break;
+        }
+        if (!q.armNotification()) {
+            continue;
+        }
+        ASSERT_EQ(1, epoll_wait(ep, &ev, 1, 5000));
+        q.clearNotification();
+        ++wakeups;
+    }
+    for (auto& t : producers) {
+        t.join();
+    }
+    close(ep);
+    EXPECT_EQ(int64_t(numProducers) * perProducer * (perProducer + 1) / 2, sum);
+    // far fewer wakeups than elements
+    EXPECT_LT(wakeups, total);
+}
+
+} // namespace myfolly
@@ -0,0 +1,129 @@
+#include <iostream>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <iomanip>
+
+#include <sys/resource.h>
+
+#include "detail/turn_sequencer.h"
+#include "parking_lot.h"
+
+using namespace myfolly;
+using namespace myfolly::detail;
+
+static uint64_t now_steady_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>
+      (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// Voluntary context switches of the calling thread, one per wait that
+/// actually slept
+static uint64_t voluntary_ctx_switches() {
+    struct rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    return usage.ru_nvcsw;
+}
+
+/// The TurnSequencer path: a 32-bit futex shared by all waiters
+struct FutexTurns {
+    TurnSequencer seq;
+    std::atomic<uint32_t> spinCutoff{0};
+
+    void wait(uint64_t turn) {
+        seq.waitForTurn(uint32_t(turn), spinCutoff, (turn % 128) == 0);
+    }
+
+    void complete(uint64_t turn) {
+        seq.completeTurn(uint32_t(turn));
+    }
+};
+
+/// A 64-bit turn in a ParkingLot: every waiter parks with the turn it
+/// waits for, and completing a turn unparks only its successor
+struct ParkingLotTurns {
+    ParkingLot<uint64_t> lot;
+    std::atomic<uint64_t> current{0};
+
+    void wait(uint64_t turn) {
+        while (current.load(std::memory_order_acquire) != turn) {
+            lot.park(&current, turn,
+                    [&] { return current.load() != turn; },
+                    [] {});
+        }
+    }
+
+    void complete(uint64_t turn) {
+        current.store(turn + 1, std::memory_order_release);
+        lot.unpark(&current, [turn](const uint64_t& waiting) {
+                return waiting == turn + 1 ?
+                    UnparkControl::RemoveBreak : UnparkControl::RetainContinue;
+                });
+    }
+};
+
+/// The same with std::condition_variable, which can't pick a thread and
+/// has to wake them all
+struct CondVarTurns {
+    std::mutex mutex;
+    std::condition_variable cv;
+    uint64_t current{0};
+
+    void wait(uint64_t turn) {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&] { return current == turn; });
+    }
+
+    void complete(uint64_t turn) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            current = turn + 1;
+        }
+        cv.notify_all();
+    }
+};
+
+/// numThreads threads take turns round-robin, so all but one of them are
+/// waiting at any time
+template <typename Turns>
+void runHandoff(const char* name, int numThreads, uint64_t numTurns) {
+    Turns turns;
+    std::atomic<uint64_t> ctxSwitches{0};
+
+    std::vector<std::unique_ptr<std::thread>> threads(numThreads);
+    auto start = now_steady_ns();
+    for (int t = 0; t < numThreads; ++t) {
+        threads[t].reset(new std::thread([&, t]() {
+                auto startSwitches = voluntary_ctx_switches();
+                for (uint64_t turn = t; turn < numTurns; turn += numThreads) {
+                    turns.wait(turn);
+                    turns.complete(turn);
+                }
+                ctxSwitches += voluntary_ctx_switches() - startSwitches;
+                }));
+    }
+    for (auto& t : threads) {
+        t->join();
+    }
+    auto elapsed = now_steady_ns() - start;
+
+    std::cout << name << " threads:" << std::setw(3) << numThreads
+      << " " << std::setw(7) << elapsed / numTurns << " ns/handoff"
+      << " blocking waits/handoff: " << std::setprecision(3)
+      << double(ctxSwitches.load()) / numTurns << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "Start ParkingLotBenchmark!" << std::endl;
+    const uint64_t numTurns = 100000;
+    int nts[] = {2, 4, 16, 64, 128};
+    for (int nt : nts) {
+        runHandoff<FutexTurns>("futex      ", nt, numTurns);
+        runHandoff<ParkingLotTurns>("parking lot", nt, numTurns);
+        runHandoff<CondVarTurns>("condvar    ", nt, numTurns / 4);
+    }
+    return 0;
+}
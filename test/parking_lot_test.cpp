@@ -0,0 +1,151 @@
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "parking_lot.h"
+#include "gtest/gtest.h"
+
+using namespace myfolly;
+using namespace std::chrono;
+
+TEST(ParkingLotTest, skip) {
+    ParkingLot<> lot;
+    int word = 0;
+    bool preWaitCalled = false;
+    EXPECT_EQ(ParkResult::Skip, lot.park(&word, uint64_t(0),
+                [] { return false; },
+                [&] { preWaitCalled = true; }));
+    EXPECT_FALSE(preWaitCalled);
+}
+
+TEST(ParkingLotTest, park_unpark) {
+    ParkingLot<> lot;
+    std::atomic<bool> ready{false};
+    std::atomic<bool> parked{false};
+    ParkResult result = ParkResult::Skip;
+
+    std::thread t([&]() {
+            result = lot.park(&ready, uint64_t(0),
+                    [&] { return !ready.load(); },
+                    [&] { parked = true; });
+            });
+    while (!parked.load()) {
+        std::this_thread::yield();
+    }
+    ready = true;
+    lot.unpark(&ready, [](const uint64_t&) { return UnparkControl::RemoveBreak; });
+    t.join();
+    EXPECT_EQ(ParkResult::Unpark, result);
+}
+
+TEST(ParkingLotTest, timeout) {
+    ParkingLot<> lot;
+    int word = 0;
+    auto const start = steady_clock::now();
+    EXPECT_EQ(ParkResult::Timeout, lot.parkUntil(&word, uint64_t(0),
+                [] { return true; }, [] {}, start + milliseconds(20)));
+    EXPECT_GE(steady_clock::now() - start, milliseconds(20));
+
+    // nothing is left parked: unpark doesn't see the node
+    int seen = 0;
+    lot.unpark(&word, [&](const uint64_t&) {
+            ++seen;
+            return UnparkControl::RemoveContinue;
+            });
+    EXPECT_EQ(0, seen);
+}
+
+TEST(ParkingLotTest, unpark_by_data) {
+    // threads park with the turn they wait for; completing a turn wakes
+    // only the thread whose turn is next
+    ParkingLot<uint64_t> lot;
+    std::atomic<uint64_t> turn{0};
+    const uint64_t numThreads = 20;
+    const uint64_t numTurns = 2000;
+    std::atomic<uint64_t> unparks{0};
+
+    std::vector<std::thread> threads;
+    for (uint64_t t = 0; t < numThreads; ++t) {
+        threads.emplace_back([&, t]() {
+                for (uint64_t my = t; my < numTurns; my += numThreads) {
+                    while (turn.load() != my) {
+                        if (lot.park(&turn, my,
+                                    [&] { return turn.load() != my; },
+                                    [] {}) == ParkResult::Unpark) {
+                            ++unparks;
+                        }
+                    }
+                    turn.store(my + 1);
+                    lot.unpark(&turn, [&](const uint64_t& waiting) {
+                            return waiting == my + 1 ?
+                                UnparkControl::RemoveBreak :
+                                UnparkControl::RetainContinue;
+                            });
+                }
+                });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    EXPECT_EQ(numTurns, turn.load());
+    // every unpark woke the one thread that could go on
+    EXPECT_LE(unparks.load(), numTurns);
+}
+
+TEST(ParkingLotTest, separate_lots) {
+    ParkingLot<> a;
+    ParkingLot<int> b;
+    int word = 0;
+    std::atomic<bool> parked{false};
+    std::atomic<bool> done{false};
+
+    std::thread t([&]() {
+            a.park(&word, uint64_t(0), [&] { return !done.load(); },
+                    [&] { parked = true; });
+            });
+    while (!parked.load()) {
+        std::this_thread::yield();
+    }
+    int seen = 0;
+    b.unpark(&word, [&](const int&) {
+            ++seen;
+            return UnparkControl::RemoveContinue;
+            });
+    EXPECT_EQ(0, seen);
+    done = true;
+    a.unpark(&word, [&](const uint64_t&) {
+            ++seen;
+            return UnparkControl::RemoveContinue;
+            });
+    t.join();
+    EXPECT_EQ(1, seen);
+}
+
+TEST(ParkingLotTest, atomic_wait_64) {
+    std::atomic<uint64_t> ticket{uint64_t(1) << 40};
+    const uint64_t first = ticket.load();
+
+    EXPECT_FALSE(atomicWaitUntil(&ticket, first,
+                steady_clock::now() + milliseconds(10)));
+    EXPECT_TRUE(atomicWaitUntil(&ticket, first + 1,
+                steady_clock::now() + milliseconds(10)));
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&]() { atomicWait(&ticket, first); });
+    }
+    std::this_thread::sleep_for(milliseconds(20));
+    // only the high half changes, which a 32-bit futex wouldn't notice
+    ticket.store(first + (uint64_t(1) << 32));
+    atomicNotifyAll(&ticket);
+    for (auto& t : threads) {
+        t.join();
+    }
+}
+
+int main(int argc, char* argv[]) {
+    testing::InitGoogleTest(&argc, argv);
+
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,283 @@
+#pragma once
+
+#include <array>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <utility>
+
+#include <linux/perf_event.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace myfolly {
+
+/// Process-wide event counts for the benchmarks, from perf_event_open.
+///
+/// Counters are opened with inherit set, so they also count every thread
+/// the process starts afterwards: open them before the benchmark threads
+/// exist.  A thread's counts are added to the counters when it exits, so
+/// read them once the threads of a phase have been joined, and take the
+/// difference of two reads (PerfCounters::Delta) to get one phase.
+///
+/// What can be counted depends on the machine.  Hardware events are
+/// usually missing in VMs and containers or with perf_event_paranoid > 2;
+/// they are then left out and the software events are still counted.  If
+/// perf_event_open isn't available at all, context switches, page faults
+/// and CPU time come from getrusage.
+///
+/// There is no portable event for cache-to-cache transfers.  LLC hits
+/// (LLC references that didn't miss) are used as a proxy: they are the
+/// L2 misses served on chip, which under contention are mostly lines
+/// owned by another core.
+class PerfCounters {
+public:
+    enum Counter {
+        kCycles,
+        kInstructions,
+        kL1dMisses,
+        kLlcReferences,
+        kLlcMisses,
+        kContextSwitches,
+        kCpuMigrations,
+        kPageFaults,
+        kTaskClockNs,
+        kNumCounters
+    };
+
+    struct Values {
+        std::array<uint64_t, kNumCounters> counts{};
+    };
+
+    /// The difference between two reads
+    struct Delta {
+        std::array<uint64_t, kNumCounters> counts{};
+        std::array<bool, kNumCounters> valid{};
+
+        /// Cache-to-cache transfer proxy, see above
+        bool hasLlcHits() const noexcept {
+            return valid[kLlcReferences] && valid[kLlcMisses];
+        }
+
+        uint64_t llcHits() const noexcept {
+            return counts[kLlcReferences] > counts[kLlcMisses] ?
+                counts[kLlcReferences] - counts[kLlcMisses] : 0;
+        }
+    };
+
+    /// Opens nothing if enabled is false, so that callers can construct
+    /// one unconditionally
+    explicit PerfCounters(bool enabled = true) {
+        _fds.fill(-1);
+        _valid.fill(false);
+        if (!enabled) {
+            _source = "off";
+            return;
+        }
+        bool hardware = false;
+        bool software = false;
+        for (int c = 0; c < kNumCounters; ++c) {
+            _fds[c] = open(Counter(c));
+            if (_fds[c] >= 0) {
+                _valid[c] = true;
+                (isHardware(Counter(c)) ? hardware : software) = true;
+            }
+        }
+        if (hardware) {
+            _source = "perf";
+        } else if (software) {
+            _source = "perf software";
+        } else {
+            _source = "rusage";
+            _rusage = true;
+            _valid[kContextSwitches] = true;
+            _valid[kPageFaults] = true;
+            _valid[kTaskClockNs] = true;
+        }
+    }
+
+    ~PerfCounters() {
+        for (int fd : _fds) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool enabled() const noexcept { return _source != "off"; }
+
+    /// "perf", "perf software", "rusage" or "off"
+    const std::string& source() const noexcept { return _source; }
+
+    Values read() const noexcept {
+        Values v;
+        if (_rusage) {
+            struct rusage ru;
+            if (getrusage(RUSAGE_SELF, &ru) == 0) {
+                v.counts[kContextSwitches] = ru.ru_nvcsw + ru.ru_nivcsw;
+                v.counts[kPageFaults] = ru.ru_minflt + ru.ru_majflt;
+                v.counts[kTaskClockNs] =
+                    (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000000ULL +
+                    (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1000ULL;
+            }
+            return v;
+        }
+        for (int c = 0; c < kNumCounters; ++c) {
+            if (_fds[c] >= 0) {
+                v.counts[c] = readScaled(_fds[c]);
+            }
+        }
+        return v;
+    }
+
+    Delta delta(const Values& start, const Values& end) const noexcept {
+        Delta d;
+        for (int c = 0; c < kNumCounters; ++c) {
+            d.valid[c] = _valid[c];
+            d.counts[c] = end.counts[c] - start.counts[c];
+        }
+        return d;
+    }
+
+    static const char* name(Counter c) noexcept {
+        static const char* const names[kNumCounters] = {
+            "cycles", "instructions", "l1d_misses", "llc_references",
+            "llc_misses", "context_switches", "cpu_migrations",
+            "page_faults", "task_clock_ns",
+        };
+        return names[c];
+    }
+
+    /// Prints the valid counts of d divided by ops on one line
+    static void print(std::ostream& out, const Delta& d, double ops) {
+        out << std::fixed << std::setprecision(3);
+        for (int c = 0; c < kNumCounters; ++c) {
+            if (d.valid[c]) {
+                out << " " << name(Counter(c)) << " "
+                  << double(d.counts[c]) / ops;
+            }
+        }
+        if (d.hasLlcHits()) {
+            out << " llc_hits(c2c proxy) " << double(d.llcHits()) / ops;
+        }
+    }
+
+private:
+    static bool isHardware(Counter c) noexcept { return c < kContextSwitches; }
+
+    static int open(Counter c) noexcept {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.inherit = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+            PERF_FORMAT_TOTAL_TIME_RUNNING;
+        switch (c) {
+        case kCycles:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case kInstructions:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case kL1dMisses:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_L1D |
+                (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        case kLlcReferences:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CACHE_REFERENCES;
+            break;
+        case kLlcMisses:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CACHE_MISSES;
+            break;
+        case kContextSwitches:
+            attr.type = PERF_TYPE_SOFTWARE;
+            attr.config = PERF_COUNT_SW_CONTEXT_SWITCHES;
+            break;
+        case kCpuMigrations:
+            attr.type = PERF_TYPE_SOFTWARE;
+            attr.config = PERF_COUNT_SW_CPU_MIGRATIONS;
+            break;
+        case kPageFaults:
+            attr.type = PERF_TYPE_SOFTWARE;
+            attr.config = PERF_COUNT_SW_PAGE_FAULTS;
+            break;
+        case kTaskClockNs:
+            attr.type = PERF_TYPE_SOFTWARE;
+            attr.config = PERF_COUNT_SW_TASK_CLOCK;
+            break;
+        default:
+            return -1;
+        }
+        int fd = int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        if (fd < 0 && isHardware(c)) {
+            // some setups only allow user-space counting
+            attr.exclude_kernel = 1;
+            fd = int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        }
+        return fd;
+    }
+
+    /// Extrapolates counts of counters that were multiplexed
+    static uint64_t readScaled(int fd) noexcept {
+        uint64_t buf[3];
+        if (::read(fd, buf, sizeof(buf)) != ssize_t(sizeof(buf))) {
+            return 0;
+        }
+        if (buf[2] == 0) {
+            return 0;
+        }
+        if (buf[2] >= buf[1]) {
+            return buf[0];
+        }
+        return uint64_t(double(buf[0]) * double(buf[1]) / double(buf[2]));
+    }
+
+    std::array<int, kNumCounters> _fds;
+    std::array<bool, kNumCounters> _valid;
+    std::string _source;
+    bool _rusage{false};
+};
+
+/// Counts one phase of a benchmark, from construction to destruction, and
+/// prints the counts per operation when it ends.  Does nothing if the
+/// counters aren't enabled
+class PerfPhase {
+public:
+    PerfPhase(const PerfCounters& counters, std::string name, double ops) :
+        _counters(counters), _name(std::move(name)), _ops(ops),
+        _start(counters.read()) {}
+
+    ~PerfPhase() {
+        if (!_counters.enabled()) {
+            return;
+        }
+        auto d = _counters.delta(_start, _counters.read());
+        std::cout << "perf " << _name << " (" << _counters.source()
+          << ", per op):";
+        PerfCounters::print(std::cout, d, _ops);
+        std::cout << std::endl;
+    }
+
+    PerfPhase(const PerfPhase&) = delete;
+    PerfPhase& operator=(const PerfPhase&) = delete;
+
+private:
+    const PerfCounters& _counters;
+    std::string _name;
+    double _ops;
+    PerfCounters::Values _start;
+};
+
+};  // namespace myfolly
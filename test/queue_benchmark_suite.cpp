@@ -0,0 +1,762 @@
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#include "bounded_queue.h"
+#include "mpmc_queue.h"
+#include "portability.h"
+#include "latency_histogram.h"
+#include "normal_queue.h"
+#include "perf_counters.h"
+
+using namespace myfolly;
+
+static uint64_t now_steady_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000 + uint64_t(ts.tv_nsec);
+}
+
+static uint64_t now_cpu_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/// Where the benchmark threads run
+enum class Placement {
+    /// Wherever the scheduler puts them
+    None,
+    /// Producer i and consumer i next to each other, SMT siblings first
+    Compact,
+    /// One thread per physical core before any core gets a second one
+    Cores,
+    /// Producers on one socket, consumers on the others
+    Sockets,
+};
+
+static const char* placementName(Placement p) {
+    switch (p) {
+    case Placement::None: return "none";
+    case Placement::Compact: return "compact";
+    case Placement::Cores: return "cores";
+    case Placement::Sockets: return "sockets";
+    }
+    return "?";
+}
+
+struct Options {
+    std::vector<std::string> queues{"normal", "bounded", "mpmc"};
+    std::vector<int> producers{1, 2, 4};
+    std::vector<int> consumers{1, 2, 4};
+    std::vector<size_t> capacities{128, 1024};
+    std::vector<size_t> payloads{16, 64, 256};
+    uint64_t ops = 200000;
+    int warmup = 1;
+    int repeats = 3;
+    uint64_t sample = 16;
+    Placement placement = Placement::None;
+    bool perf = false;
+    std::string json;
+    std::string csv;
+};
+
+struct CpuInfo {
+    int cpu;
+    int core;
+    int package;
+};
+
+static int readTopology(int cpu, const char* name, int fallback) {
+    std::ostringstream path;
+    path << "/sys/devices/system/cpu/cpu" << cpu << "/topology/" << name;
+    std::ifstream in(path.str());
+    int value;
+    return (in >> value) ? value : fallback;
+}
+
+/// The CPUs this process may run on, with their core and socket
+static std::vector<CpuInfo> allowedCpus() {
+    std::vector<CpuInfo> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+        return cpus;
+    }
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &set)) {
+            cpus.push_back(CpuInfo{cpu,
+                    readTopology(cpu, "core_id", cpu),
+                    readTopology(cpu, "physical_package_id", 0)});
+        }
+    }
+    return cpus;
+}
+
+/// Returns the CPU for each thread, producers first, or -1 for threads
+/// that aren't pinned.  Threads beyond the number of CPUs wrap around
+static std::vector<int> placeThreads(Placement placement,
+        int numProducers, int numConsumers) {
+    const int numThreads = numProducers + numConsumers;
+    std::vector<int> result(numThreads, -1);
+    std::vector<CpuInfo> cpus = allowedCpus();
+    if (placement == Placement::None || cpus.empty()) {
+        return result;
+    }
+
+    auto bySocketAndCore = [](const CpuInfo& a, const CpuInfo& b) {
+        return std::tie(a.package, a.core, a.cpu) <
+            std::tie(b.package, b.core, b.cpu);
+    };
+    std::sort(cpus.begin(), cpus.end(), bySocketAndCore);
+    if (placement != Placement::Compact) {
+        // the i-th sibling of every core before the (i+1)-th of any
+        std::vector<std::pair<int, CpuInfo>> ranked;
+        for (size_t i = 0; i < cpus.size(); ++i) {
+            int rank = 0;
+            for (size_t j = i; j > 0 && cpus[j - 1].package ==
+                    cpus[i].package && cpus[j - 1].core == cpus[i].core; --j) {
+                ++rank;
+            }
+            ranked.emplace_back(rank, cpus[i]);
+        }
+        std::stable_sort(ranked.begin(), ranked.end(),
+                [](const std::pair<int, CpuInfo>& a,
+                    const std::pair<int, CpuInfo>& b) {
+                    return a.first < b.first;
+                });
+        for (size_t i = 0; i < cpus.size(); ++i) {
+            cpus[i] = ranked[i].second;
+        }
+    }
+
+    if (placement == Placement::Sockets) {
+        std::vector<int> home;
+        std::vector<int> remote;
+        for (const CpuInfo& c : cpus) {
+            (c.package == cpus[0].package ? home : remote).push_back(c.cpu);
+        }
+        if (remote.empty()) {
+            // one socket: same as Cores
+            remote = home;
+        }
+        for (int i = 0; i < numProducers; ++i) {
+            result[i] = home[i % home.size()];
+        }
+        for (int i = 0; i < numConsumers; ++i) {
+            result[numProducers + i] = remote[i % remote.size()];
+        }
+        return result;
+    }
+
+    // producer 0, consumer 0, producer 1, consumer 1, ...
+    size_t next = 0;
+    for (int i = 0; i < std::max(numProducers, numConsumers); ++i) {
+        if (i < numProducers) {
+            result[i] = cpus[next++ % cpus.size()].cpu;
+        }
+        if (i < numConsumers) {
+            result[numProducers + i] = cpus[next++ % cpus.size()].cpu;
+        }
+    }
+    return result;
+}
+
+static void pinCurrentThread(int cpu) {
+    if (cpu < 0) {
+        return;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+/// The queued element: a sequence number, the time it was written (0 if
+/// its write wasn't sampled), and padding up to N bytes
+template <size_t N>
+struct Payload {
+    static_assert(N > 2 * sizeof(uint64_t), "payload too small");
+    uint64_t value;
+    uint64_t stamp;
+    char pad[N - 2 * sizeof(uint64_t)];
+};
+
+template <>
+struct Payload<16> {
+    uint64_t value;
+    uint64_t stamp;
+};
+
+struct RunResult {
+    uint64_t wallNs{0};
+    uint64_t cpuUs{0};
+    bool ok{true};
+    LatencyHistogram enqueue;
+    LatencyHistogram dequeue;
+    LatencyHistogram endToEnd;
+};
+
+/// Histograms are big, so every thread records into its own, on its own
+/// cache lines
+struct alignas(128) ThreadStats {
+    LatencyHistogram op;
+    LatencyHistogram endToEnd;
+    uint64_t sum{0};
+};
+
+template <typename Q, typename P>
+static void runOnce(size_t capacity, int numProducers, int numConsumers,
+        const Options& options, const std::vector<int>& cpus,
+        RunResult& result) {
+    Q q(capacity);
+    const uint64_t n = options.ops;
+    const uint64_t sample = options.sample;
+    const int numThreads = numProducers + numConsumers;
+    std::vector<ThreadStats*> stats;
+    for (int t = 0; t < numThreads; ++t) {
+        stats.push_back(detail::alignedNew<ThreadStats>());
+    }
+    std::atomic<int> ready{0};
+    std::atomic<bool> go{false};
+    auto waitForStart = [&](int t) {
+        pinCurrentThread(cpus[t]);
+        ready.fetch_add(1);
+        while (!go.load(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numProducers; ++t) {
+        threads.emplace_back([&, t]() {
+                waitForStart(t);
+                ThreadStats& s = *stats[t];
+                P elem{};
+                uint64_t k = 0;
+                for (uint64_t v = t; v < n; v += numProducers, ++k) {
+                    elem.value = v;
+                    if (sample != 0 && k % sample == 0) {
+                        uint64_t start = now_steady_ns();
+                        elem.stamp = start;
+                        q.blockingWrite(elem);
+                        s.op.record(now_steady_ns() - start);
+                    } else {
+                        elem.stamp = 0;
+                        q.blockingWrite(elem);
+                    }
+                }
+                });
+    }
+    for (int t = 0; t < numConsumers; ++t) {
+        threads.emplace_back([&, t]() {
+                waitForStart(numProducers + t);
+                ThreadStats& s = *stats[numProducers + t];
+                P elem;
+                uint64_t k = 0;
+                for (uint64_t v = t; v < n; v += numConsumers, ++k) {
+                    if (sample != 0 && k % sample == 0) {
+                        uint64_t start = now_steady_ns();
+                        q.blockingRead(elem);
+                        uint64_t end = now_steady_ns();
+                        s.op.record(end - start);
+                        if (elem.stamp != 0) {
+                            s.endToEnd.record(end - elem.stamp);
+                        }
+                    } else {
+                        q.blockingRead(elem);
+                        if (elem.stamp != 0) {
+                            s.endToEnd.record(now_steady_ns() - elem.stamp);
+                        }
+                    }
+                    s.sum += elem.value;
+                }
+                });
+    }
+
+    while (ready.load() != numThreads) {
+        std::this_thread::yield();
+    }
+    uint64_t cpuStart = now_cpu_us();
+    uint64_t start = now_steady_ns();
+    go.store(true, std::memory_order_release);
+    for (auto& t : threads) {
+        t.join();
+    }
+    result.wallNs = now_steady_ns() - start;
+    result.cpuUs = now_cpu_us() - cpuStart;
+
+    uint64_t sum = 0;
+    for (int t = 0; t < numThreads; ++t) {
+        if (t < numProducers) {
+            result.enqueue.merge(stats[t]->op);
+        } else {
+            result.dequeue.merge(stats[t]->op);
+            result.endToEnd.merge(stats[t]->endToEnd);
+        }
+        sum += stats[t]->sum;
+        detail::alignedDelete(stats[t]);
+    }
+    result.ok = (sum == n * (n - 1) / 2) && q.isEmpty();
+}
+
+template <typename P>
+static bool runQueue(const std::string& queue, size_t capacity,
+        int numProducers, int numConsumers, const Options& options,
+        const std::vector<int>& cpus, RunResult& result) {
+    if (queue == "normal") {
+        runOnce<NormalQueue<P>, P>(capacity, numProducers, numConsumers,
+                options, cpus, result);
+    } else if (queue == "bounded") {
+        runOnce<BoundedQueue<P>, P>(capacity, numProducers, numConsumers,
+                options, cpus, result);
+    } else if (queue == "mpmc") {
+        runOnce<MPMCQueue<P>, P>(capacity, numProducers, numConsumers,
+                options, cpus, result);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static bool runConfig(const std::string& queue, size_t capacity,
+        size_t payload, int numProducers, int numConsumers,
+        const Options& options, const std::vector<int>& cpus,
+        RunResult& result) {
+    switch (payload) {
+    case 16:
+        return runQueue<Payload<16>>(queue, capacity, numProducers,
+                numConsumers, options, cpus, result);
+    case 64:
+        return runQueue<Payload<64>>(queue, capacity, numProducers,
+                numConsumers, options, cpus, result);
+    case 256:
+        return runQueue<Payload<256>>(queue, capacity, numProducers,
+                numConsumers, options, cpus, result);
+    case 1024:
+        return runQueue<Payload<1024>>(queue, capacity, numProducers,
+                numConsumers, options, cpus, result);
+    }
+    return false;
+}
+
+/// One swept configuration and what its measured repeats gave
+struct Report {
+    std::string queue;
+    int producers;
+    int consumers;
+    size_t capacity;
+    size_t payload;
+    std::vector<double> opsPerSec;
+    std::vector<uint64_t> cpuUs;
+    bool ok{true};
+    LatencyHistogram enqueue;
+    LatencyHistogram dequeue;
+    LatencyHistogram endToEnd;
+    /// Over all measured repeats
+    PerfCounters::Delta perf;
+};
+
+template <typename T>
+static T median(std::vector<T> v) {
+    std::sort(v.begin(), v.end());
+    return v.empty() ? T() : v[v.size() / 2];
+}
+
+static std::string latencySummary(const LatencyHistogram& h) {
+    std::ostringstream out;
+    out << h.percentile(0.5) << "/" << h.percentile(0.99) << "/"
+      << h.percentile(0.999) << "/" << h.max();
+    return out.str();
+}
+
+static void printReport(const Report& r, const Options& options,
+        const PerfCounters& perf) {
+    std::cout << std::left << std::setw(8) << r.queue << std::right
+      << " P" << std::setw(3) << r.producers
+      << " C" << std::setw(3) << r.consumers
+      << " cap " << std::setw(6) << r.capacity
+      << " payload " << std::setw(5) << r.payload << ": "
+      << std::fixed << std::setprecision(2) << std::setw(7)
+      << median(r.opsPerSec) / 1e6 << " Mops/s"
+      << " [" << *std::min_element(r.opsPerSec.begin(), r.opsPerSec.end())
+        / 1e6 << ", "
+      << *std::max_element(r.opsPerSec.begin(), r.opsPerSec.end()) / 1e6
+      << "], cpu " << median(r.cpuUs) << " us"
+      << ". p50/p99/p99.9/max ns enq " << latencySummary(r.enqueue)
+      << " deq " << latencySummary(r.dequeue)
+      << " e2e " << latencySummary(r.endToEnd);
+    if (!r.ok) {
+        std::cout << " ERROR Result!";
+    }
+    std::cout << std::endl;
+    if (perf.enabled()) {
+        std::cout << "    " << perf.source() << " per element:";
+        PerfCounters::print(std::cout, r.perf,
+                double(options.ops) * options.repeats);
+        std::cout << std::endl;
+    }
+}
+
+static void writeJsonLatency(std::ostream& out, const char* name,
+        const LatencyHistogram& h) {
+    out << "\"" << name << "\": {\"count\": " << h.count()
+      << ", \"mean\": " << h.mean()
+      << ", \"min\": " << h.min()
+      << ", \"p50\": " << h.percentile(0.5)
+      << ", \"p90\": " << h.percentile(0.9)
+      << ", \"p99\": " << h.percentile(0.99)
+      << ", \"p999\": " << h.percentile(0.999)
+      << ", \"max\": " << h.max() << "}";
+}
+
+static void writeJsonPerf(std::ostream& out, const PerfCounters::Delta& d,
+        double ops) {
+    out << "\"perf_per_element\": {";
+    const char* sep = "";
+    for (int c = 0; c < PerfCounters::kNumCounters; ++c) {
+        if (d.valid[c]) {
+            out << sep << "\"" << PerfCounters::name(PerfCounters::Counter(c))
+              << "\": " << std::setprecision(4) << double(d.counts[c]) / ops;
+            sep = ", ";
+        }
+    }
+    if (d.hasLlcHits()) {
+        out << sep << "\"llc_hits\": " << double(d.llcHits()) / ops;
+    }
+    out << std::setprecision(1) << "}";
+}
+
+static void writeJson(std::ostream& out, const Options& options,
+        const PerfCounters& perf, const std::vector<Report>& reports) {
+    out << std::fixed << std::setprecision(1);
+    out << "{\n  \"hardware_threads\": "
+      << std::thread::hardware_concurrency()
+      << ",\n  \"ops\": " << options.ops
+      << ",\n  \"warmup\": " << options.warmup
+      << ",\n  \"repeats\": " << options.repeats
+      << ",\n  \"sample\": " << options.sample
+      << ",\n  \"placement\": \"" << placementName(options.placement)
+      << "\",\n  \"perf_source\": \"" << perf.source()
+      << "\",\n  \"results\": [";
+    for (size_t i = 0; i < reports.size(); ++i) {
+        const Report& r = reports[i];
+        out << (i == 0 ? "\n" : ",\n")
+          << "    {\"queue\": \"" << r.queue << "\""
+          << ", \"producers\": " << r.producers
+          << ", \"consumers\": " << r.consumers
+          << ", \"capacity\": " << r.capacity
+          << ", \"payload\": " << r.payload
+          << ", \"ok\": " << (r.ok ? "true" : "false")
+          << ",\n     \"ops_per_sec\": [";
+        for (size_t j = 0; j < r.opsPerSec.size(); ++j) {
+            out << (j == 0 ? "" : ", ") << r.opsPerSec[j];
+        }
+        out << "], \"ops_per_sec_median\": " << median(r.opsPerSec)
+          << ", \"cpu_us_median\": " << median(r.cpuUs)
+          << ",\n     \"latency_ns\": {";
+        writeJsonLatency(out, "enqueue", r.enqueue);
+        out << ",\n       ";
+        writeJsonLatency(out, "dequeue", r.dequeue);
+        out << ",\n       ";
+        writeJsonLatency(out, "end_to_end", r.endToEnd);
+        out << "}";
+        if (perf.enabled()) {
+            out << ",\n     ";
+            writeJsonPerf(out, r.perf, double(options.ops) * options.repeats);
+        }
+        out << "}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+/// Perf columns only when perf is enabled, empty where a counter isn't
+/// available
+static void writeCsv(std::ostream& out, const Options& options,
+        const PerfCounters& perf, const std::vector<Report>& reports) {
+    out << "queue,producers,consumers,capacity,payload,ok,"
+      "ops_per_sec_median,ops_per_sec_min,ops_per_sec_max,cpu_us_median";
+    for (const char* h : {"enq", "deq", "e2e"}) {
+        for (const char* p : {"p50", "p99", "p999", "max"}) {
+            out << "," << h << "_" << p << "_ns";
+        }
+    }
+    if (perf.enabled()) {
+        for (int c = 0; c < PerfCounters::kNumCounters; ++c) {
+            out << "," << PerfCounters::name(PerfCounters::Counter(c))
+              << "_per_element";
+        }
+        out << ",llc_hits_per_element";
+    }
+    out << "\n" << std::fixed << std::setprecision(1);
+    for (const Report& r : reports) {
+        out << r.queue << "," << r.producers << "," << r.consumers << ","
+          << r.capacity << "," << r.payload << "," << (r.ok ? 1 : 0) << ","
+          << median(r.opsPerSec) << ","
+          << *std::min_element(r.opsPerSec.begin(), r.opsPerSec.end()) << ","
+          << *std::max_element(r.opsPerSec.begin(), r.opsPerSec.end()) << ","
+          << median(r.cpuUs);
+        for (const LatencyHistogram* h :
+                {&r.enqueue, &r.dequeue, &r.endToEnd}) {
+            out << "," << h->percentile(0.5) << "," << h->percentile(0.99)
+              << "," << h->percentile(0.999) << "," << h->max();
+        }
+        if (perf.enabled()) {
+            const double ops = double(options.ops) * options.repeats;
+            out << std::setprecision(4);
+            for (int c = 0; c < PerfCounters::kNumCounters; ++c) {
+                out << ",";
+                if (r.perf.valid[c]) {
+                    out << double(r.perf.counts[c]) / ops;
+                }
+            }
+            out << ",";
+            if (r.perf.hasLlcHits()) {
+                out << double(r.perf.llcHits()) / ops;
+            }
+            out << std::setprecision(1);
+        }
+        out << "\n";
+    }
+}
+
+/// Writes to path, or to stdout if path is "-"
+template <typename F>
+static bool writeOutput(const std::string& path, F write) {
+    if (path == "-") {
+        write(std::cout);
+        return true;
+    }
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "cannot open " << path << std::endl;
+        return false;
+    }
+    write(out);
+    return bool(out);
+}
+
+template <typename T>
+static bool parseList(const std::string& value, std::vector<T>& out) {
+    out.clear();
+    std::istringstream in(value);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        std::istringstream conv(item);
+        T v;
+        if (!(conv >> v)) {
+            return false;
+        }
+        out.push_back(v);
+    }
+    return !out.empty();
+}
+
+template <typename T>
+static bool parseValue(const std::string& value, T& out) {
+    std::istringstream conv(value);
+    return bool(conv >> out);
+}
+
+static void usage() {
+    std::cout <<
+        "usage: queue_benchmark_suite [options]\n"
+        "  --queues=normal,bounded,mpmc\n"
+        "  --producers=1,2,4       producer thread counts\n"
+        "  --consumers=1,2,4       consumer thread counts, every pair with\n"
+        "                          --producers is run\n"
+        "  --capacities=128,1024\n"
+        "  --payloads=16,64,256    element bytes: 16, 64, 256 or 1024\n"
+        "  --ops=200000            elements per run\n"
+        "  --warmup=1              unmeasured runs per configuration\n"
+        "  --repeats=3             measured runs per configuration\n"
+        "  --sample=16             time every n-th operation, 0 for none\n"
+        "  --placement=none        none, compact, cores or sockets\n"
+        "  --perf                  count cycles, cache misses, context\n"
+        "                          switches, ... with perf_event_open\n"
+        "  --json=FILE             write results as JSON (- for stdout)\n"
+        "  --csv=FILE              write results as CSV (- for stdout)\n";
+}
+
+static bool parseOptions(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--perf") {
+            options.perf = true;
+            continue;
+        }
+        size_t eq = arg.find('=');
+        if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos) {
+            return false;
+        }
+        std::string name = arg.substr(2, eq - 2);
+        std::string value = arg.substr(eq + 1);
+        bool ok;
+        if (name == "queues") {
+            ok = parseList(value, options.queues);
+            for (const auto& q : options.queues) {
+                ok = ok && (q == "normal" || q == "bounded" || q == "mpmc");
+            }
+        } else if (name == "producers") {
+            ok = parseList(value, options.producers);
+        } else if (name == "consumers") {
+            ok = parseList(value, options.consumers);
+        } else if (name == "capacities") {
+            ok = parseList(value, options.capacities);
+        } else if (name == "payloads") {
+            ok = parseList(value, options.payloads);
+            for (size_t p : options.payloads) {
+                ok = ok && (p == 16 || p == 64 || p == 256 || p == 1024);
+            }
+        } else if (name == "ops") {
+            ok = parseValue(value, options.ops) && options.ops > 0;
+        } else if (name == "warmup") {
+            ok = parseValue(value, options.warmup) && options.warmup >= 0;
+        } else if (name == "repeats") {
+            ok = parseValue(value, options.repeats) && options.repeats > 0;
+        } else if (name == "sample") {
+            ok = parseValue(value, options.sample);
+        } else if (name == "placement") {
+            ok = true;
+            if (value == "none") {
+                options.placement = Placement::None;
+            } else if (value == "compact") {
+                options.placement = Placement::Compact;
+            } else if (value == "cores") {
+                options.placement = Placement::Cores;
+            } else if (value == "sockets") {
+                options.placement = Placement::Sockets;
+            } else {
+                ok = false;
+            }
+        } else if (name == "json") {
+            options.json = value;
+            ok = !value.empty();
+        } else if (name == "csv") {
+            options.csv = value;
+            ok = !value.empty();
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            std::cerr << "bad option " << arg << std::endl;
+            return false;
+        }
+    }
+    for (int p : options.producers) {
+        if (p <= 0) {
+            return false;
+        }
+    }
+    for (int c : options.consumers) {
+        if (c <= 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// A configurable queue benchmark for regression tracking and for choosing
+/// queue parameters.  Every combination of the swept queue types,
+/// producer counts, consumer counts, capacities and payload sizes is run
+/// warmup times unmeasured and then repeats times measured, and reported
+/// on stdout and optionally as JSON and CSV:
+///
+///   queue_benchmark_suite --queues=bounded,mpmc --producers=1,4
+///       --consumers=1,2,8 --capacities=128,4096 --payloads=16,256
+///       --ops=1000000 --warmup=1 --repeats=5 --placement=cores
+///       --json=run.json --csv=run.csv
+///
+/// Every sample-th operation of each thread is timed on its own, giving
+/// per-operation enqueue and dequeue latency, and its element carries the
+/// time it was written, giving enqueue-to-dequeue latency.  The clock
+/// reads cost some throughput; --sample=0 turns them off.
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        usage();
+        return 2;
+    }
+    // before any benchmark thread exists, so that they are all counted
+    PerfCounters perf(options.perf);
+    std::cout << "Start QueueBenchmarkSuite! placement "
+      << placementName(options.placement) << ", " << options.ops
+      << " ops, " << options.warmup << " warmup, " << options.repeats
+      << " repeats";
+    if (perf.enabled()) {
+        std::cout << ", counters from " << perf.source();
+    }
+    std::cout << std::endl;
+
+    std::vector<Report> reports;
+    for (const std::string& queue : options.queues) {
+        for (size_t payload : options.payloads) {
+            for (size_t capacity : options.capacities) {
+                for (int p : options.producers) {
+                    for (int c : options.consumers) {
+                        Report r;
+                        r.queue = queue;
+                        r.producers = p;
+                        r.consumers = c;
+                        r.capacity = capacity;
+                        r.payload = payload;
+                        auto cpus = placeThreads(options.placement, p, c);
+                        PerfCounters::Values perfStart;
+                        for (int i = 0; i < options.warmup + options.repeats;
+                                ++i) {
+                            if (i == options.warmup) {
+                                perfStart = perf.read();
+                            }
+                            RunResult run;
+                            runConfig(queue, capacity, payload, p, c,
+                                    options, cpus, run);
+                            r.ok = r.ok && run.ok;
+                            if (i < options.warmup) {
+                                continue;
+                            }
+                            r.opsPerSec.push_back(
+                                    double(options.ops) * 1e9 / run.wallNs);
+                            r.cpuUs.push_back(run.cpuUs);
+                            r.enqueue.merge(run.enqueue);
+                            r.dequeue.merge(run.dequeue);
+                            r.endToEnd.merge(run.endToEnd);
+                        }
+                        r.perf = perf.delta(perfStart, perf.read());
+                        printReport(r, options, perf);
+                        reports.push_back(std::move(r));
+                    }
+                }
+            }
+        }
+    }
+
+    bool written = true;
+    if (!options.json.empty()) {
+        written = writeOutput(options.json, [&](std::ostream& out) {
+                writeJson(out, options, perf, reports);
+                }) && written;
+    }
+    if (!options.csv.empty()) {
+        written = writeOutput(options.csv, [&](std::ostream& out) {
+                writeCsv(out, options, perf, reports);
+                }) && written;
+    }
+    for (const Report& r : reports) {
+        if (!r.ok) {
+            return 1;
+        }
+    }
+    return written ? 0 : 1;
+}
@@ -0,0 +1,108 @@
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <iomanip>
+
+#include "mpmc_queue.h"
+#include "bounded_queue.h"
+
+using namespace myfolly;
+
+static uint64_t now_real_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>
+      (std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+template <typename Capacity>
+using MPMC = MPMCQueue<uint64_t,
+      std::allocator<SingleElementQueue<uint64_t>>, false, Capacity>;
+
+template <typename Capacity>
+using Bounded = BoundedQueue<uint64_t,
+      AlignedAllocator<Slot<uint64_t>>, Capacity>;
+
+/// One thread keeps the queue half full and alternates write and read, so
+/// the ticket -> slot mapping is a large part of every operation
+template <typename Q>
+uint64_t runSingleThreadTest(size_t capacity, uint64_t n) {
+    Q q(capacity);
+    uint64_t elem = 0;
+    uint64_t sum = 0;
+    for (size_t i = 0; i < capacity / 2; ++i) {
+        q.write(i);
+    }
+    auto start = now_real_us();
+    for (uint64_t i = 0; i < n; ++i) {
+        q.write(i);
+        q.read(elem);
+        sum += elem;
+    }
+    auto elapsed = now_real_us() - start;
+    if (sum == 0) {
+        std::cout << "ERROR Result! sum is 0" << std::endl;
+    }
+    return elapsed;
+}
+
+template <typename Q>
+uint64_t runThreadsTest(size_t capacity, int numThreads, uint64_t n) {
+    Q q(capacity);
+    std::atomic<uint64_t> sum(0);
+    std::vector<std::thread> threads;
+    auto start = now_real_us();
+    for (int t = 0; t < numThreads; ++t) {
+        threads.emplace_back([&, t]() {
+                for (uint64_t i = t; i < n; i += numThreads) {
+                    q.blockingWrite(i);
+                }
+                });
+        threads.emplace_back([&, t]() {
+                uint64_t threadSum = 0;
+                uint64_t elem;
+                for (uint64_t i = t; i < n; i += numThreads) {
+                    q.blockingRead(elem);
+                    threadSum += elem;
+                }
+                sum += threadSum;
+                });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    auto elapsed = now_real_us() - start;
+    if (n * (n - 1) / 2 != sum) {
+        std::cout << "ERROR Result! sum:" << n * (n - 1) / 2
+          << " : " << sum << std::endl;
+    }
+    return elapsed;
+}
+
+template <typename Q>
+void runTests(const char* name, size_t capacity) {
+    const uint64_t n = 10000000;
+    auto single = runSingleThreadTest<Q>(capacity, n);
+    std::cout << name << " capacity:" << std::setw(5) << capacity
+      << ". 1 thread: " << std::setw(6) << single * 1000 / n << " ns/op pair";
+    for (int nt : {1, 4}) {
+        auto elapsed = runThreadsTest<Q>(capacity, nt, n / 10);
+        std::cout << ", " << nt << "+" << nt << " threads: " << std::setw(7)
+          << elapsed << " us";
+    }
+    std::cout << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "Start QueueCapacityBenchmark!" << std::endl;
+    runTests<MPMC<RuntimeCapacity>>(   "mpmc    runtime   ", 1000);
+    runTests<MPMC<RuntimeCapacity>>(   "mpmc    runtime   ", 1024);
+    runTests<MPMC<PowerOfTwoCapacity>>("mpmc    pow2      ", 1024);
+    runTests<MPMC<FixedCapacity<1000>>>("mpmc    fixed     ", 1000);
+    runTests<MPMC<FixedCapacity<1024>>>("mpmc    fixed     ", 1024);
+    runTests<Bounded<RuntimeCapacity>>(   "bounded runtime   ", 1000);
+    runTests<Bounded<RuntimeCapacity>>(   "bounded runtime   ", 1024);
+    runTests<Bounded<PowerOfTwoCapacity>>("bounded pow2      ", 1024);
+    runTests<Bounded<FixedCapacity<1000>>>("bounded fixed     ", 1000);
+    runTests<Bounded<FixedCapacity<1024>>>("bounded fixed     ", 1024);
+    return 0;
+}
@@ -0,0 +1,162 @@
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <iomanip>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "bounded_queue.h"
+#include "mpmc_queue.h"
+#include "portability.h"
+
+using namespace myfolly;
+
+static uint64_t now_steady_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>
+      (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// NAIVE: producers write a separate eventfd after every element, what an
+/// event loop integration does without the queue's help.  ARMED: the
+/// queue's notificationFd(), written only when the consumer armed it
+enum class Mode { NAIVE, ARMED };
+
+/// The consumer is an epoll loop on one fd; it counts its epoll_wait and
+/// read(2) calls, the producers count their write(2) calls
+template <typename Queue>
+void runNotification(const char* name, Mode mode, Queue& q,
+        int numProducers, int numItems, int burst) {
+    int naiveFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    int fd = mode == Mode::NAIVE ? naiveFd : q.notificationFd();
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u64 = 0;
+    epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
+
+    const uint64_t signalsBefore = q.readinessEvent().eventFdSignals();
+    std::atomic<uint64_t> naiveWrites{0};
+    const int perProducer = numItems / numProducers;
+    auto start = now_steady_ns();
+    std::vector<std::unique_ptr<std::thread>> producers(numProducers);
+    for (int t = 0; t < numProducers; ++t) {
+        producers[t].reset(new std::thread([&]() {
+                uint64_t writes = 0;
+                for (int i = 0; i < perProducer; ++i) {
+                    if (i % burst == 0) {
+                        std::this_thread::yield();
+                    }
+                    q.blockingWrite(i);
+                    if (mode == Mode::NAIVE) {
+                        uint64_t one = 1;
+                        ssize_t rv = write(naiveFd, &one, sizeof(one));
+                        (void)rv;
+                        ++writes;
+                    }
+                }
+                naiveWrites += writes;
+                }));
+    }
+
+    const int total = perProducer * numProducers;
+    uint64_t consumerSyscalls = 0;
+    int received = 0;
+    while (received < total) {
+        int elem;
+        while (q.read(elem)) {
+            ++received;
+        }
+        if (received == total) {
+            break;
+        }
+        if (mode == Mode::ARMED && !q.armNotification()) {
+            continue;
+        }
+        epoll_wait(ep, &ev, 1, -1);
+        if (mode == Mode::NAIVE) {
+            uint64_t count;
+            ssize_t rv = read(naiveFd, &count, sizeof(count));
+            (void)rv;
+        } else {
+            q.clearNotification();
+        }
+        consumerSyscalls += 2;
+    }
+    for (auto& t : producers) {
+        t->join();
+    }
+    auto elapsed = now_steady_ns() - start;
+
+    uint64_t producerSyscalls = mode == Mode::NAIVE ? naiveWrites.load() :
+        q.readinessEvent().eventFdSignals() - signalsBefore;
+    std::cout << name << (mode == Mode::NAIVE ? " naive" : " armed")
+      << " producers:" << std::setw(2) << numProducers
+      << " " << std::setw(6) << elapsed / total << " ns/item"
+      << " syscalls/item producer: " << std::setw(6) << std::setprecision(3)
+      << double(producerSyscalls) / total
+      << " consumer: " << std::setw(6) << double(consumerSyscalls) / total
+      << std::endl;
+
+    close(ep);
+    close(naiveFd);
+}
+
+/// BoundedQueue doesn't expose its ReadinessEvent; notificationsSent() is
+/// the same count
+template <typename Queue>
+struct BoundedAdapter {
+    Queue q;
+    struct Signals {
+        Queue& q;
+        uint64_t eventFdSignals() const { return q.notificationsSent(); }
+    } signals{q};
+
+    explicit BoundedAdapter(size_t capacity) : q(capacity) {}
+    int notificationFd() { return q.notificationFd(); }
+    bool armNotification() { return q.armNotification(); }
+    void clearNotification() { q.clearNotification(); }
+    void blockingWrite(int v) { q.blockingWrite(v); }
+    bool read(int& v) { return q.read(v); }
+    Signals& readinessEvent() { return signals; }
+};
+
+template <typename Queue>
+void runMPMC(Mode mode, int numProducers, int numItems, int burst) {
+    auto q = detail::alignedNew<Queue>(1024);
+    runNotification("MPMCQueue        ", mode, *q, numProducers, numItems,
+            burst);
+    detail::alignedDelete(q);
+}
+
+template <typename Queue>
+void runBounded(const char* name, Mode mode, int numProducers, int numItems,
+        int burst) {
+    auto q = detail::alignedNew<BoundedAdapter<Queue>>(1024);
+    runNotification(name, mode, *q, numProducers, numItems, burst);
+    detail::alignedDelete(q);
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "Start QueueNotificationBenchmark!" << std::endl;
+    const int numItems = 1000000;
+    const int burst = 64;
+    Mode modes[] = {Mode::NAIVE, Mode::ARMED};
+    for (Mode mode : modes) {
+        runBounded<SPSCBoundedQueue<int>>("SPSCBoundedQueue ", mode, 1,
+                numItems, burst);
+    }
+    int nps[] = {1, 4};
+    for (int np : nps) {
+        for (Mode mode : modes) {
+            runMPMC<MPMCQueue<int>>(mode, np, numItems, burst);
+            runBounded<BoundedQueue<int>>("BoundedQueue     ", mode, np,
+                    numItems, burst);
+        }
+    }
+    return 0;
+}
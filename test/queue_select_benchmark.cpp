@@ -0,0 +1,133 @@
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+#include <iomanip>
+
+#include <sys/resource.h>
+
+#include "mpmc_queue.h"
+#include "portability.h"
+#include "queue_select.h"
+
+using namespace myfolly;
+
+static uint64_t now_steady_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>
+      (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// CPU time (user + system) of the calling thread
+static uint64_t thread_cpu_us() {
+    struct rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000ull +
+        usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+using Queue = MPMCQueue<uint64_t>;
+
+enum class Dispatch { READ_ANY, POLL_SLEEP_100US, POLL_SLEEP_1MS, POLL_YIELD };
+
+static const char* name(Dispatch d) {
+    switch (d) {
+    case Dispatch::READ_ANY: return "readAny          ";
+    case Dispatch::POLL_SLEEP_100US: return "poll+sleep(100us)";
+    case Dispatch::POLL_SLEEP_1MS: return "poll+sleep(1ms)  ";
+    case Dispatch::POLL_YIELD: return "poll+yield       ";
+    }
+    return "";
+}
+
+/// Round-robin read() over all queues, what dispatchers do without readAny
+static size_t pollOnce(std::vector<Queue*>& queues, uint64_t& elem) {
+    for (size_t i = 0; i < queues.size(); ++i) {
+        if (queues[i]->read(elem)) {
+            return i;
+        }
+    }
+    return queues.size();
+}
+
+/// A producer writes a timestamp to a random one of numQueues queues every
+/// gapUs; one dispatcher thread receives them.  Reports the latency from
+/// write to receipt and the dispatcher's CPU time per message.
+static void runDispatch(Dispatch how, size_t numQueues, int numMessages,
+        uint64_t gapUs) {
+    std::vector<Queue*> queues;
+    for (size_t i = 0; i < numQueues; ++i) {
+        queues.push_back(detail::alignedNew<Queue>(64));
+    }
+
+    std::vector<uint64_t> latencies;
+    latencies.reserve(numMessages);
+    uint64_t cpuUs = 0;
+    std::thread dispatcher([&]() {
+            auto startCpu = thread_cpu_us();
+            uint64_t stamp;
+            for (int m = 0; m < numMessages; ++m) {
+                while (true) {
+                    size_t i;
+                    if (how == Dispatch::READ_ANY) {
+                        i = readAny(queues.data(), numQueues, stamp);
+                    } else {
+                        i = pollOnce(queues, stamp);
+                    }
+                    if (i != numQueues) {
+                        break;
+                    }
+                    if (how == Dispatch::POLL_SLEEP_100US) {
+                        std::this_thread::sleep_for(std::chrono::microseconds(100));
+                    } else if (how == Dispatch::POLL_SLEEP_1MS) {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    } else {
+                        std::this_thread::yield();
+                    }
+                }
+                latencies.push_back(now_steady_ns() - stamp);
+            }
+            cpuUs = thread_cpu_us() - startCpu;
+            });
+
+    std::mt19937 rng(1);
+    for (int m = 0; m < numMessages; ++m) {
+        std::this_thread::sleep_for(std::chrono::microseconds(gapUs));
+        queues[rng() % numQueues]->blockingWrite(now_steady_ns());
+    }
+    dispatcher.join();
+
+    std::sort(latencies.begin(), latencies.end());
+    auto pct = [&latencies](double p) {
+        return latencies[size_t(p * (latencies.size() - 1))] / 1000;
+    };
+    std::cout << name(how) << " queues:" << std::setw(3) << numQueues
+      << " latency p50:" << std::setw(6) << pct(0.50) << " us"
+      << " p99:" << std::setw(6) << pct(0.99) << " us"
+      << " max:" << std::setw(6) << latencies.back() / 1000 << " us"
+      << " dispatcher cpu/msg:" << std::setw(6) << cpuUs / numMessages
+      << " us" << std::endl;
+
+    for (auto q : queues) {
+        detail::alignedDelete(q);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "Start QueueSelectBenchmark!" << std::endl;
+    std::cout << "futex_waitv "
+      << (detail::futexWaitvSupported() ? "supported" : "not supported")
+      << std::endl;
+    const int numMessages = 2000;
+    const uint64_t gapUs = 200;
+    size_t counts[] = {8, 32};
+    Dispatch hows[] = {Dispatch::READ_ANY, Dispatch::POLL_SLEEP_100US,
+        Dispatch::POLL_SLEEP_1MS, Dispatch::POLL_YIELD};
+    for (size_t n : counts) {
+        for (Dispatch how : hows) {
+            runDispatch(how, n, numMessages, gapUs);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,160 @@
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "bounded_queue.h"
+#include "sharded_queue.h"
+#include "gtest/gtest.h"
+
+using namespace myfolly;
+using namespace std::chrono;
+
+TEST(ShardedQueueTest, home_shard_is_fifo) {
+    ShardedQueue<int> q(16, 4, ShardSelection::Thread);
+    EXPECT_EQ(4u, q.numShards());
+    EXPECT_EQ(64u, q.capacity());
+    size_t home = q.homeShard();
+    for (int i = 0; i < 10; ++i) {
+        EXPECT_TRUE(q.write(i));
+    }
+    EXPECT_EQ(10, q.size());
+    EXPECT_EQ(10, q.shard(home).size());
+    int v = -1;
+    for (int i = 0; i < 10; ++i) {
+        ASSERT_TRUE(q.read(v));
+        EXPECT_EQ(i, v);
+    }
+    EXPECT_FALSE(q.read(v));
+    EXPECT_TRUE(q.isEmpty());
+}
+
+TEST(ShardedQueueTest, spill_and_steal) {
+    ShardedQueue<int> q(2, 4, ShardSelection::Thread);
+    for (int i = 0; i < 8; ++i) {
+        EXPECT_TRUE(q.write(i));
+    }
+    // every shard is full now
+    EXPECT_FALSE(q.write(8));
+    for (size_t i = 0; i < q.numShards(); ++i) {
+        EXPECT_EQ(2, q.shard(i).size());
+    }
+
+    // a reader with another home shard steals what it doesn't have
+    std::thread reader([&q]() {
+            int sum = 0;
+            int v = -1;
+            for (int i = 0; i < 8; ++i) {
+                EXPECT_TRUE(q.read(v));
+                sum += v;
+            }
+            EXPECT_FALSE(q.read(v));
+            EXPECT_EQ(28, sum);
+            });
+    reader.join();
+}
+
+TEST(ShardedQueueTest, blocking_read_wakes_on_any_shard) {
+    ShardedQueue<int> q(8, 4, ShardSelection::Thread);
+    std::atomic<int> sum{0};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 3; ++t) {
+        readers.emplace_back([&q, &sum]() {
+                int v;
+                q.blockingRead(v);
+                sum += v;
+                });
+    }
+    std::this_thread::sleep_for(milliseconds(10));
+    // written from other threads, i.e. (usually) to other home shards
+    for (int t = 1; t <= 3; ++t) {
+        std::thread([&q, t]() { q.blockingWrite(t); }).join();
+    }
+    for (auto& t : readers) {
+        t.join();
+    }
+    EXPECT_EQ(6, sum.load());
+    EXPECT_TRUE(q.isEmpty());
+}
+
+TEST(ShardedQueueTest, try_read_for) {
+    ShardedQueue<int> q(8, 2);
+    int v = -1;
+    auto start = steady_clock::now();
+    EXPECT_FALSE(q.tryReadFor(milliseconds(20), v));
+    EXPECT_GE(steady_clock::now() - start, milliseconds(20));
+
+    std::thread producer([&q]() {
+            std::this_thread::sleep_for(milliseconds(10));
+            q.write(7);
+            });
+    EXPECT_TRUE(q.tryReadFor(seconds(10), v));
+    EXPECT_EQ(7, v);
+    producer.join();
+}
+
+TEST(ShardedQueueTest, move_only) {
+    ShardedQueue<std::unique_ptr<int>> q(1, 2, ShardSelection::Thread);
+    EXPECT_TRUE(q.write(std::unique_ptr<int>(new int(1))));
+    EXPECT_TRUE(q.write(std::unique_ptr<int>(new int(2))));
+    std::unique_ptr<int> p(new int(3));
+    EXPECT_FALSE(q.write(std::move(p)));
+    // a failed write leaves its argument alone
+    ASSERT_TRUE(p != nullptr);
+    EXPECT_EQ(3, *p);
+    std::unique_ptr<int> out;
+    q.blockingRead(out);
+    q.blockingRead(out);
+    EXPECT_TRUE(q.isEmpty());
+}
+
+template <typename Q>
+static void runMtSum(int numThreads, uint64_t perThread,
+        ShardSelection selection) {
+    Q q(16, 4, selection);
+    std::atomic<uint64_t> sum{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; ++t) {
+        threads.emplace_back([&q, perThread]() {
+                for (uint64_t i = 1; i <= perThread; ++i) {
+                    q.blockingWrite(i);
+                }
+                });
+        threads.emplace_back([&q, &sum, perThread, t]() {
+                uint64_t local = 0;
+                uint64_t v;
+                for (uint64_t i = 0; i < perThread; ++i) {
+                    if (t % 2 == 0) {
+                        q.blockingRead(v);
+                    } else {
+                        while (!q.tryReadFor(milliseconds(1), v)) {
+                        }
+                    }
+                    local += v;
+                }
+                sum += local;
+                });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    EXPECT_EQ(perThread * (perThread + 1) / 2 * numThreads, sum.load());
+    EXPECT_TRUE(q.isEmpty());
+}
+
+TEST(ShardedQueueTest, mt_sum) {
+    runMtSum<ShardedQueue<uint64_t>>(6, 20000, ShardSelection::Cpu);
+    runMtSum<ShardedQueue<uint64_t>>(6, 20000, ShardSelection::Thread);
+}
+
+TEST(ShardedQueueTest, mt_sum_bounded_shards) {
+    runMtSum<ShardedQueue<uint64_t, BoundedQueue<uint64_t>>>(6, 20000,
+            ShardSelection::Thread);
+}
+
+int main(int argc, char* argv[]) {
+    testing::InitGoogleTest(&argc, argv);
+
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,165 @@
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <iomanip>
+
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "shared_mpmc_queue.h"
+
+using namespace myfolly;
+
+static uint64_t now_steady_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>
+      (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// CPU time (user + system) of this process and its reaped children
+static uint64_t process_cpu_us() {
+    uint64_t total = 0;
+    int whos[] = {RUSAGE_SELF, RUSAGE_CHILDREN};
+    for (int who : whos) {
+        struct rusage usage;
+        getrusage(who, &usage);
+        total += (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000ull +
+            usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+    }
+    return total;
+}
+
+template <size_t Size>
+struct Message {
+    uint64_t seq;
+    char payload[Size - sizeof(uint64_t)];
+};
+
+enum class Transport { SHARED_QUEUE, SOCKET, SOCKET_BATCH };
+
+static const char* name(Transport t) {
+    switch (t) {
+    case Transport::SHARED_QUEUE: return "SharedMPMCQueue     ";
+    case Transport::SOCKET: return "unix socket         ";
+    case Transport::SOCKET_BATCH: return "unix socket batch 64";
+    }
+    return "";
+}
+
+static bool writeAll(int fd, const void* buf, size_t len) {
+    auto p = static_cast<const char*>(buf);
+    while (len > 0) {
+        ssize_t rv = write(fd, p, len);
+        if (rv <= 0) {
+            return false;
+        }
+        p += rv;
+        len -= size_t(rv);
+    }
+    return true;
+}
+
+static bool readAll(int fd, void* buf, size_t len) {
+    auto p = static_cast<char*>(buf);
+    while (len > 0) {
+        ssize_t rv = read(fd, p, len);
+        if (rv <= 0) {
+            return false;
+        }
+        p += rv;
+        len -= size_t(rv);
+    }
+    return true;
+}
+
+/// A forked child produces numMessages messages, this process consumes
+/// them; the time and CPU include the child's startup
+template <size_t Size>
+void runTransport(Transport how, uint64_t numMessages) {
+    using Msg = Message<Size>;
+    const size_t kBatch = 64;
+    std::string shm = "/myfolly_bench_" + std::to_string(getpid());
+    int fds[2] = {-1, -1};
+    SharedMPMCQueue<Msg>* q = nullptr;
+    if (how == Transport::SHARED_QUEUE) {
+        q = new SharedMPMCQueue<Msg>(
+                SharedMPMCQueue<Msg>::createShm(shm, 1024));
+    } else if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        return;
+    }
+
+    auto startCpu = process_cpu_us();
+    auto start = now_steady_ns();
+    pid_t child = fork();
+    if (child == 0) {
+        Msg batch[kBatch];
+        if (how == Transport::SHARED_QUEUE) {
+            auto producer = SharedMPMCQueue<Msg>::openShm(shm);
+            for (uint64_t i = 0; i < numMessages; ++i) {
+                batch[0].seq = i;
+                producer.blockingWrite(batch[0]);
+            }
+        } else {
+            close(fds[0]);
+            size_t perWrite = how == Transport::SOCKET_BATCH ? kBatch : 1;
+            for (uint64_t i = 0; i < numMessages; i += perWrite) {
+                for (size_t k = 0; k < perWrite; ++k) {
+                    batch[k].seq = i + k;
+                }
+                writeAll(fds[1], batch, perWrite * sizeof(Msg));
+            }
+        }
+        _exit(0);
+    }
+
+    uint64_t errors = 0;
+    Msg batch[kBatch];
+    if (how == Transport::SHARED_QUEUE) {
+        for (uint64_t i = 0; i < numMessages; ++i) {
+            q->blockingRead(batch[0]);
+            errors += batch[0].seq != i;
+        }
+    } else {
+        close(fds[1]);
+        size_t perRead = how == Transport::SOCKET_BATCH ? kBatch : 1;
+        for (uint64_t i = 0; i < numMessages; i += perRead) {
+            readAll(fds[0], batch, perRead * sizeof(Msg));
+            for (size_t k = 0; k < perRead; ++k) {
+                errors += batch[k].seq != i + k;
+            }
+        }
+        close(fds[0]);
+    }
+    int status;
+    waitpid(child, &status, 0);
+    auto elapsed = now_steady_ns() - start;
+    auto cpu = process_cpu_us() - startCpu;
+
+    std::cout << name(how) << " msg:" << std::setw(5) << Size << " B "
+      << std::setw(6) << elapsed / numMessages << " ns/msg "
+      << std::setw(8) << std::setprecision(4)
+      << double(numMessages) * Size / elapsed * 1e9 / (1 << 20) << " MB/s"
+      << " cpu/msg: " << std::setw(6) << cpu * 1000 / numMessages << " ns"
+      << (errors != 0 ? " ERRORS" : "") << std::endl;
+
+    if (q != nullptr) {
+        delete q;
+        SharedMPMCQueue<Msg>::unlinkShm(shm);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "Start SharedMPMCQueueBenchmark!" << std::endl;
+    const uint64_t numMessages = 1 << 20;
+    Transport hows[] = {Transport::SHARED_QUEUE, Transport::SOCKET,
+        Transport::SOCKET_BATCH};
+    for (Transport how : hows) {
+        runTransport<64>(how, numMessages);
+    }
+    for (Transport how : hows) {
+        runTransport<1024>(how, numMessages / 4);
+    }
+    return 0;
+}
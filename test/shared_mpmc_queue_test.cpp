@@ -0,0 +1,186 @@
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "shared_mpmc_queue.h"
+#include "gtest/gtest.h"
+
+using namespace myfolly;
+using namespace std::chrono;
+
+struct Record {
+    uint64_t seq;
+    uint64_t payload[7];
+};
+
+/// A shm name no other test run uses
+static std::string shmName(const char* test) {
+    return "/myfolly_" + std::string(test) + "_" + std::to_string(getpid());
+}
+
+TEST(SharedMPMCQueueTest, two_handles) {
+    auto name = shmName("two_handles");
+    auto producer = SharedMPMCQueue<Record>::createShm(name, 10);
+    auto consumer = SharedMPMCQueue<Record>::openShm(name);
+    SharedMPMCQueue<Record>::unlinkShm(name);
+
+    EXPECT_EQ(10u, consumer.capacity());
+    Record r{};
+    EXPECT_FALSE(consumer.read(r));
+    for (uint64_t i = 0; i < 10; ++i) {
+        r.seq = i;
+        EXPECT_TRUE(producer.write(r));
+    }
+    EXPECT_FALSE(producer.write(r));
+    EXPECT_TRUE(consumer.isFull());
+    EXPECT_FALSE(producer.tryWriteFor(milliseconds(1), r));
+    for (uint64_t i = 0; i < 10; ++i) {
+        ASSERT_TRUE(consumer.blockingRead(r));
+        EXPECT_EQ(i, r.seq);
+    }
+    EXPECT_FALSE(consumer.tryReadFor(milliseconds(1), r));
+    EXPECT_TRUE(producer.isEmpty());
+    EXPECT_FALSE(producer.isBroken());
+}
+
+TEST(SharedMPMCQueueTest, layout_validation) {
+    auto name = shmName("layout_validation");
+    auto q = SharedMPMCQueue<Record>::createShm(name, 10);
+    EXPECT_THROW(SharedMPMCQueue<Record>::createShm(name, 10),
+            std::system_error);
+    EXPECT_THROW(SharedMPMCQueue<uint32_t>::openShm(name),
+            std::runtime_error);
+    SharedMPMCQueue<Record>::unlinkShm(name);
+    EXPECT_THROW(SharedMPMCQueue<Record>::openShm(name), std::system_error);
+
+    // a region that doesn't hold a queue at all
+    auto region = detail::SharedRegion::createShm(name, 4096);
+    EXPECT_THROW(SharedMPMCQueue<Record>::openShm(name), std::runtime_error);
+    SharedMPMCQueue<Record>::unlinkShm(name);
+}
+
+TEST(SharedMPMCQueueTest, file_backed) {
+    char path[] = "/tmp/myfolly_queue_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    close(fd);
+    unlink(path);
+
+    auto q = SharedMPMCQueue<uint64_t>::createFile(path, 100);
+    auto other = SharedMPMCQueue<uint64_t>::openFile(path);
+    unlink(path);
+    EXPECT_TRUE(q.write(42));
+    uint64_t v = 0;
+    EXPECT_TRUE(other.read(v));
+    EXPECT_EQ(42u, v);
+}
+
+TEST(SharedMPMCQueueTest, two_processes) {
+    auto name = shmName("two_processes");
+    auto q = SharedMPMCQueue<Record>::createShm(name, 64);
+    const uint64_t n = 100000;
+
+    pid_t child = fork();
+    ASSERT_GE(child, 0);
+    if (child == 0) {
+        bool ok = true;
+        {
+            auto producer = SharedMPMCQueue<Record>::openShm(name);
+            Record r{};
+            for (uint64_t i = 0; i < n && ok; ++i) {
+                r.seq = i;
+                r.payload[6] = i * 3;
+                ok = producer.blockingWrite(r);
+            }
+        }
+        _exit(ok ? 0 : 1);
+    }
+
+    Record r{};
+    uint64_t mismatches = 0;
+    for (uint64_t i = 0; i < n; ++i) {
+        ASSERT_TRUE(q.blockingRead(r));
+        mismatches += r.seq != i || r.payload[6] != i * 3;
+    }
+    EXPECT_EQ(0u, mismatches);
+    int status = 0;
+    ASSERT_EQ(child, waitpid(child, &status, 0));
+    EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    SharedMPMCQueue<Record>::unlinkShm(name);
+}
+
+TEST(SharedMPMCQueueTest, peer_exits_between_operations) {
+    auto name = shmName("peer_exits");
+    auto q = SharedMPMCQueue<uint64_t>::createShm(name, 8);
+
+    pid_t child = fork();
+    ASSERT_GE(child, 0);
+    if (child == 0) {
+        // exits without detaching
+        auto producer = new SharedMPMCQueue<uint64_t>(
+                SharedMPMCQueue<uint64_t>::openShm(name));
+        producer->blockingWrite(7);
+        _exit(0);
+    }
+    int status = 0;
+    ASSERT_EQ(child, waitpid(child, &status, 0));
+
+    uint64_t v = 0;
+    EXPECT_TRUE(q.tryReadFor(seconds(1), v));
+    EXPECT_EQ(7u, v);
+    EXPECT_FALSE(q.tryReadFor(milliseconds(300), v));
+    EXPECT_FALSE(q.isBroken());
+    EXPECT_TRUE(q.write(8));
+    SharedMPMCQueue<uint64_t>::unlinkShm(name);
+}
+
+TEST(SharedMPMCQueueTest, peer_dies_inside_operation) {
+    auto name = shmName("peer_dies");
+    auto q = SharedMPMCQueue<uint64_t>::createShm(name, 4);
+    for (uint64_t i = 0; i < 4; ++i) {
+        ASSERT_TRUE(q.write(i));
+    }
+
+    pid_t child = fork();
+    ASSERT_GE(child, 0);
+    if (child == 0) {
+        // takes a ticket and blocks on the full queue until killed
+        auto producer = SharedMPMCQueue<uint64_t>::openShm(name);
+        producer.blockingWrite(4);
+        _exit(0);
+    }
+    while (q.size() <= 4) {
+        std::this_thread::sleep_for(milliseconds(1));
+    }
+    kill(child, SIGKILL);
+    int status = 0;
+    ASSERT_EQ(child, waitpid(child, &status, 0));
+
+    // the elements written before are still there, but the dead child's
+    // ticket can never be completed
+    uint64_t v = 0;
+    for (uint64_t i = 0; i < 4; ++i) {
+        ASSERT_TRUE(q.read(v));
+        EXPECT_EQ(i, v);
+    }
+    auto start = steady_clock::now();
+    EXPECT_FALSE(q.blockingRead(v));
+    EXPECT_LT(steady_clock::now() - start, seconds(5));
+    EXPECT_TRUE(q.isBroken());
+    EXPECT_FALSE(q.write(5));
+    EXPECT_FALSE(q.blockingWrite(5));
+    SharedMPMCQueue<uint64_t>::unlinkShm(name);
+}
+
+int main(int argc, char* argv[]) {
+    testing::InitGoogleTest(&argc, argv);
+
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,111 @@
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <thread>
+#include <vector>
+
+#include "mpmc_queue.h"
+#include "portability.h"
+
+using namespace myfolly;
+
+static uint64_t now_steady_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>
+      (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// An N byte message whose first word carries the value
+template <size_t N>
+struct Payload {
+    explicit Payload(uint64_t v = 0) noexcept {
+        memset(data, 0, sizeof(data));
+        memcpy(data, &v, sizeof(v));
+    }
+
+    uint64_t value() const noexcept {
+        uint64_t v;
+        memcpy(&v, data, sizeof(v));
+        return v;
+    }
+
+    char data[N];
+};
+
+/// numThreads producers and as many consumers move n messages through a
+/// queue with the given slot layout.  Returns ns per message
+template <typename Layout, size_t N>
+static uint64_t runLayout(int numThreads, uint64_t n, size_t capacity) {
+    using Q = LayoutMPMCQueue<Payload<N>, Layout>;
+    Q* q = detail::alignedNew<Q>(capacity);
+
+    std::atomic<uint64_t> sum{0};
+    std::vector<std::thread> threads;
+    uint64_t start = now_steady_ns();
+    for (int t = 0; t < numThreads; ++t) {
+        threads.emplace_back([&, t]() {
+                for (uint64_t i = t; i < n; i += numThreads) {
+                    q->blockingWrite(i);
+                }
+                });
+        threads.emplace_back([&, t]() {
+                uint64_t threadSum = 0;
+                Payload<N> elem;
+                for (uint64_t i = t; i < n; i += numThreads) {
+                    q->blockingRead(elem);
+                    threadSum += elem.value();
+                }
+                sum += threadSum;
+                });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    uint64_t elapsed = now_steady_ns() - start;
+    if (sum.load() != n * (n - 1) / 2) {
+        std::cout << "ERROR sum mismatch!" << std::endl;
+    }
+    detail::alignedDelete(q);
+    return elapsed / n;
+}
+
+template <size_t N>
+static void runPayload(const std::vector<int>& numThreads, uint64_t n,
+        size_t capacity) {
+    using Dense = SingleElementQueue<Payload<N>, TurnSequencer, DenseSlots>;
+    using Isolated =
+        SingleElementQueue<Payload<N>, TurnSequencer, IsolatedSlots>;
+    using Split = SingleElementQueue<Payload<N>, TurnSequencer, SplitSlots>;
+    std::cout << "payload " << N << " bytes, slot sizes: dense "
+      << sizeof(Dense) << " isolated " << sizeof(Isolated) << " split "
+      << sizeof(Split) << " + " << N << std::endl;
+    for (int threads : numThreads) {
+        uint64_t dense = runLayout<DenseSlots, N>(threads, n, capacity);
+        uint64_t isolated = runLayout<IsolatedSlots, N>(threads, n, capacity);
+        uint64_t split = runLayout<SplitSlots, N>(threads, n, capacity);
+        std::cout << "  " << std::setw(2) << threads << "P/"
+          << std::setw(2) << threads << "C capacity " << capacity
+          << ". dense " << std::setw(5) << dense
+          << " ns/op, isolated " << std::setw(5) << isolated
+          << " ns/op, split " << std::setw(5) << split << " ns/op"
+          << std::endl;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "Start SlotLayoutBenchmark!" << std::endl;
+    const uint64_t n = 1000000;
+    const int hw = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<int> numThreads = {1, 2, 4, hw};
+    std::sort(numThreads.begin(), numThreads.end());
+    numThreads.erase(std::unique(numThreads.begin(), numThreads.end()),
+            numThreads.end());
+    for (size_t capacity : {16, 1024}) {
+        runPayload<8>(numThreads, n, capacity);
+        runPayload<64>(numThreads, n, capacity);
+        runPayload<256>(numThreads, n / 2, capacity);
+        runPayload<1024>(numThreads, n / 4, capacity);
+    }
+    return 0;
+}
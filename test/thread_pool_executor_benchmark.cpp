@@ -0,0 +1,164 @@
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <iomanip>
+#include <mutex>
+#include <queue>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "thread_pool_executor.h"
+
+using namespace myfolly;
+
+static uint64_t now_steady_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>
+      (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// The usual home-grown pool: a std::queue of std::functions under a
+/// mutex, and a condition variable whose notify_one wakes whichever worker
+/// the kernel picks
+class NaiveThreadPool {
+public:
+    explicit NaiveThreadPool(size_t numThreads) {
+        for (size_t i = 0; i < numThreads; ++i) {
+            _threads.emplace_back([this]() { run(); });
+        }
+    }
+
+    ~NaiveThreadPool() { join(); }
+
+    void add(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _tasks.push(std::move(task));
+        }
+        _cv.notify_one();
+    }
+
+    void join() {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_stop) {
+                return;
+            }
+            _stop = true;
+        }
+        _cv.notify_all();
+        for (auto& t : _threads) {
+            t.join();
+        }
+    }
+
+private:
+    void run() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _cv.wait(lock, [this]() { return _stop || !_tasks.empty(); });
+                if (_tasks.empty()) {
+                    return;
+                }
+                task = std::move(_tasks.front());
+                _tasks.pop();
+            }
+            task();
+        }
+    }
+
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    std::queue<std::function<void()>> _tasks;
+    bool _stop = false;
+    std::vector<std::thread> _threads;
+};
+
+/// numProducers threads add numTasks tiny tasks in total; the time runs
+/// until the last one has executed
+template <typename Pool>
+uint64_t runThroughput(size_t numWorkers, int numProducers, int numTasks) {
+    Pool pool(numWorkers);
+    std::atomic<int> done{0};
+    auto start = now_steady_ns();
+    std::vector<std::thread> producers;
+    for (int p = 0; p < numProducers; ++p) {
+        producers.emplace_back([&pool, &done, numProducers, numTasks]() {
+                for (int i = 0; i < numTasks / numProducers; ++i) {
+                    pool.add([&done]() {
+                            done.fetch_add(1, std::memory_order_relaxed);
+                            });
+                }
+                });
+    }
+    for (auto& t : producers) {
+        t.join();
+    }
+    pool.join();
+    return (now_steady_ns() - start) / numTasks;
+}
+
+/// Adds one task at a time to an idle pool and measures how long it takes
+/// a worker to start it.  Also counts the workers that ran any of them
+template <typename Pool>
+void runWakeLatency(const char* name, size_t numWorkers, int rounds) {
+    Pool pool(numWorkers);
+    std::vector<uint64_t> latencies;
+    std::set<std::thread::id> workers;
+    std::mutex mutex;
+    for (int i = 0; i < rounds; ++i) {
+        // let the workers go to sleep
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+        std::atomic<uint64_t> started{0};
+        uint64_t added = now_steady_ns();
+        pool.add([&]() {
+                started.store(now_steady_ns(), std::memory_order_release);
+                std::lock_guard<std::mutex> lock(mutex);
+                workers.insert(std::this_thread::get_id());
+                });
+        while (started.load(std::memory_order_acquire) == 0) {
+            std::this_thread::yield();
+        }
+        latencies.push_back(started.load() - added);
+    }
+    pool.join();
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << name << " wake latency p50 " << std::setw(7)
+      << latencies[latencies.size() / 2] / 1000.0 << " us p99 "
+      << std::setw(7) << latencies[latencies.size() * 99 / 100] / 1000.0
+      << " us, workers used " << workers.size() << "/" << numWorkers
+      << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "Start ThreadPoolExecutorBenchmark!" << std::endl;
+    const int numTasks = 1000000;
+    const size_t hw = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<size_t> numWorkers = {1, 4, hw};
+    std::sort(numWorkers.begin(), numWorkers.end());
+    numWorkers.erase(std::unique(numWorkers.begin(), numWorkers.end()),
+            numWorkers.end());
+    for (size_t workers : numWorkers) {
+        for (int producers : {1, 4}) {
+            std::cout << "workers " << std::setw(3) << workers
+              << " producers " << producers
+              << ". executor " << std::setw(5)
+              << runThroughput<ThreadPoolExecutor>(workers, producers,
+                      numTasks)
+              << " ns/task, naive pool " << std::setw(5)
+              << runThroughput<NaiveThreadPool>(workers, producers, numTasks)
+              << " ns/task" << std::endl;
+        }
+    }
+    std::cout << std::endl;
+
+    const int rounds = 2000;
+    runWakeLatency<ThreadPoolExecutor>("executor  ", 8, rounds);
+    runWakeLatency<NaiveThreadPool>("naive pool", 8, rounds);
+    return 0;
+}
@@ -0,0 +1,131 @@
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+
+#include "thread_pool_executor.h"
+#include "gtest/gtest.h"
+
+using namespace myfolly;
+using namespace std::chrono;
+
+TEST(TaskTest, inline_and_heap) {
+    int calls = 0;
+    Task small([&calls]() { ++calls; });
+    EXPECT_TRUE(small.isInline());
+    small();
+
+    char big[2 * Task::kInlineSize] = {1};
+    Task large([&calls, big]() { calls += big[0]; });
+    EXPECT_FALSE(large.isInline());
+    large();
+
+    Task moved(std::move(large));
+    EXPECT_FALSE(large);
+    moved();
+    EXPECT_EQ(3, calls);
+
+    moved = std::move(small);
+    EXPECT_TRUE(moved.isInline());
+    moved();
+    EXPECT_EQ(4, calls);
+    EXPECT_FALSE(Task());
+}
+
+TEST(TaskTest, destroys_captures) {
+    auto counter = std::make_shared<int>(0);
+    {
+        Task a([counter]() {});
+        Task b(std::move(a));
+        EXPECT_EQ(2, counter.use_count());
+        b.reset();
+        EXPECT_EQ(1, counter.use_count());
+    }
+    {
+        std::unique_ptr<int> p(new int(5));
+        int seen = 0;
+        Task c([p = std::move(p), &seen]() { seen = *p; });
+        Task d;
+        d = std::move(c);
+        d();
+        EXPECT_EQ(5, seen);
+    }
+    EXPECT_EQ(1, counter.use_count());
+}
+
+TEST(ThreadPoolExecutorTest, runs_all_tasks) {
+    std::atomic<int> count{0};
+    {
+        ThreadPoolExecutor executor(4, 64);
+        EXPECT_EQ(4u, executor.numThreads());
+        for (int i = 0; i < 10000; ++i) {
+            executor.add([&count]() { ++count; });
+        }
+        executor.join();
+        EXPECT_EQ(10000, count.load());
+        EXPECT_THROW(executor.add([]() {}), std::logic_error);
+    }
+    EXPECT_EQ(10000, count.load());
+}
+
+TEST(ThreadPoolExecutorTest, tasks_add_tasks) {
+    std::atomic<int> count{0};
+    ThreadPoolExecutor executor(3);
+    std::atomic<int> done{0};
+    for (int i = 0; i < 100; ++i) {
+        executor.add([&]() {
+                ++count;
+                executor.add([&]() {
+                        ++count;
+                        ++done;
+                        });
+                });
+    }
+    while (done.load() < 100) {
+        std::this_thread::yield();
+    }
+    executor.join();
+    EXPECT_EQ(200, count.load());
+}
+
+TEST(ThreadPoolExecutorTest, exceptions_are_swallowed) {
+    std::atomic<int> count{0};
+    ThreadPoolExecutor executor(2);
+    executor.add([]() { throw std::runtime_error("task"); });
+    executor.add([&count]() { ++count; });
+    executor.join();
+    EXPECT_EQ(1, count.load());
+    EXPECT_THROW(ThreadPoolExecutor(1).add(Task()), std::invalid_argument);
+}
+
+TEST(ThreadPoolExecutorTest, idle_pool_reuses_last_worker) {
+    ThreadPoolExecutor executor(4);
+    std::mutex mutex;
+    std::set<std::thread::id> workers;
+    for (int i = 0; i < 50; ++i) {
+        std::atomic<bool> ran{false};
+        executor.add([&]() {
+                std::lock_guard<std::mutex> lock(mutex);
+                workers.insert(std::this_thread::get_id());
+                ran = true;
+                });
+        while (!ran.load()) {
+            std::this_thread::yield();
+        }
+        // let the worker go back to sleep
+        std::this_thread::sleep_for(milliseconds(1));
+    }
+    executor.join();
+    // the first task may find a worker that hasn't started waiting yet,
+    // after that the one on top of the stack keeps getting the work
+    EXPECT_LE(workers.size(), 2u);
+}
+
+int main(int argc, char* argv[]) {
+    testing::InitGoogleTest(&argc, argv);
+
+    return RUN_ALL_TESTS();
+}
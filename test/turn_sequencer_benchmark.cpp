@@ -0,0 +1,119 @@
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <iomanip>
+
+#include <sys/resource.h>
+
+#include "detail/turn_sequencer.h"
+#include "detail/wide_turn_sequencer.h"
+
+using namespace myfolly;
+using namespace myfolly::detail;
+
+static uint64_t now_steady_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>
+      (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// Voluntary context switches of the calling thread.  Every futexWait that
+/// actually sleeps costs one, so this is a cheap proxy for the number of
+/// FUTEX_WAIT syscalls that blocked.
+static uint64_t voluntary_ctx_switches() {
+    struct rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    return usage.ru_nvcsw;
+}
+
+static void busy_wait_ns(uint64_t ns) {
+    auto end = now_steady_ns() + ns;
+    while (now_steady_ns() < end) {
+    }
+}
+
+/// numThreads threads take turns round-robin on a single TurnSequencer.  The
+/// owner of turn t spends workNs inside its critical section, then stamps
+/// the time and completes the turn.  The handoff latency is measured from
+/// that stamp until the owner of turn t+1 returns from waitForTurn.
+///
+/// With more threads than futex channels most of them are parked at any
+/// time, and "woken/handoff" (futex wakeups per completed turn, only
+/// counted with MYFOLLY_QUEUE_STATS) shows how many of them each
+/// completeTurn disturbs.  1 is ideal; "blocking waits/handoff" above 1
+/// means threads were woken only to park again.
+template <typename Sequencer>
+void runHandoff(const char* name, int numThreads, uint32_t numTurns,
+        uint64_t workNs) {
+    Sequencer seq;
+    std::atomic<uint32_t> spinCutoff{0};
+    QueueStatsCounters stats;
+    std::vector<uint64_t> stamps(numTurns, 0);
+    std::vector<uint64_t> latencies(numTurns, 0);
+    std::atomic<uint64_t> ctxSwitches{0};
+
+    std::vector<std::unique_ptr<std::thread>> threads(numThreads);
+    for (int t = 0; t < numThreads; ++t) {
+        threads[t].reset(new std::thread([&, t]() {
+                auto startSwitches = voluntary_ctx_switches();
+                for (uint32_t turn = t; turn < numTurns; turn += numThreads) {
+                    seq.waitForTurn(turn, spinCutoff, (turn % 128) == 0,
+                            &stats);
+                    if (turn > 0) {
+                        latencies[turn] = now_steady_ns() - stamps[turn - 1];
+                    }
+                    busy_wait_ns(workNs);
+                    stamps[turn] = now_steady_ns();
+                    seq.completeTurn(turn, &stats);
+                }
+                ctxSwitches += voluntary_ctx_switches() - startSwitches;
+                }));
+    }
+    for (auto& t : threads) {
+        if (t->joinable()) {
+            t->join();
+        }
+    }
+
+    latencies.erase(latencies.begin());
+    std::sort(latencies.begin(), latencies.end());
+    auto pct = [&latencies](double p) {
+        return latencies[size_t(p * (latencies.size() - 1))];
+    };
+    std::cout << name << " threads:" << std::setw(3) << numThreads
+      << " work:" << std::setw(6) << workNs << " ns"
+      << " p50:" << std::setw(8) << pct(0.50) << " ns"
+      << " p99:" << std::setw(8) << pct(0.99) << " ns"
+      << " max:" << std::setw(10) << latencies.back() << " ns"
+      << " blocking waits/handoff: " << std::setprecision(3)
+      << double(ctxSwitches.load()) / numTurns;
+    if (kQueueStatsEnabled) {
+        auto const s = stats.snapshot().sequencer;
+        std::cout << " woken/handoff: " << double(s.futexWoken) / numTurns
+          << " early wakeups: " << s.earlyWakeups;
+    }
+    std::cout << " spinCutoff: " << spinCutoff.load() << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "Start TurnSequencerBenchmark!" << std::endl;
+    const uint32_t numTurns = 200000;
+    int nts[] = {2, 4};
+    uint64_t works[] = {0, 200, 1000, 10000};
+    for (int nt : nts) {
+        for (uint64_t work : works) {
+            runHandoff<TurnSequencer>("narrow", nt, numTurns, work);
+            runHandoff<WideTurnSequencer>("wide  ", nt, numTurns, work);
+        }
+    }
+
+    // more blocked waiters than either sequencer has channels
+    int manyNts[] = {48, 100, 200, 400};
+    for (int nt : manyNts) {
+        runHandoff<TurnSequencer>("narrow", nt, numTurns / 4, 1000);
+        runHandoff<WideTurnSequencer>("wide  ", nt, numTurns / 4, 1000);
+    }
+    return 0;
+}
@@ -1,7 +1,9 @@
 #include <iostream>
 #include <thread>
+#include <vector>
 
 #include "detail/turn_sequencer.h"
+#include "detail/wide_turn_sequencer.h"
 #include "gtest/gtest.h"
 
 using namespace myfolly;
@@ -27,6 +29,210 @@ TEST(TurnSequencerTest, mt_sequence) {
     threads.clear();
 }
 
+TEST(TurnSequencerTest, wait_until_timeout) {
+    TurnSequencer seq;
+    std::atomic<uint32_t> spinCutoff{0};
+
+    auto const timeout = std::chrono::milliseconds(20);
+    auto const start = std::chrono::steady_clock::now();
+    auto const deadline = start + timeout;
+    EXPECT_EQ(TryWaitResult::TIMEDOUT,
+            seq.tryWaitForTurn(1, spinCutoff, false, &deadline));
+    EXPECT_GE(std::chrono::steady_clock::now() - start, timeout);
+
+    auto const sysDeadline = std::chrono::system_clock::now() + timeout;
+    EXPECT_EQ(TryWaitResult::TIMEDOUT,
+            seq.tryWaitForTurn(1, spinCutoff, false, &sysDeadline));
+    EXPECT_GE(std::chrono::system_clock::now(), sysDeadline);
+}
+
+TEST(TurnSequencerTest, wait_until_success) {
+    TurnSequencer seq;
+    std::atomic<uint32_t> spinCutoff{0};
+
+    std::thread t([&seq]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            seq.completeTurn(0);
+            });
+    auto const deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    EXPECT_EQ(TryWaitResult::SUCCESS,
+            seq.tryWaitForTurn(1, spinCutoff, false, &deadline));
+    EXPECT_EQ(TryWaitResult::PAST,
+            seq.tryWaitForTurn(0, spinCutoff, false, &deadline));
+    t.join();
+}
+
+TEST(TurnSequencerTest, stats) {
+    TurnSequencer seq;
+    std::atomic<uint32_t> spinCutoff{0};
+    QueueStatsCounters stats;
+
+    // turn 33 shares futexChannel 1 with turn 1, so completing turn 0
+    // wakes it early
+    std::thread t([&]() {
+            seq.waitForTurn(33, spinCutoff, false, &stats);
+            seq.completeTurn(33, &stats);
+            });
+    for (uint32_t turn = 0; turn < 33; ++turn) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(turn < 2 ? 50 : 0));
+        seq.completeTurn(turn, &stats);
+    }
+    t.join();
+
+    auto const s = stats.snapshot();
+    if (!kQueueStatsEnabled) {
+        EXPECT_EQ(0u, s.sequencer.futexWakes);
+        EXPECT_EQ(0u, s.sequencer.spins);
+        return;
+    }
+    EXPECT_GT(s.sequencer.spins, 0u);
+    EXPECT_GE(s.sequencer.futexWaits[int(FutexResult::AWOKEN)], 2u);
+    EXPECT_GE(s.sequencer.futexWakes, 2u);
+    EXPECT_GE(s.sequencer.futexWoken, 2u);
+    EXPECT_GE(s.sequencer.earlyWakeups, 1u);
+    stats.reset();
+    EXPECT_EQ(0u, stats.get(QueueStat::FUTEX_WAKES));
+}
+
+TEST(TurnSequencerTest, sharded_counters) {
+    QueueStatsCounters stats;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; ++t) {
+        threads.emplace_back([&stats]() {
+                for (int i = 0; i < 10000; ++i) {
+                    stats.add(QueueStat::SPINS);
+                    stats.add(QueueStat::FUTEX_WOKEN, 2);
+                }
+                });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    EXPECT_EQ(80000u, stats.get(QueueStat::SPINS));
+    EXPECT_EQ(80000u, stats.snapshot().sequencer.spins);
+    EXPECT_EQ(160000u, stats.snapshot().sequencer.futexWoken);
+    stats.reset();
+    EXPECT_EQ(0u, stats.snapshot().sequencer.spins);
+}
+
+TEST(WideTurnSequencerTest, mt_sequence) {
+    // more threads than channels, each waiting for turns kChannels apart
+    WideTurnSequencer seq;
+    std::atomic<uint32_t> spinCutoff{0};
+    const int numThreads = 200;
+    const uint64_t numTurns = 20000;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; ++t) {
+        threads.emplace_back([&, t]() {
+                for (uint64_t turn = t; turn < numTurns; turn += numThreads) {
+                    seq.waitForTurn(turn, spinCutoff, (turn % 32) == 0);
+                    EXPECT_TRUE(seq.isTurn(turn));
+                    seq.completeTurn(turn);
+                }
+                });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    EXPECT_TRUE(seq.isTurn(numTurns));
+}
+
+TEST(WideTurnSequencerTest, wait_until) {
+    WideTurnSequencer seq(uint64_t(1) << 40);
+    std::atomic<uint32_t> spinCutoff{0};
+    const uint64_t first = uint64_t(1) << 40;
+
+    auto const timeout = std::chrono::milliseconds(20);
+    auto const start = std::chrono::steady_clock::now();
+    auto const deadline = start + timeout;
+    EXPECT_EQ(TryWaitResult::TIMEDOUT,
+            seq.tryWaitForTurn(first + 1, spinCutoff, false, &deadline));
+    EXPECT_GE(std::chrono::steady_clock::now() - start, timeout);
+
+    std::thread t([&]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            seq.completeTurn(first);
+            });
+    auto const sysDeadline =
+        std::chrono::system_clock::now() + std::chrono::seconds(10);
+    EXPECT_EQ(TryWaitResult::SUCCESS,
+            seq.tryWaitForTurn(first + 1, spinCutoff, false, &sysDeadline));
+    EXPECT_EQ(TryWaitResult::PAST,
+            seq.tryWaitForTurn(first, spinCutoff, false, &sysDeadline));
+    t.join();
+}
+
+TEST(WideTurnSequencerTest, exact_wakes) {
+    // turns 1 and 33 share a TurnSequencer channel but not a
+    // WideTurnSequencer one, so completing turn 0 wakes only the first
+    WideTurnSequencer seq;
+    std::atomic<uint32_t> spinCutoff{0};
+    QueueStatsCounters stats;
+    std::vector<std::thread> threads;
+    for (uint64_t turn : {uint64_t(1), uint64_t(33)}) {
+        threads.emplace_back([&, turn]() {
+                seq.waitForTurn(turn, spinCutoff, false, &stats);
+                seq.completeTurn(turn, &stats);
+                });
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    seq.completeTurn(0, &stats);
+    threads[0].join();
+    for (uint64_t turn = 2; turn < 33; ++turn) {
+        seq.completeTurn(turn, &stats);
+    }
+    threads[1].join();
+    EXPECT_TRUE(seq.isTurn(34));
+
+    auto const s = stats.snapshot();
+    if (!kQueueStatsEnabled) {
+        EXPECT_EQ(0u, s.sequencer.futexWakes);
+        return;
+    }
+    EXPECT_EQ(0u, s.sequencer.earlyWakeups);
+    EXPECT_EQ(s.sequencer.futexWakes, s.sequencer.futexWoken);
+}
+
+TEST(WideTurnSequencerTest, wait_until_full_channel) {
+    // a channel with kMaxChannelWaiters parked waiters makes the next
+    // waiter yield instead of parking, and it must still time out
+    WideTurnSequencer seq;
+    std::atomic<uint32_t> spinCutoff{0};
+    const uint64_t kChannels = WideTurnSequencer::kChannels;
+    const uint64_t numWaiters = WideTurnSequencer::kMaxChannelWaiters;
+    std::vector<std::thread> threads;
+    for (uint64_t i = 1; i <= numWaiters; ++i) {
+        threads.emplace_back([&, i]() {
+                seq.waitForTurn(1 + i * kChannels, spinCutoff, false);
+                seq.completeTurn(1 + i * kChannels);
+                });
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    auto const timeout = std::chrono::milliseconds(20);
+    auto const start = std::chrono::steady_clock::now();
+    auto const deadline = start + timeout;
+    EXPECT_EQ(TryWaitResult::TIMEDOUT,
+            seq.tryWaitForTurn(1, spinCutoff, false, &deadline));
+    auto const elapsed = std::chrono::steady_clock::now() - start;
+    EXPECT_GE(elapsed, timeout);
+    EXPECT_LT(elapsed, std::chrono::seconds(5));
+
+    const uint64_t last = 1 + numWaiters * kChannels;
+    for (uint64_t turn = 0; turn <= last; ++turn) {
+        if (turn > 1 && turn % kChannels == 1) {
+            continue;
+        }
+        seq.waitForTurn(turn, spinCutoff, false);
+        seq.completeTurn(turn);
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    EXPECT_TRUE(seq.isTurn(last + 1));
+}
+
 int main(int argc, char* argv[]) {
     testing::InitGoogleTest(&argc, argv);
 
@@ -0,0 +1,149 @@
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <iomanip>
+
+#include "mpmc_queue.h"
+#include "portability.h"
+#include "unbounded_queue.h"
+
+using namespace myfolly;
+
+static uint64_t now_steady_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>
+      (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// The queues are over-aligned
+template <typename Q, typename... Args>
+std::unique_ptr<Q, void (*)(Q*)> makeQueue(Args&&... args) {
+    return std::unique_ptr<Q, void (*)(Q*)>(
+            detail::alignedNew<Q>(std::forward<Args>(args)...),
+            &detail::alignedDelete<Q>);
+}
+
+using Bounded = MPMCQueue<uint64_t>;
+using Unbounded = UnboundedQueue<uint64_t>;
+
+/// Bytes of queue memory, the fixed array or the segments allocated now
+static size_t footprint(const Bounded& q) {
+    return q.capacity() * sizeof(Bounded::Slot);
+}
+
+static size_t footprint(const Unbounded& q) {
+    return q.segmentsAllocated() *
+        (Unbounded::kSegmentSize * sizeof(Unbounded::Slot) + 128);
+}
+
+static void spinFor(uint64_t ns) {
+    uint64_t end = now_steady_ns() + ns;
+    while (now_steady_ns() < end) {
+    }
+}
+
+/// Producers and consumers run flat out, but producers hold off while the
+/// queue has depth elements, so both queues run at the same depth
+template <typename Q>
+void runSteady(const char* name, Q& q, int numThreads, uint64_t numOps,
+        ssize_t depth) {
+    std::vector<std::thread> threads;
+    const uint64_t perThread = numOps / numThreads;
+    auto start = now_steady_ns();
+    for (int t = 0; t < numThreads; ++t) {
+        threads.emplace_back([&q, perThread, depth]() {
+                for (uint64_t i = 0; i < perThread; ++i) {
+                    while (q.size() >= depth) {
+                        std::this_thread::yield();
+                    }
+                    q.blockingWrite(i);
+                }
+                });
+        threads.emplace_back([&q, perThread]() {
+                uint64_t v;
+                for (uint64_t i = 0; i < perThread; ++i) {
+                    q.blockingRead(v);
+                }
+                });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    auto elapsed = now_steady_ns() - start;
+    std::cout << name << " steady  " << numThreads << "P/" << numThreads
+      << "C " << std::setw(5) << elapsed / (perThread * numThreads)
+      << " ns/op  memory " << std::setw(8) << footprint(q) / 1024 << " KiB"
+      << std::endl;
+}
+
+/// One producer writes bursts of burstSize elements and then pauses long
+/// enough for the consumer (workNs per element) to drain them, so the
+/// average depth is far below the burst.  Reports how long the producer
+/// was held up by writes and the queue's memory
+template <typename Q>
+void runBursts(const char* name, Q& q, uint64_t burstSize, int numBursts,
+        uint64_t workNs) {
+    const uint64_t total = burstSize * numBursts;
+    std::vector<uint64_t> burstNs;
+    size_t peakBytes = 0;
+    std::thread consumer([&q, total, workNs]() {
+            uint64_t v;
+            for (uint64_t i = 0; i < total; ++i) {
+                q.blockingRead(v);
+                spinFor(workNs);
+            }
+            });
+    for (int b = 0; b < numBursts; ++b) {
+        auto start = now_steady_ns();
+        for (uint64_t i = 0; i < burstSize; ++i) {
+            q.blockingWrite(i);
+        }
+        burstNs.push_back(now_steady_ns() - start);
+        peakBytes = std::max(peakBytes, footprint(q));
+        while (!q.isEmpty()) {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    }
+    consumer.join();
+    std::sort(burstNs.begin(), burstNs.end());
+    std::cout << name << " burst " << std::setw(6) << burstSize
+      << " producer time/burst p50 " << std::setw(8)
+      << burstNs[burstNs.size() / 2] / 1000 << " us max " << std::setw(8)
+      << burstNs.back() / 1000 << " us  peak memory " << std::setw(6)
+      << peakBytes / 1024 << " KiB" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "Start UnboundedQueueBenchmark!" << std::endl;
+    const uint64_t numOps = 2000000;
+    const ssize_t depth = 1024;
+    int nts[] = {1, 4};
+    for (int nt : nts) {
+        auto bounded = makeQueue<Bounded>(depth);
+        runSteady("MPMCQueue(1024)   ", *bounded, nt, numOps, depth);
+        auto unbounded = makeQueue<Unbounded>();
+        runSteady("UnboundedQueue    ", *unbounded, nt, numOps, depth);
+    }
+
+    // bursts 100x the average depth of ~64
+    const uint64_t avgDepth = 64;
+    const uint64_t burst = 100 * avgDepth;
+    const int numBursts = 20;
+    const uint64_t workNs = 200;
+    {
+        auto q = makeQueue<Bounded>(avgDepth);
+        runBursts("MPMCQueue(64)     ", *q, burst, numBursts, workNs);
+    }
+    {
+        auto q = makeQueue<Bounded>(burst);
+        runBursts("MPMCQueue(6400)   ", *q, burst, numBursts, workNs);
+    }
+    {
+        auto q = makeQueue<Unbounded>();
+        runBursts("UnboundedQueue    ", *q, burst, numBursts, workNs);
+    }
+    return 0;
+}
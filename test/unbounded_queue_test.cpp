@@ -0,0 +1,175 @@
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "unbounded_queue.h"
+#include "gtest/gtest.h"
+
+using namespace myfolly;
+using namespace std::chrono;
+
+TEST(UnboundedQueueTest, fifo_across_segments) {
+    UnboundedQueue<int, 4> q;
+    int v = -1;
+    EXPECT_FALSE(q.read(v));
+    // never blocks, however far ahead of the readers
+    for (int i = 0; i < 1000; ++i) {
+        q.write(i);
+    }
+    EXPECT_EQ(1000, q.size());
+    for (int i = 0; i < 1000; ++i) {
+        if (i % 2 == 0) {
+            ASSERT_TRUE(q.read(v));
+        } else {
+            q.blockingRead(v);
+        }
+        EXPECT_EQ(i, v);
+    }
+    EXPECT_FALSE(q.read(v));
+    EXPECT_TRUE(q.isEmpty());
+}
+
+TEST(UnboundedQueueTest, try_read_for) {
+    UnboundedQueue<int, 2> q;
+    int v = -1;
+    auto start = steady_clock::now();
+    EXPECT_FALSE(q.tryReadFor(milliseconds(20), v));
+    EXPECT_GE(steady_clock::now() - start, milliseconds(20));
+
+    std::thread producer([&q]() {
+            std::this_thread::sleep_for(milliseconds(10));
+            q.write(7);
+            });
+    EXPECT_TRUE(q.tryReadFor(seconds(10), v));
+    EXPECT_EQ(7, v);
+    producer.join();
+
+    // waiting readers don't keep the queue from moving on
+    for (int i = 0; i < 100; ++i) {
+        q.write(i);
+        ASSERT_TRUE(q.tryReadFor(seconds(1), v));
+        EXPECT_EQ(i, v);
+    }
+}
+
+TEST(UnboundedQueueTest, segments_are_reused) {
+    UnboundedQueue<uint64_t, 4> q;
+    uint64_t v = 0;
+    for (uint64_t i = 0; i < 100000; ++i) {
+        q.write(i);
+        q.write(i);
+        q.blockingRead(v);
+        q.blockingRead(v);
+    }
+    EXPECT_LE(q.segmentsAllocated(), 8u);
+}
+
+TEST(UnboundedQueueTest, destroys_unread_elements) {
+    auto counter = std::make_shared<int>(0);
+    {
+        UnboundedQueue<std::shared_ptr<int>, 3> q;
+        for (int i = 0; i < 50; ++i) {
+            q.write(counter);
+        }
+        std::shared_ptr<int> p;
+        for (int i = 0; i < 20; ++i) {
+            q.blockingRead(p);
+        }
+        p.reset();
+        EXPECT_EQ(31, counter.use_count());
+    }
+    EXPECT_EQ(1, counter.use_count());
+}
+
+template <unsigned SegmentBits>
+static void runMtSum(int numProducers, int numConsumers, uint64_t perProducer) {
+    UnboundedQueue<uint64_t, SegmentBits> q;
+    std::atomic<uint64_t> sum{0};
+    std::atomic<uint64_t> received{0};
+    const uint64_t total = perProducer * numProducers;
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numProducers; ++t) {
+        threads.emplace_back([&q, perProducer]() {
+                for (uint64_t i = 1; i <= perProducer; ++i) {
+                    q.write(i);
+                }
+                });
+    }
+    for (int t = 0; t < numConsumers; ++t) {
+        threads.emplace_back([&, t]() {
+                uint64_t local = 0;
+                uint64_t v;
+                while (received.load() < total) {
+                    bool got;
+                    if (t % 3 == 0) {
+                        got = q.read(v);
+                        if (!got) {
+                            std::this_thread::yield();
+                        }
+                    } else {
+                        got = q.tryReadFor(milliseconds(1), v);
+                    }
+                    if (got) {
+                        local += v;
+                        received++;
+                    }
+                }
+                sum += local;
+                });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    EXPECT_EQ(perProducer * (perProducer + 1) / 2 * numProducers, sum.load());
+    EXPECT_TRUE(q.isEmpty());
+}
+
+TEST(UnboundedQueueTest, mt_sum) {
+    runMtSum<2>(4, 4, 20000);
+    runMtSum<8>(3, 5, 50000);
+}
+
+TEST(UnboundedQueueTest, mt_blocking_read) {
+    UnboundedQueue<uint64_t, 5> q;
+    const int numConsumers = 4;
+    const uint64_t perConsumer = 20000;
+    std::atomic<uint64_t> sum{0};
+    std::vector<std::thread> consumers;
+    for (int t = 0; t < numConsumers; ++t) {
+        consumers.emplace_back([&]() {
+                uint64_t local = 0;
+                uint64_t v;
+                for (uint64_t i = 0; i < perConsumer; ++i) {
+                    q.blockingRead(v);
+                    local += v;
+                }
+                sum += local;
+                });
+    }
+    // readers are usually ahead of the writers here
+    std::vector<std::thread> producers;
+    for (int t = 0; t < 2; ++t) {
+        producers.emplace_back([&q]() {
+                for (uint64_t i = 1; i <= perConsumer * numConsumers / 2; ++i) {
+                    q.write(i);
+                }
+                });
+    }
+    for (auto& t : producers) {
+        t.join();
+    }
+    for (auto& t : consumers) {
+        t.join();
+    }
+    const uint64_t n = perConsumer * numConsumers / 2;
+    EXPECT_EQ(n * (n + 1), sum.load());
+}
+
+int main(int argc, char* argv[]) {
+    testing::InitGoogleTest(&argc, argv);
+
+    return RUN_ALL_TESTS();
+}
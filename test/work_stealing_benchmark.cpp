@@ -0,0 +1,215 @@
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "mpmc_queue.h"
+#include "portability.h"
+#include "work_stealing_scheduler.h"
+
+using namespace myfolly;
+
+static uint64_t now_real_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>
+      (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// The fork/join pool we are replacing: every spawned task goes through
+/// one MPMCQueue, and a thread that syncs runs whatever it reads from it.
+/// That is the oldest task, so the recursion runs breadth first and a
+/// large part of the task tree is queued at once; the queue must hold it
+/// all, or every thread ends up blocked in spawn
+class SharedQueueScheduler {
+public:
+    struct Job {
+        Task fn;
+        std::atomic<uint32_t>* pending;
+    };
+
+    class Group {
+    public:
+        explicit Group(SharedQueueScheduler& s) : _scheduler(s) {}
+
+        ~Group() { sync(); }
+
+        template <typename F>
+        void spawn(F&& f) {
+            _pending.fetch_add(1, std::memory_order_relaxed);
+            _scheduler._queue->blockingWrite(
+                    new Job{Task(std::forward<F>(f)), &_pending});
+        }
+
+        void sync() {
+            while (_pending.load(std::memory_order_acquire) != 0) {
+                Job* job;
+                if (_scheduler._queue->read(job)) {
+                    _scheduler.execute(job);
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+    private:
+        SharedQueueScheduler& _scheduler;
+        std::atomic<uint32_t> _pending{0};
+    };
+
+    explicit SharedQueueScheduler(size_t numThreads) {
+        _queue = detail::alignedNew<Queue>(1 << 20);
+        for (size_t i = 0; i < numThreads; ++i) {
+            _threads.emplace_back([this]() {
+                    Job* job;
+                    while (true) {
+                        _queue->blockingRead(job);
+                        if (job == nullptr) {
+                            return;
+                        }
+                        execute(job);
+                    }
+                    });
+        }
+    }
+
+    ~SharedQueueScheduler() {
+        for (size_t i = 0; i < _threads.size(); ++i) {
+            _queue->blockingWrite(nullptr);
+        }
+        for (auto& t : _threads) {
+            t.join();
+        }
+        detail::alignedDelete(_queue);
+    }
+
+    template <typename F>
+    void run(F&& f) {
+        Group group(*this);
+        group.spawn(std::forward<F>(f));
+        group.sync();
+    }
+
+private:
+    using Queue = MPMCQueue<Job*>;
+
+    void execute(Job* job) {
+        job->fn();
+        auto* pending = job->pending;
+        delete job;
+        pending->fetch_sub(1, std::memory_order_release);
+    }
+
+    Queue* _queue;
+    std::vector<std::thread> _threads;
+};
+
+template <typename Scheduler> struct GroupOf;
+
+template <> struct GroupOf<WorkStealingScheduler> {
+    using type = TaskGroup;
+};
+
+template <> struct GroupOf<SharedQueueScheduler> {
+    using type = SharedQueueScheduler::Group;
+};
+
+static uint64_t serialFib(int n) {
+    return n < 2 ? n : serialFib(n - 1) + serialFib(n - 2);
+}
+
+/// Spawns down to n == cutoff, so a run spawns about fib(n - cutoff + 2)
+/// tasks of a few hundred ns each
+template <typename Scheduler>
+uint64_t fib(Scheduler& scheduler, int n, int cutoff) {
+    if (n <= cutoff) {
+        return serialFib(n);
+    }
+    uint64_t a = 0;
+    typename GroupOf<Scheduler>::type group(scheduler);
+    group.spawn([&]() { a = fib(scheduler, n - 1, cutoff); });
+    uint64_t b = fib(scheduler, n - 2, cutoff);
+    group.sync();
+    return a + b;
+}
+
+/// Sums data[begin, end) by splitting in halves down to grain elements
+template <typename Scheduler>
+double reduce(Scheduler& scheduler, const double* data, size_t begin,
+        size_t end, size_t grain) {
+    if (end - begin <= grain) {
+        double sum = 0;
+        for (size_t i = begin; i < end; ++i) {
+            sum += data[i];
+        }
+        return sum;
+    }
+    size_t mid = begin + (end - begin) / 2;
+    double right = 0;
+    typename GroupOf<Scheduler>::type group(scheduler);
+    group.spawn([&]() { right = reduce(scheduler, data, mid, end, grain); });
+    double left = reduce(scheduler, data, begin, mid, grain);
+    group.sync();
+    return left + right;
+}
+
+template <typename Scheduler>
+void runFib(const char* name, size_t numThreads, int n, int cutoff) {
+    Scheduler scheduler(numThreads);
+    uint64_t result = 0;
+    auto start = now_real_us();
+    scheduler.run([&]() { result = fib(scheduler, n, cutoff); });
+    auto elapsed = now_real_us() - start;
+    std::cout << name << " threads " << std::setw(3) << numThreads
+      << " fib(" << n << ") cutoff " << cutoff << ": " << std::setw(8)
+      << elapsed << " us";
+    if (result != serialFib(n)) {
+        std::cout << " ERROR Result! " << result;
+    }
+    std::cout << std::endl;
+}
+
+template <typename Scheduler>
+void runReduce(const char* name, size_t numThreads,
+        const std::vector<double>& data, size_t grain) {
+    Scheduler scheduler(numThreads);
+    double result = 0;
+    auto start = now_real_us();
+    const int rounds = 10;
+    for (int r = 0; r < rounds; ++r) {
+        scheduler.run([&]() {
+                result = reduce(scheduler, data.data(), 0, data.size(), grain);
+                });
+    }
+    auto elapsed = (now_real_us() - start) / rounds;
+    std::cout << name << " threads " << std::setw(3) << numThreads
+      << " reduce " << data.size() << " grain " << grain << ": "
+      << std::setw(8) << elapsed << " us";
+    if (result != double(data.size())) {
+        std::cout << " ERROR Result! " << result;
+    }
+    std::cout << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "Start WorkStealingBenchmark!" << std::endl;
+    const size_t hw = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<size_t> nts = {1, 2, 4, hw};
+    std::sort(nts.begin(), nts.end());
+    nts.erase(std::unique(nts.begin(), nts.end()), nts.end());
+
+    for (size_t nt : nts) {
+        runFib<WorkStealingScheduler>("work stealing", nt, 32, 10);
+        runFib<SharedQueueScheduler>("shared queue ", nt, 32, 10);
+    }
+    std::cout << std::endl;
+
+    std::vector<double> data(1 << 24, 1.0);
+    for (size_t nt : nts) {
+        runReduce<WorkStealingScheduler>("work stealing", nt, data, 4096);
+        runReduce<SharedQueueScheduler>("shared queue ", nt, data, 4096);
+    }
+    return 0;
+}
@@ -0,0 +1,148 @@
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "work_stealing_scheduler.h"
+#include "gtest/gtest.h"
+
+using namespace myfolly;
+
+TEST(ChaseLevDequeTest, owner_lifo_thief_fifo) {
+    detail::ChaseLevDeque<uintptr_t> deque(4);
+    uintptr_t v = 0;
+    EXPECT_FALSE(deque.pop(v));
+    EXPECT_FALSE(deque.steal(v));
+    // grows past its initial capacity
+    for (uintptr_t i = 1; i <= 100; ++i) {
+        deque.push(i);
+    }
+    EXPECT_GE(deque.capacity(), 100u);
+    ASSERT_TRUE(deque.steal(v));
+    EXPECT_EQ(1u, v);
+    ASSERT_TRUE(deque.pop(v));
+    EXPECT_EQ(100u, v);
+    for (uintptr_t i = 2; i < 100; ++i) {
+        ASSERT_TRUE(deque.steal(v));
+        EXPECT_EQ(i, v);
+    }
+    EXPECT_FALSE(deque.pop(v));
+    EXPECT_TRUE(deque.isEmpty());
+}
+
+TEST(ChaseLevDequeTest, mt_each_element_once) {
+    detail::ChaseLevDeque<uintptr_t> deque(8);
+    const uintptr_t n = 200000;
+    std::atomic<uint64_t> sum{0};
+    std::atomic<uint64_t> count{0};
+    std::atomic<bool> done{false};
+    std::vector<std::thread> thieves;
+    for (int t = 0; t < 3; ++t) {
+        thieves.emplace_back([&]() {
+                uint64_t local = 0;
+                uint64_t c = 0;
+                uintptr_t v;
+                while (!done.load() || !deque.isEmpty()) {
+                    if (deque.steal(v)) {
+                        local += v;
+                        ++c;
+                    }
+                }
+                sum += local;
+                count += c;
+                });
+    }
+    uint64_t local = 0;
+    uint64_t c = 0;
+    uintptr_t v;
+    for (uintptr_t i = 1; i <= n; ++i) {
+        deque.push(i);
+        if (i % 3 == 0 && deque.pop(v)) {
+            local += v;
+            ++c;
+        }
+    }
+    while (deque.pop(v)) {
+        local += v;
+        ++c;
+    }
+    done = true;
+    for (auto& t : thieves) {
+        t.join();
+    }
+    EXPECT_EQ(n, count.load() + c);
+    EXPECT_EQ(n * (n + 1) / 2, sum.load() + local);
+}
+
+static uint64_t fib(WorkStealingScheduler& scheduler, int n) {
+    if (n < 2) {
+        return n;
+    }
+    uint64_t a = 0;
+    TaskGroup group(scheduler);
+    group.spawn([&]() { a = fib(scheduler, n - 1); });
+    uint64_t b = fib(scheduler, n - 2);
+    group.sync();
+    return a + b;
+}
+
+TEST(WorkStealingSchedulerTest, fib) {
+    for (size_t threads : {1, 2, 4}) {
+        WorkStealingScheduler scheduler(threads);
+        EXPECT_EQ(threads, scheduler.numThreads());
+        uint64_t result = 0;
+        scheduler.run([&]() { result = fib(scheduler, 20); });
+        EXPECT_EQ(6765u, result);
+    }
+}
+
+TEST(WorkStealingSchedulerTest, parallel_for_visits_each_index_once) {
+    WorkStealingScheduler scheduler(4);
+    const size_t n = 100000;
+    std::vector<std::atomic<int>> hits(n);
+    for (auto& h : hits) {
+        h.store(0);
+    }
+    parallelFor(scheduler, 0, n, 64, [&](size_t i) { ++hits[i]; });
+    for (size_t i = 0; i < n; ++i) {
+        ASSERT_EQ(1, hits[i].load()) << i;
+    }
+
+    // nested inside a task
+    std::atomic<uint64_t> sum{0};
+    scheduler.run([&]() {
+            parallelFor(scheduler, 0, 1000, 1, [&](size_t i) {
+                    parallelFor(scheduler, 0, 10, 2,
+                            [&](size_t j) { sum += i * 10 + j; });
+                    });
+            });
+    EXPECT_EQ(9999u * 10000 / 2, sum.load());
+    parallelFor(scheduler, 5, 5, 1, [&](size_t) { FAIL(); });
+}
+
+TEST(WorkStealingSchedulerTest, external_threads_spawn_and_sync) {
+    WorkStealingScheduler scheduler(2);
+    std::atomic<int> count{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&]() {
+                for (int round = 0; round < 50; ++round) {
+                    TaskGroup group(scheduler);
+                    for (int i = 0; i < 20; ++i) {
+                        group.spawn([&]() { ++count; });
+                    }
+                    group.sync();
+                }
+                });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    EXPECT_EQ(4 * 50 * 20, count.load());
+    EXPECT_EQ(nullptr, WorkStealingScheduler::current());
+}
+
+int main(int argc, char* argv[]) {
+    testing::InitGoogleTest(&argc, argv);
+
+    return RUN_ALL_TESTS();
+}